@@ -0,0 +1,363 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <cmath>
+#include "track/track_types.h"
+#include "track_geometry.h"
+
+// One motion sample; NAN marks a channel the source does not have
+struct CornerSample {
+    uint32_t time;             // ms
+    GpsPoint position;
+    float speed;               // m/s
+    float heading;             // Course over ground, degrees
+    float longitudinal;        // m/s^2, forward positive
+    float lateral;             // m/s^2, left positive
+};
+
+// What a driver wants to know about one corner of one lap
+struct CornerMetrics {
+    static const uint8_t UNMATCHED = 0xFF;
+
+    uint8_t corner;            // Index in the corner map, UNMATCHED if not in it
+    int8_t direction;          // 1 left, -1 right
+    uint16_t lap;              // Lap count when the corner was driven
+    float entryDistance;       // m from where the start/finish gate triggered
+    float apexDistance;        // Where the minimum speed was
+    float exitDistance;
+    float brakingPoint;        // Where braking for the corner began, NAN if none
+    float minSpeed;            // m/s
+    float exitSpeed;           // m/s
+    float peakLateral;         // m/s^2
+};
+
+// Corners of a track, learned from the first laps
+struct CornerMap {
+    static const size_t MAX_CORNERS = 24;
+
+    struct Corner {
+        float entry;
+        float apex;
+        float exit;
+        int8_t direction;
+        uint8_t seen;          // Laps the corner was seen in while learning
+    };
+
+    Corner corners[MAX_CORNERS];
+    uint8_t count;
+
+    CornerMap() : count(0) {}
+
+    // Nearest corner of the same direction whose apex is within tolerance
+    int match(float apex, int8_t direction, float tolerance) const {
+        int best = -1;
+        float bestDistance = tolerance;
+        for (uint8_t i = 0; i < count; i++) {
+            float d = fabsf(corners[i].apex - apex);
+            if (corners[i].direction == direction && d <= bestDistance) {
+                best = i;
+                bestDistance = d;
+            }
+        }
+        return best;
+    }
+
+    // Averages a sighting into a known corner or inserts it in lap order
+    int learn(const CornerMetrics& m, float tolerance) {
+        int i = match(m.apexDistance, m.direction, tolerance);
+        if (i >= 0) {
+            Corner& c = corners[i];
+            float weight = 1.0f / (c.seen + 1);
+            c.entry += (m.entryDistance - c.entry) * weight;
+            c.apex += (m.apexDistance - c.apex) * weight;
+            c.exit += (m.exitDistance - c.exit) * weight;
+            c.seen++;
+            return i;
+        }
+        if (count == MAX_CORNERS) {
+            return -1;
+        }
+        uint8_t at = count;
+        while (at > 0 && corners[at - 1].apex > m.apexDistance) {
+            corners[at] = corners[at - 1];
+            at--;
+        }
+        corners[at] = Corner{ m.entryDistance, m.apexDistance, m.exitDistance, m.direction, 1 };
+        count++;
+        return at;
+    }
+
+    // Drops corners seen in fewer than minSeen laps, keeping lap order
+    void prune(uint8_t minSeen) {
+        uint8_t kept = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            if (corners[i].seen >= minSeen) corners[kept++] = corners[i];
+        }
+        count = kept;
+    }
+};
+
+/**
+ * Online corner segmentation and per-corner metrics.
+ *
+ * Each sample costs O(1). Lateral acceleration comes from the IMU when
+ * there is one, otherwise from speed times the GNSS heading rate, and as a
+ * last resort from the course between positions a few metres apart. A
+ * corner starts when the smoothed lateral acceleration passes
+ * ENTER_LATERAL. It ends when it stays below EXIT_LATERAL for EXIT_HOLD
+ * metres, or when the direction flips in a chicane. Distance along the
+ * lap is integrated speed since the last start/finish crossing.
+ *
+ * Corners seen during the first LEARN_LAPS laps build the corner map; the
+ * ones seen in fewer than MIN_SEEN of them are dropped at the end. After
+ * that corners are only matched against the map, so metrics from
+ * different laps refer to the same corner index.
+ */
+class CornerEngine {
+public:
+    static constexpr float ENTER_LATERAL = 3.0f;     // m/s^2
+    static constexpr float EXIT_LATERAL = 1.5f;
+    static constexpr float EXIT_HOLD = 10.0f;        // m
+    static constexpr float MIN_LENGTH = 15.0f;       // m, shorter events are kinks
+    static constexpr float BRAKE_DECEL = 3.0f;       // m/s^2
+    static constexpr float BRAKE_LOOKBACK = 150.0f;  // m before entry a braking start counts
+    static constexpr float MATCH_TOLERANCE = 50.0f;  // m between apexes
+    static constexpr float SMOOTHING = 0.35f;        // Per sample, exponential
+    static constexpr float COURSE_BASELINE = 20.0f;  // m between positions for a course
+    static const uint8_t LEARN_LAPS = 3;
+    static const uint8_t MIN_SEEN = 2;               // Learning laps a corner must appear in
+
+    CornerEngine() {
+        reset();
+    }
+
+    // Forgets the corner map too, for a new track
+    void reset() {
+        map = CornerMap();
+        lapsCompleted = 0;
+        lapActive = false;
+        hasPrevious = false;
+        smoothLateral = 0;
+        smoothLongitudinal = 0;
+        braking = false;
+        course = NAN;
+        courseRate = 0;
+        for (size_t i = 0; i < CornerMap::MAX_CORNERS; i++) {
+            last[i].corner = CornerMetrics::UNMATCHED;
+        }
+        resetLapState();
+    }
+
+    void startLap() {
+        resetLapState();
+        lapActive = true;
+    }
+
+    // Lap discarded, e.g. on a manual reset; it does not count towards learning
+    void abortLap() {
+        lapActive = false;
+        inCorner = false;
+    }
+
+    void completeLap() {
+        lapActive = false;
+        inCorner = false;
+        if (lapsCompleted < 0xFFFF) lapsCompleted++;
+        if (lapsCompleted == LEARN_LAPS) {
+            map.prune(MIN_SEEN);   // One-off detections were noise or traffic
+            for (size_t i = 0; i < CornerMap::MAX_CORNERS; i++) {
+                last[i].corner = CornerMetrics::UNMATCHED;
+            }
+        }
+    }
+
+    // Returns true and fills out when a corner has just been completed
+    bool update(const CornerSample& s, CornerMetrics* out) {
+        if (!hasPrevious || (int32_t)(s.time - previous.time) < 0) {
+            // First sample, or a discontinuity: start over from here
+            frame = geometry::LocalFrame(s.position.latitude, s.position.longitude);
+            previous = s;
+            anchorX = anchorY = 0;
+            anchorTime = s.time;
+            hasPrevious = true;
+            return false;
+        }
+
+        float dt = (s.time - previous.time) / 1000.0f;
+        if (dt <= 0) {
+            return false;
+        }
+        float step = 0.5f * (s.speed + previous.speed) * dt;
+        distance += step;
+
+        float lateral = lateralFrom(s, dt);
+        float longitudinal = std::isnan(s.longitudinal) ? (s.speed - previous.speed) / dt : s.longitudinal;
+        previous = s;
+        if (std::isnan(lateral)) {
+            return false;  // Course not known yet
+        }
+        smoothLateral += (lateral - smoothLateral) * SMOOTHING;
+        smoothLongitudinal += (longitudinal - smoothLongitudinal) * SMOOTHING;
+
+        if (!lapActive) {
+            return false;
+        }
+        trackBraking();
+
+        float magnitude = fabsf(smoothLateral);
+        int8_t direction = smoothLateral > 0 ? 1 : -1;
+
+        if (!inCorner) {
+            if (magnitude > ENTER_LATERAL) {
+                enterCorner(direction, s.speed);
+            }
+            return false;
+        }
+
+        // Chicane: the next corner starts without a straight in between
+        if (magnitude > ENTER_LATERAL && direction != current.direction) {
+            bool done = finishCorner(distance, s.speed, out);
+            enterCorner(direction, s.speed);
+            return done;
+        }
+
+        if (s.speed < current.minSpeed) {
+            current.minSpeed = s.speed;
+            current.apexDistance = distance;
+        }
+        if (magnitude > current.peakLateral && direction == current.direction) {
+            current.peakLateral = magnitude;
+        }
+
+        if (magnitude < EXIT_LATERAL) {
+            if (std::isnan(belowSince)) {
+                belowSince = distance;
+                speedAtBelow = s.speed;
+            } else if (distance - belowSince >= EXIT_HOLD) {
+                return finishCorner(belowSince, speedAtBelow, out);
+            }
+        } else {
+            belowSince = NAN;
+        }
+        return false;
+    }
+
+    const CornerMap& getMap() const { return map; }
+    bool isLearning() const { return lapsCompleted < LEARN_LAPS; }
+    float getDistance() const { return distance; }
+
+    // Latest metrics per map corner, corner is UNMATCHED until driven
+    const CornerMetrics& getLast(uint8_t corner) const { return last[corner]; }
+
+private:
+    CornerMap map;
+    CornerMetrics last[CornerMap::MAX_CORNERS];
+    uint16_t lapsCompleted;
+    bool lapActive;
+
+    geometry::LocalFrame frame;
+    CornerSample previous;
+    bool hasPrevious;
+    float anchorX, anchorY;        // Position the course baseline starts at
+    uint32_t anchorTime;
+    float course;                  // Radians, NAN until known
+    float courseRate;
+
+    float distance;
+    float smoothLateral;
+    float smoothLongitudinal;
+    bool braking;
+    float brakeStart;              // NAN if no recent braking
+
+    bool inCorner;
+    CornerMetrics current;
+    float belowSince;
+    float speedAtBelow;
+
+    // Filters keep running across the line, only lap positions restart
+    void resetLapState() {
+        distance = 0;
+        brakeStart = NAN;
+        inCorner = false;
+        belowSince = NAN;
+    }
+
+    static float wrapPi(float angle) {
+        return remainderf(angle, 2.0f * (float)M_PI);
+    }
+
+    float lateralFrom(const CornerSample& s, float dt) {
+        if (!std::isnan(s.lateral)) {
+            return s.lateral;
+        }
+        if (!std::isnan(s.heading) && !std::isnan(previous.heading)) {
+            float rate = wrapPi((previous.heading - s.heading) * (float)M_PI / 180.0f) / dt;  // Heading is clockwise
+            return s.speed * rate;
+        }
+
+        // Course over a baseline long enough to keep position noise down
+        float x = frame.x(s.position.longitude);
+        float y = frame.y(s.position.latitude);
+        float dx = x - anchorX;
+        float dy = y - anchorY;
+        if (dx * dx + dy * dy < COURSE_BASELINE * COURSE_BASELINE) {
+            return std::isnan(course) ? NAN : s.speed * courseRate;
+        }
+        float next = atan2f(dy, dx);
+        float elapsed = (s.time - anchorTime) / 1000.0f;
+        if (!std::isnan(course) && elapsed > 0) {
+            courseRate = wrapPi(next - course) / elapsed;
+        }
+        course = next;
+        anchorX = x;
+        anchorY = y;
+        anchorTime = s.time;
+        return s.speed * courseRate;
+    }
+
+    void trackBraking() {
+        if (smoothLongitudinal < -BRAKE_DECEL) {
+            if (!braking) {
+                braking = true;
+                brakeStart = distance;
+            }
+        } else if (smoothLongitudinal > -BRAKE_DECEL / 2) {
+            braking = false;
+        }
+    }
+
+    void enterCorner(int8_t direction, float speed) {
+        inCorner = true;
+        belowSince = NAN;
+        current.corner = CornerMetrics::UNMATCHED;
+        current.direction = direction;
+        current.lap = lapsCompleted;
+        current.entryDistance = distance;
+        current.apexDistance = distance;
+        current.exitDistance = distance;
+        current.minSpeed = speed;
+        current.exitSpeed = speed;
+        current.peakLateral = fabsf(smoothLateral);
+        bool recent = !std::isnan(brakeStart) && distance - brakeStart <= BRAKE_LOOKBACK;
+        current.brakingPoint = recent ? brakeStart : NAN;
+        brakeStart = NAN;   // One braking zone per corner
+    }
+
+    bool finishCorner(float exitDistance, float exitSpeed, CornerMetrics* out) {
+        inCorner = false;
+        current.exitDistance = exitDistance;
+        current.exitSpeed = exitSpeed;
+        if (exitDistance - current.entryDistance < MIN_LENGTH) {
+            return false;
+        }
+
+        int index = isLearning() ? map.learn(current, MATCH_TOLERANCE)
+                                 : map.match(current.apexDistance, current.direction, MATCH_TOLERANCE);
+        if (index >= 0) {
+            current.corner = (uint8_t)index;
+            last[index] = current;
+        }
+        *out = current;
+        return true;
+    }
+};
@@ -5,175 +5,365 @@
 #include <stdint.h>
 #include <vector>
 #include <cmath>
-#include "track_types.h"
+#include "track/track_types.h"
+#include "reference_trace.h"
+#include "track_geometry.h"
 
-struct LapPoint {
-    GpsPoint position;     // Position with isSet and radius from track_types.h
-    uint32_t timestamp;    // Time since lap start in milliseconds
-    int32_t speed;        // Speed in mm/s
-};
-
-struct LapData {
-    std::vector<LapPoint> points;
-    uint32_t lapTime;      // Total lap time in milliseconds
-    bool isValid;
-    
-    LapData() : lapTime(0), isValid(false) {
-        points.reserve(3000);  // Pre-allocate for 2-minute lap at 25Hz
-    }
-    
-    void clear() {
-        points.clear();
-        lapTime = 0;
-        isValid = false;
-    }
+// Laps the live delta can be measured against
+enum class ReferenceKind : uint8_t {
+    SessionBest = 0,   // Fastest lap of this session
+    AllTimeBest = 1,   // Fastest lap ever on this track, persisted in flash
+    Optimal = 2,       // Best sectors stitched into one lap
 };
 
 class delta_calculator {
+public:
+    static const size_t REFERENCE_COUNT = 3;
+    static const uint8_t SECTOR_COUNT = 3;
+
 private:
-    LapData bestLap;
-    LapData currentLap;
+    struct Reference {
+        ReferenceTrace trace;
+        std::vector<TracePoint> storage;   // Backing points when not mapped from flash
+        std::vector<float> distance;       // Cumulative distance along the lap per point (m)
+        size_t cursor;                     // Last matched point, only moves forward within a lap
+        int32_t delta;
+        bool hasDelta;
+
+        Reference() : cursor(0), delta(0), hasDelta(false) {}
+    };
+
+    Reference references[REFERENCE_COUNT];
+    std::vector<TracePoint> currentLap;
+    uint32_t sectorEnd[SECTOR_COUNT - 1];   // Lap time at each sector line this lap
+    bool newAllTimeBest;
+
+    // Best sector segments, timestamps relative to the sector start
+    std::vector<TracePoint> sectorBest[SECTOR_COUNT];
+    uint32_t sectorBestTime[SECTOR_COUNT];
+
+    // Geometry of the reference that positions are resolved against
+    int resolver;
+    bool resolverDirty;
+    std::vector<float> resolverX;
+    std::vector<float> resolverY;
+    size_t resolverCursor;
+    geometry::LocalFrame frame;
+
     static const uint32_t SAMPLE_INTERVAL_MS = 40;  // 25Hz data rate
     static const uint32_t MAX_POINTS = 3000;        // 2-minute lap at 25Hz
-    static constexpr double EARTH_RADIUS = 6371000.0;     // Earth radius in meters
-    
-    // Calculate Haversine distance between two points in meters
-    double calculateDistance(const GpsPoint& p1, const GpsPoint& p2) {
-        double lat1 = p1.latitude * M_PI / 180.0;
-        double lat2 = p2.latitude * M_PI / 180.0;
-        double deltaLat = (p2.latitude - p1.latitude) * M_PI / 180.0;
-        double deltaLon = (p2.longitude - p1.longitude) * M_PI / 180.0;
-
-        double a = sin(deltaLat/2) * sin(deltaLat/2) +
-                  cos(lat1) * cos(lat2) *
-                  sin(deltaLon/2) * sin(deltaLon/2);
-        double c = 2 * atan2(sqrt(a), sqrt(1-a));
-
-        return EARTH_RADIUS * c;
-    }
-
-    // Find the closest point in bestLap to the given position
-    int findClosestPoint(const GpsPoint& position, size_t searchStart, size_t searchEnd) {
-        int closestIdx = -1;
-        double minDistance = position.radius; // Use radius from GpsPoint for threshold
-
-        // Local search around expected position
-        for (size_t i = searchStart; i < searchEnd && i < bestLap.points.size(); i++) {
-            double distance = calculateDistance(position, bestLap.points[i].position);
-            if (distance < minDistance) {
-                minDistance = distance;
-                closestIdx = i;
+    static constexpr float OFF_TRACK_DISTANCE = 30.0f;   // Max distance from the reference line (m)
+    static const size_t SEARCH_BEHIND = 5;
+    static const size_t SEARCH_AHEAD = 25;
+
+    Reference& ref(ReferenceKind kind) {
+        return references[(size_t)kind];
+    }
+
+    void setTrace(ReferenceKind kind, const ReferenceTrace& trace) {
+        Reference& reference = ref(kind);
+        reference.trace = trace;
+        reference.cursor = 0;
+        reference.hasDelta = false;
+        geometry::cumulativeDistances(trace.points, trace.count, reference.distance);
+        resolverDirty = true;
+    }
+
+    // Copies points into the reference's own storage and points the view at it
+    void storeTrace(ReferenceKind kind, const TracePoint* points, size_t count, uint32_t lapTime) {
+        Reference& reference = ref(kind);
+        reference.storage.assign(points, points + count);
+        setTrace(kind, ReferenceTrace(reference.storage.data(), count, lapTime));
+    }
+
+    void selectResolver() {
+        // Prefer the most stable line: persisted best, then session best, then optimal
+        static const ReferenceKind order[] = {
+            ReferenceKind::AllTimeBest, ReferenceKind::SessionBest, ReferenceKind::Optimal
+        };
+
+        int selected = -1;
+        for (ReferenceKind kind : order) {
+            if (ref(kind).trace.isValid && ref(kind).trace.count >= 2) {
+                selected = (int)kind;
+                break;
+            }
+        }
+        if (selected == resolver && !resolverDirty) {
+            return;  // Same line as last lap
+        }
+
+        resolver = selected;
+        resolverDirty = false;
+        if (resolver < 0) {
+            return;
+        }
+
+        const ReferenceTrace& trace = references[resolver].trace;
+        frame = geometry::LocalFrame(trace.points[0].latitudeE7 / 1e7, trace.points[0].longitudeE7 / 1e7);
+        geometry::project(frame, trace.points, trace.count, resolverX, resolverY);
+    }
+
+    /**
+     * Resolve a position to a fraction of the lap (0..1) on the resolver line.
+     * Searches a small window around the previous match and only falls back
+     * to the whole lap when the car is not found there.
+     */
+    bool resolvePosition(const GpsPoint& position, float* fraction) {
+        const Reference& line = references[resolver];
+        size_t segments = line.trace.count - 1;
+        float x = frame.x(position.longitude);
+        float y = frame.y(position.latitude);
+
+        size_t first = resolverCursor > SEARCH_BEHIND ? resolverCursor - SEARCH_BEHIND : 0;
+        size_t last = std::min(resolverCursor + SEARCH_AHEAD, segments);
+        size_t segment = 0;
+        float along = 0;
+        float distSq = geometry::projectOnto(resolverX.data(), resolverY.data(), x, y, first, last, &segment, &along);
+
+        const float maxSq = OFF_TRACK_DISTANCE * OFF_TRACK_DISTANCE;
+        if (distSq > maxSq) {
+            distSq = geometry::projectOnto(resolverX.data(), resolverY.data(), x, y, 0, segments, &segment, &along);
+            if (distSq > maxSq) {
+                return false;
+            }
+        }
+
+        resolverCursor = segment;
+        float length = line.distance.back();
+        if (length <= 0) {
+            return false;
+        }
+        *fraction = (line.distance[segment] + along) / length;
+        return true;
+    }
+
+    // Keep the fastest version of each sector and rebuild the optimal lap
+    void updateOptimalLap(uint32_t finalLapTime) {
+        uint32_t bounds[SECTOR_COUNT + 1] = { 0, sectorEnd[0], sectorEnd[1], finalLapTime };
+        bool improved = false;
+
+        for (uint8_t s = 0; s < SECTOR_COUNT; s++) {
+            if (bounds[s + 1] <= bounds[s] || (s > 0 && bounds[s] == 0)) {
+                continue;  // Sector line not crossed this lap
+            }
+            uint32_t time = bounds[s + 1] - bounds[s];
+            if (time >= sectorBestTime[s]) {
+                continue;
+            }
+
+            sectorBestTime[s] = time;
+            sectorBest[s].clear();
+            for (const auto& point : currentLap) {
+                if (point.timestamp >= bounds[s] && point.timestamp <= bounds[s + 1]) {
+                    TracePoint shifted = point;
+                    shifted.timestamp -= bounds[s];
+                    sectorBest[s].push_back(shifted);
+                }
             }
+            improved = true;
+        }
+
+        if (!improved) {
+            return;
+        }
+
+        size_t total = 0;
+        for (uint8_t s = 0; s < SECTOR_COUNT; s++) {
+            if (sectorBest[s].empty()) return;
+            total += sectorBest[s].size();
         }
 
-        return closestIdx;
+        Reference& optimal = ref(ReferenceKind::Optimal);
+        optimal.storage.clear();
+        optimal.storage.reserve(total);
+        uint32_t offset = 0;
+        for (uint8_t s = 0; s < SECTOR_COUNT; s++) {
+            for (const auto& point : sectorBest[s]) {
+                TracePoint stitched = point;
+                stitched.timestamp += offset;
+                optimal.storage.push_back(stitched);
+            }
+            offset += sectorBestTime[s];
+        }
+        setTrace(ReferenceKind::Optimal, ReferenceTrace(optimal.storage.data(), optimal.storage.size(), offset));
     }
 
 public:
-    delta_calculator() {}
+    delta_calculator()
+        : newAllTimeBest(false)
+        , resolver(-1)
+        , resolverDirty(true)
+        , resolverCursor(0)
+    {
+        currentLap.reserve(MAX_POINTS);
+        reset();
+    }
 
+    // Clears everything; the all-time best is restored with setAllTimeBest()
     void reset() {
-        bestLap.clear();
+        for (auto& reference : references) {
+            reference.trace = ReferenceTrace();
+            reference.storage.clear();
+            reference.distance.clear();
+            reference.cursor = 0;
+            reference.hasDelta = false;
+        }
+        for (uint8_t s = 0; s < SECTOR_COUNT; s++) {
+            sectorBest[s].clear();
+            sectorBestTime[s] = UINT32_MAX;
+        }
         currentLap.clear();
+        newAllTimeBest = false;
+        resolver = -1;
+        resolverDirty = true;
+        startLap();
     }
 
+    /**
+     * Use a previously stored lap as the all-time reference, typically a
+     * memory-mapped view from ReferenceStore. The points must stay valid
+     * until the next setAllTimeBest(), reset() or a faster lap replaces it.
+     */
+    void setAllTimeBest(const ReferenceTrace& trace) {
+        setTrace(ReferenceKind::AllTimeBest, trace);
+        selectResolver();
+    }
+
+    const ReferenceTrace& getReference(ReferenceKind kind) const {
+        return references[(size_t)kind].trace;
+    }
+
+    // True once after each lap that became the new all-time best
+    bool consumeNewBestLap() {
+        bool result = newAllTimeBest;
+        newAllTimeBest = false;
+        return result;
+    }
+
+    void startLap() {
+        currentLap.clear();
+        for (uint8_t s = 0; s < SECTOR_COUNT - 1; s++) {
+            sectorEnd[s] = 0;
+        }
+        for (auto& reference : references) {
+            reference.cursor = 0;
+            reference.hasDelta = false;
+        }
+        resolverCursor = 0;
+        selectResolver();
+    }
+
+    // speed in mm/s, as TracePoint keeps it
     void storePoint(uint32_t currentLapTime, const GpsPoint& point, int32_t speed) {
-        if (currentLap.points.size() >= MAX_POINTS || !point.isSet) {
+        if (currentLap.size() >= MAX_POINTS || !point.isSet) {
             return;
         }
 
         // Only store points at fixed intervals
-        if (currentLap.points.empty() || 
-            (currentLapTime - currentLap.points.back().timestamp) >= SAMPLE_INTERVAL_MS) {
-            
-            LapPoint lapPoint;
-            lapPoint.position = point;
-            lapPoint.timestamp = currentLapTime;
-            lapPoint.speed = speed;
-            currentLap.points.push_back(lapPoint);
+        if (currentLap.empty() ||
+            (currentLapTime - currentLap.back().timestamp) >= SAMPLE_INTERVAL_MS) {
+            currentLap.push_back(TracePoint::from(point, currentLapTime, speed));
+        }
+    }
+
+    // Record the lap time at which sector line `sector` (0 = end of S1) was crossed
+    void markSector(uint8_t sector, uint32_t currentLapTime) {
+        if (sector < SECTOR_COUNT - 1) {
+            sectorEnd[sector] = currentLapTime;
         }
     }
 
     void completeLap(uint32_t finalLapTime) {
-        currentLap.lapTime = finalLapTime;
-        currentLap.isValid = true;
+        if (currentLap.size() >= 2) {
+            const ReferenceTrace& session = ref(ReferenceKind::SessionBest).trace;
+            if (!session.isValid || finalLapTime < session.lapTime) {
+                storeTrace(ReferenceKind::SessionBest, currentLap.data(), currentLap.size(), finalLapTime);
+            }
 
-        // Update best lap if this lap is faster or no valid best lap exists
-        if (!bestLap.isValid || finalLapTime < bestLap.lapTime) {
-            bestLap = currentLap;
+            const ReferenceTrace& allTime = ref(ReferenceKind::AllTimeBest).trace;
+            if (!allTime.isValid || finalLapTime < allTime.lapTime) {
+                storeTrace(ReferenceKind::AllTimeBest, currentLap.data(), currentLap.size(), finalLapTime);
+                newAllTimeBest = true;
+            }
+
+            updateOptimalLap(finalLapTime);
         }
 
-        currentLap.clear();
+        startLap();
     }
 
     /**
-     * Calculate delta time using spatial matching and interpolation.
-     * 
+     * Calculate the delta to every reference for the current position.
+     *
      * The algorithm:
-     * 1. Find the closest point in the best lap to current position
-     * 2. Use local search window to improve matching efficiency
-     * 3. Interpolate between closest points for smooth delta
-     * 
-     * @param currentLapTime Current time in milliseconds
-     * @param position Current GPS position
-     * @return Delta in ms (positive = slower, negative = faster)
+     * 1. Project the position onto one reference line (the resolver) to get
+     *    the fraction of the lap driven, searching near the previous match
+     * 2. Scale that fraction to each reference's own lap length
+     * 3. Interpolate each reference's time at that distance, walking a
+     *    per-reference cursor that only moves a step or two per fix
+     *
+     * The projection is done once per fix, so K references cost about as
+     * much as one.
      */
-    int32_t calculateDelta(uint32_t currentLapTime, const GpsPoint& position) {
-        if (!bestLap.isValid || bestLap.points.empty() || currentLap.points.empty() || !position.isSet) {
-            return 0;
+    void update(uint32_t currentLapTime, const GpsPoint& position) {
+        for (auto& reference : references) {
+            reference.hasDelta = false;
         }
-
-        // Calculate expected search window based on current time
-        double lapProgressRatio = (double)currentLapTime / bestLap.lapTime;
-        size_t expectedIndex = (size_t)(lapProgressRatio * bestLap.points.size());
-        
-        // Define search window (20% of lap points)
-        size_t windowSize = bestLap.points.size() / 5;
-        size_t searchStart = (expectedIndex > windowSize) ? expectedIndex - windowSize : 0;
-        size_t searchEnd = std::min(expectedIndex + windowSize, bestLap.points.size());
-
-        // Find closest point using GpsPoint's radius as threshold
-        int closestIdx = findClosestPoint(position, searchStart, searchEnd);
-        
-        if (closestIdx < 0) {
-            return 0;  // No matching point found within threshold
+        if (resolver < 0 || currentLap.empty() || !position.isSet) {
+            return;
         }
 
-        // Find second closest point for interpolation
-        int nextIdx = closestIdx + 1;
-        if (nextIdx >= (int)bestLap.points.size()) {
-            return currentLapTime - bestLap.lapTime;  // At end of lap
+        float fraction;
+        if (!resolvePosition(position, &fraction)) {
+            return;  // Off the reference line
         }
 
-        // Calculate interpolation ratio based on relative distances
-        double d1 = calculateDistance(position, bestLap.points[closestIdx].position);
-        double d2 = calculateDistance(position, bestLap.points[nextIdx].position);
-        double totalDist = d1 + d2;
-        
-        if (totalDist < 0.1) {  // Avoid division by very small numbers
-            return currentLapTime - bestLap.points[closestIdx].timestamp;
+        for (auto& reference : references) {
+            if (!reference.trace.isValid || reference.trace.count < 2) {
+                continue;
+            }
+            float distance = fraction * reference.distance.back();
+            uint32_t expectedTime = geometry::timeAtDistance(reference.trace.points, reference.distance.data(),
+                                                             reference.trace.count, distance, reference.cursor);
+            reference.delta = (int32_t)(currentLapTime - expectedTime);  // Positive = slower
+            reference.hasDelta = true;
         }
+    }
 
-        // Interpolate between points
-        double ratio = d1 / totalDist;
-        uint32_t expectedTime = bestLap.points[closestIdx].timestamp +
-                              (uint32_t)((bestLap.points[nextIdx].timestamp - 
-                                        bestLap.points[closestIdx].timestamp) * ratio);
+    // Delta in ms from the last update() (positive = slower, negative = faster)
+    int32_t getDelta(ReferenceKind kind) const {
+        const Reference& reference = references[(size_t)kind];
+        return reference.hasDelta ? reference.delta : 0;
+    }
+
+    bool hasDelta(ReferenceKind kind) const {
+        return references[(size_t)kind].hasDelta;
+    }
+
+    // Single-reference convenience wrapper around update()
+    int32_t calculateDelta(uint32_t currentLapTime, const GpsPoint& position,
+                           ReferenceKind kind = ReferenceKind::SessionBest) {
+        update(currentLapTime, position);
+        return getDelta(kind);
+    }
 
-        // Return delta (positive = slower, negative = faster)
-        return currentLapTime - expectedTime;
+    uint32_t getBestLapTime(ReferenceKind kind = ReferenceKind::SessionBest) const {
+        const ReferenceTrace& trace = references[(size_t)kind].trace;
+        return trace.isValid ? trace.lapTime : 0;
     }
 
-    uint32_t getBestLapTime() const {
-        return bestLap.isValid ? bestLap.lapTime : 0;
+    bool hasBestLap(ReferenceKind kind = ReferenceKind::SessionBest) const {
+        return references[(size_t)kind].trace.isValid;
     }
 
-    bool hasBestLap() const {
-        return bestLap.isValid;
+    // Sum of the best sectors, as stitched into the optimal lap
+    uint32_t getOptimalLapTime() const {
+        return getBestLapTime(ReferenceKind::Optimal);
     }
 
     // Get current best lap point count
-    size_t getBestLapPointCount() const {
-        return bestLap.points.size();
+    size_t getBestLapPointCount(ReferenceKind kind = ReferenceKind::SessionBest) const {
+        return references[(size_t)kind].trace.count;
     }
 };
\ No newline at end of file
@@ -0,0 +1,161 @@
+#pragma once
+#include <stdint.h>
+#include <cmath>
+#include "track/track_types.h"
+
+// Gate positions the lap and sector logic checks fixes against
+struct TimingGates {
+    GpsPoint startFinish;
+    GpsPoint sector1;      // End of sector 1
+    GpsPoint sector2;      // End of sector 2
+    GpsPoint pitEntry;
+    GpsPoint pitExit;
+};
+
+// What a single fix triggered, in the order it has to be handled
+struct TimingEvents {
+    uint8_t sectors;          // Bit n set when sector n was completed
+    uint32_t sectorTime[3];   // Duration of each completed sector (ms)
+    uint32_t sectorEnd[3];    // Lap time at the end of each completed sector (ms)
+    bool lapCompleted;
+    uint32_t lapTime;
+    bool lapStarted;
+    bool pitEntered;
+    bool pitExited;
+};
+
+/**
+ * Lap, sector and pit lane timing from proximity gates.
+ *
+ * A gate triggers on the first fix within its radius. Time is passed in by
+ * the caller (millis() in the car, simulated time in host tools), so the
+ * logic has no display or clock dependencies.
+ */
+class LapTiming {
+public:
+    static constexpr float MIN_START_SPEED = 1.389f;   // 5 km/h in m/s
+
+    LapTiming() { reset(); }
+
+    void reset() {
+        lapActive = false;
+        lapStartTime = 0;
+        sector1CrossTime = 0;
+        sector2CrossTime = 0;
+        inSector1 = false;
+        inSector2 = false;
+        inSector3 = false;
+        inPitLane = false;
+        atStartFinish = false;
+    }
+
+    TimingEvents update(uint32_t now, const GpsPoint& position, float speed, const TimingGates& gates) {
+        TimingEvents events = {};
+
+        // Only entering the start/finish radius counts, not every fix inside it
+        bool nearStartFinish = isNearPoint(position, gates.startFinish);
+        if (nearStartFinish && !atStartFinish) {
+            handleStartFinishCrossing(now, speed, events);
+        }
+        atStartFinish = nearStartFinish;
+
+        if (lapActive) {
+            checkSectorCrossings(now, position, gates, events);
+            checkPitLane(position, gates, events);
+        }
+        return events;
+    }
+
+    bool isLapActive() const { return lapActive; }
+    bool isInPitLane() const { return inPitLane; }
+    uint32_t getLapTime(uint32_t now) const { return lapActive ? now - lapStartTime : 0; }
+
+    static bool isNearPoint(const GpsPoint& pos, const GpsPoint& target) {
+        if (!target.isSet) return false;
+
+        // Haversine formula for accurate distance calculation
+        const double R = 6371000; // Earth radius in meters
+        double lat1 = pos.latitude * M_PI / 180;
+        double lat2 = target.latitude * M_PI / 180;
+        double dlat = (target.latitude - pos.latitude) * M_PI / 180;
+        double dlon = (target.longitude - pos.longitude) * M_PI / 180;
+
+        double a = sin(dlat/2) * sin(dlat/2) +
+                  cos(lat1) * cos(lat2) *
+                  sin(dlon/2) * sin(dlon/2);
+        double c = 2 * atan2(sqrt(a), sqrt(1-a));
+        double distance = R * c;
+
+        return distance <= target.radius;
+    }
+
+private:
+    bool lapActive;
+    uint32_t lapStartTime;
+    uint32_t sector1CrossTime;
+    uint32_t sector2CrossTime;
+    bool inSector1;
+    bool inSector2;
+    bool inSector3;
+    bool inPitLane;
+    bool atStartFinish;
+
+    void handleStartFinishCrossing(uint32_t now, float speed, TimingEvents& events) {
+        if (lapActive) {
+            uint32_t lapTime = now - lapStartTime;
+
+            // Final sector ends with the lap
+            if (inSector3) {
+                events.sectors |= 1 << 2;
+                events.sectorTime[2] = lapTime - sector2CrossTime;
+                events.sectorEnd[2] = lapTime;
+            }
+
+            events.lapCompleted = true;
+            events.lapTime = lapTime;
+            inSector1 = false;
+            inSector2 = false;
+            inSector3 = false;
+        }
+
+        // Start new lap if speed is above minimum threshold
+        if (speed > MIN_START_SPEED) {
+            lapActive = true;
+            lapStartTime = now;
+            sector1CrossTime = 0;
+            sector2CrossTime = 0;
+            events.lapStarted = true;
+        }
+    }
+
+    void checkSectorCrossings(uint32_t now, const GpsPoint& position, const TimingGates& gates, TimingEvents& events) {
+        if (isNearPoint(position, gates.sector1) && !inSector1) {
+            inSector1 = true;
+            sector1CrossTime = now - lapStartTime;
+            events.sectors |= 1 << 0;
+            events.sectorTime[0] = sector1CrossTime;
+            events.sectorEnd[0] = sector1CrossTime;
+        }
+
+        if (isNearPoint(position, gates.sector2) && !inSector2 && inSector1) {
+            inSector2 = true;
+            sector2CrossTime = now - lapStartTime;
+            events.sectors |= 1 << 1;
+            events.sectorTime[1] = sector2CrossTime - sector1CrossTime;
+            events.sectorEnd[1] = sector2CrossTime;
+            inSector3 = true; // Start sector 3 timing
+        }
+    }
+
+    void checkPitLane(const GpsPoint& position, const TimingGates& gates, TimingEvents& events) {
+        if (!gates.pitEntry.isSet || !gates.pitExit.isSet) return;
+
+        if (isNearPoint(position, gates.pitEntry) && !inPitLane) {
+            inPitLane = true;
+            events.pitEntered = true;
+        } else if (isNearPoint(position, gates.pitExit) && inPitLane) {
+            inPitLane = false;
+            events.pitExited = true;
+        }
+    }
+};
@@ -0,0 +1,329 @@
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include "delta_calculator.h"
+#include "lap_timing.h"
+#include "corner_engine.h"
+#include "session_stats.h"
+#include "session/warm_state.h"
+#include "util/triple_buffer.h"
+#include "util/profiler.h"
+#include "util/latency_trace.h"
+
+// Everything the racing display shows, as of one GNSS fix
+struct RacingState {
+    uint32_t sequence;         // GNSSData::sequence of the fix
+    uint32_t timestamp;        // millis() when the fix was processed
+    uint32_t generation;       // Changes on reset, the renderer redraws everything
+
+    bool gpsValid;
+    uint8_t satellites;
+    int32_t speedKph;
+    bool rbmConnected;
+
+    bool lapActive;
+    uint32_t lapStartTime;     // millis() at the start of the current lap
+    uint16_t lapCount;
+    uint32_t lastLapTime;
+
+    ReferenceKind deltaReference;
+    bool hasDelta;
+    int32_t delta;             // ms against deltaReference, positive = slower
+
+    uint32_t sectorTime[3];    // Last completed time of each sector, 0 if none
+    uint32_t sectorBest[3];    // UINT32_MAX if none
+    uint32_t theoreticalBest;  // 0 if unknown
+
+    SeriesSummary lapStats;    // Session statistics, updated on lap and sector events
+    SeriesSummary sectorStats[3];
+
+    bool inPitLane;
+    bool stintActive;
+    uint32_t stintStartTime;
+
+    uint16_t cornersCompleted; // Counts corners this session, lastCorner is valid if non-zero
+    CornerMetrics lastCorner;
+};
+
+// Compute-side notifications, called from inside RacingEngine::update()
+class RacingListener {
+public:
+    virtual ~RacingListener() = default;
+    virtual void onSector(uint8_t /*sector*/, uint32_t /*time*/) {}
+    virtual void onLap(uint16_t /*lapNumber*/, uint32_t /*lapTime*/, bool /*isSessionBest*/) {}
+    virtual void onNewAllTimeBest(const ReferenceTrace& /*trace*/) {}
+    virtual void onCorner(const CornerMetrics& /*corner*/) {}
+};
+
+/**
+ * The compute half of the racing display: gates, deltas, bests and corners.
+ *
+ * update() runs once per fix and ends by publishing an immutable
+ * RacingState into a triple buffer. The renderer, usually on the other
+ * core, picks up the newest state at its own rate, so slow display I/O
+ * never delays gate detection or delta. Everything here is plain C++ and
+ * runs the same way on the host.
+ */
+class RacingEngine {
+public:
+    explicit RacingEngine(TripleBuffer<RacingState>& output) : output(output), listener(nullptr), motionValid(false) {
+        state = RacingState();
+        state.deltaReference = ReferenceKind::SessionBest;
+        for (uint8_t s = 0; s < 3; s++) {
+            state.sectorBest[s] = UINT32_MAX;
+        }
+        publish();
+    }
+
+    void setListener(RacingListener* target) {
+        listener = target;
+    }
+
+    void update(uint32_t now, const GpsPoint& position, float speed, bool valid, uint8_t satellites,
+                uint32_t sequence, const TimingGates& gates) {
+        state.sequence = sequence;
+        state.timestamp = now;
+        state.gpsValid = valid;
+        state.satellites = satellites;
+
+        if (valid) {
+            state.speedKph = (int32_t)lroundf(speed * 3.6f);  // Convert m/s to km/h
+
+            // Deltas to all references from one position lookup
+            if (timing.isLapActive()) {
+                PROFILE_SCOPE(ProfileStage::DeltaCalc);
+                uint32_t currentLapTime = timing.getLapTime(now);
+                deltaCalculator.storePoint(currentLapTime, position, (int32_t)lroundf(speed * 1000.0f));
+                deltaCalculator.update(currentLapTime, position);
+                state.hasDelta = true;
+                state.delta = deltaCalculator.getDelta(state.deltaReference);
+            }
+            LATENCY_MARK(sequence, LatencyStage::DeltaComputed);
+
+            {
+                PROFILE_SCOPE(ProfileStage::GateCheck);
+                handleEvents(timing.update(now, position, speed, gates), now);
+            }
+
+            // After the gates, so a new lap's first sample is at distance 0
+            CornerSample sample = { now, position, speed, NAN, NAN, NAN };
+            if (motionValid) {
+                sample.speed = motion.speed;
+                sample.heading = motion.heading;
+                sample.longitudinal = motion.longitudinal;
+                sample.lateral = motion.lateral;
+            }
+            CornerMetrics corner;
+            if (corners.update(sample, &corner)) {
+                state.cornersCompleted++;
+                state.lastCorner = corner;
+                if (listener) {
+                    listener->onCorner(corner);
+                }
+            }
+        }
+        motionValid = false;
+
+        publish();
+    }
+
+    // Optional, before update(): the fix's exact speed (m/s) and course
+    // (degrees) and the latest acceleration in the vehicle frame (m/s^2,
+    // forward and left positive). NAN for what is not available. Without
+    // it corners are found from the positions alone.
+    void updateMotion(float speed, float heading, float longitudinal, float lateral) {
+        motion = { 0, GpsPoint(), speed, heading, longitudinal, lateral };
+        motionValid = true;
+    }
+
+    void setDeltaReference(ReferenceKind kind) {
+        state.deltaReference = kind;
+        state.delta = deltaCalculator.getDelta(kind);
+        publish();
+    }
+
+    void setRbmConnected(bool connected) {
+        state.rbmConnected = connected;
+        publish();
+    }
+
+    void startStint(uint32_t now) {
+        state.stintActive = true;
+        state.stintStartTime = now;
+        publish();
+    }
+
+    void stopStint() {
+        state.stintActive = false;
+        publish();
+    }
+
+    void resetStint(uint32_t now) {
+        if (state.stintActive) {
+            state.stintStartTime = now;
+            publish();
+        }
+    }
+
+    void resetLap() {
+        timing.reset();
+        deltaCalculator.reset();
+        corners.abortLap();
+        state.lapActive = false;
+        state.hasDelta = false;
+        state.delta = 0;
+        state.lastLapTime = 0;
+        state.generation++;
+        publish();
+    }
+
+    // Resets everything including lap count, stint, sector bests and statistics
+    void reset() {
+        sessionStats.reset();
+        state.lapStats = sessionStats.getLaps().summary();
+        for (uint8_t s = 0; s < 3; s++) {
+            state.sectorStats[s] = sessionStats.getSector(s).summary();
+        }
+        state.lapCount = 0;
+        state.stintActive = false;
+        state.cornersCompleted = 0;
+        corners.reset();
+        state.theoreticalBest = 0;
+        for (uint8_t s = 0; s < 3; s++) {
+            state.sectorTime[s] = 0;
+            state.sectorBest[s] = UINT32_MAX;
+        }
+        resetLap();
+    }
+
+    // Bests carried over from a stored track
+    void setSectorBests(uint32_t sector1, uint32_t sector2, uint32_t sector3) {
+        state.sectorBest[0] = sector1;
+        state.sectorBest[1] = sector2;
+        state.sectorBest[2] = sector3;
+        publish();
+    }
+
+    void setAllTimeBest(const ReferenceTrace& trace) {
+        deltaCalculator.setAllTimeBest(trace);
+    }
+
+    // Stint, bests and lap count for a warm restart snapshot
+    void saveWarm(WarmState* warm, uint32_t now) const {
+        warm->stintActive = state.stintActive;
+        warm->stintElapsedMs = state.stintActive ? now - state.stintStartTime : 0;
+        for (uint8_t s = 0; s < 3; s++) {
+            warm->sectorBest[s] = state.sectorBest[s];
+        }
+        warm->theoreticalBest = state.theoreticalBest;
+        warm->lapCount = state.lapCount;
+        warm->deltaReference = (uint8_t)state.deltaReference;
+    }
+
+    // After a reset, on a reset engine: the snapshot's stint, which kept
+    // running for the ageMs since it was saved, its bests and lap count
+    void restoreWarm(const WarmState& warm, uint32_t now, uint32_t ageMs) {
+        state.stintActive = warm.stintActive;
+        state.stintStartTime = now - warm.stintElapsedMs - ageMs;
+        for (uint8_t s = 0; s < 3; s++) {
+            if (warm.sectorBest[s] < state.sectorBest[s]) {
+                state.sectorBest[s] = warm.sectorBest[s];
+            }
+        }
+        state.theoreticalBest = warm.theoreticalBest;
+        state.lapCount = warm.lapCount;
+        if (warm.deltaReference <= (uint8_t)ReferenceKind::Optimal) {
+            state.deltaReference = (ReferenceKind)warm.deltaReference;
+        }
+        publish();
+    }
+
+    // Compute-side view, only valid on the thread calling update()
+    const RacingState& current() const { return state; }
+    const delta_calculator& deltas() const { return deltaCalculator; }
+    const CornerEngine& cornerEngine() const { return corners; }
+    const SessionStats& stats() const { return sessionStats; }
+    bool isInPitLane() const { return timing.isInPitLane(); }
+
+private:
+    TripleBuffer<RacingState>& output;
+    RacingListener* listener;
+    RacingState state;
+    LapTiming timing;
+    delta_calculator deltaCalculator;
+    CornerEngine corners;
+    SessionStats sessionStats;
+    CornerSample motion;       // Only speed, heading and accelerations are used
+    bool motionValid;
+
+    void publish() {
+        output.writeBuffer() = state;
+        output.publish();
+    }
+
+    void completeSector(uint8_t sector, uint32_t time) {
+        state.sectorTime[sector] = time;
+        if (time > 0 && (state.sectorBest[sector] == UINT32_MAX || time < state.sectorBest[sector])) {
+            state.sectorBest[sector] = time;
+        }
+        sessionStats.addSector(sector, time);
+        state.sectorStats[sector] = sessionStats.getSector(sector).summary();
+        if (listener) {
+            listener->onSector(sector, time);
+        }
+    }
+
+    void handleEvents(const TimingEvents& events, uint32_t now) {
+        // Start/finish first: final sector, lap completion, new lap
+        if (events.sectors & (1 << 2)) {
+            completeSector(2, events.sectorTime[2]);
+        }
+
+        if (events.lapCompleted) {
+            deltaCalculator.completeLap(events.lapTime);
+            corners.completeLap();
+            state.lapCount++;
+            state.lastLapTime = events.lapTime;
+            sessionStats.addLap(events.lapTime);
+            state.lapStats = sessionStats.getLaps().summary();
+
+            // Theoretical best is the lap time of the stitched optimal lap;
+            // one carried over a warm restart stands until it is beaten
+            uint32_t theoretical = deltaCalculator.getOptimalLapTime();
+            if (theoretical > 0 && (state.theoreticalBest == 0 || theoretical < state.theoreticalBest)) {
+                state.theoreticalBest = theoretical;
+            }
+
+            bool newAllTimeBest = deltaCalculator.consumeNewBestLap();
+            if (listener) {
+                if (newAllTimeBest) {
+                    listener->onNewAllTimeBest(deltaCalculator.getReference(ReferenceKind::AllTimeBest));
+                }
+                const ReferenceTrace& best = deltaCalculator.getReference(ReferenceKind::SessionBest);
+                listener->onLap(state.lapCount, events.lapTime, best.isValid && best.lapTime == events.lapTime);
+            }
+        }
+
+        if (events.lapStarted) {
+            corners.startLap();
+            state.lapStartTime = now;
+            state.hasDelta = false;
+        }
+        state.lapActive = timing.isLapActive();
+
+        for (uint8_t sector = 0; sector < 2; sector++) {
+            if (events.sectors & (1 << sector)) {
+                deltaCalculator.markSector(sector, events.sectorEnd[sector]);
+                completeSector(sector, events.sectorTime[sector]);
+            }
+        }
+
+        state.inPitLane = timing.isInPitLane();
+        if (events.pitExited) {
+            // Reset stint timer on pit exit
+            if (state.stintActive) {
+                state.stintStartTime = now;
+            }
+        }
+    }
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <cmath>
+#include "track/track_types.h"
+
+// One sample of a reference lap. Fixed 16 byte layout so traces can be
+// written to flash as-is and read back through a memory-mapped view.
+struct TracePoint {
+    int32_t latitudeE7;    // Degrees * 1e7
+    int32_t longitudeE7;   // Degrees * 1e7
+    uint32_t timestamp;    // Time since lap start in milliseconds
+    int32_t speed;         // Speed in mm/s
+
+    GpsPoint position() const {
+        GpsPoint point;
+        point.latitude = latitudeE7 / 1e7;
+        point.longitude = longitudeE7 / 1e7;
+        point.isSet = true;
+        return point;
+    }
+
+    static TracePoint from(const GpsPoint& position, uint32_t timestamp, int32_t speed) {
+        TracePoint point;
+        point.latitudeE7 = (int32_t)lround(position.latitude * 1e7);
+        point.longitudeE7 = (int32_t)lround(position.longitude * 1e7);
+        point.timestamp = timestamp;
+        point.speed = speed;
+        return point;
+    }
+};
+
+static_assert(sizeof(TracePoint) == 16, "TracePoint is a flash format");
+
+// Non-owning view of a reference lap, backed by RAM or mapped flash
+struct ReferenceTrace {
+    const TracePoint* points;
+    size_t count;
+    uint32_t lapTime;      // Total lap time in milliseconds
+    bool isValid;
+
+    ReferenceTrace() : points(nullptr), count(0), lapTime(0), isValid(false) {}
+
+    ReferenceTrace(const TracePoint* points, size_t count, uint32_t lapTime)
+        : points(points), count(count), lapTime(lapTime), isValid(points && count > 0) {}
+};
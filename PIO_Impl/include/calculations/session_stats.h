@@ -0,0 +1,279 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+/**
+ * Fixed-size streaming statistics for lap and sector times.
+ *
+ * Everything here is updated in constant time per value and never
+ * allocates, so it can run inside the lap and sector events. Values are
+ * milliseconds.
+ */
+namespace stats {
+
+    // Mean and variance by Welford's method, plus the extremes
+    class Running {
+    public:
+        Running() { reset(); }
+
+        void reset() {
+            count = 0;
+            mean = 0;
+            m2 = 0;
+            min = UINT32_MAX;
+            max = 0;
+        }
+
+        void add(uint32_t value) {
+            count++;
+            double delta = value - mean;
+            mean += delta / count;
+            m2 += delta * (value - mean);
+            if (value < min) min = value;
+            if (value > max) max = value;
+        }
+
+        uint32_t getCount() const { return count; }
+        double getMean() const { return mean; }
+        double getStddev() const { return count > 1 ? sqrt(m2 / (count - 1)) : 0.0; }
+        uint32_t getMin() const { return count ? min : 0; }
+        uint32_t getMax() const { return max; }
+
+    private:
+        uint32_t count;
+        double mean;
+        double m2;
+        uint32_t min;
+        uint32_t max;
+    };
+
+    /**
+     * Extended P-square estimator (Jain and Chlamtac, generalised by
+     * Raatikainen) for the 10th, 50th and 90th percentiles. Nine markers
+     * track the minimum, the three quantiles, the midpoints between them and
+     * the maximum. Each value moves at most one marker per position along a
+     * parabola through its neighbours. Until the markers are initialised the
+     * quantiles are exact.
+     */
+    class Quantiles {
+    public:
+        static const size_t COUNT = 3;
+        static const size_t MARKERS = 2 * COUNT + 3;
+
+        Quantiles() { reset(); }
+
+        void reset() {
+            count = 0;
+            for (size_t i = 0; i < MARKERS; i++) {
+                position[i] = (float)i;
+            }
+        }
+
+        void add(uint32_t value) {
+            float x = (float)value;
+            if (count < MARKERS) {
+                // Insertion sort while the markers fill
+                size_t i = count++;
+                while (i > 0 && height[i - 1] > x) {
+                    height[i] = height[i - 1];
+                    i--;
+                }
+                height[i] = x;
+                return;
+            }
+
+            size_t k;
+            if (x < height[0]) {
+                height[0] = x;
+                k = 0;
+            } else if (x >= height[MARKERS - 1]) {
+                height[MARKERS - 1] = x;
+                k = MARKERS - 2;
+            } else {
+                k = 0;
+                while (x >= height[k + 1]) k++;
+            }
+            for (size_t i = k + 1; i < MARKERS; i++) {
+                position[i] += 1;
+            }
+            count++;
+
+            for (size_t i = 1; i < MARKERS - 1; i++) {
+                float d = desired(i) * (count - 1) - position[i];
+                if ((d >= 1 && position[i + 1] - position[i] > 1) || (d <= -1 && position[i - 1] - position[i] < -1)) {
+                    int s = d > 0 ? 1 : -1;
+                    float q = parabolic(i, s);
+                    if (height[i - 1] < q && q < height[i + 1]) {
+                        height[i] = q;
+                    } else {
+                        height[i] += s * (height[i + s] - height[i]) / (position[i + s] - position[i]);
+                    }
+                    position[i] += s;
+                }
+            }
+        }
+
+        // Percentile index 0, 1, 2 for p10, p50, p90; 0 if empty
+        uint32_t get(size_t quantile) const {
+            if (count == 0) return 0;
+            if (count < MARKERS) {
+                float rank = desired(2 * quantile + 2) * (count - 1);
+                size_t i = (size_t)rank;
+                float f = rank - i;
+                float v = i + 1 < count ? height[i] + (height[i + 1] - height[i]) * f : height[i];
+                return (uint32_t)lroundf(v);
+            }
+            return (uint32_t)lroundf(height[2 * quantile + 2]);
+        }
+
+        uint32_t getCount() const { return count; }
+
+    private:
+        uint32_t count;
+        float height[MARKERS];
+        float position[MARKERS];
+
+        // Target rank of each marker as a fraction of the count
+        static float desired(size_t i) {
+            static const float fractions[MARKERS] = { 0.0f, 0.05f, 0.1f, 0.3f, 0.5f, 0.7f, 0.9f, 0.95f, 1.0f };
+            return fractions[i];
+        }
+
+        float parabolic(size_t i, int s) const {
+            float left = position[i] - position[i - 1];
+            float right = position[i + 1] - position[i];
+            return height[i] + s / (position[i + 1] - position[i - 1]) *
+                   ((left + s) * (height[i + 1] - height[i]) / right + (right - s) * (height[i] - height[i - 1]) / left);
+        }
+    };
+
+    // The N smallest values seen, ascending
+    template<size_t N>
+    class Best {
+    public:
+        Best() { reset(); }
+
+        void reset() { count = 0; }
+
+        void add(uint32_t value) {
+            if (count == N && value >= values[N - 1]) return;
+            size_t i = count < N ? count++ : N - 1;
+            while (i > 0 && values[i - 1] > value) {
+                values[i] = values[i - 1];
+                i--;
+            }
+            values[i] = value;
+        }
+
+        // Mean of the best n, 0 until there are n values
+        uint32_t average(size_t n) const {
+            if (n == 0 || n > count) return 0;
+            uint64_t sum = 0;
+            for (size_t i = 0; i < n; i++) sum += values[i];
+            return (uint32_t)((sum + n / 2) / n);
+        }
+
+        uint32_t getBest() const { return count ? values[0] : 0; }
+
+    private:
+        uint32_t values[N];
+        size_t count;
+    };
+
+}
+
+// What the panels and the session index keep of one series
+struct SeriesSummary {
+    uint16_t count;            // All times
+    uint16_t cleanCount;       // Times within CLEAN_LIMIT of the best so far
+    uint32_t best;             // ms, 0 if none
+    uint32_t mean;             // Of all times
+    uint32_t stddev;           // Of clean times
+    uint32_t p10, p50, p90;    // Of all times
+    uint32_t bestAverage3;     // Mean of the best three, 0 until there are three
+    uint32_t bestAverage5;
+    uint16_t consistency;      // 0.01 %: 100 % minus the clean coefficient of variation
+};
+
+/**
+ * Rolling statistics of one series of times (laps, or one sector).
+ *
+ * Out-laps, traffic and spins make a few times much slower than the rest,
+ * so spread and consistency are taken over "clean" times only. A time is
+ * clean if it is within CLEAN_LIMIT of the best time seen up to then. The
+ * rule is decided when the time arrives, since a stream cannot revisit it.
+ */
+class SeriesStats {
+public:
+    static constexpr float CLEAN_LIMIT = 1.07f;
+
+    SeriesStats() { reset(); }
+
+    void reset() {
+        all.reset();
+        clean.reset();
+        quantiles.reset();
+        best.reset();
+    }
+
+    void add(uint32_t time) {
+        if (time == 0) return;
+        uint32_t fastest = best.getBest();
+        all.add(time);
+        quantiles.add(time);
+        best.add(time);
+        if (fastest == 0 || time <= fastest * CLEAN_LIMIT) {
+            clean.add(time);
+        }
+    }
+
+    SeriesSummary summary() const {
+        SeriesSummary s;
+        s.count = (uint16_t)(all.getCount() < 0xFFFF ? all.getCount() : 0xFFFF);
+        s.cleanCount = (uint16_t)(clean.getCount() < 0xFFFF ? clean.getCount() : 0xFFFF);
+        s.best = best.getBest();
+        s.mean = (uint32_t)lround(all.getMean());
+        s.stddev = (uint32_t)lround(clean.getStddev());
+        s.p10 = quantiles.get(0);
+        s.p50 = quantiles.get(1);
+        s.p90 = quantiles.get(2);
+        s.bestAverage3 = best.average(3);
+        s.bestAverage5 = best.average(5);
+        double variation = clean.getMean() > 0 ? clean.getStddev() / clean.getMean() : 0.0;
+        s.consistency = clean.getCount() > 1 ? (uint16_t)lround(10000.0 * (variation < 1.0 ? 1.0 - variation : 0.0)) : 0;
+        return s;
+    }
+
+    const stats::Running& getAll() const { return all; }
+    const stats::Running& getClean() const { return clean; }
+
+private:
+    stats::Running all;
+    stats::Running clean;
+    stats::Quantiles quantiles;
+    stats::Best<5> best;
+};
+
+// Lap and sector statistics of one session
+class SessionStats {
+public:
+    void reset() {
+        laps.reset();
+        for (uint8_t s = 0; s < 3; s++) {
+            sectors[s].reset();
+        }
+    }
+
+    void addLap(uint32_t time) { laps.add(time); }
+    void addSector(uint8_t sector, uint32_t time) {
+        if (sector < 3) sectors[sector].add(time);
+    }
+
+    const SeriesStats& getLaps() const { return laps; }
+    const SeriesStats& getSector(uint8_t sector) const { return sectors[sector]; }
+
+private:
+    SeriesStats laps;
+    SeriesStats sectors[3];
+};
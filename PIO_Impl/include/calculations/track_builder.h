@@ -0,0 +1,351 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <cmath>
+#include <vector>
+#include "track/track_types.h"
+#include "track_geometry.h"
+
+// Simplified circuit shape for drawing, in metres from the start/finish gate
+struct TrackOutline {
+    static const size_t MAX_POINTS = 128;
+
+    GpsPoint origin;
+    uint16_t count;
+    int16_t x[MAX_POINTS];     // East
+    int16_t y[MAX_POINTS];     // North
+};
+
+// What TrackBuilder suggests for a TrackConfig
+struct TrackProposal {
+    GpsPoint startFinish;
+    GpsPoint sector2Start;
+    GpsPoint sector3Start;
+    float length;              // m around the loop
+    TrackOutline outline;
+};
+
+/**
+ * Builds a track from one recorded drive, typically an out-lap.
+ *
+ * add() takes every fix and keeps the mean of the fixes over each
+ * MIN_SPACING metres, which keeps position noise from inflating the path
+ * length. The buffers are sized once at construction, 16 bytes a point. A
+ * uniform grid over the kept points finds where the path comes back,
+ * heading the same way, at least MIN_LOOP metres later. The builder drives
+ * on for CLOSE_WINDOW metres and closes the loop at the closest pair seen,
+ * so a pit exit converging on the track is left out. Each point costs a
+ * lookup of the few points in nine grid cells.
+ *
+ * build() then places the gates. Start/finish goes on the longest
+ * straight. The sector gates go either at a third and two thirds of the
+ * lap, or on the straightest point near those marks. Every gate keeps
+ * clear of other parts of the track, shrinking its radius if it must. The
+ * outline is the loop simplified by Douglas-Peucker. All steps are linear
+ * in the loop length except the simplification, which is bounded by the
+ * point count.
+ */
+class TrackBuilder {
+public:
+    enum class Status : uint8_t { Recording, Closed, Full };
+    enum class SectorMode : uint8_t { Even, Straights };
+
+    static constexpr float MIN_SPACING = 10.0f;       // m between kept points
+    static constexpr float MIN_LOOP = 400.0f;         // m of path before the loop may close
+    static constexpr float CLOSE_RADIUS = 12.0f;      // m from the earlier path
+    static constexpr float CLOSE_WINDOW = 150.0f;     // m driven looking for the closest pair
+    static constexpr float CELL = 25.0f;              // m, grid cell edge
+    static constexpr float STRAIGHT = 1.0f / 500.0f;  // Curvature (1/m) below which a point is straight
+    static constexpr float GATE_RADIUS = 15.0f;       // m
+    static constexpr float MIN_GATE_RADIUS = 6.0f;
+    static constexpr float OUTLINE_TOLERANCE = 1.5f;  // m, doubled until the outline fits
+    static const size_t HASH_SIZE = 1024;              // Power of two
+
+    explicit TrackBuilder(size_t capacity = 2048) : capacity(capacity) {
+        xs.reserve(capacity);
+        ys.reserve(capacity);
+        distance.reserve(capacity);
+        next.reserve(capacity);
+        reset();
+    }
+
+    void reset() {
+        xs.clear();
+        ys.clear();
+        distance.clear();
+        next.clear();
+        for (size_t i = 0; i < HASH_SIZE; i++) head[i] = -1;
+        status = Status::Recording;
+        loopStart = loopEnd = 0;
+        closing = false;
+        closestSq = 0;
+        sumX = sumY = 0;
+        sumCount = 0;
+    }
+
+    Status add(double latitude, double longitude) {
+        if (status != Status::Recording) {
+            return status;
+        }
+        if (xs.empty() && sumCount == 0) {
+            frame = geometry::LocalFrame(latitude, longitude);
+        }
+        float x = frame.x(longitude);
+        float y = frame.y(latitude);
+        sumX += x;
+        sumY += y;
+        sumCount++;
+        size_t n = xs.size();
+        if (n > 0 && hypotf(x - xs[n - 1], y - ys[n - 1]) < MIN_SPACING) {
+            return status;
+        }
+        if (n == capacity) {
+            status = closing ? Status::Closed : Status::Full;
+            return status;
+        }
+
+        x = sumX / sumCount;
+        y = sumY / sumCount;
+        sumX = sumY = 0;
+        sumCount = 0;
+        float d = n > 0 ? distance[n - 1] + hypotf(x - xs[n - 1], y - ys[n - 1]) : 0;
+        xs.push_back(x);
+        ys.push_back(y);
+        distance.push_back(d);
+        size_t bucket = cellOf(x, y);
+        next.push_back(head[bucket]);
+        head[bucket] = (int32_t)n;
+
+        if (n >= 2 && d >= MIN_LOOP) {
+            float sq;
+            int earlier = findClosure(n, &sq);
+            if (earlier >= 0 && (!closing || sq < closestSq)) {
+                if (!closing) closeFrom = d;
+                closing = true;
+                closestSq = sq;
+                loopStart = (size_t)earlier;
+                loopEnd = n;
+            }
+        }
+        if (closing && d - closeFrom >= CLOSE_WINDOW) {
+            status = Status::Closed;
+        }
+        return status;
+    }
+
+    Status getStatus() const { return status; }
+    float getPathLength() const { return distance.empty() ? 0 : distance.back(); }
+    size_t getPointCount() const { return xs.size(); }
+
+    // False until the loop has closed
+    bool build(SectorMode mode, TrackProposal* out) const {
+        if (status != Status::Closed) {
+            return false;
+        }
+        size_t n = loopEnd - loopStart;
+        float length = distance[loopEnd] - distance[loopStart] + hypotf(xs[loopEnd] - xs[loopStart], ys[loopEnd] - ys[loopStart]);
+
+        std::vector<float> curvature(n);
+        curvatures(curvature);
+
+        // Start/finish in the middle of the longest straight
+        size_t bestRun = 0, bestMiddle = 0, run = 0;
+        for (size_t k = 0; k < 2 * n; k++) {   // Twice round, for a straight across the seam
+            if (fabsf(curvature[k % n]) < STRAIGHT) {
+                run++;
+                if (run > bestRun && run <= n) {
+                    bestRun = run;
+                    bestMiddle = (k + n - run / 2) % n;
+                }
+            } else {
+                run = 0;
+            }
+        }
+        size_t start = bestMiddle;
+        if (bestRun == 0) {
+            // No straight at all: the least curved point
+            for (size_t k = 1; k < n; k++) {
+                if (fabsf(curvature[k]) < fabsf(curvature[start])) start = k;
+            }
+        }
+
+        size_t sector2, sector3;
+        if (mode == SectorMode::Straights) {
+            sector2 = straightestNear(start, length / 3, length / 10, curvature);
+            sector3 = straightestNear(start, 2 * length / 3, length / 10, curvature);
+        } else {
+            sector2 = pointAt(start, length / 3);
+            sector3 = pointAt(start, 2 * length / 3);
+        }
+
+        out->length = length;
+        out->startFinish = gate(start);
+        out->sector2Start = gate(sector2);
+        out->sector3Start = gate(sector3);
+        outline(start, out->outline);
+        out->outline.origin = out->startFinish;
+        return true;
+    }
+
+private:
+    size_t capacity;
+    geometry::LocalFrame frame;
+    std::vector<float> xs;
+    std::vector<float> ys;
+    std::vector<float> distance;    // Path length to each point
+    std::vector<int32_t> next;      // Next point in the same grid bucket
+    int32_t head[HASH_SIZE];
+    Status status;
+    size_t loopStart;
+    size_t loopEnd;                 // The closing point, not part of the loop
+    bool closing;                   // A match was found, looking for a closer one
+    float closeFrom;                // Path length at the first match
+    float closestSq;
+    float sumX, sumY;               // Fixes since the last kept point
+    uint32_t sumCount;
+
+    static size_t cellOf(float x, float y) {
+        return cellHash((int32_t)floorf(x / CELL), (int32_t)floorf(y / CELL));
+    }
+
+    static size_t cellHash(int32_t cx, int32_t cy) {
+        return ((uint32_t)cx * 73856093u ^ (uint32_t)cy * 19349663u) & (HASH_SIZE - 1);
+    }
+
+    // Nearest earlier point within CLOSE_RADIUS, MIN_LOOP back, same heading
+    int findClosure(size_t n, float* distanceSq) const {
+        float x = xs[n], y = ys[n];
+        float hx = x - xs[n - 2], hy = y - ys[n - 2];
+        int32_t cx = (int32_t)floorf(x / CELL), cy = (int32_t)floorf(y / CELL);
+        int best = -1;
+        float bestSq = CLOSE_RADIUS * CLOSE_RADIUS;
+        for (int32_t i = -1; i <= 1; i++) {
+            for (int32_t j = -1; j <= 1; j++) {
+                for (int32_t k = head[cellHash(cx + i, cy + j)]; k >= 0; k = next[k]) {
+                    if (k < 2 || distance[n] - distance[k] < MIN_LOOP) continue;
+                    float dx = xs[k] - x, dy = ys[k] - y;
+                    float sq = dx * dx + dy * dy;
+                    float ex = xs[k] - xs[k - 2], ey = ys[k] - ys[k - 2];
+                    if (sq < bestSq && hx * ex + hy * ey > 0.7f * hypotf(hx, hy) * hypotf(ex, ey)) {
+                        best = k;
+                        bestSq = sq;
+                    }
+                }
+            }
+        }
+        *distanceSq = bestSq;
+        return best;
+    }
+
+    size_t at(size_t k) const { return loopStart + k % (loopEnd - loopStart); }
+
+    // Path length from loop point a forward to b
+    float between(size_t a, size_t b) const {
+        float d = distance[at(b)] - distance[at(a)];
+        return d < 0 ? d + distance[loopEnd] - distance[loopStart] : d;
+    }
+
+    // Signed curvature from the turn between chords about 15 m either side
+    void curvatures(std::vector<float>& curvature) const {
+        size_t n = curvature.size();
+        size_t w = (size_t)(15.0f / MIN_SPACING) + 1;
+        for (size_t k = 0; k < n; k++) {
+            size_t p = at(k + n - w), c = at(k), q = at(k + w);
+            float h1 = atan2f(ys[c] - ys[p], xs[c] - xs[p]);
+            float h2 = atan2f(ys[q] - ys[c], xs[q] - xs[c]);
+            float span = between(k + n - w, k + w);
+            curvature[k] = span > 0 ? remainderf(h2 - h1, 2 * (float)M_PI) / (span / 2) : 0;
+        }
+    }
+
+    size_t pointAt(size_t from, float along) const {
+        size_t n = loopEnd - loopStart;
+        size_t k = from;
+        while (between(from, k) < along && k < from + n - 1) k++;
+        return k % n;
+    }
+
+    size_t straightestNear(size_t from, float along, float window, const std::vector<float>& curvature) const {
+        size_t n = curvature.size();
+        size_t k = pointAt(from, along - window);
+        size_t best = pointAt(from, along);
+        for (; between(from, k) <= along + window && k < from + n; k++) {
+            if (fabsf(curvature[k % n]) < fabsf(curvature[best])) best = k % n;
+        }
+        return best;
+    }
+
+    // Gate at a loop point, radius kept clear of other parts of the track
+    GpsPoint gate(size_t k) const {
+        size_t n = loopEnd - loopStart;
+        size_t p = at(k);
+        float clearance = 2 * GATE_RADIUS;
+        for (size_t i = 0; i < n; i++) {
+            if (between(k, i) < 3 * GATE_RADIUS || between(i, k) < 3 * GATE_RADIUS) continue;
+            float d = hypotf(xs[at(i)] - xs[p], ys[at(i)] - ys[p]);
+            if (d < clearance) clearance = d;
+        }
+        GpsPoint point;
+        point.latitude = frame.originLat + ys[p] / geometry::METERS_PER_DEGREE;
+        point.longitude = frame.originLon + xs[p] / frame.metersPerDegLon;
+        point.isSet = true;
+        float radius = clearance / 2;
+        point.radius = radius > GATE_RADIUS ? GATE_RADIUS : (radius < MIN_GATE_RADIUS ? MIN_GATE_RADIUS : radius);
+        return point;
+    }
+
+    // Douglas-Peucker over the loop from the start point, iteratively
+    void outline(size_t start, TrackOutline& out) const {
+        size_t n = loopEnd - loopStart;
+        std::vector<uint8_t> keep(n + 1);
+        std::vector<uint32_t> stack;
+        stack.reserve(64);
+        float tolerance = OUTLINE_TOLERANCE;
+        size_t kept;
+        do {
+            std::fill(keep.begin(), keep.end(), 0);
+            keep[0] = keep[n] = 1;
+            stack.clear();
+            stack.push_back(0);
+            stack.push_back((uint32_t)n);
+            while (!stack.empty()) {
+                size_t last = stack.back(); stack.pop_back();
+                size_t first = stack.back(); stack.pop_back();
+                size_t a = at(start + first), b = at(start + last);
+                float sx = xs[b] - xs[a], sy = ys[b] - ys[a];
+                float length = hypotf(sx, sy);
+                float worst = 0;
+                size_t split = 0;
+                for (size_t k = first + 1; k < last; k++) {
+                    size_t c = at(start + k);
+                    float d = length > 1e-3f ? fabsf((xs[c] - xs[a]) * sy - (ys[c] - ys[a]) * sx) / length
+                                             : hypotf(xs[c] - xs[a], ys[c] - ys[a]);
+                    if (d > worst) {
+                        worst = d;
+                        split = k;
+                    }
+                }
+                if (worst > tolerance) {
+                    keep[split] = 1;
+                    stack.push_back((uint32_t)first);
+                    stack.push_back((uint32_t)split);
+                    stack.push_back((uint32_t)split);
+                    stack.push_back((uint32_t)last);
+                }
+            }
+            kept = 0;
+            for (size_t k = 0; k < n; k++) kept += keep[k];   // The end is the start again
+            tolerance *= 2;
+        } while (kept > TrackOutline::MAX_POINTS);
+
+        size_t origin = at(start);
+        out.count = 0;
+        for (size_t k = 0; k < n; k++) {
+            if (!keep[k]) continue;
+            size_t c = at(start + k);
+            out.x[out.count] = (int16_t)lroundf(xs[c] - xs[origin]);
+            out.y[out.count] = (int16_t)lroundf(ys[c] - ys[origin]);
+            out.count++;
+        }
+    }
+};
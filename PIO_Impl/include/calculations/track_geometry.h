@@ -0,0 +1,106 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <cmath>
+#include <vector>
+#include "reference_trace.h"
+
+/**
+ * Lap geometry shared by the in-car delta and the host session tools, so
+ * that both align laps the same way.
+ */
+namespace geometry {
+
+    static constexpr double METERS_PER_DEGREE = 111195.0;
+
+    // Equirectangular projection around a fixed origin, plenty accurate over a circuit
+    struct LocalFrame {
+        double originLat;
+        double originLon;
+        double metersPerDegLon;
+
+        LocalFrame() : originLat(0), originLon(0), metersPerDegLon(METERS_PER_DEGREE) {}
+
+        LocalFrame(double lat, double lon)
+            : originLat(lat)
+            , originLon(lon)
+            , metersPerDegLon(METERS_PER_DEGREE * cos(lat * M_PI / 180.0)) {}
+
+        float x(double longitude) const { return (float)((longitude - originLon) * metersPerDegLon); }
+        float y(double latitude) const { return (float)((latitude - originLat) * METERS_PER_DEGREE); }
+    };
+
+    // Cumulative distance along the lap per point (m)
+    inline void cumulativeDistances(const TracePoint* points, size_t count, std::vector<float>& distance) {
+        distance.resize(count);
+        if (count == 0) return;
+
+        double cosLat = cos(points[0].latitudeE7 / 1e7 * M_PI / 180.0);
+        double total = 0;
+        distance[0] = 0;
+        for (size_t i = 1; i < count; i++) {
+            double dx = (points[i].longitudeE7 - points[i - 1].longitudeE7) / 1e7 * cosLat;
+            double dy = (points[i].latitudeE7 - points[i - 1].latitudeE7) / 1e7;
+            total += sqrt(dx * dx + dy * dy) * METERS_PER_DEGREE;
+            distance[i] = (float)total;
+        }
+    }
+
+    // Projects a trace into the local frame as separate x and y arrays
+    inline void project(const LocalFrame& frame, const TracePoint* points, size_t count,
+                        std::vector<float>& xs, std::vector<float>& ys) {
+        xs.resize(count);
+        ys.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            xs[i] = frame.x(points[i].longitudeE7 / 1e7);
+            ys[i] = frame.y(points[i].latitudeE7 / 1e7);
+        }
+    }
+
+    /**
+     * Best projection of (x, y) onto the polyline segments [first, last).
+     * Returns the squared distance and sets the segment index and the
+     * distance along that segment. The first of equally close segments wins.
+     */
+    inline float projectOnto(const float* xs, const float* ys, float x, float y,
+                             size_t first, size_t last, size_t* segment, float* along) {
+        float bestSq = INFINITY;
+        for (size_t i = first; i < last; i++) {
+            float sx = xs[i + 1] - xs[i];
+            float sy = ys[i + 1] - ys[i];
+            float lengthSq = sx * sx + sy * sy;
+            float t = 0;
+            if (lengthSq > 1e-6f) {
+                t = ((x - xs[i]) * sx + (y - ys[i]) * sy) / lengthSq;
+                t = t < 0 ? 0 : (t > 1 ? 1 : t);
+            }
+            float dx = x - (xs[i] + t * sx);
+            float dy = y - (ys[i] + t * sy);
+            float distSq = dx * dx + dy * dy;
+            if (distSq < bestSq) {
+                bestSq = distSq;
+                *segment = i;
+                *along = t * sqrtf(lengthSq);
+            }
+        }
+        return bestSq;
+    }
+
+    // Lap time at the given distance, walking a cursor that is kept between calls
+    inline uint32_t timeAtDistance(const TracePoint* points, const float* distance, size_t count,
+                                   float target, size_t& cursor) {
+        size_t last = count - 1;
+        size_t i = cursor;
+        while (i < last - 1 && distance[i + 1] < target) i++;
+        while (i > 0 && distance[i] > target) i--;
+        cursor = i;
+
+        const TracePoint& a = points[i];
+        const TracePoint& b = points[i + 1];
+        float span = distance[i + 1] - distance[i];
+        float ratio = span > 0.01f ? (target - distance[i]) / span : 0;
+        ratio = ratio < 0 ? 0 : (ratio > 1 ? 1 : ratio);
+        return a.timestamp + (uint32_t)((b.timestamp - a.timestamp) * ratio);
+    }
+
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <Arduino.h>
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+#include "channels/channel_registry.h"
+#include "util/log.h"
+
+/**
+ * Analog sensors sampled by the ADC in continuous mode.
+ *
+ * The ADC steps through the inputs by itself and DMA collects the
+ * results, so sampling costs no CPU and the rate does not depend on the
+ * scheduler. A task drains the DMA buffer every few milliseconds,
+ * converts each result to millivolts with the factory calibration, scales
+ * it into the channel's unit and publishes it. Results carry no time, so
+ * each is stamped by its position in the block from the known conversion
+ * rate.
+ *
+ * Only ADC1 pins can be used: ADC2 is shared with the radio.
+ */
+class AdcSource {
+public:
+    static const size_t MAX_INPUTS = 8;
+
+    explicit AdcSource(ChannelRegistry& registry)
+        : registry(registry), count(0), periodUs(0), task(nullptr) {
+        memset(inputOf, 0xFF, sizeof(inputOf));
+    }
+
+    // Before begin(). value = millivolts * scale + offset.
+    bool addInput(uint8_t pin, uint8_t channel, float scale, float offset = 0.0f) {
+        int8_t adcChannel = digitalPinToAnalogChannel(pin);
+        if (count == MAX_INPUTS || adcChannel < 0 || adcChannel >= ADC1_CHANNEL_MAX || !registry.find(channel)) {
+            LOG_ERROR("Pin %u is not a free ADC1 input", pin);
+            return false;
+        }
+        Input& input = inputs[count];
+        input.adcChannel = (uint8_t)adcChannel;
+        input.channel = channel;
+        input.scale = scale;
+        input.offset = offset;
+        inputOf[adcChannel] = (uint8_t)count++;
+        return true;
+    }
+
+    // Every input is sampled at ratePerInputHz; its channel's decimation
+    // then sets what is stored
+    bool begin(uint32_t ratePerInputHz, BaseType_t core = 1) {
+        if (count == 0) {
+            return false;
+        }
+        uint32_t totalHz = ratePerInputHz * count;
+        if (totalHz < SOC_ADC_SAMPLE_FREQ_THRES_LOW) {
+            totalHz = SOC_ADC_SAMPLE_FREQ_THRES_LOW;
+        }
+        periodUs = 1000000.0f / totalHz;
+
+        adc_digi_init_config_t init = {};
+        init.max_store_buf_size = BLOCK_BYTES * 4;
+        init.conv_num_each_intr = BLOCK_BYTES;
+        adc_digi_pattern_config_t pattern[MAX_INPUTS] = {};
+        for (size_t i = 0; i < count; i++) {
+            init.adc1_chan_mask |= 1u << inputs[i].adcChannel;
+            pattern[i].atten = ADC_ATTEN_DB_11;
+            pattern[i].channel = inputs[i].adcChannel;
+            pattern[i].unit = 0;   // ADC1
+            pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+        }
+        adc_digi_configuration_t config = {};
+        config.pattern_num = count;
+        config.adc_pattern = pattern;
+        config.sample_freq_hz = totalHz;
+        config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+        config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+
+        if (adc_digi_initialize(&init) != ESP_OK || adc_digi_controller_configure(&config) != ESP_OK) {
+            LOG_ERROR("ADC continuous mode setup failed");
+            return false;
+        }
+        esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 1100, &calibration);
+        if (adc_digi_start() != ESP_OK) {
+            LOG_ERROR("ADC start failed");
+            return false;
+        }
+        return xTaskCreatePinnedToCore(taskEntry, "adc_rx", 3072, this, 2, &task, core) == pdPASS;
+    }
+
+private:
+    // Four bytes per result; 64 results is about 10 ms at a few kHz total
+    static const uint32_t BLOCK_BYTES = 256;
+
+    struct Input {
+        uint8_t adcChannel;
+        uint8_t channel;
+        float scale;
+        float offset;
+    };
+
+    ChannelRegistry& registry;
+    Input inputs[MAX_INPUTS];
+    uint8_t inputOf[ADC1_CHANNEL_MAX];   // ADC channel to input, 0xFF if unused
+    size_t count;
+    float periodUs;                      // Between two conversions, any input
+    esp_adc_cal_characteristics_t calibration;
+    TaskHandle_t task;
+
+    void drain() {
+        uint8_t block[BLOCK_BYTES];
+        uint32_t length = 0;
+        if (adc_digi_read_bytes(block, sizeof(block), &length, pdMS_TO_TICKS(100)) != ESP_OK) {
+            return;
+        }
+        uint32_t now = micros();
+        uint32_t results = length / SOC_ADC_DIGI_RESULT_BYTES;
+        for (uint32_t i = 0; i < results; i++) {
+            const adc_digi_output_data_t* result =
+                reinterpret_cast<const adc_digi_output_data_t*>(&block[i * SOC_ADC_DIGI_RESULT_BYTES]);
+            uint32_t adcChannel = result->type2.channel;
+            if (result->type2.unit != 0 || adcChannel >= ADC1_CHANNEL_MAX || inputOf[adcChannel] == 0xFF) {
+                continue;
+            }
+            const Input& input = inputs[inputOf[adcChannel]];
+            uint32_t millivolts = esp_adc_cal_raw_to_voltage(result->type2.data, &calibration);
+            uint32_t timeUs = now - (uint32_t)((results - 1 - i) * periodUs);
+            registry.publish(input.channel, timeUs, millivolts * input.scale + input.offset);
+        }
+    }
+
+    static void taskEntry(void* param) {
+        AdcSource* source = static_cast<AdcSource*>(param);
+        while (true) {
+            source->drain();
+        }
+    }
+};
@@ -0,0 +1,158 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "channels/channel_registry.h"
+
+struct CanFrame {
+    uint32_t id;
+    bool extended;
+    uint8_t length;
+    uint8_t data[8];
+};
+
+/**
+ * Where one value sits in a frame, as in a DBC file: start bit and length,
+ * byte order, signedness, then value = raw * scale + offset. For Intel
+ * (little endian) signals the start bit is the least significant bit; for
+ * Motorola (big endian) it is the most significant one, in the DBC's
+ * sawtooth bit numbering.
+ */
+struct CanSignal {
+    uint32_t frameId;
+    uint8_t startBit;
+    uint8_t length;       // 1 to 32 bits
+    bool bigEndian;
+    bool isSigned;
+    float scale;
+    float offset;
+    uint8_t channel;      // ChannelRegistry id
+};
+
+// What CanSource reads frames from: TWAI on the device, SocketCAN on the host
+class CanPort {
+public:
+    virtual ~CanPort() = default;
+    virtual bool receive(CanFrame* frame, uint32_t timeoutMs) = 0;
+};
+
+/**
+ * Turns frames into channel samples with a fixed signal table. Signals
+ * are kept sorted by frame id, so a frame costs a binary search plus its
+ * own signals. Frames nobody asked for are only counted.
+ */
+class CanDecoder {
+public:
+    static const size_t MAX_SIGNALS = 64;
+
+    CanDecoder() : count(0), unknownFrames(0) {}
+
+    bool add(const CanSignal& signal) {
+        if (count == MAX_SIGNALS || signal.length == 0 || signal.length > 32) {
+            return false;
+        }
+        size_t at = count;
+        while (at > 0 && signals[at - 1].frameId > signal.frameId) {
+            signals[at] = signals[at - 1];
+            at--;
+        }
+        signals[at] = signal;
+        count++;
+        return true;
+    }
+
+    // Publishes every signal of the frame; returns how many
+    size_t decode(const CanFrame& frame, uint32_t timeUs, ChannelRegistry& registry) {
+        size_t lo = 0, hi = count;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (signals[mid].frameId < frame.id) lo = mid + 1;
+            else hi = mid;
+        }
+        size_t published = 0;
+        for (size_t i = lo; i < count && signals[i].frameId == frame.id; i++) {
+            const CanSignal& s = signals[i];
+            uint32_t raw;
+            if (!extract(frame, s.startBit, s.length, s.bigEndian, &raw)) {
+                continue;
+            }
+            float value;
+            if (s.isSigned && s.length < 32 && (raw >> (s.length - 1)) & 1) {
+                value = (float)(int32_t)(raw | (~0u << s.length));
+            } else {
+                value = s.isSigned ? (float)(int32_t)raw : (float)raw;
+            }
+            registry.publish(s.channel, timeUs, value * s.scale + s.offset);
+            published++;
+        }
+        if (published == 0) {
+            unknownFrames++;
+        }
+        return published;
+    }
+
+    // Raw bits of a signal; false if the frame is too short for it
+    static bool extract(const CanFrame& frame, uint8_t startBit, uint8_t length, bool bigEndian, uint32_t* raw) {
+        uint64_t mask = length == 32 ? 0xFFFFFFFFull : ((1ull << length) - 1);
+        uint64_t bits = 0;
+        if (!bigEndian) {
+            if (startBit + length > frame.length * 8) {
+                return false;
+            }
+            for (int i = frame.length; i-- > 0;) {
+                bits = bits << 8 | frame.data[i];
+            }
+            *raw = (uint32_t)((bits >> startBit) & mask);
+            return true;
+        }
+        // Sawtooth to sequential numbering, bit 0 the MSB of byte 0
+        uint32_t msb = (startBit / 8) * 8 + (7 - startBit % 8);
+        if (msb + length > frame.length * 8u) {
+            return false;
+        }
+        for (int i = 0; i < 8; i++) {
+            bits = bits << 8 | (i < frame.length ? frame.data[i] : 0);
+        }
+        *raw = (uint32_t)((bits >> (64 - msb - length)) & mask);
+        return true;
+    }
+
+    size_t size() const { return count; }
+    uint32_t getUnknownFrames() const { return unknownFrames; }
+
+private:
+    CanSignal signals[MAX_SIGNALS];
+    size_t count;
+    uint32_t unknownFrames;
+};
+
+/**
+ * Receive loop shared by the firmware task and the host tools: one frame
+ * per poll(), decoded into the registry with the clock's timestamp. The
+ * poll()ing task is the only publisher of the CAN channels.
+ */
+class CanSource {
+public:
+    CanSource(CanPort& port, CanDecoder& decoder, ChannelRegistry& registry, uint32_t (*clock)())
+        : port(port), decoder(decoder), registry(registry), clock(clock), frames(0) {}
+
+    // Waits up to timeoutMs for a frame; false on timeout
+    bool poll(uint32_t timeoutMs) {
+        CanFrame frame;
+        if (!port.receive(&frame, timeoutMs)) {
+            return false;
+        }
+        frames++;
+        decoder.decode(frame, clock(), registry);
+        return true;
+    }
+
+    uint32_t getFrames() const { return frames; }
+    const CanDecoder& getDecoder() const { return decoder; }
+
+private:
+    CanPort& port;
+    CanDecoder& decoder;
+    ChannelRegistry& registry;
+    uint32_t (*clock)();
+    uint32_t frames;
+};
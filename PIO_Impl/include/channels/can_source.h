@@ -0,0 +1,80 @@
+#pragma once
+#include <Arduino.h>
+#include <driver/twai.h>
+#include "channels/can_decoder.h"
+#include "util/log.h"
+
+// CAN transceiver on the TWAI controller
+#define CAN_TX_PIN 12
+#define CAN_RX_PIN 13
+
+// The on-chip TWAI controller as a CanPort
+class TwaiPort : public CanPort {
+public:
+    // Listen-only by default: the logger never acknowledges or transmits
+    // on a car's bus
+    bool begin(uint32_t bitrate, bool listenOnly = true) {
+        twai_general_config_t general = TWAI_GENERAL_CONFIG_DEFAULT((gpio_num_t)CAN_TX_PIN, (gpio_num_t)CAN_RX_PIN,
+                                                                    listenOnly ? TWAI_MODE_LISTEN_ONLY : TWAI_MODE_NORMAL);
+        general.rx_queue_len = 64;   // About 6 ms of a fully loaded 1 Mbit/s bus
+        twai_timing_config_t timing;
+        switch (bitrate) {
+            case 250000:  timing = TWAI_TIMING_CONFIG_250KBITS(); break;
+            case 500000:  timing = TWAI_TIMING_CONFIG_500KBITS(); break;
+            case 1000000: timing = TWAI_TIMING_CONFIG_1MBITS(); break;
+            default:
+                LOG_ERROR("Unsupported CAN bitrate %u", (unsigned int)bitrate);
+                return false;
+        }
+        twai_filter_config_t filter = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+        if (twai_driver_install(&general, &timing, &filter) != ESP_OK || twai_start() != ESP_OK) {
+            LOG_ERROR("TWAI start failed");
+            return false;
+        }
+        return true;
+    }
+
+    bool receive(CanFrame* frame, uint32_t timeoutMs) override {
+        twai_message_t message;
+        if (twai_receive(&message, pdMS_TO_TICKS(timeoutMs)) != ESP_OK || message.rtr) {
+            return false;
+        }
+        frame->id = message.identifier;
+        frame->extended = message.extd;
+        frame->length = message.data_length_code > 8 ? 8 : message.data_length_code;
+        memcpy(frame->data, message.data, frame->length);
+        return true;
+    }
+};
+
+/**
+ * Decodes the CAN bus into the channel registry on its own task, so a
+ * burst of frames never waits on the main loop. The task is the only
+ * publisher of the channels in the decoder's signal table.
+ */
+class CanTask {
+public:
+    CanTask(CanDecoder& decoder, ChannelRegistry& registry)
+        : source(port, decoder, registry, micros), task(nullptr) {}
+
+    bool begin(uint32_t bitrate = 500000, BaseType_t core = 1) {
+        if (!port.begin(bitrate)) {
+            return false;
+        }
+        return xTaskCreatePinnedToCore(taskEntry, "can_rx", 3072, this, 2, &task, core) == pdPASS;
+    }
+
+    const CanSource& getSource() const { return source; }
+
+private:
+    TwaiPort port;
+    CanSource source;
+    TaskHandle_t task;
+
+    static void taskEntry(void* param) {
+        CanTask* can = static_cast<CanTask*>(param);
+        while (true) {
+            can->source.poll(100);
+        }
+    }
+};
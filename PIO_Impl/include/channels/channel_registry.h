@@ -0,0 +1,260 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+
+// One stored value of a channel
+struct ChannelSample {
+    uint32_t timeUs;   // micros() of the newest raw sample it includes
+    float value;       // In the channel's unit
+};
+
+// How raw samples combine when a channel is decimated
+enum class ChannelType : uint8_t {
+    Analog,     // Mean of the raw samples: pressures, temperatures, RPM
+    Discrete    // Newest raw sample: gear, switches, states
+};
+
+struct ChannelDef {
+    uint8_t id;             // Stable across builds; logs and telemetry carry it
+    char name[12];
+    char unit[8];
+    ChannelType type;
+    uint16_t rateHz;        // Raw rate the source delivers
+    uint8_t decimation;     // Raw samples per stored sample, 1 to keep all
+    float resolution;       // Smallest step worth logging, in unit
+};
+
+/**
+ * One channel's history: a ring written by exactly one source and read by
+ * any number of subscribers, each with its own cursor. The writer never
+ * waits. A reader that falls a whole ring behind loses the oldest samples
+ * and is told how many.
+ */
+class ChannelRing {
+public:
+    ChannelRing() : slots(nullptr), mask(0), written(0) {}
+
+    // capacity is a power of two
+    void init(ChannelSample* storage, uint32_t capacity) {
+        slots = storage;
+        mask = capacity - 1;
+        written.store(0, std::memory_order_relaxed);
+    }
+
+    void push(const ChannelSample& sample) {
+        uint32_t w = written.load(std::memory_order_relaxed);
+        slots[w & mask] = sample;
+        written.store(w + 1, std::memory_order_release);
+    }
+
+    uint32_t getWritten() const { return written.load(std::memory_order_acquire); }
+    uint32_t getCapacity() const { return mask + 1; }
+
+    /**
+     * Copies up to max samples from position cursor on. Samples the writer
+     * may have overwritten during the copy are discarded afterwards, so
+     * out never holds a torn value. Advances cursor and adds to lost.
+     */
+    size_t read(uint32_t& cursor, ChannelSample* out, size_t max, uint32_t& lost) const {
+        uint32_t w = getWritten();
+        uint32_t capacity = mask + 1;
+        if (w - cursor > capacity) {
+            lost += w - cursor - capacity;
+            cursor = w - capacity;
+        }
+        size_t n = w - cursor < max ? w - cursor : max;
+        for (size_t i = 0; i < n; i++) {
+            out[i] = slots[(cursor + i) & mask];
+        }
+        // A sample being stored right now already overwrites its slot, so
+        // count it as written
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint32_t after = written.load(std::memory_order_relaxed) + 1;
+        size_t torn = 0;
+        if (after - cursor > capacity) {
+            torn = after - capacity - cursor;
+            if (torn > n) torn = n;
+            memmove(out, out + torn, (n - torn) * sizeof(ChannelSample));
+            lost += torn;
+        }
+        cursor += n;
+        return n - torn;
+    }
+
+    bool latest(ChannelSample* out) const {
+        for (int attempt = 0; attempt < 3; attempt++) {
+            uint32_t w = getWritten();
+            if (w == 0) {
+                return false;
+            }
+            *out = slots[(w - 1) & mask];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (written.load(std::memory_order_relaxed) - (w - 1) < mask + 1) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    ChannelSample* slots;
+    uint32_t mask;
+    std::atomic<uint32_t> written;   // Samples pushed so far
+};
+
+// A subscriber's position in one channel
+class ChannelReader {
+public:
+    ChannelReader() : ring(nullptr), cursor(0), lost(0), id(0) {}
+    ChannelReader(const ChannelRing* ring, uint8_t id) : ring(ring), cursor(ring->getWritten()), lost(0), id(id) {}
+
+    bool isValid() const { return ring != nullptr; }
+    uint8_t getId() const { return id; }
+
+    // Samples since the last read, oldest first
+    size_t read(ChannelSample* out, size_t max) {
+        return ring ? ring->read(cursor, out, max, lost) : 0;
+    }
+
+    size_t available() const { return ring ? ring->getWritten() - cursor : 0; }
+
+    // Drops all but the newest keep samples; they do not count as lost
+    void skip(size_t keep) {
+        if (ring && ring->getWritten() - cursor > keep) {
+            cursor = ring->getWritten() - keep;
+        }
+    }
+    uint32_t getLost() const { return lost; }
+
+private:
+    const ChannelRing* ring;
+    uint32_t cursor;
+    uint32_t lost;
+    uint8_t id;
+};
+
+/**
+ * Every measured quantity beyond the fixed GNSS and IMU structs: engine
+ * data from the CAN bus, analog sensors, anything a later source adds.
+ *
+ * Channels are added at boot with their definition, and each gets a ring
+ * sized for HISTORY_MS of stored samples. Sources then publish() raw
+ * samples by id. The channel decimates them by its type and pushes them to
+ * its ring. Consumers never see the sources: a logger or telemetry
+ * subscribe()s to an id and drains it, a panel asks for the latest()
+ * value. Each channel must have a single publishing task; readers may be
+ * on any task.
+ *
+ * publish() is an id lookup and a ring write, a few thousand a second is
+ * nothing. add() allocates, so channels are not added once sources run.
+ */
+class ChannelRegistry {
+public:
+    static const size_t MAX_CHANNELS = 32;
+    static const uint32_t HISTORY_MS = 500;
+    static const uint32_t MIN_RING = 16;
+    static const uint32_t MAX_RING = 1024;
+    static const uint8_t NONE = 0xFF;
+
+    ChannelRegistry() : count(0) {
+        memset(slotOf, NONE, sizeof(slotOf));
+    }
+
+    ~ChannelRegistry() {
+        for (size_t i = 0; i < count; i++) {
+            delete[] channels[i].storage;
+        }
+    }
+
+    ChannelRegistry(const ChannelRegistry&) = delete;
+    ChannelRegistry& operator=(const ChannelRegistry&) = delete;
+
+    // Fails on a duplicate id, a full registry or no memory
+    bool add(const ChannelDef& def) {
+        if (count == MAX_CHANNELS || slotOf[def.id] != NONE || def.rateHz == 0) {
+            return false;
+        }
+        uint32_t decimation = def.decimation ? def.decimation : 1;
+        uint32_t wanted = (uint32_t)def.rateHz * HISTORY_MS / 1000 / decimation;
+        uint32_t capacity = MIN_RING;
+        while (capacity < wanted && capacity < MAX_RING) capacity <<= 1;
+
+        Channel& channel = channels[count];
+        channel.storage = new (std::nothrow) ChannelSample[capacity];
+        if (!channel.storage) {
+            return false;
+        }
+        channel.def = def;
+        channel.def.decimation = (uint8_t)decimation;
+        channel.def.name[sizeof(channel.def.name) - 1] = '\0';
+        channel.def.unit[sizeof(channel.def.unit) - 1] = '\0';
+        channel.ring.init(channel.storage, capacity);
+        channel.sum = 0;
+        channel.pending = 0;
+        channel.published = 0;
+        slotOf[def.id] = (uint8_t)count++;
+        return true;
+    }
+
+    size_t size() const { return count; }
+    const ChannelDef& getDef(size_t index) const { return channels[index].def; }
+
+    const ChannelDef* find(uint8_t id) const {
+        return slotOf[id] == NONE ? nullptr : &channels[slotOf[id]].def;
+    }
+
+    // Source side: one raw sample. False for an unknown id.
+    bool publish(uint8_t id, uint32_t timeUs, float value) {
+        uint8_t slot = slotOf[id];
+        if (slot == NONE) {
+            return false;
+        }
+        Channel& channel = channels[slot];
+        channel.published++;
+        channel.sum += value;
+        if (++channel.pending < channel.def.decimation) {
+            return true;
+        }
+        ChannelSample sample;
+        sample.timeUs = timeUs;
+        sample.value = channel.def.type == ChannelType::Analog ? channel.sum / channel.pending : value;
+        channel.ring.push(sample);
+        channel.sum = 0;
+        channel.pending = 0;
+        return true;
+    }
+
+    // Consumer side: a reader that starts with the next stored sample
+    ChannelReader subscribe(uint8_t id) const {
+        uint8_t slot = slotOf[id];
+        return slot == NONE ? ChannelReader() : ChannelReader(&channels[slot].ring, id);
+    }
+
+    bool latest(uint8_t id, ChannelSample* out) const {
+        uint8_t slot = slotOf[id];
+        return slot != NONE && channels[slot].ring.latest(out);
+    }
+
+    // Raw samples published, before decimation; source side counter
+    uint32_t getPublished(uint8_t id) const {
+        uint8_t slot = slotOf[id];
+        return slot == NONE ? 0 : channels[slot].published;
+    }
+
+private:
+    struct Channel {
+        ChannelDef def;
+        ChannelRing ring;
+        ChannelSample* storage;
+        float sum;          // Raw values since the last stored sample
+        uint8_t pending;
+        uint32_t published;
+    };
+
+    Channel channels[MAX_CHANNELS];
+    size_t count;
+    uint8_t slotOf[256];    // Channel id to index, NONE if unused
+};
@@ -15,7 +15,41 @@ public:
     uint16_t getWidth() override;
     uint16_t getHeight() override;
 
+    // Racing widget drawing, inclusive corners. Each call is a command on
+    // the serial link, drawn by the module as it arrives.
+    void fillRect(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+        display.gfx_RectangleFilled(x0, y0, x1, y1, color);
+    }
+
+    void line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+        display.gfx_Line(x0, y0, x1, y1, color);
+    }
+
+    void circle(int16_t x, int16_t y, int16_t radius, uint16_t color) {
+        display.gfx_Circle(x, y, radius, color);
+    }
+
+    void fillCircle(int16_t x, int16_t y, int16_t radius, uint16_t color) {
+        display.gfx_CircleFilled(x, y, radius, color);
+    }
+
+    // Module font times scale, left top at x, y
+    void text(int16_t x, int16_t y, uint8_t scale, uint16_t color, const char* str) {
+        display.txt_Width(scale);
+        display.txt_Height(scale);
+        display.txt_FGcolour(color);
+        display.gfx_MoveTo(x, y);
+        display.putStr(str);
+    }
+
+    // The module itself, e.g. for Diablo16LayoutCache
+    Diablo_Serial_4DLib* getModule() { return &display; }
+
 private:
+    static const uint32_t RESET_PULSE_US = 100;
+    static const int READY_POLL_MS = 50;          // Reply timeout per attempt
+    static const uint32_t READY_TIMEOUT_MS = 5000;
+
     Diablo_Serial_4DLib display;
     HardwareSerial* serial;
     uint8_t resetPin;
@@ -24,5 +58,6 @@ private:
     uint16_t backgroundColor;
 
     void hardwareReset();
+    bool waitReady();
     void updateScreenDimensions();
 };
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Diablo_Serial_4DLib.h>
+#include "display/layout_cache.h"
+
+/**
+ * Layout cache on the Diablo16's own uSD card.
+ *
+ * capture() writes the screen to LAYOUTn.GCI with file_ScreenCapture, and
+ * the file stays open for reading. restore() is a seek and one file_Image
+ * call, so the pixels go from the card to the screen inside the display
+ * and never cross the serial link. Without a card begin() fails, and
+ * callers draw their layouts instead.
+ */
+class Diablo16LayoutCache : public LayoutCache {
+public:
+    static const uint8_t MAX_SLOTS = 4;
+
+    explicit Diablo16LayoutCache(Diablo_Serial_4DLib* display);
+    ~Diablo16LayoutCache() override;
+
+    // Mounts the card and reads the screen size
+    bool begin();
+
+    bool capture(uint8_t slot) override;
+    bool restore(uint8_t slot) override;
+
+private:
+    static const uint16_t NO_HANDLE = 0;
+
+    Diablo_Serial_4DLib* display;
+    bool mounted;
+    uint16_t width;
+    uint16_t height;
+    uint16_t handles[MAX_SLOTS];   // Open for reading once captured
+
+    static void fileName(uint8_t slot, char* name);
+    void close(uint8_t slot);
+};
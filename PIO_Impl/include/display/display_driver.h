@@ -1,6 +1,15 @@
 #pragma once
 #include <cstdint>
 
+/**
+ * A display as the panels see it.
+ *
+ * Drivers used by the racing widgets also draw with the same set of
+ * non-virtual calls, so a widget templated on the driver type compiles to
+ * direct calls into it: fillRect(), line(), circle(), fillCircle() and
+ * text(). Corners are inclusive and colours RGB565 for a dark screen;
+ * each driver maps them to what its panel can show.
+ */
 class IDisplay {
 public:
     virtual ~IDisplay() = default;
@@ -11,6 +20,10 @@ public:
     // Basic drawing operations
     virtual void clear() = 0;
     virtual void setBackgroundColor(uint16_t color) = 0;
+
+    // End of a frame: puts what was drawn since the last flush on the
+    // panel. Nothing to do where drawing goes straight to the screen.
+    virtual void flush() {}
     
     // Screen properties
     virtual uint16_t getWidth() = 0;
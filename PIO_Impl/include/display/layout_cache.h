@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * Whole-screen snapshots of panel layouts, kept where the display can put
+ * them back in one operation. Slots are small indices chosen by the
+ * caller. Both calls may take a while and belong on the render side.
+ */
+class LayoutCache {
+public:
+    virtual ~LayoutCache() = default;
+
+    // Stores what is on screen now
+    virtual bool capture(uint8_t slot) = 0;
+
+    // Puts a captured screen back; false if the slot was never captured
+    virtual bool restore(uint8_t slot) = 0;
+};
@@ -5,42 +5,119 @@
 #include <Adafruit_SharpMem.h>
 #include "display/display_driver.h"
 
+// The library's framebuffer, which it keeps to itself
+class SharpFramebuffer : public Adafruit_SharpMem {
+public:
+    using Adafruit_SharpMem::Adafruit_SharpMem;
+
+    // Allocated by begin(), one bit per pixel
+    uint8_t* getBuffer() { return sharpmem_buffer; }
+};
+
+/**
+ * Sharp memory LCD, drawn into the library's framebuffer.
+ *
+ * Drawing calls only change the framebuffer; flush() sends it to the
+ * panel once per frame, so a frame of many small updates costs one
+ * transfer. The panel is reflective and one bit deep: colours meant for a
+ * dark screen become ink if any channel is over half (white, red, green,
+ * blue), paper if not (black and the dark grays used for backgrounds).
+ */
 class SharpDisplay : public IDisplay {
 public:
-    SharpDisplay(uint8_t ssPin, uint8_t sckPin, uint8_t mosiPin, uint16_t width = 400, uint16_t height = 240) 
-        : display(ssPin, width, height) {
-        SPI.begin(sckPin, -1, mosiPin, ssPin);  // SCK, MISO, MOSI, SS
-    }
+    SharpDisplay(uint8_t sckPin, uint8_t mosiPin, uint8_t ssPin, uint16_t width = 400, uint16_t height = 240)
+        : display(sckPin, mosiPin, ssPin, width, height)
+        , width(width)
+        , height(height)
+        , dirty(false)
+    {}
 
     bool init() override {
-        display.begin();
+        if (!display.begin()) {
+            return false;
+        }
+        display.setTextWrap(false);
         display.clearDisplay();
         return true;
     }
 
+    // Blanks the panel at once, framebuffer included
     void clear() override {
         display.clearDisplay();
-        display.refresh();
+        dirty = false;
     }
 
     void setBackgroundColor(uint16_t color) override {
-        display.fillScreen(color ? BLACK : WHITE);
-        display.refresh();
+        display.fillScreen(ink(color));
+        dirty = true;
+    }
+
+    void flush() override {
+        if (dirty) {
+            display.refresh();
+            dirty = false;
+        }
+    }
+
+    uint16_t getWidth() override { return width; }
+    uint16_t getHeight() override { return height; }
+
+    // Racing widget drawing, inclusive corners
+    void fillRect(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+        display.fillRect(x0, y0, x1 - x0 + 1, y1 - y0 + 1, ink(color));
+        dirty = true;
+    }
+
+    void line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+        display.drawLine(x0, y0, x1, y1, ink(color));
+        dirty = true;
     }
 
-    uint16_t getWidth() override { return display_width; }
-    uint16_t getHeight() override { return display_height; }
+    void circle(int16_t x, int16_t y, int16_t radius, uint16_t color) {
+        display.drawCircle(x, y, radius, ink(color));
+        dirty = true;
+    }
+
+    void fillCircle(int16_t x, int16_t y, int16_t radius, uint16_t color) {
+        display.fillCircle(x, y, radius, ink(color));
+        dirty = true;
+    }
 
-    void drawText(int16_t x, int16_t y, const char* text, uint8_t size = 1, bool color = false) {
-        display.setTextSize(size);
-        display.setTextColor(color ? BLACK : WHITE);
+    // Built-in 6x8 font times scale, left top at x, y, no background
+    void text(int16_t x, int16_t y, uint8_t scale, uint16_t color, const char* str) {
+        display.setTextSize(scale);
+        display.setTextColor(ink(color));
         display.setCursor(x, y);
-        display.print(text);
-        display.refresh();
+        display.print(str);
+        dirty = true;
     }
 
+    // Direct access for screens the widgets do not cover
+    Adafruit_SharpMem& getGfx() {
+        dirty = true;
+        return display;
+    }
+
+    // The framebuffer itself, for whole-screen copies; null before init()
+    uint8_t* getFramebuffer() {
+        dirty = true;
+        return display.getBuffer();
+    }
+
+    size_t getFramebufferSize() const { return (size_t)width * height / 8; }
+
 private:
-    Adafruit_SharpMem display;
-    uint16_t display_width;
-    uint16_t display_height;
-};
\ No newline at end of file
+    // Pixel values in the framebuffer
+    static constexpr uint16_t INK = 0;
+    static constexpr uint16_t PAPER = 1;
+
+    SharpFramebuffer display;
+    uint16_t width;
+    uint16_t height;
+    bool dirty;                // Framebuffer differs from the panel
+
+    static uint16_t ink(uint16_t color) {
+        bool lit = (color >> 11) >= 16 || ((color >> 5) & 0x3F) >= 32 || (color & 0x1F) >= 16;
+        return lit ? INK : PAPER;
+    }
+};
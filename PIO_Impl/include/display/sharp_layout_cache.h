@@ -0,0 +1,33 @@
+#pragma once
+
+#include "display/sharp_driver.h"
+#include "display/layout_cache.h"
+
+/**
+ * Layout cache for the Sharp memory LCD, in PSRAM.
+ *
+ * The screen is only the driver's framebuffer until flush(), so capture()
+ * and restore() are each one copy of it: 12 KB at 400x240. A restore
+ * costs a memcpy instead of redrawing the layout, and the next flush()
+ * sends it with the panel's values. Without PSRAM begin() fails, and
+ * callers draw their layouts instead.
+ */
+class SharpLayoutCache : public LayoutCache {
+public:
+    static const uint8_t MAX_SLOTS = 4;
+
+    explicit SharpLayoutCache(SharpDisplay* display);
+    ~SharpLayoutCache() override;
+
+    // After the display's init(): sets aside a frame per slot
+    bool begin();
+
+    bool capture(uint8_t slot) override;
+    bool restore(uint8_t slot) override;
+
+private:
+    SharpDisplay* display;
+    uint8_t* frames;               // MAX_SLOTS framebuffers back to back
+    size_t frameSize;
+    bool captured[MAX_SLOTS];
+};
@@ -1 +1,26 @@
+#pragma once
 
+/**
+ * One full-screen page of the display.
+ *
+ * A panel's model (timing, sensors, settings) is fed on the compute side
+ * whether or not it is visible. The three calls here are render side only
+ * and come from PanelManager, which calls them only for the visible panel.
+ */
+class Panel {
+public:
+    virtual ~Panel() = default;
+
+    virtual const char* getName() const = 0;
+
+    // Everything that never changes: frames, scales, labels, placeholders.
+    // Drawn once on a cleared screen and then cached by the manager.
+    virtual void drawLayout() = 0;
+
+    // The layout was just put back: forget what is on screen, so the next
+    // render() draws every value
+    virtual void invalidate() = 0;
+
+    // Draws the values that changed since the last render()
+    virtual void render() = 0;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <Arduino.h>
+#include "panel.h"
+#include "display/display_driver.h"
+#include "display/layout_cache.h"
+#include "util/log.h"
+#include "util/profiler.h"
+
+/**
+ * Owns the screen and shows one panel at a time.
+ *
+ * begin() draws every panel's layout once and captures it in the layout
+ * cache. A switch is then a single restore() from the cache, followed by
+ * the new panel's values. Without a cache, or if a capture failed, the
+ * switch clears the screen and draws the layout instead. Every frame ends
+ * with the display's flush(). Each switch is logged with its time, which
+ * also goes to the profiler's panel_switch stage.
+ *
+ * show() may be called from any task. It only records the request; the
+ * switch itself happens at the start of the next render(), so the compute
+ * side never waits on the display. Panels that are not visible are not
+ * rendered, but their models keep running.
+ */
+class PanelManager {
+public:
+    static const uint8_t MAX_PANELS = 4;
+    static const uint8_t NONE = 0xFF;
+
+    PanelManager(IDisplay* display, LayoutCache* cache = nullptr)
+        : display(display)
+        , cache(cache)
+        , count(0)
+        , active(NONE)
+        , requested(0)
+        , lastSwitchUs(0)
+        , renderTask(nullptr)
+        , renderPeriodMs(33)
+    {
+        for (uint8_t i = 0; i < MAX_PANELS; i++) {
+            panels[i] = nullptr;
+            cached[i] = false;
+        }
+    }
+
+    // Before begin(). Returns the panel's index, or NONE when full.
+    uint8_t add(Panel* panel) {
+        if (count == MAX_PANELS) {
+            return NONE;
+        }
+        panels[count] = panel;
+        return count++;
+    }
+
+    // Render side, once: caches every layout, then shows the first panel
+    void begin() {
+        for (uint8_t i = 0; i < count; i++) {
+            display->clear();
+            panels[i]->drawLayout();
+            cached[i] = cache && cache->capture(i);
+            if (!cached[i]) {
+                LOG_INFO("Panel %s layout not cached", panels[i]->getName());
+            }
+        }
+        active = NONE;
+        render();
+    }
+
+    // Any task: switch at the next frame
+    void show(uint8_t index) {
+        if (index < count) {
+            requested = index;
+        }
+    }
+
+    void showNext() {
+        if (count > 0) {
+            show((requested + 1) % count);
+        }
+    }
+
+    uint8_t getActive() const { return active; }
+    Panel* getPanel(uint8_t index) const { return index < count ? panels[index] : nullptr; }
+
+    // Duration of the last switch, restore to first values on the panel
+    uint32_t getLastSwitchUs() const { return lastSwitchUs; }
+
+    // Render side: one frame of the visible panel, after any pending switch
+    void render() {
+        uint8_t target = requested;
+        if (target != active && target < count) {
+            PROFILE_SCOPE(ProfileStage::PanelSwitch);
+            uint32_t start = micros();
+            if (!cached[target] || !cache->restore(target)) {
+                display->clear();
+                panels[target]->drawLayout();
+            }
+            panels[target]->invalidate();
+            panels[target]->render();
+            display->flush();
+            active = target;
+            lastSwitchUs = micros() - start;
+            LOG_INFO("Panel %s shown in %u us", panels[target]->getName(), (unsigned int)lastSwitchUs);
+            return;
+        }
+        if (active != NONE) {
+            panels[active]->render();
+            display->flush();
+        }
+    }
+
+    // After begin(): runs render() every periodMs on the given core. The
+    // display must not be touched from anywhere else afterwards.
+    bool startRenderTask(uint32_t periodMs = 33, BaseType_t core = 0) {
+        if (renderTask) return true;
+        renderPeriodMs = periodMs;
+        return xTaskCreatePinnedToCore(renderTaskEntry, "panel_render", 4096, this, 1, &renderTask, core) == pdPASS;
+    }
+
+private:
+    IDisplay* display;
+    LayoutCache* cache;
+    Panel* panels[MAX_PANELS];
+    bool cached[MAX_PANELS];
+    uint8_t count;
+    uint8_t active;              // Render side
+    volatile uint8_t requested;  // Written by show() from any task
+    uint32_t lastSwitchUs;
+    TaskHandle_t renderTask;
+    uint32_t renderPeriodMs;
+
+    static void renderTaskEntry(void* param) {
+        PanelManager* manager = static_cast<PanelManager*>(param);
+        TickType_t lastWake = xTaskGetTickCount();
+        while (true) {
+            manager->render();
+            vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(manager->renderPeriodMs));
+        }
+    }
+};
@@ -1,27 +1,40 @@
 #pragma once
 
-#include <Diablo_Serial_4DLib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "racing_layout.h"
 
+template<typename Screen>
 class DeltaBar {
 private:
-    Diablo_Serial_4DLib* display;
-    uint16_t barWidth;
-    uint16_t barHeight;
-    uint16_t centerX;
-    uint16_t centerY;
+    typedef RacingLayout<Screen> Layout;
+    typedef typename Layout::Delta L;
+    static_assert(racing_layout::fits(L::CENTER_X - L::HALF_WIDTH, L::TOP, L::CENTER_X + L::HALF_WIDTH,
+                                      L::TOP + L::HEIGHT, Layout::WIDTH, Layout::HEIGHT),
+                  "Delta bar off screen");
+
+    static constexpr uint16_t LEFT = L::CENTER_X - L::HALF_WIDTH;
+    static constexpr uint16_t RIGHT = L::CENTER_X + L::HALF_WIDTH;
+    static constexpr uint16_t BOTTOM = L::TOP + L::HEIGHT;
+
+    Screen* display;
+    const char* label;
     
     static constexpr uint16_t BLACK = 0x0000;
     static constexpr uint16_t WHITE = 0xFFFF;
     static constexpr uint16_t RED = 0xF800;
     static constexpr uint16_t GREEN = 0x07E0;
 
-    void drawDeltaText(const char* text, uint16_t color) {
-        display->txt_Width(2);
-        display->txt_Height(2);
-        uint16_t textWidth = strlen(text) * 12;  // Approximate width
-        display->txt_FGcolour(color);
-        display->gfx_MoveTo(centerX - (textWidth/2), centerY + (barHeight/2) - 12);
-        display->putStr(text);
+    void drawDeltaText(char* text, uint16_t color) {
+        racing_layout::clip<Layout>(text, RIGHT - LEFT, L::TEXT_SCALE);
+        uint16_t textWidth = strlen(text) * Layout::GLYPH_WIDTH * L::TEXT_SCALE;  // Approximate width
+        display->text(L::CENTER_X - (textWidth/2), L::TOP + L::TEXT_Y, L::TEXT_SCALE, color, text);
+    }
+    
+    // Which reference the delta is against, top left inside the bar
+    void drawLabel() {
+        if (!label) return;
+        display->text(LEFT + L::LABEL_INSET, L::TOP + L::LABEL_INSET, 1, WHITE, label);
     }
     
     static uint16_t map(uint16_t x, uint16_t in_min, uint16_t in_max, uint16_t out_min, uint16_t out_max) {
@@ -29,37 +42,39 @@ private:
     }
 
 public:
-    DeltaBar(Diablo_Serial_4DLib* disp) 
+    DeltaBar(Screen* disp) 
         : display(disp)
-        , barWidth(180)
-        , barHeight(60)
-        , centerX(200)  // Center position
-        , centerY(40)   // Top of screen with margin
+        , label(nullptr)
     {}
 
+    // Short reference name shown with the delta, e.g. "SES", "ALL", "OPT"
+    void setLabel(const char* text) {
+        label = text;
+        drawLabel();
+    }
+
     void draw() {
         // Draw background bar
-        display->gfx_RectangleFilled(centerX - barWidth, centerY,
-                                   centerX + barWidth, centerY + barHeight,
-                                   BLACK);
+        display->fillRect(LEFT, L::TOP, RIGHT, BOTTOM, BLACK);
         
         // Draw center divider
-        display->gfx_Line(centerX, centerY, centerX, centerY + barHeight, WHITE);
+        display->line(L::CENTER_X, L::TOP, L::CENTER_X, BOTTOM, WHITE);
         
         // Draw status text
-        drawDeltaText("0.000", GREEN);
+        char zero[] = "0.000";
+        drawDeltaText(zero, GREEN);
+        drawLabel();
     }
 
     void update(int32_t deltaMs) {
         const uint16_t maxDelta = 1500;  // Max delta to show (1.5 seconds)
         
         // Clear previous bar
-        display->gfx_RectangleFilled(centerX - barWidth, centerY,
-                                   centerX + barWidth, centerY + barHeight,
-                                   BLACK);
+        display->fillRect(LEFT, L::TOP, RIGHT, BOTTOM, BLACK);
         
-        // Calculate bar width based on delta
-        uint16_t deltaWidth = map(abs(deltaMs), 0, maxDelta, 0, barWidth);
+        // Calculate bar width based on delta, full at maxDelta and beyond
+        uint16_t magnitude = abs(deltaMs) < maxDelta ? abs(deltaMs) : maxDelta;
+        uint16_t deltaWidth = map(magnitude, 0, maxDelta, 0, L::HALF_WIDTH);
         
         // Choose color based on delta
         uint16_t barColor = (deltaMs < 0) ? GREEN : RED;
@@ -67,14 +82,14 @@ public:
         // Draw the bar on appropriate side
         if (deltaMs < 0) {
             // Faster - Green bar on right
-            display->gfx_RectangleFilled(centerX, centerY,
-                                       centerX + deltaWidth, centerY + barHeight,
-                                       barColor);
+            display->fillRect(L::CENTER_X, L::TOP,
+                              L::CENTER_X + deltaWidth, BOTTOM,
+                              barColor);
         } else {
             // Slower - Red bar on left
-            display->gfx_RectangleFilled(centerX - deltaWidth, centerY,
-                                       centerX, centerY + barHeight,
-                                       barColor);
+            display->fillRect(L::CENTER_X - deltaWidth, L::TOP,
+                              L::CENTER_X, BOTTOM,
+                              barColor);
         }
         
         // Draw delta text
@@ -85,5 +100,6 @@ public:
             snprintf(deltaText, sizeof(deltaText), "%.3f", deltaMs / 1000.0f);
         }
         drawDeltaText(deltaText, barColor);
+        drawLabel();
     }
 };
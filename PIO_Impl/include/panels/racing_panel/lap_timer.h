@@ -1,12 +1,21 @@
 #pragma once
 
-#include <Diablo_Serial_4DLib.h>
+#include <stdio.h>
+#include "racing_layout.h"
 
+template<typename Screen>
 class LapTimer {
 private:
-    Diablo_Serial_4DLib* display;
-    uint16_t posX;
-    uint16_t posY;
+    typedef RacingLayout<Screen> Layout;
+    typedef typename Layout::Timer L;
+    static_assert(racing_layout::fits(L::RIGHT - L::WIDTH, L::TOP, L::RIGHT, L::TOP + L::BEST_BOTTOM,
+                                      Layout::WIDTH, Layout::HEIGHT),
+                  "Lap timer off screen");
+    static_assert(L::TIME_HEIGHT <= L::BEST_TOP && L::BEST_TOP < L::BEST_BOTTOM, "Lap timer rows overlap");
+
+    static constexpr uint16_t LEFT = L::RIGHT - L::WIDTH;
+
+    Screen* display;
     uint32_t currentLapTime;
     uint32_t bestLapTime;
     uint32_t lapStartTime;
@@ -18,35 +27,29 @@ private:
 
     void drawTime(uint32_t timeMs) {
         // Clear previous time area
-        display->gfx_RectangleFilled(posX - 160, posY, posX, posY + 40, BLACK);
+        display->fillRect(LEFT, L::TOP, L::RIGHT, L::TOP + L::TIME_HEIGHT, BLACK);
         
         // Format time as M:SS.mmm
         char timeStr[16];
         formatLapTime(timeMs, timeStr);
+        racing_layout::clip<Layout>(timeStr, L::WIDTH - L::TEXT_X, L::TIME_SCALE);
         
         // Draw new time
-        display->txt_Width(3);
-        display->txt_Height(3);
-        display->txt_FGcolour(WHITE);
-        display->gfx_MoveTo(posX - 150, posY + 10);
-        display->putStr(timeStr);
+        display->text(LEFT + L::TEXT_X, L::TOP + L::TIME_TEXT_Y, L::TIME_SCALE, WHITE, timeStr);
     }
 
     void drawBestLap() {
         // Clear area below current lap time
-        display->gfx_RectangleFilled(posX - 160, posY + 50, posX, posY + 80, BLACK);
+        display->fillRect(LEFT, L::TOP + L::BEST_TOP, L::RIGHT, L::TOP + L::BEST_BOTTOM, BLACK);
         
         if (bestLapTime != UINT32_MAX) {
             char timeStr[32];
             char lapTime[16];
             formatLapTime(bestLapTime, lapTime);
             snprintf(timeStr, sizeof(timeStr), "Best: %s", lapTime);
+            racing_layout::clip<Layout>(timeStr, L::WIDTH - L::TEXT_X, L::BEST_SCALE);
             
-            display->txt_Width(2);
-            display->txt_Height(2);
-            display->txt_FGcolour(GREEN);
-            display->gfx_MoveTo(posX - 150, posY + 60);
-            display->putStr(timeStr);
+            display->text(LEFT + L::TEXT_X, L::TOP + L::BEST_TEXT_Y, L::BEST_SCALE, GREEN, timeStr);
         }
     }
 
@@ -55,14 +58,12 @@ private:
         uint32_t seconds = (timeMs / 1000) % 60;
         uint32_t millis = timeMs % 1000;
         
-        snprintf(buffer, 16, "%d:%02d.%03d", minutes, seconds, millis);
+        snprintf(buffer, 16, "%u:%02u.%03u", (unsigned int)minutes, (unsigned int)seconds, (unsigned int)millis);
     }
 
 public:
-    LapTimer(Diablo_Serial_4DLib* disp)
+    LapTimer(Screen* disp)
         : display(disp)
-        , posX(380)  // Right side of screen
-        , posY(20)   // Top with margin
         , currentLapTime(0)
         , bestLapTime(UINT32_MAX)
         , isActive(false)
@@ -73,8 +74,9 @@ public:
         drawTime(0);
     }
 
-    void startLap() {
-        lapStartTime = millis();
+    // startTime is the millis() of the start/finish crossing
+    void startLap(uint32_t startTime) {
+        lapStartTime = startTime;
         isActive = true;
     }
 
@@ -85,9 +87,11 @@ public:
         drawTime(currentLapTime);
     }
 
-    void completeLap() {
+    void completeLap(uint32_t lapTime) {
         isActive = false;
-        
+        currentLapTime = lapTime;
+        drawTime(currentLapTime);
+
         // Update best lap if this was faster
         if (currentLapTime > 0 && (bestLapTime == UINT32_MAX || currentLapTime < bestLapTime)) {
             bestLapTime = currentLapTime;
@@ -95,6 +99,12 @@ public:
         }
     }
 
+    // Current and best time again, e.g. over a restored layout
+    void redraw() {
+        drawTime(currentLapTime);
+        drawBestLap();
+    }
+
     void reset() {
         isActive = false;
         currentLapTime = 0;
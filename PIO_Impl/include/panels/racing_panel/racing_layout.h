@@ -0,0 +1,209 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+class Diablo16Driver;
+class SharpDisplay;
+
+/**
+ * Where the racing widgets go on each screen, as compile-time tables.
+ *
+ * RacingLayout<Screen> is specialized per display type; the widgets and
+ * RacingPanel take the display type as a template parameter and read
+ * their geometry from here, so every position and font scale is a
+ * constant in the generated code. Each widget checks its area against the
+ * screen with static_assert: a table that does not fit fails to build
+ * instead of drawing off the edge.
+ *
+ * A new screen is a new specialization with the same members; offsets are
+ * from the widget's own origin. Text scales are multiples of the display
+ * font, GLYPH_WIDTH pixels wide at scale 1. Text whose length depends on
+ * its value is clipped to its field, so the layout holds for any value.
+ */
+template<typename Screen>
+struct RacingLayout;
+
+namespace racing_layout {
+    // Inclusive corners, as the drawing calls take them; the far edge may
+    // touch the screen size
+    constexpr bool fits(int x0, int y0, int x1, int y1, int width, int height) {
+        return x0 >= 0 && y0 >= 0 && x0 <= x1 && y0 <= y1 && x1 <= width && y1 <= height;
+    }
+
+    // Cuts text to the characters that fit width pixels at scale
+    template<typename Layout>
+    char* clip(char* text, int width, uint8_t scale) {
+        int fit = width > 0 ? width / (Layout::GLYPH_WIDTH * scale) : 0;
+        if ((int)strlen(text) > fit) {
+            text[fit] = '\0';
+        }
+        return text;
+    }
+}
+
+// 4D Systems Diablo16 module, 480x480
+template<>
+struct RacingLayout<Diablo16Driver> {
+    static constexpr uint16_t WIDTH = 480;
+    static constexpr uint16_t HEIGHT = 480;
+    static constexpr uint8_t GLYPH_WIDTH = 6;
+
+    struct Delta {
+        static constexpr uint16_t CENTER_X = 200;
+        static constexpr uint16_t TOP = 40;
+        static constexpr uint16_t HALF_WIDTH = 180;
+        static constexpr uint16_t HEIGHT = 60;
+        static constexpr uint8_t TEXT_SCALE = 2;
+        static constexpr uint16_t TEXT_Y = 18;
+        static constexpr uint16_t LABEL_INSET = 4;
+    };
+
+    struct Speed {
+        static constexpr uint16_t CENTER_X = 200;
+        static constexpr uint16_t CENTER_Y = 240;
+        static constexpr uint16_t RADIUS = 120;
+        static constexpr uint16_t MARKER_INSET = 10;
+        static constexpr uint16_t MARKER_LABEL = 8;
+        static constexpr uint16_t INDICATOR_INSET = 20;
+        static constexpr uint16_t INDICATOR_RADIUS = 5;
+        static constexpr uint8_t VALUE_SCALE = 3;
+        static constexpr uint16_t VALUE_HALF_WIDTH = 50;
+        static constexpr uint16_t VALUE_HALF_HEIGHT = 20;
+        static constexpr int16_t VALUE_Y = -15;
+        static constexpr int16_t UNIT_X = -15;
+        static constexpr int16_t UNIT_Y = 10;
+    };
+
+    struct Sectors {
+        static constexpr uint16_t LEFT = 20;
+        static constexpr uint16_t TOP = 120;
+        static constexpr uint16_t WIDTH = 240;
+        static constexpr uint16_t HEIGHT = 240;
+        static constexpr uint8_t TEXT_SCALE = 2;
+        static constexpr uint16_t ROW_PITCH = 50;
+        static constexpr uint16_t ROW_HEIGHT = 40;
+        static constexpr uint16_t ROW_TEXT_Y = 10;
+        static constexpr uint16_t LABEL_X = 10;
+        static constexpr uint16_t TIME_X = 60;
+        static constexpr uint16_t DELTA_FROM_RIGHT = 80;
+        static constexpr uint16_t BEST_FROM_BOTTOM = 40;
+        static constexpr uint16_t BEST_HEIGHT = 30;
+        static constexpr uint16_t BEST_TEXT_Y = 5;
+        static constexpr uint16_t BEST_VALUE_X = 80;
+    };
+
+    struct Timer {
+        static constexpr uint16_t RIGHT = 380;
+        static constexpr uint16_t TOP = 20;
+        static constexpr uint16_t WIDTH = 160;
+        static constexpr uint16_t TEXT_X = 10;
+        static constexpr uint8_t TIME_SCALE = 3;
+        static constexpr uint16_t TIME_HEIGHT = 40;
+        static constexpr uint16_t TIME_TEXT_Y = 10;
+        static constexpr uint8_t BEST_SCALE = 2;
+        static constexpr uint16_t BEST_TOP = 50;
+        static constexpr uint16_t BEST_BOTTOM = 80;
+        static constexpr uint16_t BEST_TEXT_Y = 60;
+    };
+
+    struct Status {
+        static constexpr uint16_t TOP = 440;
+        static constexpr uint16_t HEIGHT = 40;
+        static constexpr uint16_t INSET = 5;
+        static constexpr uint16_t TEXT_Y = 12;
+        static constexpr uint8_t TEXT_SCALE = 1;
+        static constexpr uint16_t GPS_LEFT = 10;
+        static constexpr uint16_t GPS_RIGHT = 160;
+        static constexpr uint16_t GPS_TEXT_X = 20;
+        static constexpr uint16_t RBM_LEFT = 170;
+        static constexpr uint16_t RBM_RIGHT = 320;
+        static constexpr uint16_t RBM_TEXT_X = 180;
+        static constexpr uint16_t STINT_LEFT = 330;
+        static constexpr uint16_t STINT_RIGHT = 470;
+        static constexpr uint16_t STINT_TEXT_X = 340;
+    };
+};
+
+// Sharp memory LCD, 400x240: delta and lap time across the top, the
+// speedometer left, sectors right
+template<>
+struct RacingLayout<SharpDisplay> {
+    static constexpr uint16_t WIDTH = 400;
+    static constexpr uint16_t HEIGHT = 240;
+    static constexpr uint8_t GLYPH_WIDTH = 6;
+
+    struct Delta {
+        static constexpr uint16_t CENTER_X = 120;
+        static constexpr uint16_t TOP = 5;
+        static constexpr uint16_t HALF_WIDTH = 110;
+        static constexpr uint16_t HEIGHT = 40;
+        static constexpr uint8_t TEXT_SCALE = 2;
+        static constexpr uint16_t TEXT_Y = 12;
+        static constexpr uint16_t LABEL_INSET = 3;
+    };
+
+    struct Speed {
+        static constexpr uint16_t CENTER_X = 85;
+        static constexpr uint16_t CENTER_Y = 140;
+        static constexpr uint16_t RADIUS = 70;
+        static constexpr uint16_t MARKER_INSET = 10;
+        static constexpr uint16_t MARKER_LABEL = 8;
+        static constexpr uint16_t INDICATOR_INSET = 18;
+        static constexpr uint16_t INDICATOR_RADIUS = 4;
+        static constexpr uint8_t VALUE_SCALE = 2;
+        static constexpr uint16_t VALUE_HALF_WIDTH = 35;
+        static constexpr uint16_t VALUE_HALF_HEIGHT = 16;
+        static constexpr int16_t VALUE_Y = -12;
+        static constexpr int16_t UNIT_X = -12;
+        static constexpr int16_t UNIT_Y = 6;
+    };
+
+    struct Sectors {
+        static constexpr uint16_t LEFT = 170;
+        static constexpr uint16_t TOP = 55;
+        static constexpr uint16_t WIDTH = 225;
+        static constexpr uint16_t HEIGHT = 160;
+        static constexpr uint8_t TEXT_SCALE = 2;
+        static constexpr uint16_t ROW_PITCH = 34;
+        static constexpr uint16_t ROW_HEIGHT = 30;
+        static constexpr uint16_t ROW_TEXT_Y = 7;
+        static constexpr uint16_t LABEL_X = 5;
+        static constexpr uint16_t TIME_X = 45;
+        static constexpr uint16_t DELTA_FROM_RIGHT = 80;
+        static constexpr uint16_t BEST_FROM_BOTTOM = 40;
+        static constexpr uint16_t BEST_HEIGHT = 30;
+        static constexpr uint16_t BEST_TEXT_Y = 7;
+        static constexpr uint16_t BEST_VALUE_X = 80;
+    };
+
+    struct Timer {
+        static constexpr uint16_t RIGHT = 395;
+        static constexpr uint16_t TOP = 5;
+        static constexpr uint16_t WIDTH = 160;
+        static constexpr uint16_t TEXT_X = 10;
+        static constexpr uint8_t TIME_SCALE = 2;
+        static constexpr uint16_t TIME_HEIGHT = 24;
+        static constexpr uint16_t TIME_TEXT_Y = 4;
+        static constexpr uint8_t BEST_SCALE = 1;
+        static constexpr uint16_t BEST_TOP = 28;
+        static constexpr uint16_t BEST_BOTTOM = 44;
+        static constexpr uint16_t BEST_TEXT_Y = 32;
+    };
+
+    struct Status {
+        static constexpr uint16_t TOP = 220;
+        static constexpr uint16_t HEIGHT = 20;
+        static constexpr uint16_t INSET = 2;
+        static constexpr uint16_t TEXT_Y = 6;
+        static constexpr uint8_t TEXT_SCALE = 1;
+        static constexpr uint16_t GPS_LEFT = 5;
+        static constexpr uint16_t GPS_RIGHT = 135;
+        static constexpr uint16_t GPS_TEXT_X = 8;
+        static constexpr uint16_t RBM_LEFT = 140;
+        static constexpr uint16_t RBM_RIGHT = 265;
+        static constexpr uint16_t RBM_TEXT_X = 143;
+        static constexpr uint16_t STINT_LEFT = 270;
+        static constexpr uint16_t STINT_RIGHT = 395;
+        static constexpr uint16_t STINT_TEXT_X = 273;
+    };
+};
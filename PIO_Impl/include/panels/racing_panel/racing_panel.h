@@ -1,328 +1,406 @@
 #pragma once
 
-#include <Diablo_Serial_4DLib.h>
 #include "delta_bar.h"
 #include "speedometer.h"
 #include "sector_display.h"
 #include "lap_timer.h"
 #include "status_bar.h"
-#include "delta_calculator.h"
-#include "track_data.h"
-
-class RacingPanel {
+#include "calculations/racing_engine.h"
+#include "track/track_manager.h"
+#include "util/profiler.h"
+#include "util/log.h"
+#include "util/latency_trace.h"
+#include "util/triple_buffer.h"
+#include "telemetry/telemetry.h"
+#include "panels/panel.h"
+
+/**
+ * Racing display, split into a compute side and a render side.
+ *
+ * Compute side (the loop task): updateGPS() and the other setters feed the
+ * RacingEngine, which publishes a RacingState snapshot per fix. Render side
+ * (PanelManager, on its render task or from the loop): takes the newest
+ * snapshot and redraws only the widgets whose values changed. The two sides share nothing but
+ * the triple buffer, so a slow display never holds up gate detection.
+ * While another panel is shown nothing is rendered, and the first render
+ * after a switch starts from the newest snapshot.
+ *
+ * Screen is the display driver (Diablo16Driver, SharpDisplay). The
+ * widgets draw through it and its RacingLayout table places them; the
+ * PanelManager ends each frame with the driver's flush().
+ */
+template<typename Screen = Diablo16Driver>
+class RacingPanel : public Panel, private RacingListener {
 private:
-    Diablo_Serial_4DLib* display;
-    DeltaBar deltaBar;
-    Speedometer speedometer;
-    SectorDisplay sectorDisplay;
-    LapTimer lapTimer;
-    StatusBar statusBar;
-    delta_calculator deltaCalculator;
-
-    bool isLapActive;
-    uint32_t currentLapStartTime;
-    bool stintActive;
-    uint32_t stintStartTime;
-    
-    // Track specific variables
-    uint32_t currentSector1Time;
-    uint32_t currentSector2Time;
-    uint32_t currentSector3Time;
-    uint32_t sector1CrossTime;
-    uint32_t sector2CrossTime;
-    bool inSector1;
-    bool inSector2;
-    bool inSector3;
-    bool inPitLane;
-
-    void updateStintTimer() {
+    DeltaBar<Screen> deltaBar;
+    Speedometer<Screen> speedometer;
+    SectorDisplay<Screen> sectorDisplay;
+    LapTimer<Screen> lapTimer;
+    StatusBar<Screen> statusBar;
+    TrackManager* trackManager;
+    Telemetry* telemetry;
+    TimingGates gates;         // Of the loaded track, none set before
+    uint32_t sessionId;        // In the session index, 0 until the first lap
+    uint32_t sessionStart;
+
+    TripleBuffer<RacingState> snapshots;
+    RacingEngine engine;
+
+    // Render side: the snapshot currently on screen
+    RacingState shown;
+    bool fullRedraw;
+    bool layoutRestored;       // Widgets must put their values back
+
+    void updateStintTimer(uint32_t stintStartTime) {
         uint32_t elapsed = millis() - stintStartTime;
         uint32_t minutes = elapsed / 60000;
         uint32_t seconds = (elapsed / 1000) % 60;
-        
+
         char timeStr[10];
-        snprintf(timeStr, sizeof(timeStr), "%02lu:%02lu", minutes, seconds);
+        snprintf(timeStr, sizeof(timeStr), "%02u:%02u", (unsigned int)minutes, (unsigned int)seconds);
         statusBar.updateStintTimer(timeStr);
     }
 
-    void checkPosition(double lat, double lon, int32_t speed) {
-        // Create point for current position
-        GpsPoint currentPos = {lat, lon, true, 4.0f};
-        
-        // Check for start/finish line crossing
-        if (isNearPoint(currentPos, TrackData::startFinish)) {
-            handleStartFinishCrossing(speed);
-        }
-        
-        // Check sector points if lap is active
-        if (isLapActive) {
-            checkSectorCrossings(currentPos, speed);
-            checkPitLane(currentPos);
-        }
+    // A stored track starts sectors 2 and 3, which end sectors 1 and 2.
+    // It has no pit lane, so stints are not reset on pit exit.
+    static TimingGates trackGates(const TrackConfig& track) {
+        TimingGates result;
+        result.startFinish = track.startFinish;
+        result.sector1 = track.sector2Start;
+        result.sector2 = track.sector3Start;
+        return result;
     }
 
-    void handleStartFinishCrossing(int32_t speed) {
-        if (isLapActive) {
-            // Complete lap
-            uint32_t lapTime = millis() - currentLapStartTime;
-            
-            // Calculate final sector time
-            if (inSector3) {
-                currentSector3Time = lapTime - sector2CrossTime;
-                updateSectorTime(2, currentSector3Time);
-            }
-            
-            lapTimer.completeLap();
-            deltaCalculator.completeLap(lapTime);
-            
-            // Reset sector states
-            inSector1 = false;
-            inSector2 = false;
-            inSector3 = false;
+    // RacingListener, runs in compute context
+    void onSector(uint8_t sector, uint32_t time) override {
+        if (telemetry) {
+            telemetry->sendSector(sector, time);
         }
-        
-        // Start new lap if speed is above minimum threshold (5 km/h)
-        if (speed > 1.389) { // 5 km/h in m/s
-            isLapActive = true;
-            currentLapStartTime = millis();
-            lapTimer.startLap();
-            
-            // Reset sector times
-            currentSector1Time = 0;
-            currentSector2Time = 0;
-            currentSector3Time = 0;
-            sector1CrossTime = 0;
-            sector2CrossTime = 0;
+    }
+
+    void onLap(uint16_t lapNumber, uint32_t lapTime, bool isSessionBest) override {
+        if (telemetry) {
+            telemetry->sendLap(lapNumber, lapTime, isSessionBest);
         }
+        saveSession(lapTime);
     }
 
-    void checkSectorCrossings(const GpsPoint& currentPos, int32_t speed) {
-        // Sector 1
-        if (isNearPoint(currentPos, TrackData::sector1) && !inSector1) {
-            inSector1 = true;
-            sector1CrossTime = millis() - currentLapStartTime;
-            currentSector1Time = sector1CrossTime;
-            updateSectorTime(0, currentSector1Time);
+    // The session's statistics so far, queued for the session index
+    void saveSession(uint32_t lapTime) {
+        TrackConfig track;
+        if (!trackManager || !trackManager->getCurrentTrack(&track)) {
+            return;
         }
-        
-        // Sector 2
-        if (isNearPoint(currentPos, TrackData::sector2) && !inSector2 && inSector1) {
-            inSector2 = true;
-            sector2CrossTime = millis() - currentLapStartTime;
-            currentSector2Time = sector2CrossTime - sector1CrossTime;
-            updateSectorTime(1, currentSector2Time);
-            inSector3 = true; // Start sector 3 timing
+        if (sessionId == 0) {
+            sessionId = trackManager->newSession();
+            sessionStart = millis() - lapTime;
         }
+
+        const RacingState& state = engine.current();
+        SessionRecord record;
+        record.id = sessionId;
+        strncpy(record.track, track.name, MAX_TRACK_NAME_LENGTH - 1);
+        record.track[MAX_TRACK_NAME_LENGTH - 1] = '\0';
+        record.duration = millis() - sessionStart;
+        record.laps = state.lapStats;
+        for (uint8_t s = 0; s < 3; s++) {
+            record.sectors[s] = state.sectorStats[s];
+        }
+        trackManager->saveSession(record);
     }
 
-    void checkPitLane(const GpsPoint& currentPos) {
-        if (!TrackData::pitEntry.isSet || !TrackData::pitExit.isSet) return;
+    // Corner metrics go to the log; the live ones are in the snapshot
+    void onCorner(const CornerMetrics& corner) override {
+        LOG_INFO("Corner %d lap %u: min %.1f km/h, exit %.1f km/h, %.2f g, brake at %.0f m",
+                 corner.corner == CornerMetrics::UNMATCHED ? -1 : (int)corner.corner + 1, corner.lap,
+                 corner.minSpeed * 3.6f, corner.exitSpeed * 3.6f, corner.peakLateral / 9.81f, corner.brakingPoint);
+    }
 
-        if (isNearPoint(currentPos, TrackData::pitEntry) && !inPitLane) {
-            inPitLane = true;
-            // Optional: Handle pit entry events (e.g., pause stint timer)
-        } else if (isNearPoint(currentPos, TrackData::pitExit) && inPitLane) {
-            inPitLane = false;
-            resetStint(); // Reset stint timer on pit exit
+    // Queue the new best lap for background writing to flash
+    void onNewAllTimeBest(const ReferenceTrace& trace) override {
+        TrackConfig track;
+        if (trackManager && trackManager->getCurrentTrack(&track)) {
+            trackManager->saveReference(track, trace);
         }
     }
 
-    void updateSectorTime(uint8_t sector, uint32_t time) {
-        uint32_t& bestTime = (sector == 0) ? TrackData::sector1BestTime :
-                            (sector == 1) ? TrackData::sector2BestTime :
-                                          TrackData::sector3BestTime;
-        
-        if (time > 0 && (bestTime == UINT32_MAX || time < bestTime)) {
-            bestTime = time;
+    // Delta against the stored best lap from the first lap of a session
+    void loadReferenceLap() {
+        TrackConfig track;
+        ReferenceTrace reference;
+        if (trackManager && trackManager->getCurrentTrack(&track) &&
+            trackManager->loadReference(track, &reference)) {
+            engine.setAllTimeBest(reference);
         }
-        
-        sectorDisplay.updateSector(sector, time, bestTime);
-        updateTheoreticalBest();
     }
 
-    void updateTheoreticalBest() {
-        uint32_t theoretical = 0;
-        bool valid = true;
+    // Draws what changed between the shown snapshot and s
+    void renderSnapshot(const RacingState& s) {
+        bool all = fullRedraw;
+        fullRedraw = false;
 
-        if (TrackData::sector1BestTime != UINT32_MAX) {
-            theoretical += TrackData::sector1BestTime;
-        } else {
-            valid = false;
+        if (all || s.gpsValid != shown.gpsValid || s.satellites != shown.satellites) {
+            PROFILE_SCOPE(ProfileStage::StatusBarDraw);
+            statusBar.updateGPSStatus(s.gpsValid, s.satellites);
         }
-
-        if (TrackData::sector2BestTime != UINT32_MAX) {
-            theoretical += TrackData::sector2BestTime;
-        } else {
-            valid = false;
+        if (all || s.rbmConnected != shown.rbmConnected) {
+            statusBar.updateRBMStatus(s.rbmConnected);
         }
 
-        if (TrackData::sector3BestTime != UINT32_MAX) {
-            theoretical += TrackData::sector3BestTime;
-        } else {
-            valid = false;
+        if (s.gpsValid && (all || s.speedKph != shown.speedKph)) {
+            PROFILE_SCOPE(ProfileStage::SpeedometerDraw);
+            speedometer.updateSpeed(s.speedKph);
         }
 
-        if (valid) {
-            TrackData::theoreticalBest = theoretical;
-            sectorDisplay.updateTheoreticalBest(theoretical);
+        if (s.deltaReference != shown.deltaReference) {
+            deltaBar.setLabel(referenceLabel(s.deltaReference));
+        }
+        if (s.hasDelta && (all || s.sequence != shown.sequence || s.deltaReference != shown.deltaReference)) {
+            PROFILE_SCOPE(ProfileStage::DeltaBarDraw);
+            deltaBar.update(s.delta);
         }
-    }
 
-    static bool isNearPoint(const GpsPoint& pos, const GpsPoint& target) {
-        if (!target.isSet) return false;
-        
-        // Haversine formula for accurate distance calculation
-        const double R = 6371000; // Earth radius in meters
-        double lat1 = pos.latitude * M_PI / 180;
-        double lat2 = target.latitude * M_PI / 180;
-        double dlat = (target.latitude - pos.latitude) * M_PI / 180;
-        double dlon = (target.longitude - pos.longitude) * M_PI / 180;
+        // Lap transitions, completion before the next lap starts
+        if (s.lapCount != shown.lapCount && s.lapCount > 0) {
+            lapTimer.completeLap(s.lastLapTime);
+        }
+        if (s.lapActive && (!shown.lapActive || s.lapStartTime != shown.lapStartTime)) {
+            lapTimer.startLap(s.lapStartTime);
+        }
 
-        double a = sin(dlat/2) * sin(dlat/2) +
-                  cos(lat1) * cos(lat2) *
-                  sin(dlon/2) * sin(dlon/2);
-        double c = 2 * atan2(sqrt(a), sqrt(1-a));
-        double distance = R * c;
+        for (uint8_t sector = 0; sector < 3; sector++) {
+            if (s.sectorTime[sector] != shown.sectorTime[sector] ||
+                s.sectorBest[sector] != shown.sectorBest[sector]) {
+                PROFILE_SCOPE(ProfileStage::SectorDraw);
+                sectorDisplay.updateSector(sector, s.sectorTime[sector], s.sectorBest[sector]);
+            }
+        }
+        if (s.theoreticalBest > 0 && s.theoreticalBest != shown.theoreticalBest) {
+            sectorDisplay.updateTheoreticalBest(s.theoreticalBest);
+        }
 
-        return distance <= target.radius;
+        LATENCY_MARK(s.sequence, LatencyStage::Displayed);
+        shown = s;
     }
 
 public:
-    RacingPanel(Diablo_Serial_4DLib* disp) 
-        : display(disp)
-        , deltaBar(disp)
+    RacingPanel(Screen* disp)
+        : deltaBar(disp)
         , speedometer(disp)
         , sectorDisplay(disp)
         , lapTimer(disp)
         , statusBar(disp)
-        , deltaCalculator()
-        , isLapActive(false)
-        , stintActive(false)
-        , stintStartTime(0)
-        , currentSector1Time(0)
-        , currentSector2Time(0)
-        , currentSector3Time(0)
-        , sector1CrossTime(0)
-        , sector2CrossTime(0)
-        , inSector1(false)
-        , inSector2(false)
-        , inSector3(false)
-        , inPitLane(false)
+        , trackManager(nullptr)
+        , telemetry(nullptr)
+        , gates()
+        , sessionId(0)
+        , sessionStart(0)
+        , snapshots()
+        , engine(snapshots)
+        , shown(engine.current())
+        , fullRedraw(true)
+        , layoutRestored(false)
     {
-        display->gfx_Cls();  // Clear screen on init
+        engine.setListener(this);
     }
 
-    void draw() {
+    // Panel, render side
+    const char* getName() const override { return "Racing"; }
+
+    void drawLayout() override {
         deltaBar.draw();
-        speedometer.draw();
+        speedometer.drawLayout();
         sectorDisplay.draw();
         lapTimer.draw();
         statusBar.draw();
     }
 
-    void updateGPS(double lat, double lon, int32_t speed, bool valid, uint8_t satellites) {
-        // Update GPS status
-        statusBar.updateGPSStatus(valid, satellites);
+    void invalidate() override {
+        layoutRestored = true;
+    }
 
-        if (!valid) return;
+    void render() override {
+        update();
+    }
 
-        // Update speed display
-        int32_t speedKph = (int32_t)(speed * 3.6f);  // Convert m/s to km/h
-        speedometer.updateSpeed(speedKph);
+    // Render side: picks up the newest snapshot and ticks the running
+    // timers. The PanelManager calls it through render().
+    void update() {
+        bool fresh = snapshots.update();
+        if (fresh && snapshots.read().generation != shown.generation) {
+            // Reset on the compute side: blank the values, then diff
+            // against an empty state so every set value is drawn
+            const RacingState& latest = snapshots.read();
+            shown = RacingState();
+            shown.generation = latest.generation;
+            shown.deltaReference = latest.deltaReference;
+            for (uint8_t s = 0; s < 3; s++) {
+                shown.sectorBest[s] = UINT32_MAX;
+            }
+            lapTimer.reset();
+            sectorDisplay.reset();
+            sectorDisplay.draw();
+            deltaBar.draw();
+            speedometer.invalidate();
+            fullRedraw = true;
+        }
+        if (layoutRestored) {
+            // Over the cached layout: what the widgets last showed, then
+            // the usual diff brings it up to date
+            layoutRestored = false;
+            sectorDisplay.draw();
+            lapTimer.redraw();
+            speedometer.invalidate();
+            deltaBar.setLabel(referenceLabel(shown.deltaReference));
+            fullRedraw = true;
+        }
+        if (fresh) {
+            renderSnapshot(snapshots.read());
+        } else if (fullRedraw) {
+            renderSnapshot(shown);
+        }
 
-        // Store point for delta calculation if lap is active
-        if (isLapActive) {
-            uint32_t currentLapTime = millis() - currentLapStartTime;
-            GpsPoint point = {lat, lon, true, 4.0f};
-            deltaCalculator.storePoint(currentLapTime, point, speed);
-            
-            // Calculate and update delta time
-            int32_t delta = deltaCalculator.calculateDelta(currentLapTime, point);
-            deltaBar.update(delta);
-            
-            // Update lap time
+        if (shown.stintActive) {
+            updateStintTimer(shown.stintStartTime);
+        }
+        if (shown.lapActive) {
+            PROFILE_SCOPE(ProfileStage::LapTimerDraw);
             lapTimer.updateCurrentLap();
         }
+    }
 
-        // Check track position and handle sector/lap triggers
-        checkPosition(lat, lon, speed);
+    // Compute side from here on. speed is the ground speed in m/s,
+    // sequence is GNSSData::sequence, carried through to the snapshot for
+    // latency tracing.
+    void updateGPS(double lat, double lon, float speed, bool valid, uint8_t satellites, uint32_t sequence = 0) {
+        GpsPoint position;
+        position.latitude = lat;
+        position.longitude = lon;
+        position.isSet = true;
+        engine.update(millis(), position, speed, valid, satellites, sequence, gates);
+    }
+
+    // Optional, before updateGPS(): exact speed and course of the fix plus
+    // vehicle-frame acceleration (forward and left positive) for corners
+    void updateMotion(float speed, float heading, float longitudinal, float lateral) {
+        engine.updateMotion(speed, heading, longitudinal, lateral);
     }
 
     void updateRBMStatus(bool connected) {
-        statusBar.updateRBMStatus(connected);
+        engine.setRbmConnected(connected);
     }
 
     void startStint() {
-        stintActive = true;
-        stintStartTime = millis();
-        updateStintTimer();
+        engine.startStint(millis());
     }
 
     void stopStint() {
-        stintActive = false;
+        engine.stopStint();
     }
 
     void resetStint() {
-        if (stintActive) {
-            stintStartTime = millis();
-            updateStintTimer();
-        }
+        engine.resetStint(millis());
     }
 
-    void update() {
-        if (stintActive) {
-            updateStintTimer();
-        }
-        
-        // Update any active animations or displays
-        if (isLapActive) {
-            lapTimer.updateCurrentLap();
-        }
+    void resetLap() {
+        engine.resetLap();
     }
 
-    void resetLap() {
-        isLapActive = false;
-        currentLapStartTime = 0;
-        inSector1 = false;
-        inSector2 = false;
-        inSector3 = false;
-        currentSector1Time = 0;
-        currentSector2Time = 0;
-        currentSector3Time = 0;
-        sector1CrossTime = 0;
-        sector2CrossTime = 0;
-        lapTimer.reset();
-        deltaCalculator.reset();
+    // The session the recorder opened, so the session index and the log
+    // share its id; without one the first lap opens a session
+    void setSession(uint32_t id) {
+        sessionId = id;
+        sessionStart = millis();
     }
 
+    // The renderer redraws everything once it sees the reset
     void resetAll() {
-        resetLap();
-        stopStint();
-        TrackData::resetTrack();
-        draw(); // Redraw everything with reset values
+        engine.reset();
+        sessionId = 0;
+    }
+
+    // Choose which reference lap the delta bar shows
+    void setDeltaReference(ReferenceKind kind) {
+        engine.setDeltaReference(kind);
     }
 
-    void loadTrack(const char* name) {
+    static const char* referenceLabel(ReferenceKind kind) {
+        switch (kind) {
+            case ReferenceKind::AllTimeBest: return "ALL";
+            case ReferenceKind::Optimal: return "OPT";
+            default: return "SES";
+        }
+    }
+
+    // Storage for persisted reference laps, optional
+    void setTrackManager(TrackManager* manager) {
+        trackManager = manager;
+    }
+
+    // Live telemetry sink for lap and sector events, optional
+    void setTelemetry(Telemetry* sink) {
+        telemetry = sink;
+    }
+
+    // A new session at the track: its gates and its stored best lap. The
+    // track manager's current track must be this one.
+    void loadTrack(const TrackConfig& track) {
         resetAll();
-        TrackData::loadTrack(name);
+        gates = trackGates(track);
+        loadReferenceLap();
     }
 
-    void saveTrack(const char* name) {
-        TrackData::saveTrack(name);
+    // Warm restart, compute side: the session as a snapshot for WarmStore
+    void saveWarm(WarmState* warm) const {
+        engine.saveWarm(warm, millis());
+        TrackConfig track;
+        if (trackManager && trackManager->getCurrentTrack(&track)) {
+            strncpy(warm->track, track.name, MAX_TRACK_NAME_LENGTH - 1);
+            warm->track[MAX_TRACK_NAME_LENGTH - 1] = '\0';
+        }
+        const ReferenceTrace& best = engine.deltas().getReference(ReferenceKind::AllTimeBest);
+        warm->referenceLap = best.isValid ? best.lapTime : 0;
     }
 
-    // Getters for current state
-    bool isLapRunning() const { return isLapActive; }
-    bool isStintRunning() const { return stintActive; }
-    bool isPitLaneActive() const { return inPitLane; }
-    uint32_t getCurrentLapTime() const { return isLapActive ? (millis() - currentLapStartTime) : 0; }
-    uint32_t getStintTime() const { return stintActive ? (millis() - stintStartTime) : 0; }
-    uint32_t getTheoreticalBest() const { return TrackData::theoreticalBest; }
+    // After a reset: the snapshot's track with its gates and stored best
+    // lap, then its stint and bests. A session summary starts anew.
+    void restoreWarm(const WarmState& warm, uint32_t ageMs) {
+        TrackConfig track;
+        if (warm.track[0] && trackManager && trackManager->setCurrentTrack(warm.track) &&
+            trackManager->getCurrentTrack(&track)) {
+            loadTrack(track);
+        } else {
+            resetAll();
+        }
+        engine.restoreWarm(warm, millis(), ageMs);
+        const ReferenceTrace& best = engine.deltas().getReference(ReferenceKind::AllTimeBest);
+        if (warm.referenceLap && (!best.isValid || best.lapTime != warm.referenceLap)) {
+            LOG_WARN("Best lap of %u ms was not in flash yet, lost with the reset", (unsigned int)warm.referenceLap);
+        }
+    }
 
-    // Direct access to components if needed
-    DeltaBar& getDeltaBar() { return deltaBar; }
-    Speedometer& getSpeedometer() { return speedometer; }
-    SectorDisplay& getSectorDisplay() { return sectorDisplay; }
-    LapTimer& getLapTimer() { return lapTimer; }
-    StatusBar& getStatusBar() { return statusBar; }
+    // Getters for current state, compute side
+    bool isLapRunning() const { return engine.current().lapActive; }
+    bool isStintRunning() const { return engine.current().stintActive; }
+    bool isPitLaneActive() const { return engine.isInPitLane(); }
+    uint32_t getCurrentLapTime() const {
+        const RacingState& state = engine.current();
+        return state.lapActive ? millis() - state.lapStartTime : 0;
+    }
+    uint32_t getStintTime() const {
+        const RacingState& state = engine.current();
+        return state.stintActive ? (millis() - state.stintStartTime) : 0;
+    }
+    uint32_t getTheoreticalBest() const { return engine.current().theoreticalBest; }
+    const SeriesSummary& getLapStats() const { return engine.current().lapStats; }
+    const SeriesSummary& getSectorStats(uint8_t sector) const { return engine.current().sectorStats[sector]; }
+    ReferenceKind getDeltaReference() const { return engine.current().deltaReference; }
+    int32_t getDelta(ReferenceKind kind) const { return engine.deltas().getDelta(kind); }
+
+    // Direct access to components if needed, render side only
+    DeltaBar<Screen>& getDeltaBar() { return deltaBar; }
+    Speedometer<Screen>& getSpeedometer() { return speedometer; }
+    SectorDisplay<Screen>& getSectorDisplay() { return sectorDisplay; }
+    LapTimer<Screen>& getLapTimer() { return lapTimer; }
+    StatusBar<Screen>& getStatusBar() { return statusBar; }
 };
@@ -1,14 +1,24 @@
 #pragma once
 
-#include <Diablo_Serial_4DLib.h>
+#include <stdio.h>
+#include "racing_layout.h"
 
+template<typename Screen>
 class SectorDisplay {
 private:
-    Diablo_Serial_4DLib* display;
-    uint16_t startX;
-    uint16_t startY;
-    uint16_t width;
-    uint16_t height;
+    typedef RacingLayout<Screen> Layout;
+    typedef typename Layout::Sectors L;
+    static_assert(racing_layout::fits(L::LEFT, L::TOP, L::LEFT + L::WIDTH, L::TOP + L::HEIGHT,
+                                      Layout::WIDTH, Layout::HEIGHT),
+                  "Sector display off screen");
+    static_assert(2 * L::ROW_PITCH + L::ROW_HEIGHT <= L::HEIGHT - L::BEST_FROM_BOTTOM &&
+                  L::BEST_HEIGHT <= L::BEST_FROM_BOTTOM,
+                  "Sector rows overlap the best time");
+
+    static constexpr uint16_t RIGHT = L::LEFT + L::WIDTH;
+    static constexpr uint16_t BEST_TOP = L::TOP + L::HEIGHT - L::BEST_FROM_BOTTOM;
+
+    Screen* display;
     uint32_t bestSectorTimes[3];
     uint32_t currentSectorTimes[3];
     uint32_t theoreticalBest;
@@ -19,30 +29,23 @@ private:
     static constexpr uint16_t GREEN = 0x07E0;
 
     void drawSectorRow(uint8_t sector) {
-        uint16_t y = startY + (sector * 50);
+        uint16_t y = L::TOP + (sector * L::ROW_PITCH);
         
         // Clear row area
-        display->gfx_RectangleFilled(startX, y, startX + width, y + 40, BLACK);
+        display->fillRect(L::LEFT, y, RIGHT, y + L::ROW_HEIGHT, BLACK);
         
         // Draw sector label
-        display->txt_Width(2);
-        display->txt_Height(2);
-        display->txt_FGcolour(WHITE);
-        display->gfx_MoveTo(startX + 10, y + 10);
         char label[4];
         snprintf(label, sizeof(label), "S%d:", sector + 1);
-        display->putStr(label);
+        display->text(L::LEFT + L::LABEL_X, y + L::ROW_TEXT_Y, L::TEXT_SCALE, WHITE, label);
         
-        // Draw best time
+        // Draw best time, up to where the delta starts
+        char timeStr[16] = "--.---";
         if (bestSectorTimes[sector] != UINT32_MAX) {
-            char timeStr[16];
             formatTime(bestSectorTimes[sector], timeStr);
-            display->gfx_MoveTo(startX + 60, y + 10);
-            display->putStr(timeStr);
-        } else {
-            display->gfx_MoveTo(startX + 60, y + 10);
-            display->putStr("--.---");
         }
+        racing_layout::clip<Layout>(timeStr, L::WIDTH - L::DELTA_FROM_RIGHT - L::TIME_X, L::TEXT_SCALE);
+        display->text(L::LEFT + L::TIME_X, y + L::ROW_TEXT_Y, L::TEXT_SCALE, WHITE, timeStr);
         
         // Draw delta if we have current time
         if (currentSectorTimes[sector] != UINT32_MAX && 
@@ -52,56 +55,30 @@ private:
             char deltaStr[16];
             if (delta > 0) {
                 snprintf(deltaStr, sizeof(deltaStr), "+%.3f", delta / 1000.0f);
-                display->txt_FGcolour(RED);
             } else {
                 snprintf(deltaStr, sizeof(deltaStr), "%.3f", delta / 1000.0f);
-                display->txt_FGcolour(GREEN);
             }
-            display->gfx_MoveTo(startX + width - 80, y + 10);
-            display->putStr(deltaStr);
+            racing_layout::clip<Layout>(deltaStr, L::DELTA_FROM_RIGHT, L::TEXT_SCALE);
+            display->text(RIGHT - L::DELTA_FROM_RIGHT, y + L::ROW_TEXT_Y, L::TEXT_SCALE, delta > 0 ? RED : GREEN,
+                          deltaStr);
         }
     }
 
     void drawTheoretical() {
-        uint16_t y = startY + height - 40;
-        
         // Clear theoretical area
-        display->gfx_RectangleFilled(startX, y, startX + width, y + 30, BLACK);
+        display->fillRect(L::LEFT, BEST_TOP, RIGHT, BEST_TOP + L::BEST_HEIGHT, BLACK);
         
         // Draw label
-        display->txt_Width(2);
-        display->txt_Height(2);
-        display->txt_FGcolour(WHITE);
-        display->gfx_MoveTo(startX + 10, y + 5);
-        display->putStr("Best:");
+        display->text(L::LEFT + L::LABEL_X, BEST_TOP + L::BEST_TEXT_Y, L::TEXT_SCALE, WHITE, "Best:");
 
         // Draw theoretical best time if valid
+        char timeStr[16] = "--:--.---";
         if (theoreticalBest > 0) {
-            char timeStr[16];
             formatTime(theoreticalBest, timeStr);
-            display->gfx_MoveTo(startX + 80, y + 5);
-            display->txt_FGcolour(GREEN);
-            display->putStr(timeStr);
-        } else {
-            display->gfx_MoveTo(startX + 80, y + 5);
-            display->putStr("--:--.---");
-        }
-    }
-
-    void updateTheoretical() {
-        theoreticalBest = 0;
-        bool validTheoretical = true;
-        
-        for (int i = 0; i < 3; i++) {
-            if (bestSectorTimes[i] != UINT32_MAX) {
-                theoreticalBest += bestSectorTimes[i];
-            } else {
-                validTheoretical = false;
-                break;
-            }
         }
-        
-        drawTheoretical();
+        racing_layout::clip<Layout>(timeStr, L::WIDTH - L::BEST_VALUE_X, L::TEXT_SCALE);
+        display->text(L::LEFT + L::BEST_VALUE_X, BEST_TOP + L::BEST_TEXT_Y, L::TEXT_SCALE,
+                      theoreticalBest > 0 ? GREEN : WHITE, timeStr);
     }
 
     void formatTime(uint32_t timeMs, char* buffer) {
@@ -110,19 +87,15 @@ private:
         uint32_t millis = timeMs % 1000;
         
         if (minutes > 0) {
-            snprintf(buffer, 16, "%d:%02d.%03d", minutes, seconds, millis);
+            snprintf(buffer, 16, "%u:%02u.%03u", (unsigned int)minutes, (unsigned int)seconds, (unsigned int)millis);
         } else {
-            snprintf(buffer, 16, "%d.%03d", seconds, millis);
+            snprintf(buffer, 16, "%u.%03u", (unsigned int)seconds, (unsigned int)millis);
         }
     }
 
 public:
-    SectorDisplay(Diablo_Serial_4DLib* disp)
+    SectorDisplay(Screen* disp)
         : display(disp)
-        , startX(20)
-        , startY(120)
-        , width(240)
-        , height(240)
         , theoreticalBest(0)
     {
         // Initialize sector times
@@ -134,7 +107,7 @@ public:
 
     void draw() {
         // Draw background panel
-        display->gfx_RectangleFilled(startX, startY, startX + width, startY + height, BLACK);
+        display->fillRect(L::LEFT, L::TOP, RIGHT, L::TOP + L::HEIGHT, BLACK);
         
         // Draw sector labels
         for (int i = 0; i < 3; i++) {
@@ -145,6 +118,15 @@ public:
         drawTheoretical();
     }
 
+    // Forgets the times without drawing; draw() shows the placeholders
+    void reset() {
+        for (int i = 0; i < 3; i++) {
+            bestSectorTimes[i] = UINT32_MAX;
+            currentSectorTimes[i] = UINT32_MAX;
+        }
+        theoreticalBest = 0;
+    }
+
     void updateSector(uint8_t sector, uint32_t currentTime, uint32_t bestTime) {
         if (sector >= 3) return;
         
@@ -155,8 +137,11 @@ public:
         
         // Redraw the sector row
         drawSectorRow(sector);
-        
-        // Update theoretical best
-        updateTheoretical();
+    }
+
+    // Theoretical best comes from the stitched optimal lap
+    void updateTheoreticalBest(uint32_t timeMs) {
+        theoreticalBest = timeMs;
+        drawTheoretical();
     }
 };
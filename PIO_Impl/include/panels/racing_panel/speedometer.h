@@ -1,14 +1,21 @@
 #pragma once
 
-#include <Diablo_Serial_4DLib.h>
+#include <stdio.h>
 #include <math.h>
+#include "racing_layout.h"
 
+template<typename Screen>
 class Speedometer {
 private:
-    Diablo_Serial_4DLib* display;
-    uint16_t centerX;
-    uint16_t centerY;
-    uint16_t radius;
+    typedef RacingLayout<Screen> Layout;
+    typedef typename Layout::Speed L;
+    static_assert(racing_layout::fits(L::CENTER_X - L::RADIUS, L::CENTER_Y - L::RADIUS, L::CENTER_X + L::RADIUS,
+                                      L::CENTER_Y + L::RADIUS, Layout::WIDTH, Layout::HEIGHT),
+                  "Speedometer off screen");
+    static_assert(L::VALUE_HALF_WIDTH < L::RADIUS && L::VALUE_HALF_HEIGHT < L::RADIUS,
+                  "Speed readout outside the dial");
+
+    Screen* display;
     int32_t lastSpeed;
     int lastIndicatorX;
     int lastIndicatorY;
@@ -30,29 +37,26 @@ private:
             float angle1 = startAngle + (i * angleStep);
             float angle2 = angle1 + angleStep;
             
-            int x1 = centerX + radius * cos(angle1);
-            int y1 = centerY + radius * sin(angle1);
-            int x2 = centerX + radius * cos(angle2);
-            int y2 = centerY + radius * sin(angle2);
+            int x1 = L::CENTER_X + L::RADIUS * cos(angle1);
+            int y1 = L::CENTER_Y + L::RADIUS * sin(angle1);
+            int x2 = L::CENTER_X + L::RADIUS * cos(angle2);
+            int y2 = L::CENTER_Y + L::RADIUS * sin(angle2);
             
-            display->gfx_Line(x1, y1, x2, y2, DARK_GRAY);
+            display->line(x1, y1, x2, y2, DARK_GRAY);
         }
 
         // Draw speed markers
         for (int speed = 0; speed <= 100; speed += 20) {
             float angle = startAngle + (speed / 100.0f) * (endAngle - startAngle);
-            int markerX = centerX + (radius - 10) * cos(angle);
-            int markerY = centerY + (radius - 10) * sin(angle);
+            int markerX = L::CENTER_X + (L::RADIUS - L::MARKER_INSET) * cos(angle);
+            int markerY = L::CENTER_Y + (L::RADIUS - L::MARKER_INSET) * sin(angle);
             
-            display->gfx_Circle(markerX, markerY, 2, WHITE);
+            display->circle(markerX, markerY, 2, WHITE);
             
             // Draw speed text
             char speedText[4];
             snprintf(speedText, sizeof(speedText), "%d", speed);
-            display->txt_Width(1);
-            display->txt_Height(1);
-            display->gfx_MoveTo(markerX - 8, markerY - 8);
-            display->putStr(speedText);
+            display->text(markerX - L::MARKER_LABEL, markerY - L::MARKER_LABEL, 1, WHITE, speedText);
         }
     }
 
@@ -67,14 +71,14 @@ private:
         float speedAngle = startAngle + (speed / 100.0f) * (endAngle - startAngle);
         
         // Clear previous indicator area
-        display->gfx_CircleFilled(lastIndicatorX, lastIndicatorY, 5, BLACK);
+        display->fillCircle(lastIndicatorX, lastIndicatorY, L::INDICATOR_RADIUS, BLACK);
         
         // Calculate new indicator position
-        int indicatorX = centerX + (radius - 20) * cos(speedAngle);
-        int indicatorY = centerY + (radius - 20) * sin(speedAngle);
+        int indicatorX = L::CENTER_X + (L::RADIUS - L::INDICATOR_INSET) * cos(speedAngle);
+        int indicatorY = L::CENTER_Y + (L::RADIUS - L::INDICATOR_INSET) * sin(speedAngle);
         
         // Draw new indicator
-        display->gfx_CircleFilled(indicatorX, indicatorY, 5, GREEN);
+        display->fillCircle(indicatorX, indicatorY, L::INDICATOR_RADIUS, GREEN);
         
         // Store position for next update
         lastIndicatorX = indicatorX;
@@ -82,49 +86,49 @@ private:
     }
 
 public:
-    Speedometer(Diablo_Serial_4DLib* disp)
+    Speedometer(Screen* disp)
         : display(disp)
-        , centerX(200)
-        , centerY(240)
-        , radius(120)
         , lastSpeed(0)
         , lastIndicatorX(0)
         , lastIndicatorY(0)
     {}
 
     void draw() {
-        drawArc();
+        drawLayout();
         updateSpeed(0);
     }
 
+    // Scale and markers only
+    void drawLayout() {
+        drawArc();
+    }
+
+    // The next updateSpeed() draws even an unchanged speed
+    void invalidate() {
+        lastSpeed = INT32_MIN;
+    }
+
     void updateSpeed(int32_t speedKph) {
         if (speedKph == lastSpeed) {
             return;
         }
 
         // Clear previous text area
-        display->gfx_RectangleFilled(centerX - 50, centerY - 20,
-                                   centerX + 50, centerY + 20,
-                                   BLACK);
+        display->fillRect(L::CENTER_X - L::VALUE_HALF_WIDTH, L::CENTER_Y - L::VALUE_HALF_HEIGHT,
+                          L::CENTER_X + L::VALUE_HALF_WIDTH, L::CENTER_Y + L::VALUE_HALF_HEIGHT,
+                          BLACK);
 
         // Draw new speed
-        char speedText[8];
-        snprintf(speedText, sizeof(speedText), "%d", speedKph);
-        
-        display->txt_Width(3);
-        display->txt_Height(3);
-        display->txt_FGcolour(WHITE);
+        char speedText[12];
+        snprintf(speedText, sizeof(speedText), "%d", (int)speedKph);
+        racing_layout::clip<Layout>(speedText, 2 * L::VALUE_HALF_WIDTH, L::VALUE_SCALE);
         
         // Center text
-        uint16_t textWidth = strlen(speedText) * 18;  // Approximate width
-        display->gfx_MoveTo(centerX - (textWidth/2), centerY - 15);
-        display->putStr(speedText);
+        uint16_t textWidth = strlen(speedText) * Layout::GLYPH_WIDTH * L::VALUE_SCALE;  // Approximate width
+        display->text(L::CENTER_X - (textWidth/2), L::CENTER_Y + L::VALUE_Y, L::VALUE_SCALE, WHITE, speedText);
         
         // Draw "km/h" below
-        display->txt_Width(1);
-        display->txt_Height(1);
-        display->gfx_MoveTo(centerX - 15, centerY + 10);
-        display->putStr("km/h");
+        display->text(L::CENTER_X + L::UNIT_X, L::CENTER_Y + L::UNIT_Y, 1, WHITE, "km/h");
 
         // Update arc indicator
         updateArcIndicator(speedKph);
@@ -1,12 +1,19 @@
 #pragma once
 
-#include <Diablo_Serial_4DLib.h>
+#include <stdio.h>
+#include "racing_layout.h"
 
+template<typename Screen>
 class StatusBar {
 private:
-    Diablo_Serial_4DLib* display;
-    uint16_t startY;
-    uint16_t height;
+    typedef RacingLayout<Screen> Layout;
+    typedef typename Layout::Status L;
+    static_assert(racing_layout::fits(0, L::TOP, Layout::WIDTH, L::TOP + L::HEIGHT, Layout::WIDTH, Layout::HEIGHT),
+                  "Status bar off screen");
+    static_assert(L::GPS_RIGHT < L::RBM_LEFT && L::RBM_RIGHT < L::STINT_LEFT && L::STINT_RIGHT <= Layout::WIDTH,
+                  "Status bar fields overlap");
+
+    Screen* display;
     bool gpsValid;
     uint8_t satelliteCount;
     bool rbmConnected;
@@ -17,11 +24,16 @@ private:
     static constexpr uint16_t GREEN = 0x07E0;
     static constexpr uint16_t DARK_GRAY = 0x4208;
 
+    // One field: clear its area, then the text at its left, cut at its right
+    void drawField(uint16_t left, uint16_t right, uint16_t textX, uint16_t color, char* text) {
+        display->fillRect(left, L::TOP + L::INSET, right, L::TOP + L::HEIGHT - L::INSET, DARK_GRAY);
+        racing_layout::clip<Layout>(text, right - textX, L::TEXT_SCALE);
+        display->text(textX, L::TOP + L::TEXT_Y, L::TEXT_SCALE, color, text);
+    }
+
 public:
-    StatusBar(Diablo_Serial_4DLib* disp)
+    StatusBar(Screen* disp)
         : display(disp)
-        , startY(440)  // Bottom of screen
-        , height(40)   // Status bar height
         , gpsValid(false)
         , satelliteCount(0)
         , rbmConnected(false)
@@ -29,7 +41,7 @@ public:
 
     void draw() {
         // Draw background
-        display->gfx_RectangleFilled(0, startY, 480, startY + height, DARK_GRAY);
+        display->fillRect(0, L::TOP, Layout::WIDTH, L::TOP + L::HEIGHT, DARK_GRAY);
         
         // Draw initial status
         updateGPSStatus(gpsValid, satelliteCount);
@@ -41,53 +53,23 @@ public:
         gpsValid = valid;
         satelliteCount = satCount;
         
-        // Clear GPS status area
-        display->gfx_RectangleFilled(10, startY + 5, 160, startY + height - 5, DARK_GRAY);
-        
-        // Draw GPS status
-        display->txt_Width(1);
-        display->txt_Height(1);
-        display->txt_FGcolour(valid ? GREEN : RED);
-        
         char status[32];
         snprintf(status, sizeof(status), "GPS: %s | Sats: %d", 
                 valid ? "Yes" : "No", satCount);
-        
-        display->gfx_MoveTo(20, startY + 12);
-        display->putStr(status);
+        drawField(L::GPS_LEFT, L::GPS_RIGHT, L::GPS_TEXT_X, valid ? GREEN : RED, status);
     }
 
     void updateRBMStatus(bool connected) {
         rbmConnected = connected;
         
-        // Clear RBM status area
-        display->gfx_RectangleFilled(170, startY + 5, 320, startY + height - 5, DARK_GRAY);
-        
-        // Draw RBM status
-        display->txt_Width(1);
-        display->txt_Height(1);
-        display->txt_FGcolour(connected ? GREEN : RED);
-        
         char status[32];
         snprintf(status, sizeof(status), "RBM: %s", connected ? "Connected" : "Disconnected");
-        
-        display->gfx_MoveTo(180, startY + 12);
-        display->putStr(status);
+        drawField(L::RBM_LEFT, L::RBM_RIGHT, L::RBM_TEXT_X, connected ? GREEN : RED, status);
     }
 
     void updateStintTimer(const char* time) {
-        // Clear stint timer area
-        display->gfx_RectangleFilled(330, startY + 5, 470, startY + height - 5, DARK_GRAY);
-        
-        // Draw stint time
-        display->txt_Width(1);
-        display->txt_Height(1);
-        display->txt_FGcolour(WHITE);
-        
         char status[32];
         snprintf(status, sizeof(status), "Stint: %s", time);
-        
-        display->gfx_MoveTo(340, startY + 12);
-        display->putStr(status);
+        drawField(L::STINT_LEFT, L::STINT_RIGHT, L::STINT_TEXT_X, WHITE, status);
     }
 };
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdio.h>
+#include "panels/panel.h"
+#include "util/latency_trace.h"
+#include "util/triple_buffer.h"
+
+/**
+ * Raw position, fix and acceleration, for checking the sensors before a
+ * session. update() is the compute side and publishes the values through a
+ * triple buffer, like RacingPanel, so the loop never waits on the display.
+ *
+ * Screen is the display driver; the page uses its text() and fillRect()
+ * at scale 1, which fits any of the screens.
+ */
+template<typename Screen>
+class SensorPanel : public Panel {
+private:
+    static constexpr uint16_t BLACK = 0x0000;
+    static constexpr uint16_t WHITE = 0xFFFF;
+    static constexpr uint16_t LABEL_X = 10;
+    static constexpr uint16_t VALUE_X = 70;
+    static constexpr uint16_t VALUE_RIGHT = 200;
+    static constexpr uint16_t TOP = 10;
+    static constexpr uint16_t ROW_PITCH = 12;
+    static constexpr uint8_t ROWS = 5;
+
+    struct Values {
+        double latitude;
+        double longitude;
+        float accelX;
+        float accelY;
+        uint8_t satellites;
+        bool valid;
+        uint32_t sequence;     // GNSSData::sequence, for latency tracing
+    };
+
+    Screen* display;
+    TripleBuffer<Values> values;
+    bool stale;                // Render side: the layout was just drawn
+
+    void drawRow(uint8_t row, const char* text) {
+        uint16_t y = TOP + row * ROW_PITCH;
+        display->fillRect(VALUE_X, y, VALUE_RIGHT, y + ROW_PITCH - 2, BLACK);
+        display->text(VALUE_X, y, 1, WHITE, text);
+    }
+
+public:
+    explicit SensorPanel(Screen* disp)
+        : display(disp)
+        , values()
+        , stale(true)
+    {}
+
+    // Compute side
+    void update(double latitude, double longitude, bool valid, uint8_t satellites, float accelX, float accelY,
+                uint32_t sequence) {
+        Values& v = values.writeBuffer();
+        v.latitude = latitude;
+        v.longitude = longitude;
+        v.valid = valid;
+        v.satellites = satellites;
+        v.accelX = accelX;
+        v.accelY = accelY;
+        v.sequence = sequence;
+        values.publish();
+    }
+
+    // Panel, render side
+    const char* getName() const override { return "Sensors"; }
+
+    void drawLayout() override {
+        static const char* const labels[ROWS] = { "Lat:", "Lon:", "Fix:", "AccelX:", "AccelY:" };
+        for (uint8_t row = 0; row < ROWS; row++) {
+            display->text(LABEL_X, TOP + row * ROW_PITCH, 1, WHITE, labels[row]);
+        }
+    }
+
+    void invalidate() override {
+        stale = true;
+    }
+
+    void render() override {
+        if (!values.update() && !stale) {
+            return;
+        }
+        stale = false;
+        const Values& v = values.read();
+        char text[24];
+        snprintf(text, sizeof(text), "%.6f", v.latitude);
+        drawRow(0, text);
+        snprintf(text, sizeof(text), "%.6f", v.longitude);
+        drawRow(1, text);
+        snprintf(text, sizeof(text), "%s, %u sats", v.valid ? "yes" : "no", v.satellites);
+        drawRow(2, text);
+        snprintf(text, sizeof(text), "%.2f m/s2", v.accelX);
+        drawRow(3, text);
+        snprintf(text, sizeof(text), "%.2f m/s2", v.accelY);
+        drawRow(4, text);
+        LATENCY_MARK(v.sequence, LatencyStage::Displayed);
+    }
+};
@@ -1,18 +1,39 @@
 #pragma once
 
-#include <SparkFun_u-blox_GNSS_Arduino_Library.h>
 #include <Adafruit_LSM6DSOX.h>
 #include <Wire.h>
+#include "sensors/ubx_parser.h"
+#include "sensors/i2c_bus.h"
+#include "channels/channel_registry.h"
+#include "util/triple_buffer.h"
+#include "util/latency_trace.h"
+#include "util/log.h"
+#include "util/boot_timeline.h"
+
+// SAM-M10Q on UART1
+#define GNSS_UART_RX 38
+#define GNSS_UART_TX 39
+#define GNSS_BAUD_DEFAULT 38400   // Receiver default after power-up
+#define GNSS_BAUD 921600
+#define GNSS_RX_BUFFER 4096
+#define GNSS_REPLY_MS 100         // A running receiver answers within a few ms
+#define GNSS_SETUP_MS 3000        // Its power-up included
+
+#define IMU_ADDRESS 0x6A
+#define IMU_PERIOD_US 9615        // 104Hz output data rate
 
 struct GNSSData {
     double latitude;
     double longitude;
     double altitude;
     double speed;      // Ground speed in m/s
+    double heading;    // Course over ground in degrees
     uint8_t satellites;
     uint8_t fixType;
     bool isValid;
     uint32_t timestamp;
+    uint32_t sequence;        // Increments with every PVT message received
+    uint32_t receivedMicros;  // micros() when the PVT message was received
 };
 
 struct IMUData {
@@ -25,39 +46,61 @@ struct IMUData {
     uint32_t timestamp;
 };
 
+// From UBX-NAV-SAT, once per second
+struct SatelliteSummary {
+    uint8_t visible;
+    uint8_t used;
+    uint8_t meanCno;           // dBHz over the satellites used
+};
+
+// From UBX-TIM-TP: GPS time of the next time pulse
+struct TimePulse {
+    uint32_t towMs;
+    int32_t quantErrorPs;
+    uint32_t receivedMicros;
+};
+
+enum class GnssSetup : uint8_t {
+    Query,         // CFG-VALGET sent, waiting for the receiver's values
+    Configure,     // CFG-VALSET sent, waiting for its acknowledgement
+    Ready,
+    Failed
+};
+
+/**
+ * GNSS receiver and IMU.
+ *
+ * begin() brings the IMU up and only starts on the receiver: it asks for
+ * the receiver's configuration and returns. isGNSSDataAvailable() carries
+ * the exchange on while fixes are read, so the receiver's power-up and
+ * replies overlap the rest of the boot instead of being waited for. The
+ * configuration is written only when what the receiver reports differs,
+ * and it goes to battery-backed RAM as well, so with a backup supply the
+ * next boot finds it in place and writes nothing.
+ */
 class SensorManager {
 public:
-    SensorManager() : gnss(), imu() {}
+    SensorManager() : imu(), bus(Wire), imuChannels(nullptr), imuFirstChannel(0), pvtSequence(0),
+                      pvtReceivedMicros(0), newPvt(false), configAck(0), configMatch(0), gnssSetup(GnssSetup::Query),
+                      gnssStartMs(0), gnssSentMs(0), satellites(), timePulse() {
+        fix = GNSSData();
+        parser.setHandler(onUbx, this);
+    }
 
+    // False if the IMU failed; the receiver's setup finishes later
     bool begin() {
         Wire.begin();
-        
-        // Initialize GNSS
-        if (!gnss.begin(Wire)) {
-            Serial.println("Failed to initialize GNSS!");
-            return false;
-        }
 
-        // Configure GNSS settings
-        gnss.setI2COutput(COM_TYPE_UBX);  // Set the I2C port to output UBX only
-        gnss.saveConfigSelective(VAL_CFG_SUBSEC_IOPORT); // Save the communications port settings
-        
-        // Configure GNSS update rate to 25Hz
-        if (!gnss.setNavigationFrequency(25)) {
-            Serial.println("Warning: Failed to set GNSS rate to 25Hz!");
-            return false;
-        }
-        
-        // Verify the navigation rate was set correctly
-        uint8_t rate = gnss.getNavigationFrequency();
-        if (rate != 25) {
-            Serial.printf("Warning: GNSS rate is %dHz instead of 25Hz\n", rate);
-            return false;
-        }
+        // The receiver first: it answers while the IMU starts. After a
+        // warm restart it may already run at GNSS_BAUD
+        Serial1.setRxBufferSize(GNSS_RX_BUFFER);
+        Serial1.begin(GNSS_BAUD, SERIAL_8N1, GNSS_UART_RX, GNSS_UART_TX);
+        gnssStartMs = millis();
+        queryGNSS();
         
         // Initialize IMU
         if (!imu.begin_I2C()) {
-            Serial.println("Failed to initialize IMU!");
+            LOG_ERROR("Failed to initialize IMU!");
             return false;
         }
 
@@ -72,60 +115,354 @@ public:
         imu.setAccelDataRate(LSM6DS_RATE_104_HZ);
         imu.setGyroDataRate(LSM6DS_RATE_104_HZ);
 
+        // From here on the bus task owns Wire; the IMU is read every
+        // output period in one burst from OUTX_L_G (gyro, then accel)
+        if (!bus.begin()) {
+            LOG_ERROR("Failed to start I2C bus task!");
+            return false;
+        }
+        BusTransaction read = {};
+        read.address = IMU_ADDRESS;
+        read.client = I2cBus::CLIENT_IMU;
+        read.priority = 0;
+        read.txLength = 1;
+        read.tx[0] = 0x22;
+        read.rx = imuRaw;
+        read.rxLength = sizeof(imuRaw);
+        read.done = onImuRead;
+        read.context = this;
+        bus.addPeriodic(read, IMU_PERIOD_US);
+
         return true;
     }
 
     GNSSData readGNSS() {
-        GNSSData data;
+        GNSSData data = fix;
         data.timestamp = millis();
-        
-        // Read position data
-        data.latitude = gnss.getLatitude() / 10000000.0; // Convert to degrees
-        data.longitude = gnss.getLongitude() / 10000000.0;
-        data.altitude = gnss.getAltitude() / 1000.0; // Convert to meters
-        
-        // Read speed
-        data.speed = gnss.getGroundSpeed() / 1000.0; // Convert to m/s
-        
-        // Read fix information
-        data.satellites = gnss.getSIV();
-        data.fixType = gnss.getFixType();
-        
-        // Check if we have a valid fix
-        data.isValid = (data.fixType == 3 && data.satellites >= 4);
+
+        LATENCY_MARK(data.sequence, LatencyStage::FixRead);
         
         return data;
     }
 
+    // Before begin(): also publish every IMU sample to the registry, as six
+    // channels from firstId on in IMUData order (accel x, y, z, gyro x, y, z)
+    void setImuChannels(ChannelRegistry* registry, uint8_t firstId) {
+        imuChannels = registry;
+        imuFirstChannel = firstId;
+    }
+
+    // Latest sample from the bus task
     IMUData readIMU() {
-        IMUData data;
-        data.timestamp = millis();
-        
-        sensors_event_t accel;
-        sensors_event_t gyro;
-        sensors_event_t temp;
-        
-        imu.getEvent(&accel, &gyro, &temp);
-        
-        // Store accelerometer data (in m/s²)
-        data.accelX = accel.acceleration.x;
-        data.accelY = accel.acceleration.y;
-        data.accelZ = accel.acceleration.z;
-        
-        // Store gyroscope data (in rad/s)
-        data.gyroX = gyro.gyro.x;
-        data.gyroY = gyro.gyro.y;
-        data.gyroZ = gyro.gyro.z;
-        
-        return data;
+        imuSamples.update();
+        return imuSamples.read();
     }
 
-    // Optional: Check if new GNSS data is available
+    // Parses whatever the UART has buffered and moves the receiver's setup
+    // on; true once a new PVT arrived
     bool isGNSSDataAvailable() {
-        return gnss.getPVT();
+        pollGNSS();
+        serviceGNSS();
+        if (!newPvt) {
+            return false;
+        }
+        newPvt = false;
+        return true;
     }
 
+    bool isGNSSReady() const { return gnssSetup == GnssSetup::Ready; }
+    bool hasGNSSFailed() const { return gnssSetup == GnssSetup::Failed; }
+    SatelliteSummary getSatellites() const { return satellites; }
+    TimePulse getTimePulse() const { return timePulse; }
+    const UbxParser::Stats& getGNSSStats() const { return parser.getStats(); }
+    BusScheduler& getBusScheduler() { return bus.getScheduler(); }
+
 private:
-    SFE_UBLOX_GNSS gnss;
     Adafruit_LSM6DSOX imu;
-};
\ No newline at end of file
+    I2cBus bus;
+    uint8_t imuRaw[12];
+    TripleBuffer<IMUData> imuSamples;
+    ChannelRegistry* imuChannels;     // Published to from the bus task
+    uint8_t imuFirstChannel;
+    UbxParser parser;
+    GNSSData fix;
+    uint32_t pvtSequence;
+    uint32_t pvtReceivedMicros;
+    bool newPvt;
+    int8_t configAck;          // 1 ACK, -1 NAK, 0 waiting
+    int8_t configMatch;        // 1 matches, -1 differs, 0 waiting
+    GnssSetup gnssSetup;
+    uint32_t gnssStartMs;
+    uint32_t gnssSentMs;       // Last request of the setup
+    SatelliteSummary satellites;
+    TimePulse timePulse;
+
+    // Runs on the bus task; ±4g is 0.122 mg/LSB, ±500dps 17.5 mdps/LSB
+    static void onImuRead(void* context, const BusTransaction& transaction, bool ok) {
+        if (!ok) return;
+        SensorManager* self = static_cast<SensorManager*>(context);
+        const uint8_t* raw = transaction.rx;
+        const float gyroScale = 0.0175f * DEG_TO_RAD;
+        const float accelScale = 0.000122f * 9.80665f;
+
+        IMUData& data = self->imuSamples.writeBuffer();
+        data.timestamp = millis();
+        data.gyroX = (int16_t)(raw[1] << 8 | raw[0]) * gyroScale;
+        data.gyroY = (int16_t)(raw[3] << 8 | raw[2]) * gyroScale;
+        data.gyroZ = (int16_t)(raw[5] << 8 | raw[4]) * gyroScale;
+        data.accelX = (int16_t)(raw[7] << 8 | raw[6]) * accelScale;
+        data.accelY = (int16_t)(raw[9] << 8 | raw[8]) * accelScale;
+        data.accelZ = (int16_t)(raw[11] << 8 | raw[10]) * accelScale;
+        if (self->imuChannels) {
+            uint32_t now = micros();
+            const float values[6] = { data.accelX, data.accelY, data.accelZ, data.gyroX, data.gyroY, data.gyroZ };
+            for (uint8_t i = 0; i < 6; i++) {
+                self->imuChannels->publish(self->imuFirstChannel + i, now, values[i]);
+            }
+        }
+        self->imuSamples.publish();
+    }
+
+    // CFG-VALSET keys (u-blox M10 interface description)
+    static const uint32_t CFG_RATE_MEAS = 0x30210001;
+    static const uint32_t CFG_UART1_BAUDRATE = 0x40520001;
+    static const uint32_t CFG_UART1OUTPROT_UBX = 0x10740001;
+    static const uint32_t CFG_UART1OUTPROT_NMEA = 0x10740002;
+    static const uint32_t CFG_MSGOUT_NAV_PVT_UART1 = 0x20910007;
+    static const uint32_t CFG_MSGOUT_NAV_SAT_UART1 = 0x20910016;
+    static const uint32_t CFG_MSGOUT_TIM_TP_UART1 = 0x2091017E;
+
+    static const uint8_t LAYER_RAM = 0x01;
+    static const uint8_t LAYER_BBR = 0x02;
+
+    struct ConfigItem {
+        uint32_t key;
+        uint32_t value;
+    };
+
+    // UBX only at GNSS_BAUD, PVT every epoch at 25Hz, NAV-SAT and TIM-TP
+    // once a second
+    static const ConfigItem* gnssConfig(size_t* count) {
+        static const ConfigItem items[] = {
+            { CFG_UART1_BAUDRATE, GNSS_BAUD },
+            { CFG_UART1OUTPROT_UBX, 1 },
+            { CFG_UART1OUTPROT_NMEA, 0 },
+            { CFG_RATE_MEAS, 40 },
+            { CFG_MSGOUT_NAV_PVT_UART1, 1 },
+            { CFG_MSGOUT_NAV_SAT_UART1, 25 },
+            { CFG_MSGOUT_TIM_TP_UART1, 25 },
+        };
+        *count = sizeof(items) / sizeof(items[0]);
+        return items;
+    }
+
+    void pollGNSS() {
+        uint8_t chunk[256];
+        int available;
+        while ((available = Serial1.available()) > 0) {
+            size_t length = Serial1.read(chunk, (size_t)available < sizeof(chunk) ? available : sizeof(chunk));
+            parser.feed(chunk, length);
+        }
+    }
+
+    // Payloads are read in place; only the decoded fields are kept
+    static void onUbx(void* context, uint16_t message, const uint8_t* payload, uint16_t length) {
+        SensorManager* self = static_cast<SensorManager*>(context);
+        switch (message) {
+            case ubx::NAV_PVT:
+                if (length >= ubx::NavPvt::LENGTH) self->onPvt(ubx::NavPvt{ payload });
+                break;
+            case ubx::NAV_SAT:
+                if (length >= 8) self->onSat(ubx::NavSat{ payload, length });
+                break;
+            case ubx::TIM_TP:
+                if (length >= ubx::TimTp::LENGTH) self->onTimePulse(ubx::TimTp{ payload });
+                break;
+            case ubx::CFG_VALGET:
+                self->onValget(payload, length);
+                break;
+            case ubx::ACK_ACK:
+            case ubx::ACK_NAK:
+                // Acknowledges CFG-VALSET (0x06 0x8A); a refused CFG-VALGET
+                // (0x06 0x8B) asked for a key the receiver does not have
+                if (length >= 2 && payload[0] == 0x06 && payload[1] == 0x8A) {
+                    self->configAck = message == ubx::ACK_ACK ? 1 : -1;
+                } else if (length >= 2 && payload[0] == 0x06 && payload[1] == 0x8B && message == ubx::ACK_NAK) {
+                    self->configMatch = -1;
+                }
+                break;
+        }
+    }
+
+    void onPvt(const ubx::NavPvt& pvt) {
+        // Tag the fix so its latency can be followed through the pipeline
+        pvtSequence++;
+        pvtReceivedMicros = micros();
+        LATENCY_MARK_AT(pvtSequence, LatencyStage::FixReceived, pvtReceivedMicros);
+
+        fix.latitude = pvt.lat() / 10000000.0; // Convert to degrees
+        fix.longitude = pvt.lon() / 10000000.0;
+        fix.altitude = pvt.hMSL() / 1000.0; // Convert to meters
+        fix.speed = pvt.gSpeed() / 1000.0; // Convert to m/s
+        fix.heading = pvt.headMot() / 100000.0;
+        fix.satellites = pvt.numSV();
+        fix.fixType = pvt.fixType();
+        fix.isValid = (fix.fixType == 3 && fix.satellites >= 4);
+        fix.sequence = pvtSequence;
+        fix.receivedMicros = pvtReceivedMicros;
+        newPvt = true;
+    }
+
+    void onSat(const ubx::NavSat& sat) {
+        uint8_t count = sat.numSvs();
+        uint8_t used = 0;
+        uint32_t cno = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            if (sat.svUsed(i)) {
+                used++;
+                cno += sat.cno(i);
+            }
+        }
+        satellites.visible = count;
+        satellites.used = used;
+        satellites.meanCno = used ? cno / used : 0;
+    }
+
+    void onTimePulse(const ubx::TimTp& tp) {
+        timePulse.towMs = tp.towMS();
+        timePulse.quantErrorPs = tp.qErr();
+        timePulse.receivedMicros = micros();
+    }
+
+    // Appends a key and its value, sized by the key's storage bits
+    static size_t putValue(uint8_t* out, uint32_t key, uint32_t value) {
+        static const uint8_t sizes[] = { 0, 1, 1, 2, 4, 8, 0, 0 };
+        uint8_t size = sizes[(key >> 28) & 0x07];
+        for (int i = 0; i < 4; i++) out[i] = key >> (8 * i);
+        for (int i = 0; i < size; i++) out[4 + i] = i < 4 ? value >> (8 * i) : 0;
+        return 4 + size;
+    }
+
+    // Compares a CFG-VALGET reply with gnssConfig(); values are sized by
+    // their keys like in putValue()
+    void onValget(const uint8_t* payload, uint16_t length) {
+        static const uint8_t sizes[] = { 0, 1, 1, 2, 4, 8, 0, 0 };
+        size_t count;
+        const ConfigItem* items = gnssConfig(&count);
+        size_t matched = 0;
+        size_t offset = 4;
+        while (offset + 4 <= length) {
+            uint32_t key = ubx::u32(payload + offset);
+            uint8_t size = sizes[(key >> 28) & 0x07];
+            if (size == 0 || size > 4 || offset + 4 + size > length) {
+                break;
+            }
+            uint32_t value = 0;
+            for (uint8_t i = 0; i < size; i++) value |= (uint32_t)payload[offset + 4 + i] << (8 * i);
+            for (size_t i = 0; i < count; i++) {
+                if (items[i].key == key && items[i].value == value) matched++;
+            }
+            offset += 4 + size;
+        }
+        configMatch = matched == count ? 1 : -1;
+    }
+
+    // Asks for the configured keys as the receiver runs them
+    void queryGNSS() {
+        size_t count;
+        const ConfigItem* items = gnssConfig(&count);
+        uint8_t payload[4 + 4 * 8];
+        payload[0] = 0;     // Version
+        payload[1] = 0;     // RAM layer
+        payload[2] = payload[3] = 0;
+        for (size_t i = 0; i < count; i++) {
+            for (int b = 0; b < 4; b++) payload[4 + 4 * i + b] = items[i].key >> (8 * b);
+        }
+        uint8_t frame[sizeof(payload) + ubx::OVERHEAD];
+        size_t size = ubx::buildFrame(0x06, 0x8B, payload, 4 + 4 * count, frame);
+        configMatch = 0;
+        configAck = 0;
+        Serial1.write(frame, size);
+        gnssSetup = GnssSetup::Query;
+        gnssSentMs = millis();
+    }
+
+    // Sends CFG-VALSET to the given layers; the acknowledgement comes later
+    void sendValset(const ConfigItem* items, size_t count, uint8_t layers) {
+        uint8_t payload[4 + 8 * 8];
+        size_t length = 4;
+        payload[0] = 0;     // Version
+        payload[1] = layers;
+        payload[2] = payload[3] = 0;
+        for (size_t i = 0; i < count; i++) {
+            length += putValue(payload + length, items[i].key, items[i].value);
+        }
+
+        uint8_t frame[sizeof(payload) + ubx::OVERHEAD];
+        size_t size = ubx::buildFrame(0x06, 0x8A, payload, length, frame);
+        configAck = 0;
+        Serial1.write(frame, size);
+    }
+
+    // At the receiver's power-up rate: switch to GNSS_BAUD. The reply would
+    // come at the new rate, so there is none to wait for; the next query
+    // tells whether it took
+    void setGNSSBaud() {
+        const ConfigItem item = { CFG_UART1_BAUDRATE, GNSS_BAUD };
+        Serial1.updateBaudRate(GNSS_BAUD_DEFAULT);
+        sendValset(&item, 1, LAYER_RAM);
+        Serial1.flush();
+        Serial1.updateBaudRate(GNSS_BAUD);
+        parser.reset();
+    }
+
+    // One step of the receiver's setup, on replies and timeouts only. A
+    // receiver that is silent at GNSS_BAUD is either still powering up or
+    // at its default rate: it is told to switch and asked again, until
+    // GNSS_SETUP_MS have passed
+    void serviceGNSS() {
+        uint32_t now = millis();
+        switch (gnssSetup) {
+            case GnssSetup::Query:
+                if (configMatch > 0) {
+                    gnssSetup = GnssSetup::Ready;
+                    boot::mark("gnss kept");
+                } else if (configMatch < 0) {
+                    size_t count;
+                    const ConfigItem* items = gnssConfig(&count);
+                    sendValset(items, count, LAYER_RAM | LAYER_BBR);
+                    gnssSetup = GnssSetup::Configure;
+                    gnssSentMs = now;
+                } else if (now - gnssSentMs >= GNSS_REPLY_MS) {
+                    if (now - gnssStartMs >= GNSS_SETUP_MS) {
+                        failGNSS();
+                    } else {
+                        setGNSSBaud();
+                        queryGNSS();
+                    }
+                }
+                break;
+            case GnssSetup::Configure:
+                if (configAck > 0) {
+                    gnssSetup = GnssSetup::Ready;
+                    boot::mark("gnss configured");
+                } else if (configAck < 0) {
+                    failGNSS();
+                } else if (now - gnssSentMs >= GNSS_REPLY_MS) {
+                    if (now - gnssStartMs >= GNSS_SETUP_MS) {
+                        failGNSS();
+                    } else {
+                        queryGNSS();
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    void failGNSS() {
+        gnssSetup = GnssSetup::Failed;
+        LOG_ERROR("Failed to initialize GNSS!");
+    }
+};
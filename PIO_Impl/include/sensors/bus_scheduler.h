@@ -0,0 +1,207 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include "util/profiler.h"
+
+// One register-style transfer: write tx, then read rx with a repeated start
+struct BusTransaction {
+    uint8_t address;
+    uint8_t client;            // Index for per-client statistics
+    uint8_t priority;          // 0 is most urgent
+    uint8_t txLength;
+    uint8_t tx[6];
+    uint8_t* rx;
+    uint16_t rxLength;
+    uint32_t deadline;         // micros() by which it must have completed, 0 for none
+    void (*done)(void* context, const BusTransaction& transaction, bool ok);
+    void* context;
+    uint32_t released;         // Set by the scheduler; nominal time for periodic ones
+};
+
+// What the scheduler drives; the firmware wraps Wire, the host a mock
+class BusPort {
+public:
+    virtual ~BusPort() = default;
+    virtual bool transfer(uint8_t address, const uint8_t* tx, size_t txLength, uint8_t* rx, size_t rxLength) = 0;
+};
+
+/**
+ * Priority and deadline ordered transaction queue for one shared bus.
+ *
+ * Clients submit() one-off transactions or register periodic ones that
+ * release() queues every period with the next release as deadline.
+ * runNext() performs the most urgent pending transaction: lowest priority
+ * value first, earliest deadline within a priority, then submission order.
+ * A transfer is never preempted, so the worst wait of an urgent client is
+ * one transfer of the longest lower-priority transaction.
+ *
+ * submit() may be called from any task; release() and runNext() belong to
+ * the one task that owns the bus.
+ */
+class BusScheduler {
+public:
+    static const size_t QUEUE_SIZE = 16;
+    static const size_t MAX_CLIENTS = 4;
+    static const size_t MAX_PERIODIC = 4;
+
+    struct ClientStats {
+        uint32_t transactions;
+        uint32_t failures;
+        uint32_t deadlineMisses;
+        profiler::Histogram waitUs;   // Release to start of transfer
+    };
+
+    explicit BusScheduler(uint32_t (*clock)()) : clock(clock), count(0), periodicCount(0), sequence(0) {
+        resetStats();
+    }
+
+    bool submit(const BusTransaction& transaction) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return enqueue(transaction, clock());
+    }
+
+    // Runs template every periodUs, starting now
+    bool addPeriodic(const BusTransaction& transaction, uint32_t periodUs) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (periodicCount == MAX_PERIODIC) return false;
+        Periodic& p = periodic[periodicCount++];
+        p.transaction = transaction;
+        p.periodUs = periodUs;
+        p.nextRelease = clock();
+        p.queued = false;
+        return true;
+    }
+
+    // Queues periodic transactions that are due; returns microseconds
+    // until the next one is, for the owning task to sleep
+    uint32_t release() {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t now = clock();
+        uint32_t sleep = UINT32_MAX;
+        for (size_t i = 0; i < periodicCount; i++) {
+            Periodic& p = periodic[i];
+            int32_t until = (int32_t)(p.nextRelease - now);
+            if (until <= 0) {
+                // A job still queued from the last period is overrun, skip
+                if (!p.queued) {
+                    BusTransaction job = p.transaction;
+                    job.deadline = p.nextRelease + p.periodUs;
+                    p.queued = enqueue(job, p.nextRelease, &p);
+                }
+                p.nextRelease += p.periodUs;
+                if ((int32_t)(p.nextRelease - now) <= 0) {
+                    p.nextRelease = now + p.periodUs;   // Fell behind, do not burst
+                }
+                until = (int32_t)(p.nextRelease - now);
+            }
+            if ((uint32_t)until < sleep) sleep = until;
+        }
+        return sleep;
+    }
+
+    // Performs the most urgent transaction; false if none was pending
+    bool runNext(BusPort& port) {
+        Entry entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (count == 0) return false;
+            size_t best = 0;
+            for (size_t i = 1; i < count; i++) {
+                if (before(queue[i], queue[best])) best = i;
+            }
+            entry = queue[best];
+            queue[best] = queue[--count];
+        }
+
+        BusTransaction& t = entry.transaction;
+        uint32_t start = clock();
+        bool ok = port.transfer(t.address, t.tx, t.txLength, t.rx, t.rxLength);
+        uint32_t end = clock();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyUs += end - start;
+            ClientStats& s = stats[t.client < MAX_CLIENTS ? t.client : MAX_CLIENTS - 1];
+            s.transactions++;
+            s.waitUs.record(start - t.released);
+            if (!ok) s.failures++;
+            if (t.deadline && (int32_t)(end - t.deadline) > 0) s.deadlineMisses++;
+            if (entry.periodic) entry.periodic->queued = false;
+        }
+
+        if (t.done) {
+            t.done(t.context, t, ok);
+        }
+        return true;
+    }
+
+    void resetStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < MAX_CLIENTS; i++) {
+            stats[i].transactions = stats[i].failures = stats[i].deadlineMisses = 0;
+            stats[i].waitUs.reset();
+        }
+        busyUs = 0;
+        statsStart = clock();
+    }
+
+    // Copies are taken under the lock, the bus task keeps running
+    ClientStats getStats(uint8_t client) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats[client < MAX_CLIENTS ? client : MAX_CLIENTS - 1];
+    }
+
+    // Fraction of time since resetStats() the bus spent transferring
+    float utilization() {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t elapsed = clock() - statsStart;
+        return elapsed ? (float)busyUs / elapsed : 0.0f;
+    }
+
+private:
+    struct Periodic {
+        BusTransaction transaction;
+        uint32_t periodUs;
+        uint32_t nextRelease;
+        bool queued;
+    };
+
+    struct Entry {
+        BusTransaction transaction;
+        uint32_t order;
+        Periodic* periodic;
+    };
+
+    uint32_t (*clock)();
+    std::mutex mutex;
+    Entry queue[QUEUE_SIZE];
+    size_t count;
+    Periodic periodic[MAX_PERIODIC];
+    size_t periodicCount;
+    uint32_t sequence;
+    ClientStats stats[MAX_CLIENTS];
+    uint32_t busyUs;
+    uint32_t statsStart;
+
+    bool enqueue(const BusTransaction& transaction, uint32_t released, Periodic* source = nullptr) {
+        if (count == QUEUE_SIZE) return false;
+        Entry& e = queue[count++];
+        e.transaction = transaction;
+        e.transaction.released = released;
+        e.order = sequence++;
+        e.periodic = source;
+        return true;
+    }
+
+    static bool before(const Entry& a, const Entry& b) {
+        const BusTransaction& x = a.transaction;
+        const BusTransaction& y = b.transaction;
+        if (x.priority != y.priority) return x.priority < y.priority;
+        if (x.deadline && y.deadline && x.deadline != y.deadline) {
+            return (int32_t)(x.deadline - y.deadline) < 0;
+        }
+        if (!x.deadline != !y.deadline) return x.deadline != 0;
+        return (int32_t)(a.order - b.order) < 0;
+    }
+};
@@ -0,0 +1,93 @@
+#pragma once
+#include <Arduino.h>
+#include <Wire.h>
+#include "sensors/bus_scheduler.h"
+
+// Wire as a BusPort: write the register address, repeated start, read
+class WirePort : public BusPort {
+public:
+    explicit WirePort(TwoWire& wire) : wire(wire) {}
+
+    bool transfer(uint8_t address, const uint8_t* tx, size_t txLength, uint8_t* rx, size_t rxLength) override {
+        wire.beginTransmission(address);
+        wire.write(tx, txLength);
+        if (wire.endTransmission(rxLength == 0) != 0) {
+            return false;
+        }
+        if (rxLength == 0) {
+            return true;
+        }
+        if (wire.requestFrom(address, rxLength) != rxLength) {
+            return false;
+        }
+        for (size_t i = 0; i < rxLength; i++) {
+            rx[i] = wire.read();
+        }
+        return true;
+    }
+
+private:
+    TwoWire& wire;
+};
+
+/**
+ * Owner of the shared I2C bus.
+ *
+ * A task pinned next to the sensors performs all transfers through the
+ * BusScheduler, so clients queue work and get a completion callback
+ * instead of blocking each other on Wire. Callbacks run on the bus task
+ * and should only hand the data over.
+ */
+class I2cBus {
+public:
+    // Client indices for statistics
+    enum Client : uint8_t { CLIENT_IMU, CLIENT_OTHER };
+
+    I2cBus(TwoWire& wire) : wire(wire), port(wire), scheduler(micros), task(nullptr) {}
+
+    // Fast-mode plus; devices must be configured before begin() is called
+    // since their drivers still use Wire directly
+    bool begin(uint32_t clockHz = 1000000, BaseType_t core = 1) {
+        wire.setClock(clockHz);
+        scheduler.resetStats();
+        return xTaskCreatePinnedToCore(taskEntry, "i2c_bus", 3072, this, 3, &task, core) == pdPASS;
+    }
+
+    bool submit(const BusTransaction& transaction) {
+        if (!scheduler.submit(transaction)) {
+            return false;
+        }
+        if (task) xTaskNotifyGive(task);
+        return true;
+    }
+
+    bool addPeriodic(const BusTransaction& transaction, uint32_t periodUs) {
+        if (!scheduler.addPeriodic(transaction, periodUs)) {
+            return false;
+        }
+        if (task) xTaskNotifyGive(task);
+        return true;
+    }
+
+    BusScheduler& getScheduler() { return scheduler; }
+
+private:
+    TwoWire& wire;
+    WirePort port;
+    BusScheduler scheduler;
+    TaskHandle_t task;
+
+    static void taskEntry(void* param) {
+        I2cBus* bus = static_cast<I2cBus*>(param);
+        while (true) {
+            // Releases are checked between transfers so deadlines stay current
+            uint32_t sleepUs = bus->scheduler.release();
+            if (bus->scheduler.runNext(bus->port)) {
+                continue;
+            }
+            // Tick granularity; a periodic release can be up to a tick late
+            TickType_t ticks = sleepUs == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS((sleepUs + 999) / 1000);
+            ulTaskNotifyTake(pdTRUE, ticks);
+        }
+    }
+};
@@ -0,0 +1,259 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * Incremental UBX frame parser.
+ *
+ * feed() takes whatever contiguous bytes the UART delivered and scans them
+ * in place. A frame that lies entirely inside one chunk is checksummed and
+ * handed to its handler as a pointer into that chunk; only frames split
+ * across two chunks are assembled in a small internal buffer. Handlers
+ * read the fields they need straight from the payload through the view
+ * structs below and must not keep the pointer.
+ *
+ * A bad checksum or impossible length drops only the sync byte and the scan
+ * resumes right after it, so a corrupted frame never hides the good frames
+ * that follow it.
+ */
+namespace ubx {
+
+    static const uint8_t SYNC1 = 0xB5;
+    static const uint8_t SYNC2 = 0x62;
+    static const size_t HEADER = 6;          // Sync, class, id, length
+    static const size_t OVERHEAD = 8;        // Header plus checksum
+    static const size_t MAX_PAYLOAD = 1024;  // NAV-SAT with 84 satellites fits
+
+    enum MessageId : uint16_t {
+        NAV_PVT = 0x0107,
+        NAV_SAT = 0x0135,
+        TIM_TP = 0x0D01,
+        CFG_VALGET = 0x068B,
+        ACK_NAK = 0x0500,
+        ACK_ACK = 0x0501,
+    };
+
+    inline uint16_t messageId(uint8_t cls, uint8_t id) {
+        return (uint16_t)(cls << 8 | id);
+    }
+
+    // Little-endian field access, UBX payloads are not aligned
+    inline uint16_t u16(const uint8_t* p) { return (uint16_t)(p[0] | p[1] << 8); }
+    inline uint32_t u32(const uint8_t* p) { return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24; }
+    inline int32_t i32(const uint8_t* p) { return (int32_t)u32(p); }
+
+    // 8-bit Fletcher over class, id, length and payload
+    inline uint16_t checksum(const uint8_t* data, size_t length, uint16_t seed = 0) {
+        uint8_t a = seed & 0xFF;
+        uint8_t b = seed >> 8;
+        for (size_t i = 0; i < length; i++) {
+            a += data[i];
+            b += a;
+        }
+        return (uint16_t)(b << 8 | a);
+    }
+
+    // Writes a complete frame to out (length + OVERHEAD bytes), returns its size
+    inline size_t buildFrame(uint8_t cls, uint8_t id, const uint8_t* payload, uint16_t length, uint8_t* out) {
+        out[0] = SYNC1;
+        out[1] = SYNC2;
+        out[2] = cls;
+        out[3] = id;
+        out[4] = length & 0xFF;
+        out[5] = length >> 8;
+        if (length) {
+            memcpy(out + HEADER, payload, length);
+        }
+        uint16_t ck = checksum(out + 2, length + 4);
+        out[HEADER + length] = ck & 0xFF;
+        out[HEADER + length + 1] = ck >> 8;
+        return length + OVERHEAD;
+    }
+
+    // UBX-NAV-PVT, 92 bytes
+    struct NavPvt {
+        const uint8_t* p;
+        static const uint16_t LENGTH = 92;
+
+        uint32_t iTOW() const { return u32(p + 0); }
+        uint8_t fixType() const { return p[20]; }
+        bool gnssFixOk() const { return p[21] & 0x01; }
+        uint8_t numSV() const { return p[23]; }
+        int32_t lon() const { return i32(p + 24); }      // 1e-7 deg
+        int32_t lat() const { return i32(p + 28); }      // 1e-7 deg
+        int32_t hMSL() const { return i32(p + 36); }     // mm
+        uint32_t hAcc() const { return u32(p + 40); }    // mm
+        int32_t gSpeed() const { return i32(p + 60); }   // mm/s
+        int32_t headMot() const { return i32(p + 64); }  // 1e-5 deg
+    };
+
+    // UBX-NAV-SAT, 8 bytes plus 12 per satellite
+    struct NavSat {
+        const uint8_t* p;
+        uint16_t length;
+
+        uint32_t iTOW() const { return u32(p + 0); }
+        uint8_t numSvs() const {
+            uint8_t n = p[5];
+            return (size_t)8 + n * 12 <= length ? n : (uint8_t)((length - 8) / 12);
+        }
+        uint8_t cno(uint8_t i) const { return p[8 + i * 12 + 2]; }           // dBHz
+        bool svUsed(uint8_t i) const { return u32(p + 8 + i * 12 + 8) & 0x08; }
+    };
+
+    // UBX-TIM-TP, 16 bytes: time of the next time pulse
+    struct TimTp {
+        const uint8_t* p;
+        static const uint16_t LENGTH = 16;
+
+        uint32_t towMS() const { return u32(p + 0); }
+        uint32_t towSubMS() const { return u32(p + 4); }  // 2^-32 ms
+        int32_t qErr() const { return i32(p + 8); }        // ps
+        uint16_t week() const { return u16(p + 12); }
+    };
+
+}
+
+class UbxParser {
+public:
+    typedef void (*Handler)(void* context, uint16_t message, const uint8_t* payload, uint16_t length);
+
+    struct Stats {
+        uint32_t bytes;
+        uint32_t frames;
+        uint32_t checksumErrors;
+        uint32_t oversized;       // Length field beyond MAX_PAYLOAD
+        uint32_t assembled;       // Frames that straddled two feed() calls
+    };
+
+    UbxParser() : handler(nullptr), context(nullptr), pending(0) {
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    // Called for every frame with a valid checksum
+    void setHandler(Handler callback, void* target) {
+        handler = callback;
+        context = target;
+    }
+
+    void feed(const uint8_t* data, size_t length) {
+        stats.bytes += length;
+        while (pending && length) {
+            size_t used = continueFrame(data, length);
+            data += used;
+            length -= used;
+        }
+        scan(data, length);
+    }
+
+    void reset() {
+        pending = 0;
+    }
+
+    const Stats& getStats() const { return stats; }
+
+private:
+    Handler handler;
+    void* context;
+    Stats stats;
+
+    uint8_t frame[ubx::MAX_PAYLOAD + ubx::OVERHEAD];   // Frame split across feed() calls
+    size_t pending;                                     // Bytes of it held so far
+    uint8_t rescan[ubx::MAX_PAYLOAD + ubx::OVERHEAD];
+
+    // Total frame size once the header is known, 0 if the header is invalid
+    static size_t frameSize(const uint8_t* header) {
+        if (header[1] != ubx::SYNC2) return 0;
+        size_t payload = ubx::u16(header + 4);
+        return payload <= ubx::MAX_PAYLOAD ? payload + ubx::OVERHEAD : 0;
+    }
+
+    // Checksums and dispatches a complete frame in place
+    bool deliver(const uint8_t* f, size_t size) {
+        size_t payload = size - ubx::OVERHEAD;
+        uint16_t ck = ubx::checksum(f + 2, payload + 4);
+        if (f[size - 2] != (ck & 0xFF) || f[size - 1] != (ck >> 8)) {
+            stats.checksumErrors++;
+            return false;
+        }
+        stats.frames++;
+        if (handler) {
+            handler(context, ubx::messageId(f[2], f[3]), f + ubx::HEADER, (uint16_t)payload);
+        }
+        return true;
+    }
+
+    void scan(const uint8_t* data, size_t length) {
+        const uint8_t* end = data + length;
+        while (data < end) {
+            const uint8_t* sync = (const uint8_t*)memchr(data, ubx::SYNC1, end - data);
+            if (!sync) {
+                return;
+            }
+            size_t available = end - sync;
+            if (available < ubx::HEADER) {
+                // Header not complete yet; the sync byte check waits too
+                if (available < 2 || sync[1] == ubx::SYNC2) {
+                    memcpy(frame, sync, available);
+                    pending = available;
+                    return;
+                }
+                data = sync + 1;
+                continue;
+            }
+
+            size_t size = frameSize(sync);
+            if (size == 0) {
+                if (sync[1] == ubx::SYNC2) stats.oversized++;
+                data = sync + 1;
+                continue;
+            }
+            if (available < size) {
+                memcpy(frame, sync, available);
+                pending = available;
+                return;
+            }
+            data = deliver(sync, size) ? sync + size : sync + 1;
+        }
+    }
+
+    // Adds bytes to the held partial frame, returns how many were used
+    size_t continueFrame(const uint8_t* data, size_t length) {
+        size_t used = 0;
+        if (pending < ubx::HEADER) {
+            used = ubx::HEADER - pending < length ? ubx::HEADER - pending : length;
+            memcpy(frame + pending, data, used);
+            pending += used;
+            if (pending < 2 || (pending < ubx::HEADER && frame[1] == ubx::SYNC2)) {
+                return used;
+            }
+        }
+
+        size_t size = pending >= ubx::HEADER ? frameSize(frame) : 0;
+        if (size) {
+            size_t take = size - pending < length - used ? size - pending : length - used;
+            memcpy(frame + pending, data + used, take);
+            pending += take;
+            used += take;
+            if (pending < size) {
+                return used;
+            }
+            stats.assembled++;
+            if (deliver(frame, size)) {
+                pending = 0;
+                return used;
+            }
+        } else if (pending >= ubx::HEADER && frame[1] == ubx::SYNC2) {
+            stats.oversized++;
+        }
+
+        // Not a frame: everything after its sync byte is scanned again,
+        // which may leave a new partial frame pending
+        size_t held = pending;
+        pending = 0;
+        memcpy(rescan, frame + 1, held - 1);
+        scan(rescan, held - 1);
+        return used;
+    }
+};
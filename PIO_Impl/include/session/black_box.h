@@ -0,0 +1,108 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "channels/channel_registry.h"
+#include "session/session_recorder.h"
+
+/**
+ * Keeps the last minutes of every registry channel at its full stored rate
+ * and every GNSS fix in PSRAM, and writes the window around an incident to
+ * the session being recorded.
+ *
+ * Samples are encoded as they arrive, with the session log's compact
+ * encoding, into fixed segments of a ring: each segment is a complete
+ * CHUNK_BURST payload but for its header, so a capture is written without
+ * copying. At about 5 KB/s for the logger's channels, 1 MB holds three
+ * minutes.
+ *
+ * A trigger (a g threshold on two accelerometer channels, a button, a lap)
+ * freezes the segments from preUs before it; the ring keeps recording
+ * around them, and flush() writes them one per call, up to postUs after
+ * the trigger, through the SessionRecorder. Should the ring catch up with
+ * a capture that is not written yet, new samples are dropped instead.
+ *
+ * Bursts use the session chunk's channel table, so the session should log
+ * every channel, if only at a low rate. Triggers while no session is
+ * recorded are refused, and a session ending cuts its capture short.
+ */
+class BlackBox {
+public:
+    static const size_t SEGMENT_SIZE = 1024;     // A burst chunk, header included
+    static const size_t MAX_CHANNELS = ChannelRegistry::MAX_CHANNELS;
+
+    BlackBox(const ChannelRegistry& registry, SessionRecorder& recorder);
+    ~BlackBox();
+
+    // After the registry's channels are added; bytes of PSRAM for the ring
+    bool begin(size_t bytes, uint32_t preUs, uint32_t postUs);
+
+    // Triggers on the horizontal acceleration from two channels in m/s^2;
+    // rearms once it falls below 80% of the threshold
+    void setGTrigger(uint8_t xChannel, uint8_t yChannel, float thresholdG);
+
+    // speed in m/s, heading in degrees
+    void addFix(uint32_t timeUs, double latitude, double longitude, double speed, double heading);
+
+    // Drains the channels into the ring and checks the g trigger
+    void poll(uint32_t nowUs);
+
+    // Freezes the window around nowUs; false while a capture is running or
+    // no session is recorded
+    bool trigger(logfmt::BurstTrigger reason, uint32_t nowUs);
+
+    // Writes one segment of the capture; true if it wrote one
+    bool flush(uint32_t nowUs);
+
+    bool isCapturing() const { return capturing; }
+    uint32_t getHeldUs() const;
+    uint32_t getCaptures() const { return captures; }
+    uint32_t getDropped() const { return dropped; }
+
+private:
+    struct Segment {
+        uint32_t startUs;
+        uint32_t endUs;       // Newest sample
+        uint16_t length;      // Payload bytes after the burst header
+        uint8_t data[SEGMENT_SIZE];
+    };
+
+    struct Source {
+        ChannelReader reader;
+        float scale;          // 1 / resolution
+    };
+
+    const ChannelRegistry& registry;
+    SessionRecorder& recorder;
+    Segment* segments;        // In PSRAM
+    uint32_t segmentCount;
+    uint32_t tail;            // Oldest complete segment
+    uint32_t complete;        // Complete segments from tail on
+    uint32_t head;            // Segment being filled, after them
+    uint32_t headSamples;
+    logfmt::SampleEncoder encoder;
+    Source sources[MAX_CHANNELS];
+    size_t sourceCount;
+    uint32_t preUs;
+    uint32_t postUs;
+
+    uint8_t gX;
+    uint8_t gY;
+    float gThreshold;         // (m/s^2)^2, 0 disabled
+    float lastX;
+    float lastY;
+    bool gArmed;
+
+    bool capturing;
+    uint32_t flushNext;       // Next segment of the capture to write
+    logfmt::BurstTrigger reason;
+    uint32_t triggerUs;
+    uint16_t capture;
+
+    uint32_t captures;
+    uint32_t dropped;         // Samples lost to a ring full of unwritten capture
+
+    void add(uint8_t channel, uint32_t timeUs, int32_t value);
+    void checkG(uint8_t channel, uint32_t timeUs, float value);
+    void startSegment(uint32_t nowUs);
+    void closeSegment(uint32_t nowUs);
+};
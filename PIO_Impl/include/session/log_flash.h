@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Raw NOR flash as seen by the session log: bytes are read and written
+ * anywhere, but a write can only clear bits, so a sector is erased back to
+ * 0xFF before it is written again. On the device this is a partition; the
+ * host tools use a RAM image that counts erases.
+ */
+class LogFlash {
+public:
+    static const uint32_t SECTOR_SIZE = 4096;
+
+    virtual ~LogFlash() = default;
+
+    virtual uint32_t size() const = 0;
+    virtual bool read(uint32_t offset, void* data, size_t length) = 0;
+    virtual bool write(uint32_t offset, const void* data, size_t length) = 0;
+    // The sector starting at offset
+    virtual bool erase(uint32_t offset) = 0;
+};
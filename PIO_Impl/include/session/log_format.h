@@ -0,0 +1,271 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "session/log_flash.h"
+
+/**
+ * Session log stream format, shared by the recorder, the offload server
+ * and every tool that reads sessions.
+ *
+ * A session is a byte stream of BLOCK_SIZE blocks, one per flash sector
+ * (the sector header is not part of the stream). Blocks hold whole
+ * chunks; a chunk type of 0xFF, or less room than a chunk header, ends a
+ * block and the stream continues with the next one. Only the last block
+ * may be short.
+ *
+ * Chunk: [type u8][flags u8][payload length u16][CRC-32 of payload u32]
+ * followed by the payload. All integers are little endian.
+ *
+ *   CHUNK_SESSION  version u8, session id u32, track name (u8 length +
+ *                  bytes), channel count u8, then per channel: id u8, type
+ *                  u8, logged rate u16, resolution f32, name and unit as
+ *                  length-prefixed strings
+ *   CHUNK_SAMPLES  base time u32 (micros), then records until the end;
+ *                  covers at most MAX_CHUNK_SPAN_US from the base time
+ *   CHUNK_LAP      time u32 (micros), lap u16, lap time ms u32, flags u8
+ *   CHUNK_BURST    trigger u8, capture u16, trigger time u32 (micros), then
+ *                  a CHUNK_SAMPLES payload with every channel at its full
+ *                  rate: part of a black-box capture around an incident.
+ *                  A capture's parts share its number and are in order, but
+ *                  lie among later chunks of the session.
+ *
+ * Sample records start with a tag: a channel id below REC_FIX, followed by
+ * the time step and the value step (in the channel's resolution) from the
+ * channel's previous record in the chunk; or REC_FIX followed by steps of
+ * time, latitude and longitude (1e-7 deg), speed (mm/s) and heading
+ * (0.01 deg). Steps are zigzag varints, predictors start at the base time
+ * and zero in every chunk, so a chunk decodes on its own. Times are
+ * micros() and wrap after 71 minutes; readers unwrap them in order.
+ */
+namespace logfmt {
+
+    const uint8_t VERSION = 1;
+    const size_t MAX_TRACK_NAME = 32;    // MAX_TRACK_NAME_LENGTH, without Arduino.h
+
+    const uint32_t SECTOR_HEADER_SIZE = 32;
+    const uint32_t BLOCK_SIZE = LogFlash::SECTOR_SIZE - SECTOR_HEADER_SIZE;
+    const uint32_t CHUNK_HEADER_SIZE = 8;
+    const uint32_t MAX_CHUNK_PAYLOAD = BLOCK_SIZE - CHUNK_HEADER_SIZE;
+
+    enum ChunkType : uint8_t {
+        CHUNK_SESSION = 1,
+        CHUNK_SAMPLES = 2,
+        CHUNK_LAP = 3,
+        CHUNK_BURST = 4,
+        CHUNK_NONE = 0xFF    // Erased flash: end of the block
+    };
+
+    const uint32_t MAX_CHUNK_SPAN_US = 2000000;
+
+    const uint8_t REC_FIX = 0xF0;
+    const uint8_t LAP_BEST = 0x01;
+
+    const size_t BURST_HEADER_SIZE = 7;
+    enum BurstTrigger : uint8_t {
+        BURST_G_FORCE = 1,
+        BURST_BUTTON = 2,
+        BURST_LAP = 3
+    };
+
+    inline void putU16(uint8_t* p, uint16_t v) {
+        p[0] = v & 0xFF;
+        p[1] = v >> 8;
+    }
+
+    inline void putU32(uint8_t* p, uint32_t v) {
+        p[0] = v & 0xFF;
+        p[1] = (v >> 8) & 0xFF;
+        p[2] = (v >> 16) & 0xFF;
+        p[3] = v >> 24;
+    }
+
+    inline uint16_t getU16(const uint8_t* p) {
+        return p[0] | (p[1] << 8);
+    }
+
+    inline uint32_t getU32(const uint8_t* p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    inline uint32_t zigzag(int32_t v) {
+        return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+    }
+
+    inline int32_t unzigzag(uint32_t v) {
+        return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+    }
+
+    // At most 5 bytes
+    inline size_t putVarint(uint8_t* p, uint32_t v) {
+        size_t n = 0;
+        while (v >= 0x80) {
+            p[n++] = (uint8_t)(v | 0x80);
+            v >>= 7;
+        }
+        p[n++] = (uint8_t)v;
+        return n;
+    }
+
+    // Returns the bytes used, 0 if the varint runs past end
+    inline size_t getVarint(const uint8_t* p, const uint8_t* end, uint32_t* v) {
+        uint32_t result = 0;
+        for (size_t n = 0; n < 5 && p + n < end; n++) {
+            result |= (uint32_t)(p[n] & 0x7F) << (7 * n);
+            if (!(p[n] & 0x80)) {
+                *v = result;
+                return n + 1;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Builds a CHUNK_SAMPLES payload in a caller's buffer. A typical
+     * channel sample takes 3 to 5 bytes, a GNSS fix about 12.
+     */
+    class SampleEncoder {
+    public:
+        static const size_t MAX_CHANNEL_RECORD = 11;
+        static const size_t MAX_FIX_RECORD = 26;
+
+        SampleEncoder() : buffer(nullptr), capacity(0), length(0), baseUs(0) {}
+
+        void begin(uint8_t* out, size_t size, uint32_t timeUs) {
+            buffer = out;
+            capacity = size;
+            baseUs = timeUs;
+            putU32(buffer, baseUs);
+            length = 4;
+            for (int i = 0; i < 256; i++) {
+                lastTime[i] = baseUs;
+                lastValue[i] = 0;
+            }
+            memset(lastFix, 0, sizeof(lastFix));
+            lastFixTime = baseUs;
+        }
+
+        // False when the chunk is full; begin() a new one and add again
+        bool addSample(uint8_t channel, uint32_t timeUs, int32_t value) {
+            if (channel >= REC_FIX || capacity - length < MAX_CHANNEL_RECORD) {
+                return false;
+            }
+            buffer[length++] = channel;
+            length += putVarint(buffer + length, zigzag((int32_t)(timeUs - lastTime[channel])));
+            length += putVarint(buffer + length, zigzag(value - lastValue[channel]));
+            lastTime[channel] = timeUs;
+            lastValue[channel] = value;
+            return true;
+        }
+
+        // latitude and longitude in 1e-7 deg, speed in mm/s, heading in 0.01 deg
+        bool addFix(uint32_t timeUs, int32_t latitude, int32_t longitude, int32_t speed, int32_t heading) {
+            if (capacity - length < MAX_FIX_RECORD) {
+                return false;
+            }
+            const int32_t fix[4] = { latitude, longitude, speed, heading };
+            buffer[length++] = REC_FIX;
+            length += putVarint(buffer + length, zigzag((int32_t)(timeUs - lastFixTime)));
+            for (int i = 0; i < 4; i++) {
+                length += putVarint(buffer + length, zigzag(fix[i] - lastFix[i]));
+                lastFix[i] = fix[i];
+            }
+            lastFixTime = timeUs;
+            return true;
+        }
+
+        size_t size() const { return length; }
+        bool isEmpty() const { return length <= 4; }
+        uint32_t getBaseUs() const { return baseUs; }
+
+    private:
+        uint8_t* buffer;
+        size_t capacity;
+        size_t length;
+        uint32_t baseUs;
+        uint32_t lastTime[256];
+        int32_t lastValue[256];
+        int32_t lastFix[4];
+        uint32_t lastFixTime;
+    };
+
+    // One decoded sample record; fix[] is set for REC_FIX, value otherwise
+    struct SampleRecord {
+        uint8_t channel;      // Channel id or REC_FIX
+        uint32_t timeUs;
+        int32_t value;        // In the channel's resolution
+        int32_t fix[4];       // latitude, longitude, speed, heading as in addFix()
+    };
+
+    // Reads back a CHUNK_SAMPLES payload written by SampleEncoder
+    class SampleDecoder {
+    public:
+        SampleDecoder() : p(nullptr), end(nullptr), baseUs(0) {}
+
+        bool begin(const uint8_t* payload, size_t length) {
+            if (length < 4) {
+                return false;
+            }
+            baseUs = getU32(payload);
+            p = payload + 4;
+            end = payload + length;
+            for (int i = 0; i < 256; i++) {
+                lastTime[i] = baseUs;
+                lastValue[i] = 0;
+            }
+            memset(lastFix, 0, sizeof(lastFix));
+            lastFixTime = baseUs;
+            return true;
+        }
+
+        // False at the end of the chunk or at a record cut short
+        bool next(SampleRecord* record) {
+            if (p >= end) {
+                return false;
+            }
+            uint8_t tag = *p++;
+            uint32_t step;
+            record->channel = tag;
+            if (tag == REC_FIX) {
+                if (!take(&step)) return false;
+                lastFixTime += unzigzag(step);
+                for (int i = 0; i < 4; i++) {
+                    if (!take(&step)) return false;
+                    lastFix[i] += unzigzag(step);
+                    record->fix[i] = lastFix[i];
+                }
+                record->timeUs = lastFixTime;
+                return true;
+            }
+            if (tag > REC_FIX || !take(&step)) {
+                return false;
+            }
+            lastTime[tag] += unzigzag(step);
+            if (!take(&step)) {
+                return false;
+            }
+            lastValue[tag] += unzigzag(step);
+            record->timeUs = lastTime[tag];
+            record->value = lastValue[tag];
+            return true;
+        }
+
+        uint32_t getBaseUs() const { return baseUs; }
+
+    private:
+        const uint8_t* p;
+        const uint8_t* end;
+        uint32_t baseUs;
+        uint32_t lastTime[256];
+        int32_t lastValue[256];
+        int32_t lastFix[4];
+        uint32_t lastFixTime;
+
+        bool take(uint32_t* v) {
+            size_t n = getVarint(p, end, v);
+            p += n;
+            return n > 0;
+        }
+    };
+
+}
@@ -0,0 +1,156 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "session/log_format.h"
+#include "util/crc.h"
+
+// Where a session's stream comes from: StoredSession on the device, a
+// downloaded file on the host
+class LogStreamSource {
+public:
+    virtual ~LogStreamSource() = default;
+    // Copies stream bytes from offset; returns how many, 0 past the end
+    virtual size_t read(uint32_t offset, uint8_t* data, size_t length) = 0;
+};
+
+// A channel as the session chunk describes it
+struct LogChannelInfo {
+    uint8_t id;
+    uint8_t type;             // ChannelType
+    uint16_t rateHz;          // Logged rate
+    float resolution;
+    char name[12];
+    char unit[8];
+};
+
+// The CHUNK_SESSION payload
+struct LogSessionHeader {
+    static const size_t MAX_CHANNELS = 16;
+
+    uint8_t version;
+    uint32_t id;
+    char track[logfmt::MAX_TRACK_NAME];
+    uint8_t channelCount;
+    LogChannelInfo channels[MAX_CHANNELS];
+
+    bool parse(const uint8_t* payload, size_t length) {
+        const uint8_t* p = payload;
+        const uint8_t* end = payload + length;
+        if (end - p < 5 || p[0] != logfmt::VERSION) {
+            return false;
+        }
+        version = p[0];
+        id = logfmt::getU32(p + 1);
+        p += 5;
+        if (!takeString(&p, end, track, sizeof(track)) || p >= end) {
+            return false;
+        }
+        channelCount = *p++;
+        if (channelCount > MAX_CHANNELS) {
+            return false;
+        }
+        for (uint8_t i = 0; i < channelCount; i++) {
+            LogChannelInfo& channel = channels[i];
+            if (end - p < 8) {
+                return false;
+            }
+            channel.id = p[0];
+            channel.type = p[1];
+            channel.rateHz = logfmt::getU16(p + 2);
+            memcpy(&channel.resolution, p + 4, 4);
+            p += 8;
+            if (!takeString(&p, end, channel.name, sizeof(channel.name)) ||
+                !takeString(&p, end, channel.unit, sizeof(channel.unit))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const LogChannelInfo* find(uint8_t channel) const {
+        for (uint8_t i = 0; i < channelCount; i++) {
+            if (channels[i].id == channel) {
+                return &channels[i];
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    static bool takeString(const uint8_t** p, const uint8_t* end, char* out, size_t size) {
+        if (*p >= end || (size_t)(end - *p) < 1u + **p) {
+            return false;
+        }
+        size_t length = **p;
+        size_t kept = length < size - 1 ? length : size - 1;
+        memcpy(out, *p + 1, kept);
+        out[kept] = '\0';
+        *p += 1 + length;
+        return true;
+    }
+};
+
+/**
+ * Walks a session stream one chunk at a time. Only the current chunk is in
+ * memory; chunks failing their CRC are counted and skipped, a damaged
+ * header skips the rest of its block.
+ */
+class ChunkReader {
+public:
+    explicit ChunkReader(LogStreamSource& source) : source(source), position(0), badChunks(0), length(0) {}
+
+    void rewind() {
+        position = 0;
+        badChunks = 0;
+    }
+
+    // Next intact chunk; false at the end of the stream. payload() stays
+    // valid until the next call.
+    bool next(uint8_t* type) {
+        using namespace logfmt;
+        while (true) {
+            uint32_t left = BLOCK_SIZE - position % BLOCK_SIZE;
+            uint8_t header[CHUNK_HEADER_SIZE];
+            if (left < CHUNK_HEADER_SIZE) {
+                position += left;
+                continue;
+            }
+            if (source.read(position, header, sizeof(header)) < sizeof(header)) {
+                return false;
+            }
+            if (header[0] == CHUNK_NONE) {
+                position += left;
+                continue;
+            }
+            length = getU16(header + 2);
+            if (length > left - CHUNK_HEADER_SIZE) {
+                badChunks++;
+                position += left;
+                continue;
+            }
+            if (source.read(position + CHUNK_HEADER_SIZE, buffer, length) < length) {
+                return false;
+            }
+            position += CHUNK_HEADER_SIZE + length;
+            if (crc::crc32(buffer, length) != getU32(header + 4)) {
+                badChunks++;
+                continue;
+            }
+            *type = header[0];
+            return true;
+        }
+    }
+
+    const uint8_t* payload() const { return buffer; }
+    size_t size() const { return length; }
+    uint32_t getPosition() const { return position; }
+    uint32_t getBadChunks() const { return badChunks; }
+
+private:
+    LogStreamSource& source;
+    uint32_t position;
+    uint32_t badChunks;
+    size_t length;
+    uint8_t buffer[logfmt::MAX_CHUNK_PAYLOAD];
+};
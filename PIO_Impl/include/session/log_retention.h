@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "session/session_log.h"
+
+struct RetentionPolicy {
+    uint32_t reserveSectors;    // Free sectors to keep ahead of the recorder; 0 for an eighth of the log
+    uint8_t keepFastestLaps;    // Per track; sessions holding one are compacted, not evicted
+    uint32_t wearSpread;        // Erases a stored session's sectors may lag the ring by
+
+    RetentionPolicy() : reserveSectors(0), keepFastestLaps(3), wearSpread(64) {}
+};
+
+/**
+ * Keeps room in the SessionLog so recording never runs out.
+ *
+ * When fewer than reserveSectors are free (twice that while not recording,
+ * to make room for the next session ahead), the oldest session goes unless
+ * it is starred or being recorded. A session holding one of its track's
+ * keepFastestLaps fastest laps is compacted instead: rewritten with only
+ * the samples of its timed laps, and kept after that.
+ *
+ * Sessions are not erased in place; the log's ring only reuses free
+ * sectors, so long-kept sessions leave sectors that are rarely erased.
+ * When idle, a session whose sectors lag the ring by more than wearSpread
+ * erases is moved, which gives its sectors back to the ring.
+ *
+ * Work comes in bounded steps: maintain() reads or copies at most one
+ * chunk, writes at most one flag word, and starts nothing the logger would
+ * wait for. Rewrites happen only while not recording; a recording that
+ * starts abandons one in progress, which begins again later.
+ */
+class LogRetention {
+public:
+    static const size_t MAX_FASTEST = 8;
+
+    explicit LogRetention(SessionLog& log, const RetentionPolicy& policy = RetentionPolicy());
+    ~LogRetention();
+
+    // One step of work; true if there was any
+    bool maintain();
+
+    bool isBusy() const { return job != nullptr; }
+    uint32_t getEvicted() const { return evicted; }
+    uint32_t getCompacted() const { return compacted; }
+    uint32_t getRelocated() const { return relocated; }
+
+private:
+    struct Entry {
+        uint32_t id;
+        char track[logfmt::MAX_TRACK_NAME];
+        uint32_t fastest[MAX_FASTEST];   // Lap times in ms, fastest first; 0 unused
+        bool scanned;
+        bool isProtected;                // Holds one of its track's fastest laps
+        bool stuck;                      // Compaction failed, leave it
+    };
+
+    enum class JobKind : uint8_t {
+        Scan,        // Collects lap times
+        Compact,
+        Relocate
+    };
+
+    struct Lap {
+        int64_t startUs;
+        int64_t endUs;
+    };
+
+    struct Job;
+
+    SessionLog& log;
+    RetentionPolicy policy;
+    std::vector<Entry> entries;       // As the log's directory, oldest first
+    bool ranked;
+    bool full;                        // Warned that nothing can be freed
+    Job* job;
+
+    uint32_t evicted;
+    uint32_t compacted;
+    uint32_t relocated;
+
+    void sync();
+    void rank();
+    Entry* lookup(uint32_t id);
+    bool relieve();
+    bool level();
+    void startJob(JobKind kind, uint32_t id);
+    bool stepJob();
+    void endJob();
+    void addLap(Entry& entry, uint32_t lapTimeMs);
+};
@@ -0,0 +1,141 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "session/session_log.h"
+#include "util/cobs.h"
+#include "util/byte_link.h"
+
+/**
+ * Bulk transfer of stored sessions to a host, tools/offload/offload.py.
+ *
+ * Packets are framed like telemetry, [type][tag][payload][CRC16] COBS
+ * encoded with a zero delimiter, but only flow while the "offload" command
+ * has handed the port over. The client drives everything:
+ *
+ *   LIST              one ENTRY per session (id, size, track), LIST_END
+ *   READ id off len w DATA packets of DATA_SIZE bytes from off, at most w
+ *                     unacknowledged; DONE when all of them are acked
+ *   ACK off           everything before off arrived intact
+ *   CRC id len        CRC-32 of the first len bytes of a session
+ *   BYE               hand the port back
+ *
+ * Responses echo the request's tag, so DATA of an abandoned READ is told
+ * apart. A frame that fails its CRC is simply missing to the client: it
+ * stops acknowledging, and after RETRY_MS without progress the server
+ * goes back to the last acknowledged offset (go-back-N). Resuming a
+ * broken transfer is a CRC of the part the client has, then a READ from
+ * its end.
+ *
+ * service() does a bounded amount of work per call and never waits on
+ * the link, so the caller decides how much of the loop it gets. The
+ * server stops by itself after IDLE_TIMEOUT_MS without a request.
+ */
+class OffloadServer {
+public:
+    enum PacketType : uint8_t {
+        REQ_LIST = 0x40,
+        REQ_READ = 0x41,
+        REQ_ACK = 0x42,
+        REQ_CRC = 0x43,
+        REQ_BYE = 0x44,
+        RSP_READY = 0x60,
+        RSP_ENTRY = 0x61,
+        RSP_LIST_END = 0x62,
+        RSP_DATA = 0x63,
+        RSP_DONE = 0x64,
+        RSP_CRC = 0x65,
+        RSP_ERROR = 0x6F
+    };
+
+    enum Error : uint8_t {
+        ERR_MALFORMED = 1,
+        ERR_NO_SESSION = 2,
+        ERR_RANGE = 3
+    };
+
+    static const uint8_t PROTOCOL_VERSION = 1;
+    static const size_t DATA_SIZE = 1024;
+    static const uint8_t MAX_WINDOW = 32;
+    static const uint32_t RETRY_MS = 500;
+    static const uint32_t IDLE_TIMEOUT_MS = 10000;
+    static const uint32_t CRC_STEP = 8192;    // Bytes checksummed per service()
+
+    // clock returns milliseconds
+    OffloadServer(SessionLog& log, ByteLink& link, uint32_t (*clock)());
+
+    // Takes over the link and announces itself with READY
+    void begin();
+    bool isActive() const { return active; }
+
+    // One step. False once the client said BYE or went silent.
+    bool service();
+
+    uint32_t getBytesSent() const { return bytesSent; }
+    uint32_t getRetransmits() const { return retransmits; }
+    uint32_t getBadFrames() const { return badFrames; }
+
+private:
+    static const size_t MAX_REQUEST = 32;
+    static const size_t MAX_PACKET = 2 + 4 + DATA_SIZE + 2;
+    static const size_t MAX_FRAME = cobs::maxEncodedSize(MAX_PACKET) + 1;
+
+    struct Transfer {
+        bool active;
+        uint8_t tag;
+        uint32_t id;
+        uint32_t end;
+        uint32_t next;        // Next offset to send
+        uint32_t acked;       // Client has everything before this
+        uint32_t window;      // Bytes in flight allowed
+        uint32_t lastProgressMs;
+    };
+
+    struct Checksum {
+        bool active;
+        uint8_t tag;
+        uint32_t id;
+        uint32_t length;
+        uint32_t done;
+        uint32_t crc;
+    };
+
+    SessionLog& log;
+    ByteLink& link;
+    uint32_t (*clock)();
+    bool active;
+    uint32_t lastRequestMs;
+
+    uint8_t rx[MAX_REQUEST];
+    size_t rxLength;
+    bool rxOverflow;
+
+    uint8_t packet[MAX_PACKET];
+    uint8_t tx[MAX_FRAME];
+    size_t txLength;
+    size_t txOffset;
+
+    // Responses wait here until the frame in tx is out
+    uint8_t controlType;
+    uint8_t controlTag;
+    uint8_t control[MAX_REQUEST + 8];
+    size_t controlLength;
+    bool hasControl;
+
+    bool listing;
+    uint8_t listTag;
+    size_t listIndex;
+
+    Transfer transfer;
+    Checksum checksum;
+
+    uint32_t bytesSent;
+    uint32_t retransmits;
+    uint32_t badFrames;
+
+    void receive();
+    void handle(const uint8_t* body, size_t length);
+    void reply(uint8_t type, uint8_t tag, const uint8_t* payload, size_t length);
+    void error(uint8_t tag, Error code);
+    bool nextFrame();
+    void frame(uint8_t type, uint8_t tag, size_t payloadLength);
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include <esp_partition.h>
+#include "session/log_flash.h"
+#include "util/log.h"
+
+// A raw data partition as LogFlash
+class PartitionFlash : public LogFlash {
+public:
+    PartitionFlash() : partition(nullptr) {}
+
+    bool begin(const char* label) {
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+        if (!partition) {
+            LOG_ERROR("Partition %s not found", label);
+        }
+        return partition != nullptr;
+    }
+
+    uint32_t size() const override {
+        return partition ? partition->size & ~(SECTOR_SIZE - 1) : 0;
+    }
+
+    bool read(uint32_t offset, void* data, size_t length) override {
+        return esp_partition_read(partition, offset, data, length) == ESP_OK;
+    }
+
+    bool write(uint32_t offset, const void* data, size_t length) override {
+        return esp_partition_write(partition, offset, data, length) == ESP_OK;
+    }
+
+    bool erase(uint32_t offset) override {
+        return esp_partition_erase_range(partition, offset, SECTOR_SIZE) == ESP_OK;
+    }
+
+private:
+    const esp_partition_t* partition;
+};
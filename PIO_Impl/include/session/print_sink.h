@@ -0,0 +1,16 @@
+#pragma once
+#include <Arduino.h>
+#include "session/session_export.h"
+
+// An Arduino Print, the native USB CDC port, as export output
+class PrintSink : public ExportSink {
+public:
+    explicit PrintSink(Print& out) : out(out) {}
+
+    bool write(const char* text, size_t length) override {
+        return out.write((const uint8_t*)text, length) == length;
+    }
+
+private:
+    Print& out;
+};
@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "session/log_reader.h"
+
+// Receives exported text: the USB port on the device, a file on the host
+class ExportSink {
+public:
+    virtual ~ExportSink() = default;
+    virtual bool write(const char* text, size_t length) = 0;
+};
+
+/**
+ * Converts a stored session to CSV or a VBO-style text file, one chunk at
+ * a time, so memory stays the same for a five minute and a five hour
+ * session (about 12 KB, a third of it the chunk buffer).
+ *
+ * Rows are resampled to a fixed rate from the session start. Analog
+ * channels and position are interpolated between the samples around a
+ * row, discrete channels and heading hold their last value. Records of
+ * different channels arrive slightly out of order (by one recorder poll),
+ * so a row is written once the stream is LAG_US past it, and every column
+ * keeps its last HISTORY samples for that.
+ *
+ * Values leave the log as integers in the channel's resolution and are
+ * printed as fixed point, without float formatting.
+ *
+ * VBO output follows the Racelogic layout (positions in minutes, west
+ * positive, speed in km/h), but the time column counts from the session
+ * start instead of UTC, which the log does not have.
+ */
+class SessionExporter {
+public:
+    enum class Format : uint8_t {
+        Csv,
+        Vbo
+    };
+
+    static const size_t MAX_COLUMNS = 4 + LogSessionHeader::MAX_CHANNELS;
+    static const size_t HISTORY = 32;         // Covers LAG_US of a 300 Hz channel
+    static const uint32_t LAG_US = 100000;
+    static const size_t OUTPUT_SIZE = 512;
+
+    SessionExporter(LogStreamSource& source, ExportSink& sink);
+
+    // Before begin(): a channel to export; all of them if none is selected
+    bool selectChannel(uint8_t id);
+
+    // Reads the session chunk and writes the file header. False if the
+    // stream does not start like a session.
+    bool begin(Format format, uint16_t rateHz);
+
+    // Decodes one chunk and writes the rows it completes. False once the
+    // export is finished or the sink failed.
+    bool step();
+
+    bool isFinished() const { return finished; }
+    bool hasFailed() const { return failed; }
+    uint32_t getRows() const { return rows; }
+    uint32_t getBadChunks() const { return chunks.getBadChunks(); }
+    const LogSessionHeader& getHeader() const { return header; }
+
+private:
+    struct Column {
+        uint8_t channel;      // Channel id, or logfmt::REC_FIX for position columns
+        uint8_t field;        // Fix field for position columns
+        bool interpolate;
+        uint8_t decimals;
+        double factor;        // Logged integer to printed fixed point
+        uint32_t times[HISTORY];    // micros() as logged, compared by difference
+        int32_t values[HISTORY];
+        uint8_t first;        // Oldest sample in the ring
+        uint8_t count;
+    };
+
+    ChunkReader chunks;
+    ExportSink& sink;
+    LogSessionHeader header;
+    logfmt::SampleDecoder decoder;
+    Format format;
+
+    uint8_t selected[LogSessionHeader::MAX_CHANNELS];
+    size_t selectedCount;
+    Column columns[MAX_COLUMNS];
+    size_t columnCount;
+
+    int64_t startUs;          // Unwrapped micros() of the first row
+    int64_t latestUs;         // Newest time seen in the stream
+    int64_t rowUs;            // Next row
+    uint32_t periodUs;
+    bool started;
+    uint16_t lap;             // Current lap, 0 before the first crossing
+    int64_t nextLapUs;
+    uint16_t nextLap;
+
+    char output[OUTPUT_SIZE];
+    size_t outputLength;
+    uint32_t rows;
+    bool finished;
+    bool failed;
+
+    void addColumn(uint8_t channel, uint8_t field, bool interpolate, uint8_t decimals, double factor);
+    void addSample(Column& column, uint32_t timeUs, int32_t value);
+    bool valueAt(Column& column, int64_t timeUs, int64_t* value);
+    int64_t unwrap(uint32_t timeUs);
+    void writeRows(int64_t untilUs);
+    void writeHeader();
+
+    // Output buffer, written to the sink as it fills
+    void put(const char* text);
+    void put(char c);
+    void putFixed(int64_t value, uint8_t decimals, bool sign);
+    void flush();
+};
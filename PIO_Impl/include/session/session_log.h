@@ -0,0 +1,154 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "session/log_flash.h"
+#include "session/log_format.h"
+#include "session/log_reader.h"
+
+// A stored session as listed to the offload client
+struct LogSessionInfo {
+    uint32_t id;                 // Same id as the session's SessionIndex summary
+    uint32_t size;               // Stream bytes, see log_format.h
+    char track[logfmt::MAX_TRACK_NAME];
+    bool starred;                // Kept until unstarred
+    bool compacted;              // Only its timed laps are left
+};
+
+/**
+ * Recorded session data on a raw log partition, one session at a time.
+ *
+ * Sectors are used in a ring that steps over sectors still in use. Each
+ * starts with a header naming its session, its index within the session,
+ * a sequence number that grows across the whole log and the sector's erase
+ * count, so begin() rebuilds the directory and the wear map from the
+ * headers alone. A session's stream is its sectors' blocks in index order
+ * (log_format.h).
+ *
+ * Chunks are written payload first and header last: after a reset a chunk
+ * is complete or absent. A session interrupted by a reset stays readable up
+ * to its last complete chunk but is never appended to again.
+ *
+ * A session can be rewritten: openCopy() starts a new generation of it,
+ * append() fills that, and commitCopy() switches over with a single flag
+ * write on the copy's first sector. Until then a reset leaves the old
+ * generation in place. Flags (star, compacted, complete, evicted) live in
+ * a word of the first sector's header outside its CRC, where they are set
+ * by clearing bits, without an erase.
+ *
+ * When no sector is free the log is full and append() fails; LogRetention
+ * keeps that from happening.
+ */
+class SessionLog {
+public:
+    explicit SessionLog(LogFlash& flash);
+
+    bool begin();
+
+    // Recording. open() fails while a session is open or the log is full,
+    // and abandons a copy in progress: recording comes first.
+    bool open(uint32_t id, const char* track);
+    bool append(uint8_t type, const uint8_t* payload, size_t length);
+    void close();
+    bool isRecording() const { return recording; }
+
+    // Payload bytes the next chunk can have without starting a new block
+    size_t room() const;
+
+    // Erases the sector the recording or copy will need next, so append()
+    // does not wait for an erase. One erase per call; true if it did one.
+    bool maintain();
+
+    // Starring survives until unstarred, up to 16 changes per generation
+    bool setStarred(uint32_t id, bool starred);
+
+    // Frees a stored session; not the one being recorded or copied
+    bool evict(uint32_t id);
+
+    // Rewrites a stored session through append(); compacted marks the copy
+    // as holding only its laps
+    bool openCopy(uint32_t id, bool compacted);
+    bool commitCopy();
+    void abortCopy();
+    bool isCopying() const { return copying; }
+    uint32_t getCopyId() const { return copy.id; }
+
+    struct WearStats {
+        uint32_t minErases;
+        uint32_t maxErases;
+        uint32_t freeMeanErases;   // Over the sectors the ring cycles through
+        uint32_t coldErases;       // Least worn sector holding a stored session
+        uint32_t coldSession;      // Its session
+        bool hasCold;
+    };
+    WearStats getWear() const;
+    uint32_t getErases(uint16_t sector) const { return erases[sector]; }
+
+    // Directory, oldest first
+    size_t count() const { return sessions.size(); }
+    LogSessionInfo getInfo(size_t index) const;
+    bool find(uint32_t id, LogSessionInfo* info) const;
+
+    // Copies stream bytes of a session; returns how many, 0 past the end
+    size_t read(uint32_t id, uint32_t offset, uint8_t* out, size_t length);
+
+    uint32_t getSectorCount() const { return sectorCount; }
+    uint32_t getFreeSectors() const;
+
+private:
+    static const uint32_t MAGIC = 0x32474C53;  // "SLG2"
+    static const uint16_t NO_SECTOR = 0xFFFF;
+
+    // Flag word bits, cleared to set
+    static const uint32_t FLAG_STAR_TOGGLES = 0x0000FFFF;   // Starred if an odd number is cleared
+    static const uint32_t FLAG_COMPLETE = 0x00010000;       // Copy finished; generation 0 needs none
+    static const uint32_t FLAG_EVICTED = 0x00020000;
+    static const uint32_t FLAG_COMPACTED = 0x00040000;
+
+    struct Session {
+        uint32_t id;
+        uint32_t size;
+        uint32_t birth;       // Sequence number of the first sector ever written
+        uint8_t generation;
+        uint32_t flags;       // Of the first sector
+        std::vector<uint16_t> sectors;
+        char track[logfmt::MAX_TRACK_NAME];
+    };
+
+    LogFlash& flash;
+    uint32_t sectorCount;
+    std::vector<Session> sessions;    // Oldest first
+    std::vector<bool> used;
+    std::vector<uint32_t> erases;
+    uint16_t head;            // Where the ring looks for the next free sector
+    uint16_t erasedAhead;     // The next free sector, once maintain() erased it
+    uint32_t nextSeq;
+
+    bool recording;
+    bool copying;
+    Session copy;             // The new generation while copying
+    uint32_t blockUsed;       // Stream bytes in the written session's last block
+
+    const Session* lookup(uint32_t id) const;
+    Session* lookup(uint32_t id);
+    uint16_t nextFree() const;
+    bool startSector(Session& session);
+    bool writeFlags(const Session& session, uint32_t flags);
+    void release(const Session& session);
+    uint32_t usedInBlock(uint16_t sector);
+    void readTrack(Session& session);
+};
+
+// A session in the log as a stream for ChunkReader
+class StoredSession : public LogStreamSource {
+public:
+    StoredSession(SessionLog& log, uint32_t id) : log(log), id(id) {}
+
+    size_t read(uint32_t offset, uint8_t* data, size_t length) override {
+        return log.read(id, offset, data, length);
+    }
+
+private:
+    SessionLog& log;
+    uint32_t id;
+};
@@ -0,0 +1,193 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include "channels/channel_registry.h"
+#include "session/session_log.h"
+
+/**
+ * Writes a session to the SessionLog: the session chunk with the channel
+ * table, then GNSS fixes, registry channels and lap events.
+ *
+ * Each recorded channel is subscribed like any other consumer and logged
+ * at up to its own rate, quantized to its resolution. Samples collect in
+ * one chunk buffer that is written when full, before a lap event, and at
+ * least every FLUSH_US, which bounds what a power cut can lose.
+ */
+class SessionRecorder {
+public:
+    static const size_t MAX_CHANNELS = 16;
+    static const uint32_t FLUSH_US = logfmt::MAX_CHUNK_SPAN_US;
+    static const size_t MIN_CHUNK = 64;
+
+    SessionRecorder(SessionLog& log, const ChannelRegistry& registry)
+        : log(log), registry(registry), count(0), active(false), chunkStartUs(0) {}
+
+    // Before start(): records a registry channel at up to rateHz
+    bool addChannel(uint8_t id, uint16_t rateHz) {
+        const ChannelDef* def = registry.find(id);
+        if (count == MAX_CHANNELS || !def || rateHz == 0) {
+            return false;
+        }
+        Recorded& channel = channels[count++];
+        channel.def = def;
+        channel.rateHz = rateHz < def->rateHz ? rateHz : def->rateHz;
+        channel.periodUs = 1000000 / channel.rateHz;
+        channel.scale = def->resolution > 0.0f ? 1.0f / def->resolution : 1000.0f;
+        return true;
+    }
+
+    bool start(uint32_t sessionId, const char* track, uint32_t nowUs) {
+        if (active || !log.open(sessionId, track)) {
+            return false;
+        }
+        size_t length = encodeSession(sessionId, track);
+        if (!log.append(logfmt::CHUNK_SESSION, chunk, length)) {
+            log.close();
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            channels[i].reader = registry.subscribe(channels[i].def->id);
+            channels[i].lastUs = nowUs - channels[i].periodUs;
+        }
+        active = true;
+        beginChunk(nowUs);
+        return true;
+    }
+
+    void stop() {
+        if (active) {
+            flush(chunkStartUs);
+            log.close();
+            active = false;
+        }
+    }
+
+    // False once the log filled up or failed
+    bool isRecording() const { return active && log.isRecording(); }
+
+    // speed in m/s, heading in degrees
+    void addFix(uint32_t timeUs, double latitude, double longitude, double speed, double heading) {
+        if (!isRecording()) return;
+        int32_t lat = (int32_t)lround(latitude * 1e7);
+        int32_t lon = (int32_t)lround(longitude * 1e7);
+        int32_t mmPerS = (int32_t)lround(speed * 1000.0);
+        int32_t centiDeg = (int32_t)lround(heading * 100.0);
+        if (!encoder.addFix(timeUs, lat, lon, mmPerS, centiDeg)) {
+            flush(timeUs);
+            encoder.addFix(timeUs, lat, lon, mmPerS, centiDeg);
+        }
+    }
+
+    void addLap(uint32_t timeUs, uint16_t lap, uint32_t lapTimeMs, bool isBest) {
+        if (!isRecording()) return;
+        flush(timeUs);
+        uint8_t payload[11];
+        logfmt::putU32(payload, timeUs);
+        logfmt::putU16(payload + 4, lap);
+        logfmt::putU32(payload + 6, lapTimeMs);
+        payload[10] = isBest ? logfmt::LAP_BEST : 0;
+        log.append(logfmt::CHUNK_LAP, payload, sizeof(payload));
+    }
+
+    // A chunk from another writer, such as a black-box capture. The samples
+    // so far go first and the next chunk is sized to what is left, so
+    // blocks stay full.
+    bool addChunk(uint8_t type, const uint8_t* payload, size_t length, uint32_t nowUs) {
+        if (!isRecording()) return false;
+        flush(nowUs);
+        bool written = log.append(type, payload, length);
+        beginChunk(nowUs);
+        return written;
+    }
+
+    // Drains the recorded channels; writes the chunk when due
+    void poll(uint32_t nowUs) {
+        if (!isRecording()) return;
+        ChannelSample samples[32];
+        for (size_t i = 0; i < count; i++) {
+            Recorded& channel = channels[i];
+            size_t n;
+            while ((n = channel.reader.read(samples, 32)) > 0) {
+                for (size_t j = 0; j < n; j++) {
+                    // An eighth of a period of slack keeps jittery sources at their rate
+                    if (samples[j].timeUs - channel.lastUs < channel.periodUs - channel.periodUs / 8) {
+                        continue;
+                    }
+                    channel.lastUs = samples[j].timeUs;
+                    int32_t value = (int32_t)lroundf(samples[j].value * channel.scale);
+                    if (!encoder.addSample(channel.def->id, samples[j].timeUs, value)) {
+                        flush(samples[j].timeUs);
+                        encoder.addSample(channel.def->id, samples[j].timeUs, value);
+                    }
+                }
+            }
+        }
+        if (nowUs - chunkStartUs >= FLUSH_US) {
+            flush(nowUs);
+        }
+    }
+
+private:
+    struct Recorded {
+        const ChannelDef* def;
+        ChannelReader reader;
+        uint16_t rateHz;
+        uint32_t periodUs;
+        uint32_t lastUs;
+        float scale;          // 1 / resolution
+    };
+
+    SessionLog& log;
+    const ChannelRegistry& registry;
+    Recorded channels[MAX_CHANNELS];
+    size_t count;
+    bool active;
+    uint32_t chunkStartUs;
+    logfmt::SampleEncoder encoder;
+    uint8_t chunk[logfmt::MAX_CHUNK_PAYLOAD];
+
+    // Sized to what is left of the current block, so blocks fill up
+    void beginChunk(uint32_t nowUs) {
+        size_t room = log.room();
+        encoder.begin(chunk, room < MIN_CHUNK ? logfmt::MAX_CHUNK_PAYLOAD : room, nowUs);
+        chunkStartUs = nowUs;
+    }
+
+    // Writes the samples so far and starts the next chunk at nowUs
+    void flush(uint32_t nowUs) {
+        if (!encoder.isEmpty() && !log.append(logfmt::CHUNK_SAMPLES, chunk, encoder.size())) {
+            return;
+        }
+        beginChunk(nowUs);
+    }
+
+    size_t encodeSession(uint32_t sessionId, const char* track) {
+        size_t p = 0;
+        chunk[p++] = logfmt::VERSION;
+        logfmt::putU32(chunk + p, sessionId);
+        p += 4;
+        p += putString(chunk + p, track, logfmt::MAX_TRACK_NAME - 1);
+        chunk[p++] = (uint8_t)count;
+        for (size_t i = 0; i < count; i++) {
+            const ChannelDef* def = channels[i].def;
+            chunk[p++] = def->id;
+            chunk[p++] = (uint8_t)def->type;
+            logfmt::putU16(chunk + p, channels[i].rateHz);
+            p += 2;
+            float resolution = 1.0f / channels[i].scale;
+            memcpy(chunk + p, &resolution, 4);
+            p += 4;
+            p += putString(chunk + p, def->name, sizeof(def->name) - 1);
+            p += putString(chunk + p, def->unit, sizeof(def->unit) - 1);
+        }
+        return p;
+    }
+
+    static size_t putString(uint8_t* out, const char* text, size_t max) {
+        size_t length = strnlen(text, max);
+        out[0] = (uint8_t)length;
+        memcpy(out + 1, text, length);
+        return length + 1;
+    }
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "session/log_format.h"
+
+// What a reset mid-stint should not lose
+struct WarmState {
+    char track[logfmt::MAX_TRACK_NAME];  // Empty if none was selected
+    bool stintActive;
+    uint32_t stintElapsedMs;
+    uint32_t sectorBest[3];              // UINT32_MAX if none
+    uint32_t theoreticalBest;            // 0 if unknown
+    uint32_t referenceLap;               // ms of the track's best lap in flash, 0 if none
+    uint16_t lapCount;
+    uint8_t deltaReference;              // ReferenceKind
+
+    WarmState();
+};
+
+/**
+ * Session state that survives a reset, in memory the caller keeps in RTC
+ * slow memory (RTC_NOINIT_ATTR).
+ *
+ * That memory outlasts watchdog, panic and software resets, and a brown-out
+ * as long as the supply did not fall too far; not a power-off. Each save
+ * goes to the older of two slots with a sequence number and a CRC-32, so a
+ * reset during a save, or memory that decayed, leaves the previous
+ * snapshot or none, never a wrong one.
+ *
+ * The best lap itself stays in the ReferenceStore; the snapshot only keeps
+ * its lap time, so the trace loaded after the restart can be checked
+ * against it. Neither the lap in progress nor the session statistics are
+ * kept: timing resumes at the next start/finish crossing.
+ *
+ * clock is microseconds that keep counting through a reset, so load() can
+ * tell how long ago the snapshot was taken.
+ */
+class WarmStore {
+public:
+    static const uint32_t MAGIC = 0x314D5257;   // "WRM1"
+    static const size_t ENCODED_SIZE = 80;
+    static const size_t MEMORY_SIZE = 2 * ENCODED_SIZE;
+
+    WarmStore(uint8_t* memory, uint64_t (*clock)());
+
+    void save(const WarmState& state);
+
+    // The newest intact snapshot and the milliseconds since it was saved
+    // (0 if the clock was reset too)
+    bool load(WarmState* state, uint32_t* ageMs) const;
+
+    // Forgets both slots, e.g. once a session ended normally
+    void clear();
+
+    static void encode(const WarmState& state, uint32_t sequence, uint64_t savedUs, uint8_t* out);
+    static bool decode(const uint8_t* data, WarmState* state, uint32_t* sequence, uint64_t* savedUs);
+
+private:
+    uint8_t* memory;
+    uint64_t (*clock)();
+
+    // Slot of the newest intact snapshot, -1 if none
+    int newest(uint32_t* sequence) const;
+};
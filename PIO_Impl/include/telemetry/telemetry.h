@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "util/cobs.h"
+#include "util/log.h"
+#include "channels/channel_registry.h"
+#include "util/byte_link.h"
+
+// Snapshot of the live state sent at the GNSS rate
+struct TelemetryState {
+    uint32_t timestamp;    // millis()
+    double latitude;
+    double longitude;
+    double speed;          // m/s
+    float accelX;          // m/s^2
+    float accelY;
+    float accelZ;
+    float gyroZ;           // rad/s
+    uint32_t lapTime;      // Current lap time in ms, 0 when no lap is running
+    int32_t delta;         // Live delta in ms
+    uint8_t fixType;
+    uint8_t satellites;
+};
+
+/**
+ * Binary live telemetry over the native USB CDC port.
+ *
+ * Packets are [type][sequence][payload][CRC16], COBS-encoded and terminated
+ * by a zero byte. Frames wait in small per-priority queues and service()
+ * writes only as much as the link accepts without blocking: the port's
+ * StreamLink on the device, a pseudo-terminal in tools/telemetry_sim. When
+ * a queue is full its oldest frame is dropped, so under back-pressure state
+ * samples go first while lap and sector events survive. Drop counts are
+ * reported in the health packet. tools/telemetry_decode.py decodes the
+ * stream; tools/telemetry_test.py checks the two against each other.
+ */
+class Telemetry {
+public:
+    enum Priority : uint8_t {
+        PRIORITY_STATE = 0,
+        PRIORITY_HEALTH = 1,
+        PRIORITY_EVENT = 2,
+        PRIORITY_COUNT = 3
+    };
+
+    enum PacketType : uint8_t {
+        PACKET_STATE = 1,
+        PACKET_LAP = 2,
+        PACKET_SECTOR = 3,
+        PACKET_HEALTH = 4,
+        PACKET_LOG = 5,
+        PACKET_CHANNEL = 6
+    };
+
+    static const size_t MAX_CHANNEL_SAMPLES = 8;
+
+    explicit Telemetry(ByteLink& link);
+
+    void setEnabled(bool enable);
+    bool isEnabled() const { return enabled; }
+
+    void sendState(const TelemetryState& state);
+    void sendLap(uint16_t lapNumber, uint32_t lapTime, bool isBest);
+    void sendSector(uint8_t sector, uint32_t sectorTime);
+    void sendHealth();
+    // Tokenized log record; the host resolves the format from the ELF
+    void sendLog(const logging::Record& record);
+    // Up to MAX_CHANNEL_SAMPLES samples of one registry channel, oldest first
+    void sendChannel(uint8_t id, const ChannelSample* samples, size_t count);
+
+    // Writes queued frames without blocking, call every loop iteration
+    void service();
+
+    uint32_t getDropped(Priority priority) const { return queues[priority].dropped; }
+    uint32_t getFramesSent() const { return framesSent; }
+    uint32_t getOversized() const { return oversized; }
+
+    // Payload bytes of one packet
+    static const size_t MAX_PACKET = 64;
+
+private:
+    // Type, sequence, payload and CRC16, COBS encoded, plus the delimiter
+    static const size_t MAX_FRAME = cobs::maxEncodedSize(MAX_PACKET + 4) + 1;
+    static const size_t QUEUE_DEPTH = 8;
+
+    struct Frame {
+        uint8_t length;
+        uint8_t data[MAX_FRAME];
+    };
+
+    struct Queue {
+        Frame frames[QUEUE_DEPTH];
+        uint8_t head;
+        uint8_t count;
+        uint8_t capacity;
+        uint32_t dropped;
+    };
+
+    ByteLink& link;
+    bool enabled;
+    uint8_t sequence;
+    uint32_t framesSent;
+    uint32_t oversized;        // Packets refused for a payload over MAX_PACKET
+    Queue queues[PRIORITY_COUNT];
+
+    Frame inFlight;
+    size_t inFlightOffset;
+    bool hasInFlight;
+
+    void enqueue(Priority priority, PacketType type, const uint8_t* payload, size_t length);
+};
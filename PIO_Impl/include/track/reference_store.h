@@ -0,0 +1,94 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+#include <vector>
+#include "track_config.h"
+#include "calculations/reference_trace.h"
+
+/**
+ * Per-track best lap storage on a dedicated flash partition.
+ *
+ * The partition is divided into 64 KB slots, one MMU page each. A slot holds
+ * a header (track name, a hash of the track geometry, lap time) followed by
+ * the raw TracePoint array. Loading a reference maps its slot read-only and
+ * hands out a view into flash, so switching tracks costs one mmap call
+ * rather than a copy of the whole trace.
+ *
+ * Saving is queued and performed by maintain() one sector erase or write at
+ * a time. The slot header is written last, so a lap is either completely
+ * stored or not visible at all; the previous reference stays valid until then.
+ */
+class ReferenceStore {
+public:
+    static const uint32_t SLOT_SIZE = 0x10000;
+    static const size_t HEADER_SIZE = 64;
+    static const size_t MAX_POINTS = (SLOT_SIZE - HEADER_SIZE) / sizeof(TracePoint);
+
+    ReferenceStore();
+    ~ReferenceStore();
+
+    bool begin(const char* partitionLabel = "laprefs");
+
+    // Maps the stored reference for a track. The view stays valid until the
+    // next load() or release().
+    bool load(const TrackConfig& track, ReferenceTrace* trace);
+    void release();
+
+    // Queues a reference for background writing. The trace is copied.
+    bool save(const TrackConfig& track, const ReferenceTrace& trace);
+
+    // Runs one bounded step of a pending save. Returns true while work remains.
+    bool maintain();
+    bool isSaving() const { return state != State::Idle; }
+
+private:
+    enum class State : uint8_t { Idle, Erasing, Writing };
+
+    struct SlotHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t reserved;
+        uint32_t seq;
+        uint32_t configHash;   // Reference is ignored if the track geometry changes
+        uint32_t lapTime;
+        uint32_t pointCount;
+        uint32_t nameHash;
+        char name[MAX_TRACK_NAME_LENGTH];
+        uint32_t crc;
+    };
+    static_assert(sizeof(SlotHeader) == HEADER_SIZE, "Slot header is a flash format");
+
+    struct SlotInfo {
+        uint32_t nameHash;
+        uint32_t configHash;
+        uint32_t seq;
+        bool used;
+    };
+
+    static const uint32_t MAGIC = 0x4652504C;  // "LPRF"
+    static const uint16_t VERSION = 1;
+    static const uint32_t SECTOR_SIZE = 4096;
+
+    const esp_partition_t* partition;
+    std::vector<SlotInfo> slots;
+    uint32_t nextSeq;
+
+    int mappedSlot;
+    spi_flash_mmap_handle_t mapHandle;
+
+    State state;
+    int pendingSlot;
+    SlotHeader pendingHeader;
+    std::vector<TracePoint> pendingPoints;
+    uint32_t progress;
+
+    static uint32_t configHash(const TrackConfig& track);
+    static uint32_t nameHash(const char* name);
+    static uint32_t headerCrc(const SlotHeader& header);
+
+    int findSlot(const TrackConfig& track, uint32_t hash);
+    int chooseSlot();
+    bool isLatest(size_t slot) const;
+};
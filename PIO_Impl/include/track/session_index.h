@@ -0,0 +1,94 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <vector>
+#include "track_config.h"
+#include "calculations/session_stats.h"
+
+// One session as kept in the index: where, how long, and its statistics
+struct SessionRecord {
+    uint32_t id;
+    char track[MAX_TRACK_NAME_LENGTH];
+    uint32_t duration;           // ms from the first to the last lap event
+    SeriesSummary laps;
+    SeriesSummary sectors[3];
+};
+
+/**
+ * Ring of session summaries on a small flash partition.
+ *
+ * Records have a fixed size and are appended in order; a session is
+ * written again after every lap, and the record with the highest sequence
+ * number of a session id is its current state. When the ring wraps, the
+ * oldest sector is erased and the sessions that only lived there drop out.
+ *
+ * Saving is queued like ReferenceStore: maintain() performs the sector
+ * erase and the record write as separate steps. The record CRC is written
+ * with it, so a torn write is simply not found at the next boot.
+ */
+class SessionIndex {
+public:
+    static const uint8_t SCHEMA_VERSION = 1;
+    static const size_t RECORD_SIZE = 256;
+    static const size_t MAX_PAYLOAD_SIZE = RECORD_SIZE - 16;
+
+    SessionIndex();
+
+    bool begin(const char* partitionLabel = "sessions");
+
+    // A fresh id, larger than any stored one
+    uint32_t newSession() { return nextSession++; }
+
+    // Queues the current state of a session; replaces a pending one
+    bool save(const SessionRecord& record);
+
+    // Runs one bounded step of a pending save. Returns true while work remains.
+    bool maintain();
+
+    size_t count() const { return entries.size(); }
+
+    // Calls fn(const SessionRecord&) for every stored session, oldest first
+    template<typename Fn>
+    void forEach(Fn fn) {
+        SessionRecord record;
+        for (const auto& entry : entries) {
+            if (readRecord(entry.offset, &record)) {
+                fn(record);
+            }
+        }
+    }
+
+    // Schema serialization, independent of any flash access
+    static size_t encode(const SessionRecord& record, uint8_t* out, size_t capacity);
+    static bool decode(const uint8_t* data, size_t length, SessionRecord* record);
+
+private:
+    enum class State : uint8_t { Idle, Erasing, Writing };
+
+    struct Entry {
+        uint32_t id;
+        uint32_t offset;
+        uint32_t seq;
+    };
+
+    static const uint32_t MAGIC = 0x58444953;  // "SIDX"
+    static const uint32_t SECTOR_SIZE = 4096;
+    static const size_t HEADER_SIZE = 12;      // Magic, sequence, payload length, reserved
+
+    const esp_partition_t* partition;
+    std::vector<Entry> entries;   // Latest record of each session, by sequence
+    uint32_t writeOffset;         // Next record slot
+    bool sectorErased;            // Whether writeOffset's sector is ready for writing
+    uint32_t nextSeq;
+    uint32_t nextSession;
+
+    State state;
+    uint8_t pending[RECORD_SIZE];
+    uint32_t pendingId;
+
+    bool readRecord(uint32_t offset, SessionRecord* record);
+    bool validRecord(const uint8_t* raw, uint32_t* seq, size_t* length) const;
+    void forgetSector(uint32_t sectorOffset);
+    void remember(uint32_t id, uint32_t offset, uint32_t seq);
+};
@@ -2,7 +2,7 @@
 #include <Arduino.h>
 #include "track_types.h"
 
-const size_t MAX_TRACKS = 10;
+const size_t MAX_TRACKS = 512;
 const size_t MAX_TRACK_NAME_LENGTH = 32;
 const uint32_t CURRENT_CONFIG_VERSION = 1;
 
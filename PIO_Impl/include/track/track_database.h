@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+#include "track_config.h"
+#include "track_store.h"
+
+/**
+ * Read-only bundled track database, flashed as a raw data partition.
+ *
+ * Layout: a 16 byte header ("TRDB" magic, schema version, track count and
+ * data size) followed by records of one length byte and a TrackStore
+ * payload. The partition is memory-mapped, so tracks are decoded straight
+ * out of flash and the only RAM used is the caller's TrackConfig. The
+ * image is built with tools/trackdb/trackdb.py.
+ */
+class TrackDatabase {
+public:
+    TrackDatabase();
+    ~TrackDatabase();
+
+    bool begin(const char* partitionLabel = "trackdb");
+    bool isOpen() const { return data != nullptr; }
+    uint32_t count() const { return trackCount; }
+
+    // Decodes the record at the given offset (as passed to forEach)
+    bool read(uint32_t offset, TrackConfig* config) const;
+
+    // Calls fn(uint32_t offset, const TrackConfig&) for every track
+    template<typename Fn>
+    void forEach(Fn fn) const {
+        TrackConfig config;
+        uint32_t offset = 0;
+        while (offset < dataSize) {
+            uint8_t length = data[offset];
+            if (offset + 1 + length > dataSize) {
+                break;
+            }
+            if (TrackStore::decode(data + offset + 1, length, &config)) {
+                fn(offset, config);
+            }
+            offset += 1 + length;
+        }
+    }
+
+private:
+    static const uint32_t MAGIC = 0x42445254;  // "TRDB"
+    static const size_t HEADER_SIZE = 16;
+
+    const uint8_t* data;
+    uint32_t dataSize;
+    uint32_t trackCount;
+    spi_flash_mmap_handle_t mapHandle;
+};
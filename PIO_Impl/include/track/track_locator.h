@@ -0,0 +1,145 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+/**
+ * Grid index over track start/finish points for automatic track detection.
+ *
+ * The globe is cut into fixed cells of 1/CELLS_PER_DEGREE degrees and each
+ * point is keyed by its row-major cell number, so points in one grid row are
+ * contiguous once sorted. A query only binary-searches the few rows that
+ * overlap the search radius and scans the matching column range in each,
+ * which keeps lookups O(log n) for thousands of tracks.
+ *
+ * Entries are 16 bytes and carry an opaque reference chosen by the caller.
+ */
+class TrackLocator {
+public:
+    static constexpr int CELLS_PER_DEGREE = 32;  // ~3.5 km cells
+
+    void clear() {
+        entries.clear();
+        sorted = true;
+    }
+
+    void reserve(size_t count) {
+        entries.reserve(count);
+    }
+
+    void add(double latitude, double longitude, uint32_t ref) {
+        Entry entry;
+        entry.latE7 = (int32_t)lround(latitude * 1e7);
+        entry.lonE7 = (int32_t)lround(longitude * 1e7);
+        entry.key = cellKey(cellRow(latitude), cellCol(longitude));
+        entry.ref = ref;
+        entries.push_back(entry);
+        sorted = false;
+    }
+
+    // Sorts the index, must be called after adding points and before queries
+    void build() {
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry& a, const Entry& b) { return a.key < b.key; });
+        sorted = true;
+    }
+
+    /**
+     * Find the closest indexed point within maxDistance meters.
+     *
+     * @param ref Receives the caller reference of the closest point
+     * @param distance Optional, receives the distance in meters
+     * @return false if no point lies within maxDistance
+     */
+    bool findNearest(double latitude, double longitude, float maxDistance,
+                     uint32_t* ref, float* distance = nullptr) const {
+        if (!sorted || entries.empty()) {
+            return false;
+        }
+
+        double cosLat = cos(latitude * M_PI / 180.0);
+        int rowSpan = (int)ceil(maxDistance / CELL_HEIGHT_M);
+        int colSpan = (cosLat > 0.01) ? (int)ceil(maxDistance / (CELL_HEIGHT_M * cosLat)) : COLS;
+
+        int row = cellRow(latitude);
+        int col = cellCol(longitude);
+        double bestSq = (double)maxDistance * maxDistance;
+        bool found = false;
+
+        for (int r = std::max(0, row - rowSpan); r <= std::min(ROWS - 1, row + rowSpan); r++) {
+            // Column ranges wrap around the antimeridian
+            if (colSpan * 2 + 1 >= COLS) {
+                found |= scanRange(cellKey(r, 0), cellKey(r, COLS - 1), latitude, longitude, cosLat, &bestSq, ref);
+            } else if (col - colSpan < 0) {
+                found |= scanRange(cellKey(r, 0), cellKey(r, col + colSpan), latitude, longitude, cosLat, &bestSq, ref);
+                found |= scanRange(cellKey(r, COLS + col - colSpan), cellKey(r, COLS - 1), latitude, longitude, cosLat, &bestSq, ref);
+            } else if (col + colSpan >= COLS) {
+                found |= scanRange(cellKey(r, col - colSpan), cellKey(r, COLS - 1), latitude, longitude, cosLat, &bestSq, ref);
+                found |= scanRange(cellKey(r, 0), cellKey(r, col + colSpan - COLS), latitude, longitude, cosLat, &bestSq, ref);
+            } else {
+                found |= scanRange(cellKey(r, col - colSpan), cellKey(r, col + colSpan), latitude, longitude, cosLat, &bestSq, ref);
+            }
+        }
+
+        if (found && distance) {
+            *distance = (float)sqrt(bestSq);
+        }
+        return found;
+    }
+
+    size_t size() const { return entries.size(); }
+
+private:
+    struct Entry {
+        uint32_t key;
+        int32_t latE7;
+        int32_t lonE7;
+        uint32_t ref;
+    };
+
+    static constexpr int ROWS = 180 * CELLS_PER_DEGREE;
+    static constexpr int COLS = 360 * CELLS_PER_DEGREE;
+    static constexpr double METERS_PER_DEGREE = 111195.0;
+    static constexpr double CELL_HEIGHT_M = METERS_PER_DEGREE / CELLS_PER_DEGREE;
+
+    std::vector<Entry> entries;
+    bool sorted = true;
+
+    static int cellRow(double latitude) {
+        int row = (int)floor((latitude + 90.0) * CELLS_PER_DEGREE);
+        return std::min(std::max(row, 0), ROWS - 1);
+    }
+
+    static int cellCol(double longitude) {
+        int col = (int)floor((longitude + 180.0) * CELLS_PER_DEGREE);
+        return ((col % COLS) + COLS) % COLS;
+    }
+
+    static uint32_t cellKey(int row, int col) {
+        return (uint32_t)row * COLS + col;
+    }
+
+    // Equirectangular distance, accurate to well under 1% at detection range
+    bool scanRange(uint32_t firstKey, uint32_t lastKey, double latitude, double longitude,
+                   double cosLat, double* bestSq, uint32_t* ref) const {
+        auto it = std::lower_bound(entries.begin(), entries.end(), firstKey,
+                                   [](const Entry& e, uint32_t key) { return e.key < key; });
+        bool found = false;
+        for (; it != entries.end() && it->key <= lastKey; ++it) {
+            double dLat = it->latE7 / 1e7 - latitude;
+            double dLon = it->lonE7 / 1e7 - longitude;
+            if (dLon > 180.0) dLon -= 360.0;
+            if (dLon < -180.0) dLon += 360.0;
+            double x = dLon * cosLat * METERS_PER_DEGREE;
+            double y = dLat * METERS_PER_DEGREE;
+            double distSq = x * x + y * y;
+            if (distSq < *bestSq) {
+                *bestSq = distSq;
+                *ref = it->ref;
+                found = true;
+            }
+        }
+        return found;
+    }
+};
@@ -1,9 +1,13 @@
 #pragma once
 
-#include <Preferences.h>
 #include <vector>
 #include <string>
 #include "track_config.h"
+#include "track_store.h"
+#include "track_database.h"
+#include "track_locator.h"
+#include "reference_store.h"
+#include "session_index.h"
 
 class TrackManager {
 public:
@@ -17,17 +21,46 @@ public:
     bool resetStorage();
     
     std::vector<std::string> getTrackNames();
-    size_t getTrackCount() { return tracks.size(); }
+    size_t getTrackCount() { return store.count(); }
     
     bool getCurrentTrack(TrackConfig* config);
     bool setCurrentTrack(const char* name);
+
+    // Selects the track whose start/finish is nearest to the given fix.
+    // User tracks take precedence over the bundled database.
+    bool detectTrack(double latitude, double longitude, float maxDistance = DETECT_RADIUS_M);
+
+    // Best lap of a track, mapped from flash. Valid until the next load.
+    bool loadReference(const TrackConfig& track, ReferenceTrace* trace) { return references.load(track, trace); }
+    bool saveReference(const TrackConfig& track, const ReferenceTrace& trace) { return references.save(track, trace); }
+
+    // Session summaries; a session is saved again after every lap
+    uint32_t newSession() { return sessions.newSession(); }
+    bool saveSession(const SessionRecord& record) { return sessions.save(record); }
+    SessionIndex& getSessions() { return sessions; }
+
+    // Background storage upkeep, call from the main loop while idle
+    void maintain() {
+        if (!references.maintain() && !sessions.maintain()) {
+            store.maintain();
+        }
+    }
     
 private:
-    Preferences preferences;
-    static const char* STORAGE_NAMESPACE;
-    std::vector<TrackConfig> tracks;
-    size_t currentTrackIndex;
-
-    bool saveTrackByIndex(size_t index, const TrackConfig& config);
-    bool loadTrackByIndex(size_t index, TrackConfig* config);
-};
+    static constexpr float DETECT_RADIUS_M = 3000.0f;
+    static const char* LEGACY_NAMESPACE;
+    TrackStore store;
+    TrackDatabase database;
+    ReferenceStore references;
+    SessionIndex sessions;
+    TrackConfig currentTrack;
+    bool hasCurrentTrack;
+
+    TrackLocator userLocator;      // ref = index into userTrackNames
+    TrackLocator bundledLocator;   // ref = record offset in the database
+    std::vector<std::string> userTrackNames;
+    bool userLocatorDirty;
+
+    bool migrateLegacyStorage();
+    void rebuildUserLocator();
+};
\ No newline at end of file
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <vector>
+#include "track_config.h"
+
+/**
+ * Append-only, log-structured track storage on a raw flash partition.
+ *
+ * The partition is split in two halves. One half is active and receives
+ * records (a track put or a tombstone) strictly by appending; nothing is
+ * ever rewritten in place, so saving or deleting a track is one small
+ * flash write regardless of how many tracks exist.
+ *
+ * When the active half is mostly dead records or nearly full, maintain()
+ * copies the live records into the other half a few at a time. Writes made
+ * while the copy is running are mirrored into both halves, and the copy is
+ * committed by writing the new half's header with a higher generation.
+ *
+ * Record payloads use a compact versioned schema (fixed-point coordinates,
+ * length-prefixed name, optional points), not the in-memory TrackConfig
+ * layout, so the structure can change without breaking stored tracks.
+ */
+class TrackStore {
+public:
+    static const uint8_t SCHEMA_VERSION = 1;
+    static const size_t MAX_PAYLOAD_SIZE = 64;
+
+    TrackStore();
+
+    bool begin(const char* partitionLabel = "tracks");
+    bool put(const TrackConfig& config);
+    bool remove(const char* name);
+    bool get(const char* name, TrackConfig* config);
+    bool erase();
+
+    size_t count() const { return entries.size(); }
+    bool isCompacting() const { return state != State::Idle; }
+
+    // Runs one bounded step of background compaction (one sector erase or a
+    // few record copies). Starts a compaction when the log needs one.
+    // Returns true while compaction work remains.
+    bool maintain();
+
+    // Calls fn(const TrackConfig&) for every live track
+    template<typename Fn>
+    void forEach(Fn fn) {
+        TrackConfig config;
+        for (const auto& entry : entries) {
+            if (readTrack(entry.offset, &config)) {
+                fn(config);
+            }
+        }
+    }
+
+    // Schema serialization, independent of any flash access
+    static size_t encode(const TrackConfig& config, uint8_t* out, size_t capacity);
+    static bool decode(const uint8_t* data, size_t length, TrackConfig* config);
+
+private:
+    enum class State : uint8_t { Idle, Erasing, Copying };
+
+    enum RecordType : uint8_t {
+        RECORD_PUT = 1,
+        RECORD_TOMBSTONE = 2
+    };
+
+    struct IndexEntry {
+        uint32_t nameHash;
+        uint32_t offset;        // Record offset in the active half
+        uint32_t shadowOffset;  // Record offset in the compaction target half
+        uint32_t seq;
+        uint8_t length;         // Payload length, for live byte accounting
+    };
+
+    static const uint32_t HALF_MAGIC = 0x534B5254;  // "TRKS"
+    static const uint16_t RECORD_MAGIC = 0x5254;    // "TR"
+    static const size_t HALF_HEADER_SIZE = 16;
+    static const size_t RECORD_HEADER_SIZE = 12;
+    static const uint32_t NO_OFFSET = 0xFFFFFFFF;
+    static const size_t COPIES_PER_STEP = 4;
+
+    const esp_partition_t* partition;
+    std::vector<IndexEntry> entries;
+    uint32_t halfSize;
+    uint8_t activeHalf;
+    uint32_t generation;
+    uint32_t writeOffset;   // Next free byte in the active half
+    uint32_t liveBytes;     // Bytes held by current records; the rest is dead
+    uint32_t nextSeq;
+
+    State state;
+    uint32_t eraseOffset;
+    size_t copyRemaining;
+    uint32_t shadowWriteOffset;
+
+    static uint32_t hashName(const char* name);
+    static uint32_t recordSize(size_t payloadLength);
+
+    uint32_t halfBase(uint8_t half) const { return half * halfSize; }
+    uint8_t otherHalf() const { return activeHalf ^ 1; }
+
+    bool readHalfHeader(uint8_t half, uint32_t* gen);
+    bool writeHalfHeader(uint8_t half, uint32_t gen);
+    bool formatHalf(uint8_t half, uint32_t gen);
+    bool replay();
+
+    bool appendRecord(uint8_t half, uint32_t offset, RecordType type, uint32_t seq,
+                      const uint8_t* payload, size_t length);
+    bool readRecord(uint8_t half, uint32_t offset, RecordType* type, uint32_t* seq,
+                    uint8_t* payload, size_t* length);
+    bool readTrack(uint32_t offset, TrackConfig* config);
+    int findEntry(const char* name, uint32_t hash);
+
+    bool write(RecordType type, const uint8_t* payload, size_t length, IndexEntry* entry);
+    bool needsCompaction() const;
+    void startCompaction();
+    bool step();
+    bool finishCompaction();
+    void compactAll();
+};
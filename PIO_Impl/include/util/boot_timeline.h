@@ -0,0 +1,77 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "util/log.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+/**
+ * Boot timeline.
+ *
+ * setup() and the devices it starts call boot::mark("stage") as each one
+ * becomes usable, up to the first valid fix on screen. A mark keeps the
+ * milliseconds since the application started (the ROM and second stage
+ * bootloaders before that are not counted) and is logged as it happens;
+ * the "boot" serial command prints the whole timeline, for when no serial
+ * monitor was attached yet.
+ *
+ * Marks come from the loop task only. Past MAX_MARKS they are logged but
+ * not kept.
+ */
+namespace boot {
+
+    static const size_t MAX_MARKS = 16;
+
+    struct Mark {
+        const char* stage;     // A literal
+        uint32_t ms;
+    };
+
+    struct Timeline {
+        Mark marks[MAX_MARKS];
+        size_t count;
+    };
+
+    inline Timeline& timeline() {
+        static Timeline instance;
+        return instance;
+    }
+
+    inline uint32_t now() {
+#ifdef ARDUINO
+        return ::millis();
+#else
+        return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    inline void mark(const char* stage) {
+        Timeline& t = timeline();
+        uint32_t ms = now();
+        if (t.count < MAX_MARKS) {
+            t.marks[t.count].stage = stage;
+            t.marks[t.count].ms = ms;
+            t.count++;
+        }
+        LOG_INFO("Boot: %s at %u ms", stage, (unsigned int)ms);
+    }
+
+    // Each stage with its time and the time since the one before; Out needs
+    // a printf method
+    template<typename Out>
+    void dump(Out& out) {
+        const Timeline& t = timeline();
+        uint32_t last = 0;
+        for (size_t i = 0; i < t.count; i++) {
+            const Mark& m = t.marks[i];
+            out.printf("%-16s %6u ms  +%u\n", m.stage, (unsigned int)m.ms, (unsigned int)(m.ms - last));
+            last = m.ms;
+        }
+    }
+
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// A byte stream that never blocks: the native USB CDC port on the device,
+// a pseudo-terminal in the host tools
+class ByteLink {
+public:
+    virtual ~ByteLink() = default;
+    // Whatever has arrived, up to max; possibly nothing
+    virtual size_t read(uint8_t* data, size_t max) = 0;
+    // Whatever fits right now; possibly nothing
+    virtual size_t write(const uint8_t* data, size_t length) = 0;
+};
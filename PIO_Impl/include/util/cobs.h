@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Consistent Overhead Byte Stuffing. Encoded data contains no zero bytes,
+// so a single 0x00 can delimit frames on a byte stream and a receiver can
+// resynchronise after garbage by waiting for the next delimiter.
+namespace cobs {
+
+    // Worst case encoded size for a given input length
+    constexpr size_t maxEncodedSize(size_t length) {
+        return length + length / 254 + 1;
+    }
+
+    // Encodes length bytes into out (maxEncodedSize(length) bytes). Returns
+    // the encoded length, without the trailing delimiter.
+    inline size_t encode(const uint8_t* in, size_t length, uint8_t* out) {
+        size_t codeIndex = 0;
+        size_t outIndex = 1;
+        uint8_t code = 1;
+
+        for (size_t i = 0; i < length; i++) {
+            if (in[i] == 0) {
+                out[codeIndex] = code;
+                codeIndex = outIndex++;
+                code = 1;
+                continue;
+            }
+            out[outIndex++] = in[i];
+            if (++code == 0xFF) {
+                out[codeIndex] = code;
+                codeIndex = outIndex++;
+                code = 1;
+            }
+        }
+        out[codeIndex] = code;
+        return outIndex;
+    }
+
+    // Decodes a frame (without delimiter) into out, which needs length bytes.
+    // Returns the decoded length, or 0 if the frame is malformed.
+    inline size_t decode(const uint8_t* in, size_t length, uint8_t* out) {
+        size_t inIndex = 0;
+        size_t outIndex = 0;
+
+        while (inIndex < length) {
+            uint8_t code = in[inIndex++];
+            if (code == 0 || inIndex + code - 1 > length) {
+                return 0;
+            }
+            for (uint8_t i = 1; i < code; i++) {
+                uint8_t byte = in[inIndex++];
+                if (byte == 0) {
+                    return 0;
+                }
+                out[outIndex++] = byte;
+            }
+            if (code != 0xFF && inIndex < length) {
+                out[outIndex++] = 0;
+            }
+        }
+        return outIndex;
+    }
+
+}
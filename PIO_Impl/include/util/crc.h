@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Small table-free checksums shared by the flash stores and wire formats.
+// Both are plain bit-serial implementations; records are at most a few
+// hundred bytes so a lookup table is not worth the flash.
+namespace crc {
+
+    // CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+    inline uint16_t crc16(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF) {
+        for (size_t i = 0; i < length; i++) {
+            crc ^= (uint16_t)data[i] << 8;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+            }
+        }
+        return crc;
+    }
+
+    // CRC-32 (IEEE 802.3, reflected poly 0xEDB88320)
+    inline uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0) {
+        crc = ~crc;
+        for (size_t i = 0; i < length; i++) {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+            }
+        }
+        return ~crc;
+    }
+
+}
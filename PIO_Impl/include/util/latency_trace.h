@@ -0,0 +1,101 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+/**
+ * Fix-to-pixel latency tracing.
+ *
+ * Every GNSS fix gets a sequence number when it is received. Pipeline stages
+ * call LATENCY_MARK(sequence, stage) as the fix passes through them, which
+ * appends (sequence, stage, microseconds) to a fixed ring. The "trace"
+ * serial command dumps the ring as text and tools/latency_report.py turns
+ * it into per-stage and total latency distributions.
+ *
+ * Build with -D DATALOGGER_LATENCY_TRACE to enable; otherwise the marks
+ * compile away.
+ */
+enum class LatencyStage : uint8_t {
+    FixReceived,     // PVT message seen by SensorManager
+    FixRead,         // GNSSData filled in
+    DeltaComputed,   // delta_calculator::update() done
+    Displayed,       // Last display command for this fix returned
+    Count
+};
+
+namespace latency {
+
+    struct Event {
+        uint32_t sequence;
+        uint32_t micros;
+        LatencyStage stage;
+    };
+
+    inline uint32_t now() {
+#ifdef ARDUINO
+        return ::micros();
+#else
+        return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+#ifdef DATALOGGER_LATENCY_TRACE
+    static const size_t RING_SIZE = 1024;  // Power of two
+
+    struct Ring {
+        Event events[RING_SIZE];
+        std::atomic<uint32_t> head;
+    };
+
+    inline Ring& ring() {
+        static Ring instance;
+        return instance;
+    }
+
+    inline void mark(uint32_t sequence, LatencyStage stage, uint32_t micros) {
+        Ring& r = ring();
+        uint32_t slot = r.head.fetch_add(1, std::memory_order_relaxed) & (RING_SIZE - 1);
+        r.events[slot] = Event{ sequence, micros, stage };
+    }
+
+    // Prints the ring oldest first; Out needs a printf method
+    template<typename Out>
+    void dump(Out& out) {
+        Ring& r = ring();
+        uint32_t head = r.head.load(std::memory_order_relaxed);
+        uint32_t count = head < RING_SIZE ? head : RING_SIZE;
+        out.printf("trace begin %u\n", (unsigned int)count);
+        for (uint32_t i = head - count; i != head; i++) {
+            const Event& e = r.events[i & (RING_SIZE - 1)];
+            out.printf("L,%u,%u,%u\n", (unsigned int)e.sequence, (unsigned int)e.stage, (unsigned int)e.micros);
+        }
+        out.printf("trace end\n");
+    }
+
+    inline void reset() {
+        ring().head.store(0, std::memory_order_relaxed);
+    }
+#else
+    template<typename Out>
+    void dump(Out& out) {
+        out.printf("Latency tracing disabled, build with -D DATALOGGER_LATENCY_TRACE\n");
+    }
+
+    inline void reset() {}
+#endif
+
+}
+
+#ifdef DATALOGGER_LATENCY_TRACE
+#define LATENCY_MARK(sequence, stage) latency::mark((sequence), (stage), latency::now())
+#define LATENCY_MARK_AT(sequence, stage, micros) latency::mark((sequence), (stage), (micros))
+#else
+#define LATENCY_MARK(sequence, stage) do {} while (0)
+#define LATENCY_MARK_AT(sequence, stage, micros) do {} while (0)
+#endif
@@ -0,0 +1,186 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+/**
+ * Deferred, tokenized logging.
+ *
+ * LOG_INFO("GNSS rate is %dHz", rate) does not format anything. It pushes
+ * the format string address (the token), a timestamp and the raw argument
+ * bytes into a lock-free ring, which is safe from both cores. The main loop
+ * later drains the ring: as text on the debug port via logging::drain(), or
+ * as binary log packets on the telemetry stream, formatted on the host by
+ * tools/telemetry_decode.py --elf firmware.elf.
+ *
+ * Messages below DATALOGGER_LOG_LEVEL compile away entirely, arguments
+ * included. %s arguments are copied (up to MAX_STRING bytes); '*' width
+ * and precision are not supported.
+ *
+ * tools/log_bench/log_bench.cpp compares the per-call cost with
+ * Serial.printf.
+ */
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef DATALOGGER_LOG_LEVEL
+#define DATALOGGER_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+namespace logging {
+
+    static const size_t MAX_ARGS = 48;     // Encoded argument bytes per record
+    static const size_t MAX_STRING = 31;
+    static const size_t RING_SIZE = 64;    // Power of two
+
+    struct Record {
+        const char* format;
+        uint32_t micros;
+        uint8_t level;
+        uint8_t length;
+        uint8_t args[MAX_ARGS];
+    };
+
+    inline uint32_t now() {
+#ifdef ARDUINO
+        return ::micros();
+#else
+        return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Little-endian argument encoder. Integers take 4 or 8 bytes depending on
+    // their size, floating point is widened to double like printf does, and
+    // strings are stored as a length byte plus characters.
+    class ArgWriter {
+    public:
+        explicit ArgWriter(uint8_t* data) : data(data), length(0) {}
+
+        template<typename T>
+        typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+        put(T value) {
+            if (sizeof(T) <= 4) {
+                uint32_t v = std::is_signed<T>::value ? (uint32_t)(int32_t)value : (uint32_t)value;
+                bytes(&v, 4);
+            } else {
+                uint64_t v = (uint64_t)value;
+                bytes(&v, 8);
+            }
+        }
+
+        void put(double value) { bytes(&value, 8); }
+
+        void put(const char* value) {
+            size_t n = value ? strnlen(value, MAX_STRING) : 0;
+            if (length + 1 + n > MAX_ARGS) {
+                n = length + 1 < MAX_ARGS ? MAX_ARGS - length - 1 : 0;
+            }
+            if (length < MAX_ARGS) {
+                data[length++] = (uint8_t)n;
+                memcpy(data + length, value, n);
+                length += n;
+            }
+        }
+
+        void put(char* value) { put((const char*)value); }
+
+        void put(const void* value) { put((uint32_t)(uintptr_t)value); }
+
+        size_t size() const { return length; }
+
+    private:
+        uint8_t* data;
+        size_t length;
+
+        void bytes(const void* value, size_t n) {
+            if (length + n <= MAX_ARGS) {
+                memcpy(data + length, value, n);
+                length += n;
+            }
+        }
+    };
+
+    bool push(uint8_t level, const char* format, const uint8_t* args, size_t length);
+    bool pop(Record& record);
+    uint32_t dropped();
+
+    // Formats a record the way printf would have; returns the text length
+    size_t format(const Record& record, char* out, size_t size);
+
+    template<typename... Args>
+    void write(uint8_t level, const char* format, Args... args) {
+        if (sizeof...(Args) == 0) {
+            push(level, format, nullptr, 0);
+            return;
+        }
+        uint8_t data[MAX_ARGS];
+        ArgWriter writer(data);
+        int expand[] = { 0, (writer.put(args), 0)... };
+        (void)expand;
+        push(level, format, data, writer.size());
+    }
+
+    // Formats up to maxRecords queued messages as text lines on out, which
+    // needs a write(const uint8_t*, size_t) method. Returns records written.
+    template<typename Out>
+    size_t drain(Out& out, size_t maxRecords = RING_SIZE) {
+        static const char LEVELS[] = "-EWID";
+        char line[160];
+        Record record;
+        size_t written = 0;
+
+        while (written < maxRecords && pop(record)) {
+            int prefix = snprintf(line, sizeof(line), "[%c %lu.%06lu] ", LEVELS[record.level <= LOG_LEVEL_DEBUG ? record.level : 0],
+                                  (unsigned long)(record.micros / 1000000), (unsigned long)(record.micros % 1000000));
+            size_t length = prefix + format(record, line + prefix, sizeof(line) - prefix - 1);
+            line[length++] = '\n';
+            out.write((const uint8_t*)line, length);
+            written++;
+        }
+        return written;
+    }
+
+}
+
+// The dead printf call lets the compiler check arguments against the format
+#define LOG_AT(level, fmt, ...) do { \
+    if (false) printf(fmt, ##__VA_ARGS__); \
+    logging::write((level), fmt, ##__VA_ARGS__); \
+} while (0)
+
+#if DATALOGGER_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#if DATALOGGER_LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if DATALOGGER_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if DATALOGGER_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
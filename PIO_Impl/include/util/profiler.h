@@ -0,0 +1,181 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+/**
+ * Scoped per-stage latency probes based on the CPU cycle counter.
+ *
+ * Build with -D DATALOGGER_PROFILING to enable. Otherwise PROFILE_SCOPE
+ * expands to an empty statement and no histogram storage is linked in.
+ *
+ * Each stage keeps a log-linear histogram (8 sub-buckets per power of two,
+ * so percentiles are within 12.5%) plus exact min and max. On the device a
+ * tick is one CPU cycle; on the host it is one nanosecond.
+ */
+enum class ProfileStage : uint8_t {
+    Loop,
+    GnssRead,
+    ImuRead,
+    DeltaCalc,
+    GateCheck,
+    DeltaBarDraw,
+    SpeedometerDraw,
+    SectorDraw,
+    LapTimerDraw,
+    StatusBarDraw,
+    PanelSwitch,
+    Count
+};
+
+namespace profiler {
+
+    inline uint32_t now() {
+#ifdef ARDUINO
+        return ESP.getCycleCount();
+#else
+        return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    inline uint32_t ticksPerMicrosecond() {
+#ifdef ARDUINO
+        return getCpuFrequencyMhz();
+#else
+        return 1000;
+#endif
+    }
+
+    inline const char* stageName(ProfileStage stage) {
+        static const char* const names[] = {
+            "loop", "gnss_read", "imu_read", "delta_calc", "gate_check",
+            "draw_delta", "draw_speed", "draw_sector", "draw_laptime", "draw_status",
+            "panel_switch"
+        };
+        return names[(size_t)stage];
+    }
+
+    class Histogram {
+    public:
+        static const int SUB_BITS = 3;
+        static const int SUBS = 1 << SUB_BITS;
+        static const int BUCKETS = SUBS + (32 - SUB_BITS) * SUBS;
+
+        Histogram() { reset(); }
+
+        void reset() {
+            memset(buckets, 0, sizeof(buckets));
+            count = 0;
+            minTicks = UINT32_MAX;
+            maxTicks = 0;
+        }
+
+        void record(uint32_t ticks) {
+            buckets[bucketOf(ticks)]++;
+            count++;
+            if (ticks < minTicks) minTicks = ticks;
+            if (ticks > maxTicks) maxTicks = ticks;
+        }
+
+        // Upper bound of the bucket holding the given percentile (0-100)
+        uint32_t percentile(float pct) const {
+            if (count == 0) return 0;
+            uint32_t target = (uint32_t)(count * pct / 100.0f);
+            if (target >= count) target = count - 1;
+            uint32_t seen = 0;
+            for (int i = 0; i < BUCKETS; i++) {
+                seen += buckets[i];
+                if (seen > target) {
+                    uint32_t upper = upperBound(i);
+                    return upper < maxTicks ? upper : maxTicks;
+                }
+            }
+            return maxTicks;
+        }
+
+        uint32_t getCount() const { return count; }
+        uint32_t getMin() const { return count ? minTicks : 0; }
+        uint32_t getMax() const { return maxTicks; }
+
+    private:
+        uint32_t buckets[BUCKETS];
+        uint32_t count;
+        uint32_t minTicks;
+        uint32_t maxTicks;
+
+        static int bucketOf(uint32_t v) {
+            if (v < (uint32_t)SUBS) return v;
+            int msb = 31 - __builtin_clz(v);
+            int sub = (v >> (msb - SUB_BITS)) & (SUBS - 1);
+            return SUBS + (msb - SUB_BITS) * SUBS + sub;
+        }
+
+        static uint32_t upperBound(int bucket) {
+            if (bucket < SUBS) return bucket;
+            int msb = (bucket - SUBS) / SUBS + SUB_BITS;
+            uint32_t sub = (bucket - SUBS) % SUBS;
+            uint64_t lower = (uint64_t)(SUBS | sub) << (msb - SUB_BITS);
+            uint64_t upper = lower + ((uint64_t)1 << (msb - SUB_BITS)) - 1;
+            return upper > UINT32_MAX ? UINT32_MAX : (uint32_t)upper;
+        }
+    };
+
+#ifdef DATALOGGER_PROFILING
+    inline Histogram& histogram(ProfileStage stage) {
+        static Histogram histograms[(size_t)ProfileStage::Count];
+        return histograms[(size_t)stage];
+    }
+
+    class Scope {
+    public:
+        explicit Scope(ProfileStage stage) : stage(stage), start(now()) {}
+        ~Scope() { histogram(stage).record(now() - start); }
+
+    private:
+        ProfileStage stage;
+        uint32_t start;
+    };
+
+    inline void reset() {
+        for (size_t i = 0; i < (size_t)ProfileStage::Count; i++) {
+            histogram((ProfileStage)i).reset();
+        }
+    }
+
+    // Prints one row per stage in microseconds; Out needs a printf method
+    template<typename Out>
+    void dump(Out& out) {
+        float scale = 1.0f / ticksPerMicrosecond();
+        out.printf("%-14s %8s %9s %9s %9s %9s\n", "stage", "count", "min_us", "p50_us", "p99_us", "max_us");
+        for (size_t i = 0; i < (size_t)ProfileStage::Count; i++) {
+            const Histogram& h = histogram((ProfileStage)i);
+            if (h.getCount() == 0) continue;
+            out.printf("%-14s %8u %9.1f %9.1f %9.1f %9.1f\n", stageName((ProfileStage)i),
+                       (unsigned int)h.getCount(), h.getMin() * scale, h.percentile(50) * scale,
+                       h.percentile(99) * scale, h.getMax() * scale);
+        }
+    }
+#else
+    inline void reset() {}
+
+    template<typename Out>
+    void dump(Out& out) {
+        out.printf("Profiling disabled, build with -D DATALOGGER_PROFILING\n");
+    }
+#endif
+
+}
+
+#ifdef DATALOGGER_PROFILING
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(stage) profiler::Scope PROFILE_CONCAT(profileScope_, __LINE__)(stage)
+#else
+#define PROFILE_SCOPE(stage) do {} while (0)
+#endif
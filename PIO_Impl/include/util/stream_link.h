@@ -0,0 +1,28 @@
+#pragma once
+#include <Arduino.h>
+#include "util/byte_link.h"
+
+// An Arduino Stream, the native USB CDC port, as a link
+class StreamLink : public ByteLink {
+public:
+    explicit StreamLink(Stream& stream) : stream(stream) {}
+
+    size_t read(uint8_t* data, size_t max) override {
+        size_t n = 0;
+        while (n < max && stream.available() > 0) {
+            data[n++] = stream.read();
+        }
+        return n;
+    }
+
+    size_t write(const uint8_t* data, size_t length) override {
+        int room = stream.availableForWrite();
+        if (room <= 0) {
+            return 0;
+        }
+        return stream.write(data, length < (size_t)room ? length : room);
+    }
+
+private:
+    Stream& stream;
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * Single-writer, single-reader triple buffer.
+ *
+ * The writer fills writeBuffer() and publish()es it; the reader calls
+ * update() and then reads read(). Neither side ever waits for the other or
+ * sees a half-written value: the three slots are only ever swapped through
+ * one atomic exchange. The reader always gets the latest published value;
+ * intermediate ones it was too slow for are skipped.
+ */
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : buffers(), middle(1), back(2), front(0) {}
+
+    // Writer side
+    T& writeBuffer() { return buffers[back]; }
+
+    void publish() {
+        uint8_t previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = previous & INDEX;
+    }
+
+    // Reader side; true when a newer value than the last read() is available
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+            return false;
+        }
+        uint8_t previous = middle.exchange(front, std::memory_order_acq_rel);
+        front = previous & INDEX;
+        return true;
+    }
+
+    const T& read() const { return buffers[front]; }
+
+private:
+    static const uint8_t INDEX = 0x03;
+    static const uint8_t FRESH = 0x04;
+
+    T buffers[3];
+    std::atomic<uint8_t> middle;   // Index of the hand-over slot, plus FRESH
+    uint8_t back;                  // Owned by the writer
+    uint8_t front;                 // Owned by the reader
+};
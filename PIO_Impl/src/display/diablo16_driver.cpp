@@ -1,4 +1,5 @@
 #include "display/diablo16_driver.h"
+#include "util/log.h"
 
 Diablo16Driver::Diablo16Driver(uint8_t rxPin, uint8_t txPin, uint8_t resetPin)
     : display(&Serial2)
@@ -9,19 +10,15 @@ Diablo16Driver::Diablo16Driver(uint8_t rxPin, uint8_t txPin, uint8_t resetPin)
     , backgroundColor(BLACK)
 {
     // Initialize pins early to avoid floating states
-    Serial.println("Initializing display pins...");
     pinMode(rxPin, INPUT);
-    Serial.println("RX pin set to input");
     pinMode(txPin, OUTPUT);
-    Serial.println("TX pin set to output");
     pinMode(resetPin, OUTPUT);
-    Serial.println("Reset pin set to output");
     digitalWrite(resetPin, HIGH);  // Start with reset inactive
-    Serial.println("Display pins initialized");
+    LOG_DEBUG("Display pins initialized");
 }
 
 bool Diablo16Driver::init() {
-    Serial.println("Initializing Diablo16 display...");
+    LOG_DEBUG("Initializing Diablo16 display...");
     
     // Stop any existing serial communication
     if (serial->available()) {
@@ -30,27 +27,29 @@ bool Diablo16Driver::init() {
     
     // Configure serial with lower baud rate first
     serial->begin(9600, SERIAL_8N1, 18, 17);
-    delay(100);  // Give some time for serial to stabilize
 
-    Serial.println("Serial configured, performing hardware reset...");
+    LOG_DEBUG("Serial configured, performing hardware reset...");
     
     // Perform hardware reset
     hardwareReset();
+    if (!waitReady()) {
+        LOG_ERROR("Display not responding after reset!");
+        return false;
+    }
     
     // Try to get screen dimensions
     updateScreenDimensions();
     
     if (width == 0 || height == 0) {
-        Serial.println("Failed to get screen dimensions!");
+        LOG_ERROR("Failed to get screen dimensions!");
         return false;
     }
     
-    Serial.printf("Display initialized successfully. Dimensions: %dx%d\n", width, height);
+    LOG_INFO("Display initialized successfully. Dimensions: %dx%d", width, height);
     return true;
 }
 
 void Diablo16Driver::clear() {
-    Serial.println("Clearing display");
     display.gfx_Cls();
 }
 
@@ -68,29 +67,46 @@ uint16_t Diablo16Driver::getHeight() {
 }
 
 void Diablo16Driver::hardwareReset() {
-    Serial.println("Performing hardware reset...");
+    LOG_DEBUG("Performing hardware reset...");
     digitalWrite(resetPin, LOW);
-    delay(200);  // Increased reset time
+    delayMicroseconds(RESET_PULSE_US);
     digitalWrite(resetPin, HIGH);
-    delay(1000); // Reduced post-reset delay, was 3000
-    Serial.println("Hardware reset complete");
+    LOG_DEBUG("Hardware reset complete");
+}
+
+// The module ignores the link while it boots, for about a second and
+// longer with a uSD card; ask for the width until it answers
+bool Diablo16Driver::waitReady() {
+    int timeLimit = display.TimeLimit4D;
+    display.TimeLimit4D = READY_POLL_MS;
+    uint32_t start = millis();
+    bool ready = false;
+    while (!ready && millis() - start < READY_TIMEOUT_MS) {
+        // A late reply to the last attempt would be taken for this one's
+        while (serial->available()) {
+            serial->read();
+        }
+        width = display.gfx_Get(X_MAX);
+        ready = display.Error4D == Err4D_OK && width > 0;
+    }
+    display.TimeLimit4D = timeLimit;
+    if (ready) {
+        LOG_INFO("Display ready %u ms after reset", (unsigned int)(millis() - start));
+    }
+    return ready;
 }
 
 void Diablo16Driver::updateScreenDimensions() {
     // Add retry mechanism for getting screen dimensions
-    Serial.println("Getting screen dimensions...");
     for (int i = 0; i < 3; i++) {
         width = display.gfx_Get(X_MAX);
-        Serial.printf("Width: %d\n", width);
         height = display.gfx_Get(Y_MAX);
-        Serial.printf("Height: %d\n", height);
         
         if (width > 0 && height > 0) {
-            Serial.printf("Screen dimensions: %dx%d\n", width, height);
             break;
         }
         
-        Serial.printf("Retry %d getting screen dimensions...\n", i + 1);
+        LOG_WARN("Retry %d getting screen dimensions...", i + 1);
         delay(100);
     }
 }
\ No newline at end of file
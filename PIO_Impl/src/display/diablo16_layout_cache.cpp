@@ -0,0 +1,73 @@
+#include "display/diablo16_layout_cache.h"
+#include "util/log.h"
+
+Diablo16LayoutCache::Diablo16LayoutCache(Diablo_Serial_4DLib* display)
+    : display(display)
+    , mounted(false)
+    , width(0)
+    , height(0)
+{
+    for (uint8_t i = 0; i < MAX_SLOTS; i++) {
+        handles[i] = NO_HANDLE;
+    }
+}
+
+Diablo16LayoutCache::~Diablo16LayoutCache() {
+    for (uint8_t i = 0; i < MAX_SLOTS; i++) {
+        close(i);
+    }
+}
+
+bool Diablo16LayoutCache::begin() {
+    if (!display->file_Mount()) {
+        LOG_WARN("No uSD card in the display, layouts are drawn");
+        return false;
+    }
+    // gfx_Get returns the largest coordinate
+    width = display->gfx_Get(X_MAX) + 1;
+    height = display->gfx_Get(Y_MAX) + 1;
+    mounted = true;
+    return true;
+}
+
+bool Diablo16LayoutCache::capture(uint8_t slot) {
+    if (!mounted || slot >= MAX_SLOTS) {
+        return false;
+    }
+    close(slot);
+
+    char name[13];
+    fileName(slot, name);
+    uint16_t handle = display->file_Open(name, 'w');
+    if (handle == NO_HANDLE) {
+        LOG_WARN("Cannot create layout %u: error %u", slot, display->file_Error());
+        return false;
+    }
+    bool written = display->file_ScreenCapture(0, 0, width, height, handle) == 0;
+    display->file_Close(handle);
+    if (!written) {
+        LOG_WARN("Layout %u capture failed: error %u", slot, display->file_Error());
+        return false;
+    }
+
+    handles[slot] = display->file_Open(name, 'r');
+    return handles[slot] != NO_HANDLE;
+}
+
+bool Diablo16LayoutCache::restore(uint8_t slot) {
+    if (slot >= MAX_SLOTS || handles[slot] == NO_HANDLE) {
+        return false;
+    }
+    return display->file_Seek(handles[slot], 0, 0) && display->file_Image(0, 0, handles[slot]) == 0;
+}
+
+void Diablo16LayoutCache::fileName(uint8_t slot, char* name) {
+    snprintf(name, 13, "LAYOUT%u.GCI", slot);
+}
+
+void Diablo16LayoutCache::close(uint8_t slot) {
+    if (handles[slot] != NO_HANDLE) {
+        display->file_Close(handles[slot]);
+        handles[slot] = NO_HANDLE;
+    }
+}
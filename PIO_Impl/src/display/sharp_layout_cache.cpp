@@ -0,0 +1,56 @@
+#include "display/sharp_layout_cache.h"
+#include <string.h>
+#include <esp_heap_caps.h>
+#include "util/log.h"
+
+SharpLayoutCache::SharpLayoutCache(SharpDisplay* display)
+    : display(display)
+    , frames(nullptr)
+    , frameSize(0)
+{
+    for (uint8_t i = 0; i < MAX_SLOTS; i++) {
+        captured[i] = false;
+    }
+}
+
+SharpLayoutCache::~SharpLayoutCache() {
+    heap_caps_free(frames);
+}
+
+bool SharpLayoutCache::begin() {
+    if (frames) {
+        return true;
+    }
+    frameSize = display->getFramebufferSize();
+    frames = static_cast<uint8_t*>(heap_caps_malloc(MAX_SLOTS * frameSize, MALLOC_CAP_SPIRAM));
+    if (!frames) {
+        LOG_WARN("No PSRAM for %u layouts, layouts are drawn", MAX_SLOTS);
+        return false;
+    }
+    return true;
+}
+
+bool SharpLayoutCache::capture(uint8_t slot) {
+    if (!frames || slot >= MAX_SLOTS) {
+        return false;
+    }
+    const uint8_t* screen = display->getFramebuffer();
+    if (!screen) {
+        return false;
+    }
+    memcpy(frames + slot * frameSize, screen, frameSize);
+    captured[slot] = true;
+    return true;
+}
+
+bool SharpLayoutCache::restore(uint8_t slot) {
+    if (slot >= MAX_SLOTS || !captured[slot]) {
+        return false;
+    }
+    uint8_t* screen = display->getFramebuffer();
+    if (!screen) {
+        return false;
+    }
+    memcpy(screen, frames + slot * frameSize, frameSize);
+    return true;
+}
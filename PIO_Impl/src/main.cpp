@@ -1,6 +1,27 @@
 #include <Arduino.h>
 #include "display/sharp_driver.h"
+#include "display/sharp_layout_cache.h"
+#include "panels/panel_manager.h"
+#include "panels/racing_panel/racing_panel.h"
+#include "panels/sensor_panel/sensor_panel.h"
 #include "sensors/SensorManager.h"
+#include "track/track_manager.h"
+#include "calculations/track_builder.h"
+#include "util/profiler.h"
+#include "util/latency_trace.h"
+#include "telemetry/telemetry.h"
+#include "util/stream_link.h"
+#include "channels/can_source.h"
+#include "channels/adc_source.h"
+#include "session/partition_flash.h"
+#include "session/print_sink.h"
+#include "session/session_recorder.h"
+#include "session/offload_server.h"
+#include "session/log_retention.h"
+#include "session/black_box.h"
+#include "session/warm_state.h"
+#include "util/log.h"
+#include "util/boot_timeline.h"
 
 #define SHARP_SCK  36
 #define SHARP_MOSI 35
@@ -8,63 +29,669 @@
 #define DISPLAY_WIDTH 400
 #define DISPLAY_HEIGHT 240
 
-Adafruit_SharpMem display(SHARP_SCK, SHARP_MOSI, SHARP_SS, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+#define BRAKE_PRESSURE_PIN 1
+#define OIL_PRESSURE_PIN 2
+#define MARK_BUTTON_PIN 0       // BOOT button, free once running; marks an incident
+
+// Registry channel ids; logs and telemetry carry them, so never renumber
+enum ChannelId : uint8_t {
+    CH_RPM = 1,
+    CH_THROTTLE = 2,
+    CH_COOLANT = 3,
+    CH_GEAR = 4,
+    CH_BRAKE_PRESSURE = 16,
+    CH_OIL_PRESSURE = 17,
+    CH_ACCEL_X = 32,        // IMU, six ids in IMUData order
+    CH_ACCEL_Y = 33,
+    CH_ACCEL_Z = 34,
+    CH_GYRO_X = 35,
+    CH_GYRO_Y = 36,
+    CH_GYRO_Z = 37
+};
+
+const ChannelDef CHANNELS[] = {
+    { CH_RPM,            "rpm",      "1/min", ChannelType::Analog,   100,  1,  1.0f },
+    { CH_THROTTLE,       "throttle", "%",     ChannelType::Analog,   100,  1,  0.1f },
+    { CH_COOLANT,        "coolant",  "C",     ChannelType::Analog,   10,   1,  0.1f },
+    { CH_GEAR,           "gear",     "",      ChannelType::Discrete, 50,   1,  1.0f },
+    { CH_BRAKE_PRESSURE, "brake",    "bar",   ChannelType::Analog,   1000, 2,  0.05f },
+    { CH_OIL_PRESSURE,   "oil",      "bar",   ChannelType::Analog,   1000, 10, 0.05f },
+    { CH_ACCEL_X,        "accel_x",  "m/s2",  ChannelType::Analog,   104,  1,  0.01f },
+    { CH_ACCEL_Y,        "accel_y",  "m/s2",  ChannelType::Analog,   104,  1,  0.01f },
+    { CH_ACCEL_Z,        "accel_z",  "m/s2",  ChannelType::Analog,   104,  1,  0.01f },
+    { CH_GYRO_X,         "gyro_x",   "rad/s", ChannelType::Analog,   104,  1,  0.001f },
+    { CH_GYRO_Y,         "gyro_y",   "rad/s", ChannelType::Analog,   104,  1,  0.001f },
+    { CH_GYRO_Z,         "gyro_z",   "rad/s", ChannelType::Analog,   104,  1,  0.001f },
+};
+
+// Rates the session log keeps; enough for analysis at a fraction of the flash
+struct LoggedChannel {
+    uint8_t id;
+    uint16_t rateHz;
+};
+
+const LoggedChannel LOGGED_CHANNELS[] = {
+    { CH_RPM, 50 },
+    { CH_THROTTLE, 50 },
+    { CH_COOLANT, 1 },
+    { CH_GEAR, 10 },
+    { CH_BRAKE_PRESSURE, 100 },
+    { CH_OIL_PRESSURE, 10 },
+    // The black box has them at full rate around incidents
+    { CH_ACCEL_X, 25 },
+    { CH_ACCEL_Y, 25 },
+    { CH_ACCEL_Z, 25 },
+    { CH_GYRO_X, 25 },
+    { CH_GYRO_Y, 25 },
+    { CH_GYRO_Z, 25 },
+};
+
+// A session starts moving at a known track and ends after a minute standing
+const double RECORD_START_SPEED = 5.0;    // m/s
+const double RECORD_STOP_SPEED = 1.0;     // m/s
+const uint32_t RECORD_STOP_MS = 60000;
+
+// Black box: 1 MB of PSRAM holds about three minutes at full rate; a
+// capture is the 20 s before a trigger and the 10 s after
+const size_t BLACK_BOX_BYTES = 1024 * 1024;
+const uint32_t BLACK_BOX_PRE_US = 20000000;
+const uint32_t BLACK_BOX_POST_US = 10000000;
+const float BLACK_BOX_G = 1.8f;    // Beyond what the car does on grip
+
+// A reset resumes from a snapshot at most this old
+const uint32_t WARM_SAVE_MS = 1000;
+
+// The panels render on core 0, away from the loop on core 1; a Sharp
+// refresh takes a good part of this
+const uint32_t RENDER_PERIOD_MS = 50;
+const BaseType_t RENDER_CORE = 0;
+
+// ECU broadcast, from its DBC: RPM and throttle at 100 Hz, gear at 50 Hz,
+// coolant at 10 Hz
+const CanSignal CAN_SIGNALS[] = {
+    { 0x360, 0,  16, false, false, 1.0f,   0.0f,   CH_RPM },
+    { 0x360, 16, 16, false, false, 0.1f,   0.0f,   CH_THROTTLE },
+    { 0x3E0, 7,  16, true,  true,  0.1f,   -50.0f, CH_COOLANT },
+    { 0x470, 0,  4,  false, false, 1.0f,   0.0f,   CH_GEAR },
+};
+
+// 0.5-4.5 V sensors behind a 2:3 divider: 0 to 100 bar over 333-3000 mV
+const float PRESSURE_SCALE = 100.0f / 2667.0f;
+const float PRESSURE_OFFSET = -333.0f * PRESSURE_SCALE;
+
+SharpDisplay screen(SHARP_SCK, SHARP_MOSI, SHARP_SS, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+RacingPanel<SharpDisplay> racingPanel(&screen);
+SensorPanel<SharpDisplay> sensorPanel(&screen);
+SharpLayoutCache layoutCache(&screen);
+PanelManager panels(&screen, &layoutCache);
+uint8_t racingPage = PanelManager::NONE;
+bool renderTaskRunning = false;   // Otherwise the loop renders
 SensorManager sensors;
+TrackManager trackManager;
+StreamLink usbLink(Serial);   // Native USB CDC
+Telemetry telemetry(usbLink);
+bool trackDetected = false;
+TrackBuilder* trackBuilder = nullptr;   // Only while "track learn" records
+char learnName[MAX_TRACK_NAME_LENGTH];
+ChannelRegistry channels;
+CanDecoder canDecoder;
+CanTask canBus(canDecoder, channels);
+AdcSource analogInputs(channels);
+ChannelReader telemetryReaders[ChannelRegistry::MAX_CHANNELS];   // Live view of every channel
+PartitionFlash logFlash;
+SessionLog sessionLog(logFlash);
+SessionRecorder recorder(sessionLog, channels);
+LogRetention retention(sessionLog);
+BlackBox blackBox(channels, recorder);
+OffloadServer offload(sessionLog, usbLink, millis);
+bool offloading = false;    // The USB port belongs to the offload protocol
+PrintSink usbText(Serial);
+StoredSession* exportSource = nullptr;   // Only while "export" runs, like the exporter
+SessionExporter* exporter = nullptr;
+uint32_t exportStartMs = 0;
 
-void displaySensorData(const GNSSData& gnss, const IMUData& imu) {
-    display.clearDisplay();
-    display.setTextSize(1);
-    display.setTextColor(0x0000);
-    
-    // GNSS Data
-    display.setCursor(10, 10);
-    display.print("Lat: "); display.println(gnss.latitude, 6);
-    display.setCursor(10, 20);
-    display.print("Lon: "); display.println(gnss.longitude, 6);
-    
-    // IMU Data
-    display.setCursor(10, 40);
-    display.print("AccelX: "); display.println(imu.accelX);
-    
-    display.refresh();
+// System time runs on the RTC timer and keeps counting through resets
+uint64_t rtcClockUs() {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    return (uint64_t)now.tv_sec * 1000000ull + now.tv_usec;
+}
+
+RTC_NOINIT_ATTR uint8_t warmMemory[WarmStore::MEMORY_SIZE];
+WarmStore warmStore(warmMemory, rtcClockUs);
+
+// The current track's gates and stored best lap to the racing panel,
+// which then takes over the screen
+void startTrack() {
+    TrackConfig track;
+    if (trackManager.getCurrentTrack(&track)) {
+        racingPanel.loadTrack(track);
+        panels.show(racingPage);
+    }
+}
+
+void finishExport() {
+    uint32_t elapsed = millis() - exportStartMs;
+    LOG_INFO("Exported %u rows in %u ms, %u rows/s, %u damaged chunks", (unsigned int)exporter->getRows(),
+             (unsigned int)elapsed, (unsigned int)(exporter->getRows() * 1000ull / (elapsed ? elapsed : 1)),
+             (unsigned int)exporter->getBadChunks());
+    delete exporter;
+    delete exportSource;
+    exporter = nullptr;
+    exportSource = nullptr;
+}
+
+// Line-based commands on the debug serial port
+void handleSerialCommand(const char* command) {
+    if (strcmp(command, "prof") == 0) {
+        profiler::dump(Serial);
+    } else if (strcmp(command, "prof reset") == 0) {
+        profiler::reset();
+        Serial.println("Profiler reset");
+    } else if (strcmp(command, "trace") == 0) {
+        latency::dump(Serial);
+    } else if (strcmp(command, "trace reset") == 0) {
+        latency::reset();
+        Serial.println("Latency trace reset");
+    } else if (strcmp(command, "gnss") == 0) {
+        const UbxParser::Stats& stats = sensors.getGNSSStats();
+        SatelliteSummary sats = sensors.getSatellites();
+        Serial.printf("UBX %u bytes, %u frames, %u checksum errors, %u oversized, %u split\n",
+                      (unsigned int)stats.bytes, (unsigned int)stats.frames, (unsigned int)stats.checksumErrors,
+                      (unsigned int)stats.oversized, (unsigned int)stats.assembled);
+        Serial.printf("Satellites %u visible, %u used, %u dBHz\n", sats.visible, sats.used, sats.meanCno);
+    } else if (strcmp(command, "boot") == 0) {
+        boot::dump(Serial);
+        if (sensors.hasGNSSFailed()) {
+            Serial.println("GNSS not configured");
+        }
+    } else if (strcmp(command, "bus") == 0) {
+        BusScheduler& bus = sensors.getBusScheduler();
+        BusScheduler::ClientStats imu = bus.getStats(I2cBus::CLIENT_IMU);
+        Serial.printf("I2C %.1f%% busy; IMU %u reads, %u failed, %u late, wait p50 %u p99 %u max %u us\n",
+                      bus.utilization() * 100.0f, (unsigned int)imu.transactions, (unsigned int)imu.failures,
+                      (unsigned int)imu.deadlineMisses, (unsigned int)imu.waitUs.percentile(50),
+                      (unsigned int)imu.waitUs.percentile(99), (unsigned int)imu.waitUs.getMax());
+    } else if (strcmp(command, "bus reset") == 0) {
+        sensors.getBusScheduler().resetStats();
+        Serial.println("Bus statistics reset");
+    } else if (strcmp(command, "sessions") == 0) {
+        trackManager.getSessions().forEach([](const SessionRecord& s) {
+            Serial.printf("#%u %s: %u laps in %u s, best %u, p50 %u, best-3 avg %u, sd %u ms, consistency %.2f%%\n",
+                          (unsigned int)s.id, s.track, s.laps.count, (unsigned int)(s.duration / 1000),
+                          (unsigned int)s.laps.best, (unsigned int)s.laps.p50, (unsigned int)s.laps.bestAverage3,
+                          (unsigned int)s.laps.stddev, s.laps.consistency / 100.0f);
+        });
+    } else if (strncmp(command, "track learn ", 12) == 0 && command[12] != '\0') {
+        if (!trackBuilder) {
+            trackBuilder = new TrackBuilder();
+        }
+        trackBuilder->reset();
+        strncpy(learnName, command + 12, sizeof(learnName) - 1);
+        learnName[sizeof(learnName) - 1] = '\0';
+        Serial.printf("Learning %s: drive one lap\n", learnName);
+    } else if (strcmp(command, "track cancel") == 0) {
+        delete trackBuilder;
+        trackBuilder = nullptr;
+        Serial.println("Track learning cancelled");
+    } else if (strcmp(command, "channels") == 0) {
+        const CanSource& can = canBus.getSource();
+        Serial.printf("CAN %u frames, %u unknown\n", (unsigned int)can.getFrames(),
+                      (unsigned int)can.getDecoder().getUnknownFrames());
+        for (size_t i = 0; i < channels.size(); i++) {
+            const ChannelDef& def = channels.getDef(i);
+            ChannelSample latest;
+            bool hasValue = channels.latest(def.id, &latest);
+            Serial.printf("%3u %-10s %-6s %4u Hz /%u: %u published, now %.2f\n", def.id, def.name, def.unit,
+                          def.rateHz, def.decimation, (unsigned int)channels.getPublished(def.id),
+                          hasValue ? latest.value : NAN);
+        }
+    } else if (strcmp(command, "logs") == 0) {
+        for (size_t i = 0; i < sessionLog.count(); i++) {
+            LogSessionInfo info = sessionLog.getInfo(i);
+            Serial.printf("#%u %s: %u bytes%s%s\n", (unsigned int)info.id, info.track, (unsigned int)info.size,
+                          info.starred ? ", starred" : "", info.compacted ? ", laps only" : "");
+        }
+        Serial.printf("%u of %u sectors free%s\n", (unsigned int)sessionLog.getFreeSectors(),
+                      (unsigned int)sessionLog.getSectorCount(), recorder.isRecording() ? ", recording" : "");
+    } else if (strncmp(command, "star ", 5) == 0 || strncmp(command, "unstar ", 7) == 0) {
+        // Starred sessions are never evicted
+        bool star = command[0] == 's';
+        unsigned int id = atoi(command + (star ? 5 : 7));
+        if (!sessionLog.setStarred(id, star)) {
+            Serial.printf("Cannot %s session %u\n", star ? "star" : "unstar", id);
+        }
+    } else if (strcmp(command, "mark") == 0) {
+        if (!blackBox.trigger(logfmt::BURST_BUTTON, micros())) {
+            Serial.println("Not recording or already capturing");
+        }
+    } else if (strcmp(command, "blackbox") == 0) {
+        Serial.printf("Black box holds %u s, %u captures%s, %u samples dropped\n",
+                      (unsigned int)(blackBox.getHeldUs() / 1000000), (unsigned int)blackBox.getCaptures(),
+                      blackBox.isCapturing() ? ", capturing" : "", (unsigned int)blackBox.getDropped());
+    } else if (strcmp(command, "offload") == 0) {
+        // Reading a session that is still being written would race the recorder
+        if (recorder.isRecording()) {
+            Serial.println("Recording, offload refused");
+        } else {
+            telemetry.setEnabled(false);
+            offload.begin();
+            offloading = true;
+        }
+    } else if (strncmp(command, "export ", 7) == 0) {
+        // export ID [csv|vbo] [rows per second]
+        unsigned int id = 0;
+        char format[4] = "csv";
+        unsigned int rate = 10;
+        LogSessionInfo info;
+        if (sscanf(command + 7, "%u %3s %u", &id, format, &rate) < 1 || rate == 0 || rate > 1000) {
+            Serial.println("Usage: export ID [csv|vbo] [rate]");
+        } else if (recorder.isRecording()) {
+            Serial.println("Recording, export refused");
+        } else if (!sessionLog.find(id, &info)) {
+            Serial.printf("No session %u\n", id);
+        } else {
+            exportSource = new StoredSession(sessionLog, id);
+            exporter = new SessionExporter(*exportSource, usbText);
+            SessionExporter::Format kind = strcmp(format, "vbo") == 0 ? SessionExporter::Format::Vbo
+                                                                       : SessionExporter::Format::Csv;
+            telemetry.setEnabled(false);
+            logging::drain(Serial);
+            exportStartMs = millis();
+            if (!exporter->begin(kind, rate)) {
+                LOG_ERROR("Session %u is not readable", id);
+                finishExport();
+            }
+        }
+    } else if (strcmp(command, "panel") == 0) {
+        Panel* active = panels.getPanel(panels.getActive());
+        Serial.printf("Panel %s, last switch %u us\n", active ? active->getName() : "none",
+                      (unsigned int)panels.getLastSwitchUs());
+    } else if (strcmp(command, "panel next") == 0) {
+        panels.showNext();
+    } else if (strcmp(command, "telemetry on") == 0) {
+        // Binary frames share the port with text; decoders resync on 0x00
+        telemetry.setEnabled(true);
+    } else if (strcmp(command, "telemetry off") == 0) {
+        telemetry.setEnabled(false);
+        Serial.println("Telemetry off");
+    } else {
+        Serial.printf("Unknown command: %s\n", command);
+    }
+}
+
+// Feeds a fix to "track learn"; saves and selects the track once the loop closes
+void learnTrack(const GNSSData& gnss) {
+    TrackBuilder::Status status = trackBuilder->add(gnss.latitude, gnss.longitude);
+    if (status == TrackBuilder::Status::Recording) {
+        return;
+    }
+
+    TrackProposal proposal;
+    if (status == TrackBuilder::Status::Full || !trackBuilder->build(TrackBuilder::SectorMode::Straights, &proposal)) {
+        LOG_WARN("No closed loop after %u m, track not learned", (unsigned int)trackBuilder->getPathLength());
+    } else {
+        TrackConfig config;
+        strncpy(config.name, learnName, sizeof(config.name));
+        config.startFinish = proposal.startFinish;
+        config.sector2Start = proposal.sector2Start;
+        config.sector3Start = proposal.sector3Start;
+        config.isValid = true;
+        if (trackManager.saveTrack(config.name, config) && trackManager.setCurrentTrack(config.name)) {
+            trackDetected = true;
+            startTrack();
+            LOG_INFO("Learned track %s, %u m", config.name, (unsigned int)proposal.length);
+        } else {
+            LOG_ERROR("Failed to save learned track %s", config.name);
+        }
+    }
+    delete trackBuilder;
+    trackBuilder = nullptr;
+}
+
+// Starts the session log when the car moves at a known track, ends it
+// after standing for RECORD_STOP_MS
+void updateRecording(const GNSSData& gnss) {
+    static uint32_t stoppedSince = 0;
+    if (!recorder.isRecording()) {
+        if (trackDetected && gnss.isValid && gnss.speed > RECORD_START_SPEED) {
+            TrackConfig track;
+            trackManager.getCurrentTrack(&track);
+            uint32_t id = trackManager.newSession();
+            if (recorder.start(id, track.name, micros())) {
+                LOG_INFO("Recording session %u", (unsigned int)id);
+            }
+            racingPanel.setSession(id);
+            if (!racingPanel.isStintRunning()) {
+                racingPanel.startStint();   // Unless it survived a reset
+            }
+            stoppedSince = millis();
+        }
+        return;
+    }
+    if (gnss.speed >= RECORD_STOP_SPEED) {
+        stoppedSince = millis();
+    } else if (millis() - stoppedSince >= RECORD_STOP_MS) {
+        recorder.stop();
+        racingPanel.stopStint();
+        LOG_INFO("Recording stopped");
+        return;
+    }
+    if (gnss.isValid) {
+        recorder.addFix(gnss.receivedMicros, gnss.latitude, gnss.longitude, gnss.speed, gnss.heading);
+    }
+}
+
+// What a reset should not lose: the track, the racing engine's stint and
+// bests, and the time of the best lap the ReferenceStore holds for the track
+void saveWarmState() {
+    WarmState warm;
+    racingPanel.saveWarm(&warm);
+    warmStore.save(warm);
+}
+
+// After a reset mid-session: the track again without waiting for a fix,
+// with the stint still running and the bests it had
+void restoreWarmState() {
+    WarmState warm;
+    uint32_t ageMs;
+    // Power-on leaves RTC memory random, the CRCs would almost surely catch it
+    if (esp_reset_reason() == ESP_RST_POWERON) {
+        warmStore.clear();
+        return;
+    }
+    if (!warmStore.load(&warm, &ageMs)) {
+        return;
+    }
+    racingPanel.restoreWarm(warm, ageMs);
+    TrackConfig track;
+    if (warm.track[0] && trackManager.getCurrentTrack(&track)) {
+        trackDetected = true;
+        panels.show(racingPage);
+        LOG_INFO("Warm restart at %s, snapshot %u ms old", warm.track, (unsigned int)ageMs);
+    }
+}
+
+// IMU axes to the car's: the board lies flat with the sensor's X axis
+// forward and Y to the left. A different mounting is mapped here.
+void toVehicleFrame(const IMUData& imu, float* forward, float* left) {
+    if (imu.timestamp == 0) {
+        // No sample from the bus task yet
+        *forward = NAN;
+        *left = NAN;
+        return;
+    }
+    *forward = imu.accelX;
+    *left = imu.accelY;
+}
+
+// The mark button triggers a black-box capture on press
+void pollMarkButton() {
+    static bool pressed = false;
+    static uint32_t changedMs = 0;
+    bool down = digitalRead(MARK_BUTTON_PIN) == LOW;
+    if (down == pressed || millis() - changedMs < 50) {
+        return;
+    }
+    pressed = down;
+    changedMs = millis();
+    if (pressed && !blackBox.trigger(logfmt::BURST_BUTTON, micros())) {
+        LOG_INFO("Mark ignored, not recording or already capturing");
+    }
+}
+
+void pollSerialCommands() {
+    static char line[48];   // "track learn " and a full track name
+    static size_t length = 0;
+
+    while (Serial.available()) {
+        char c = Serial.read();
+        if (c == '\r' || c == '\n') {
+            if (length > 0) {
+                line[length] = '\0';
+                handleSerialCommand(line);
+                length = 0;
+            }
+        } else if (length < sizeof(line) - 1) {
+            line[length++] = c;
+        }
+    }
+}
+
+// Deferred log output: tokenized on the telemetry stream, text otherwise
+void drainLogs() {
+    if (telemetry.isEnabled()) {
+        logging::Record record;
+        for (int i = 0; i < 2 && logging::pop(record); i++) {
+            telemetry.sendLog(record);
+        }
+    } else {
+        logging::drain(Serial, 4);
+    }
 }
 
+// Newest channel samples to the live stream. The link only carries a
+// view: a few channels per update, round robin, so the state queue is not
+// overrun, and older samples of a fast channel are skipped here. The
+// registry still has them for other readers.
+void sendChannels() {
+    const size_t CHANNELS_PER_UPDATE = 2;
+    static size_t next = 0;
+    ChannelSample samples[Telemetry::MAX_CHANNEL_SAMPLES];
+    for (size_t sent = 0; sent < CHANNELS_PER_UPDATE && sent < channels.size(); sent++) {
+        next = next + 1 < channels.size() ? next + 1 : 0;
+        ChannelReader& reader = telemetryReaders[next];
+        reader.skip(Telemetry::MAX_CHANNEL_SAMPLES);
+        telemetry.sendChannel(reader.getId(), samples, reader.read(samples, Telemetry::MAX_CHANNEL_SAMPLES));
+    }
+}
+
+// Boot failed, keep the reason visible on the debug port
+void halt() {
+    while (1) {
+        logging::drain(Serial);
+        delay(10);
+    }
+}
+
+// Nothing here waits for a device: the receiver is configured in the
+// background while the rest comes up, and the loop finishes it. Nor for a
+// serial monitor; the log ring and the "boot" command keep what it missed.
 void setup() {
-    // Start with debug serial and wait for it to be ready
     Serial.begin(115200);
-    delay(5000);  // Give serial monitor time to connect
-
-    // Initialize display
-    display.begin();
-    display.clearDisplay();
     
-    Serial.println("Initializing sensors...");
+    // Channels before their sources: add() allocates, publish() does not
+    for (const ChannelDef& def : CHANNELS) {
+        if (!channels.add(def)) {
+            LOG_ERROR("Channel %u not added", def.id);
+        }
+    }
+    sensors.setImuChannels(&channels, CH_ACCEL_X);
 
     if (!sensors.begin()) {
         Serial.println("Failed to initialize sensors!");
-        while (1) delay(10);
+        halt();
     }
+    boot::mark("imu");
 
-    Serial.println("Initializing display...");
+    if (!screen.init()) {
+        LOG_ERROR("Display not responding");
+    }
+    layoutCache.begin();
+    boot::mark("display");
 
-    if (!sensors.begin()) {
-        Serial.println("Failed to initialize sensors!");
-        while (1) delay(10);
+    if (!trackManager.init()) {
+        Serial.println("Failed to initialize track storage!");
     }
+    racingPanel.setTrackManager(&trackManager);
+    racingPanel.setTelemetry(&telemetry);
+    racingPage = panels.add(&racingPanel);
+    panels.show(panels.add(&sensorPanel));   // Until a track is known
+    restoreWarmState();
+    if (!logFlash.begin("logs") || !sessionLog.begin()) {
+        LOG_ERROR("No session log, sessions are not recorded");
+    }
+    boot::mark("storage");
 
-    Serial.println("Setup sequence complete!");
+    for (const CanSignal& signal : CAN_SIGNALS) {
+        canDecoder.add(signal);
+    }
+    for (size_t i = 0; i < channels.size(); i++) {
+        telemetryReaders[i] = channels.subscribe(channels.getDef(i).id);
+    }
+    if (!canBus.begin(500000)) {
+        LOG_WARN("No CAN bus, ECU channels stay empty");
+    }
+    analogInputs.addInput(BRAKE_PRESSURE_PIN, CH_BRAKE_PRESSURE, PRESSURE_SCALE, PRESSURE_OFFSET);
+    analogInputs.addInput(OIL_PRESSURE_PIN, CH_OIL_PRESSURE, PRESSURE_SCALE, PRESSURE_OFFSET);
+    if (!analogInputs.begin(1000)) {
+        LOG_WARN("Analog inputs not started");
+    }
+    for (const LoggedChannel& logged : LOGGED_CHANNELS) {
+        recorder.addChannel(logged.id, logged.rateHz);
+    }
+    if (blackBox.begin(BLACK_BOX_BYTES, BLACK_BOX_PRE_US, BLACK_BOX_POST_US)) {
+        blackBox.setGTrigger(CH_ACCEL_X, CH_ACCEL_Y, BLACK_BOX_G);
+    }
+    pinMode(MARK_BUTTON_PIN, INPUT_PULLUP);
+
+    panels.begin();
+    renderTaskRunning = panels.startRenderTask(RENDER_PERIOD_MS, RENDER_CORE);
+    if (!renderTaskRunning) {
+        LOG_WARN("No render task, the loop draws the display");
+    }
+    boot::mark("setup");
+    logging::drain(Serial);
 }
 
 void loop() {
     static uint32_t lastUpdate = 0;
-    const uint32_t UPDATE_INTERVAL = 50; // Update display every 50ms
-    
+    const uint32_t UPDATE_INTERVAL = 50; // Display and telemetry every 50ms
+    static GNSSData gnss = {};
+    static IMUData imu = {};
+    static bool fixPending = false;     // Not yet shown or streamed
+
+    // Offload owns the port and most of the loop: no text, no telemetry
+    if (offloading) {
+        for (int i = 0; i < 64 && offloading; i++) {
+            offloading = offload.service();
+        }
+        if (!offloading) {
+            Serial.printf("Offload done, %u bytes, %u retransmits\n", (unsigned int)offload.getBytesSent(),
+                          (unsigned int)offload.getRetransmits());
+        }
+        return;
+    }
+
+    // So does an export: the text is the file
+    if (exporter) {
+        for (int i = 0; i < 4 && exporter->step(); i++) {}
+        if (exporter->isFinished() || exporter->hasFailed()) {
+            finishExport();
+        }
+        return;
+    }
+
+    // Every PVT: the receiver runs at 25 Hz and only the latest one is kept
+    if (sensors.isGNSSDataAvailable()) {
+        PROFILE_SCOPE(ProfileStage::Loop);
+        {
+            PROFILE_SCOPE(ProfileStage::GnssRead);
+            gnss = sensors.readGNSS();
+        }
+        {
+            PROFILE_SCOPE(ProfileStage::ImuRead);
+            imu = sensors.readIMU();
+        }
+
+        if (trackBuilder && gnss.isValid) {
+            learnTrack(gnss);
+        }
+
+        // First valid fix picks the track we are at
+        if (!trackDetected && gnss.isValid) {
+            trackDetected = trackManager.detectTrack(gnss.latitude, gnss.longitude);
+            if (trackDetected) {
+                TrackConfig track;
+                trackManager.getCurrentTrack(&track);
+                LOG_INFO("Track detected: %s", track.name);
+                startTrack();
+            }
+        }
+
+        if (sessionLog.getSectorCount() > 0) {
+            updateRecording(gnss);
+        }
+        if (gnss.isValid) {
+            blackBox.addFix(gnss.receivedMicros, gnss.latitude, gnss.longitude, gnss.speed, gnss.heading);
+        }
+
+        // Gates and deltas need every fix; the render side picks the snapshot up
+        float forward, left;
+        toVehicleFrame(imu, &forward, &left);
+        racingPanel.updateMotion(gnss.speed, gnss.heading, forward, left);
+        racingPanel.updateGPS(gnss.latitude, gnss.longitude, gnss.speed, gnss.isValid, gnss.satellites,
+                              gnss.sequence);
+
+        static bool fixShown = false;
+        if (gnss.isValid && !fixShown) {
+            fixShown = true;
+            boot::mark("first fix");
+        }
+        fixPending = true;
+    }
+
+    // The display and the live stream take the newest fix at their own rate
     if (millis() - lastUpdate >= UPDATE_INTERVAL) {
-        if (sensors.isGNSSDataAvailable()) {
-            GNSSData gnss = sensors.readGNSS();
-            IMUData imu = sensors.readIMU();
-            displaySensorData(gnss, imu);
+        if (fixPending) {
+            fixPending = false;
+            sensorPanel.update(gnss.latitude, gnss.longitude, gnss.isValid, gnss.satellites, imu.accelX, imu.accelY,
+                               gnss.sequence);
+
+            if (telemetry.isEnabled()) {
+                TelemetryState state = {};
+                state.timestamp = gnss.timestamp;
+                state.latitude = gnss.latitude;
+                state.longitude = gnss.longitude;
+                state.speed = gnss.speed;
+                state.accelX = imu.accelX;
+                state.accelY = imu.accelY;
+                state.accelZ = imu.accelZ;
+                state.gyroZ = imu.gyroZ;
+                state.fixType = gnss.fixType;
+                state.satellites = gnss.satellites;
+                telemetry.sendState(state);
+                sendChannels();
+            }
+        }
+        if (!renderTaskRunning) {
+            panels.render();
         }
         lastUpdate = millis();
     }
+
+    static uint32_t lastWarm = 0;
+    if (millis() - lastWarm >= WARM_SAVE_MS) {
+        saveWarmState();
+        lastWarm = millis();
+    }
+
+    static uint32_t lastHealth = 0;
+    if (telemetry.isEnabled() && millis() - lastHealth >= 1000) {
+        telemetry.sendHealth();
+        lastHealth = millis();
+    }
+
+    recorder.poll(micros());
+    blackBox.poll(micros());
+    pollMarkButton();
+    drainLogs();
+    telemetry.service();
+    trackManager.maintain();
+    // Erasing ahead for the recorder comes first, then a black-box segment,
+    // then at most one retention step
+    if (!sessionLog.maintain() && !blackBox.flush(micros())) {
+        retention.maintain();
+    }
+    pollSerialCommands();
 }
\ No newline at end of file
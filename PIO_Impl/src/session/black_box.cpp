@@ -0,0 +1,243 @@
+#include "session/black_box.h"
+#include <stdlib.h>
+#include <math.h>
+#include "util/log.h"
+#ifdef ARDUINO
+#include <esp_heap_caps.h>
+#endif
+
+using namespace logfmt;
+
+BlackBox::BlackBox(const ChannelRegistry& registry, SessionRecorder& recorder)
+    : registry(registry)
+    , recorder(recorder)
+    , segments(nullptr)
+    , segmentCount(0)
+    , tail(0)
+    , complete(0)
+    , head(0)
+    , headSamples(0)
+    , sourceCount(0)
+    , preUs(0)
+    , postUs(0)
+    , gX(0)
+    , gY(0)
+    , gThreshold(0.0f)
+    , lastX(0.0f)
+    , lastY(0.0f)
+    , gArmed(true)
+    , capturing(false)
+    , flushNext(0)
+    , reason(BURST_BUTTON)
+    , triggerUs(0)
+    , capture(0)
+    , captures(0)
+    , dropped(0)
+{}
+
+BlackBox::~BlackBox() {
+    free(segments);
+}
+
+bool BlackBox::begin(size_t bytes, uint32_t pre, uint32_t post) {
+    segmentCount = bytes / sizeof(Segment);
+    if (segmentCount < 4) {
+        return false;
+    }
+#ifdef ARDUINO
+    segments = static_cast<Segment*>(heap_caps_malloc(segmentCount * sizeof(Segment), MALLOC_CAP_SPIRAM));
+#else
+    segments = static_cast<Segment*>(malloc(segmentCount * sizeof(Segment)));
+#endif
+    if (!segments) {
+        LOG_ERROR("No PSRAM for the black box");
+        segmentCount = 0;
+        return false;
+    }
+    preUs = pre;
+    postUs = post;
+    sourceCount = 0;
+    for (size_t i = 0; i < registry.size() && i < MAX_CHANNELS; i++) {
+        const ChannelDef& def = registry.getDef(i);
+        sources[sourceCount].reader = registry.subscribe(def.id);
+        sources[sourceCount].scale = def.resolution > 0.0f ? 1.0f / def.resolution : 1000.0f;
+        sourceCount++;
+    }
+    tail = head = complete = 0;
+    startSegment(0);
+    return true;
+}
+
+void BlackBox::setGTrigger(uint8_t xChannel, uint8_t yChannel, float thresholdG) {
+    gX = xChannel;
+    gY = yChannel;
+    float threshold = thresholdG * 9.80665f;
+    gThreshold = threshold * threshold;
+}
+
+void BlackBox::addFix(uint32_t timeUs, double latitude, double longitude, double speed, double heading) {
+    if (!segments) return;
+    int32_t lat = (int32_t)lround(latitude * 1e7);
+    int32_t lon = (int32_t)lround(longitude * 1e7);
+    int32_t mmPerS = (int32_t)lround(speed * 1000.0);
+    int32_t centiDeg = (int32_t)lround(heading * 100.0);
+    if (!encoder.addFix(timeUs, lat, lon, mmPerS, centiDeg)) {
+        closeSegment(timeUs);
+        if (!encoder.addFix(timeUs, lat, lon, mmPerS, centiDeg)) {
+            dropped++;
+            return;
+        }
+    }
+    Segment& segment = segments[head];
+    if (headSamples++ == 0 || (int32_t)(timeUs - segment.endUs) > 0) {
+        segment.endUs = timeUs;
+    }
+}
+
+void BlackBox::poll(uint32_t nowUs) {
+    if (!segments) return;
+    ChannelSample samples[32];
+    for (size_t i = 0; i < sourceCount; i++) {
+        Source& source = sources[i];
+        uint8_t id = source.reader.getId();
+        size_t n;
+        while ((n = source.reader.read(samples, 32)) > 0) {
+            for (size_t j = 0; j < n; j++) {
+                add(id, samples[j].timeUs, (int32_t)lroundf(samples[j].value * source.scale));
+                checkG(id, samples[j].timeUs, samples[j].value);
+            }
+        }
+    }
+    // Segments are chunks and span what a chunk may
+    if (nowUs - segments[head].startUs >= MAX_CHUNK_SPAN_US) {
+        closeSegment(nowUs);
+    }
+    // The capture's last segment is not left waiting for more samples
+    if (capturing && flushNext == head && (int32_t)(nowUs - (triggerUs + postUs)) >= 0) {
+        closeSegment(nowUs);
+    }
+}
+
+bool BlackBox::trigger(BurstTrigger why, uint32_t nowUs) {
+    if (!segments || capturing || !recorder.isRecording()) {
+        return false;
+    }
+    // The oldest segment reaching into the window, else the one being filled
+    flushNext = head;
+    for (uint32_t i = 0; i < complete; i++) {
+        uint32_t s = (tail + i) % segmentCount;
+        if ((int32_t)(segments[s].endUs - (nowUs - preUs)) >= 0) {
+            flushNext = s;
+            break;
+        }
+    }
+    capturing = true;
+    reason = why;
+    triggerUs = nowUs;
+    capture++;
+    captures++;
+    LOG_INFO("Black box capture %u, trigger %u", (unsigned int)capture, (unsigned int)why);
+    return true;
+}
+
+bool BlackBox::flush(uint32_t nowUs) {
+    if (!capturing) {
+        return false;
+    }
+    if (!recorder.isRecording()) {
+        LOG_WARN("Black box capture %u cut short, session ended", (unsigned int)capture);
+        capturing = false;
+        return false;
+    }
+    if (flushNext == head) {
+        // Nothing complete to write; a window without samples ends here
+        if ((int32_t)(nowUs - (triggerUs + postUs)) >= 0 && headSamples == 0) {
+            capturing = false;
+        }
+        return false;
+    }
+    Segment& segment = segments[flushNext];
+    segment.data[0] = reason;
+    putU16(segment.data + 1, capture);
+    putU32(segment.data + 3, triggerUs);
+    if (!recorder.addChunk(CHUNK_BURST, segment.data, BURST_HEADER_SIZE + segment.length, nowUs)) {
+        LOG_WARN("Black box capture %u not written", (unsigned int)capture);
+        capturing = false;
+        return true;
+    }
+    flushNext = (flushNext + 1) % segmentCount;
+    if ((int32_t)(segment.endUs - (triggerUs + postUs)) >= 0) {
+        capturing = false;
+    }
+    return true;
+}
+
+uint32_t BlackBox::getHeldUs() const {
+    if (!segments || complete == 0) {
+        return 0;
+    }
+    uint32_t newest = headSamples ? segments[head].endUs : segments[(head + segmentCount - 1) % segmentCount].endUs;
+    return newest - segments[tail].startUs;
+}
+
+void BlackBox::add(uint8_t channel, uint32_t timeUs, int32_t value) {
+    if (!encoder.addSample(channel, timeUs, value)) {
+        closeSegment(timeUs);
+        if (!encoder.addSample(channel, timeUs, value)) {
+            dropped++;
+            return;
+        }
+    }
+    Segment& segment = segments[head];
+    if (headSamples++ == 0 || (int32_t)(timeUs - segment.endUs) > 0) {
+        segment.endUs = timeUs;
+    }
+}
+
+void BlackBox::checkG(uint8_t channel, uint32_t timeUs, float value) {
+    if (gThreshold <= 0.0f || (channel != gX && channel != gY)) {
+        return;
+    }
+    if (channel == gX) {
+        lastX = value;
+    } else {
+        lastY = value;
+    }
+    float magnitude = lastX * lastX + lastY * lastY;
+    if (gArmed && magnitude >= gThreshold) {
+        gArmed = false;
+        trigger(BURST_G_FORCE, timeUs);
+    } else if (!gArmed && magnitude < 0.64f * gThreshold) {
+        gArmed = true;
+    }
+}
+
+void BlackBox::startSegment(uint32_t nowUs) {
+    Segment& segment = segments[head];
+    encoder.begin(segment.data + BURST_HEADER_SIZE, SEGMENT_SIZE - BURST_HEADER_SIZE, nowUs);
+    segment.startUs = segment.endUs = nowUs;
+    segment.length = 0;
+    headSamples = 0;
+}
+
+void BlackBox::closeSegment(uint32_t nowUs) {
+    if (headSamples == 0) {
+        startSegment(nowUs);
+        return;
+    }
+    segments[head].length = (uint16_t)encoder.size();
+    if (complete + 1 == segmentCount) {
+        // The ring is full: the oldest segment goes, unless the capture
+        // still needs it, then this one does
+        if (capturing && flushNext == tail) {
+            dropped += headSamples;
+            startSegment(nowUs);
+            return;
+        }
+        tail = (tail + 1) % segmentCount;
+        complete--;
+    }
+    complete++;
+    head = (head + 1) % segmentCount;
+    startSegment(nowUs);
+}
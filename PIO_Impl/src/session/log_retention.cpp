@@ -0,0 +1,317 @@
+#include "session/log_retention.h"
+#include <string.h>
+#include "util/log.h"
+
+using namespace logfmt;
+
+// The session being read, and for rewrites whether the copy is underway
+struct LogRetention::Job {
+    JobKind kind;
+    uint32_t id;
+    bool copying;
+    StoredSession source;
+    ChunkReader reader;
+    std::vector<Lap> laps;     // Timed laps, for compaction
+    int64_t latestUs;
+    bool started;
+
+    Job(SessionLog& log, JobKind kind, uint32_t id)
+        : kind(kind), id(id), copying(false), source(log, id), reader(source), latestUs(0), started(false) {}
+
+    void rewind() {
+        reader.rewind();
+        started = false;
+    }
+
+    // Log times wrap; chunks are in order and close together
+    int64_t unwrap(uint32_t timeUs) {
+        if (!started) {
+            started = true;
+            latestUs = timeUs;
+            return latestUs;
+        }
+        int64_t unwrapped = latestUs + (int32_t)(timeUs - (uint32_t)latestUs);
+        if (unwrapped > latestUs) {
+            latestUs = unwrapped;
+        }
+        return unwrapped;
+    }
+
+    // A samples chunk starting at baseUs may hold samples of a timed lap
+    bool inLap(int64_t baseUs) const {
+        for (const Lap& lap : laps) {
+            if (baseUs >= lap.startUs - (int64_t)MAX_CHUNK_SPAN_US && baseUs <= lap.endUs) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+LogRetention::LogRetention(SessionLog& log, const RetentionPolicy& policy)
+    : log(log)
+    , policy(policy)
+    , ranked(false)
+    , full(false)
+    , job(nullptr)
+    , evicted(0)
+    , compacted(0)
+    , relocated(0)
+{
+    if (this->policy.keepFastestLaps > MAX_FASTEST) {
+        this->policy.keepFastestLaps = MAX_FASTEST;
+    }
+}
+
+LogRetention::~LogRetention() {
+    delete job;
+}
+
+bool LogRetention::maintain() {
+    sync();
+    if (job) {
+        return stepJob();
+    }
+    // Lap times of every finished session before deciding anything
+    for (Entry& entry : entries) {
+        bool open = log.isRecording() && &entry == &entries.back();
+        if (!entry.scanned && !open) {
+            startJob(JobKind::Scan, entry.id);
+            return true;
+        }
+    }
+    if (!ranked) {
+        rank();
+    }
+    // In the pits, where rewrites can run, room is made ahead
+    uint32_t reserve = policy.reserveSectors ? policy.reserveSectors : log.getSectorCount() / 8;
+    if (!log.isRecording()) {
+        reserve *= 2;
+    }
+    if (log.getFreeSectors() < reserve) {
+        return relieve();
+    }
+    full = false;
+    return level();
+}
+
+// Follows the log's directory; it only changes at the end, except through us
+void LogRetention::sync() {
+    size_t n = log.count();
+    if (n == entries.size() && (n == 0 || log.getInfo(n - 1).id == entries.back().id)) {
+        return;
+    }
+    std::vector<Entry> synced;
+    synced.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        LogSessionInfo info = log.getInfo(i);
+        Entry* known = lookup(info.id);
+        if (known) {
+            synced.push_back(*known);
+            continue;
+        }
+        Entry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.id = info.id;
+        memcpy(entry.track, info.track, sizeof(entry.track));
+        synced.push_back(entry);
+    }
+    entries.swap(synced);
+    ranked = false;
+}
+
+// Marks the sessions holding one of their track's fastest laps
+void LogRetention::rank() {
+    size_t keep = policy.keepFastestLaps;
+    for (Entry& entry : entries) {
+        entry.isProtected = false;
+        if (keep == 0 || entry.fastest[0] == 0) {
+            continue;
+        }
+        // The track's keep fastest laps; a lap no slower than the last is one
+        uint32_t best[MAX_FASTEST] = {};
+        for (const Entry& other : entries) {
+            if (strcmp(other.track, entry.track) != 0) {
+                continue;
+            }
+            for (size_t i = 0; i < keep && other.fastest[i]; i++) {
+                uint32_t lap = other.fastest[i];
+                for (size_t j = 0; j < keep; j++) {
+                    if (best[j] == 0 || lap < best[j]) {
+                        memmove(best + j + 1, best + j, (keep - j - 1) * sizeof(best[0]));
+                        best[j] = lap;
+                        break;
+                    }
+                }
+            }
+        }
+        entry.isProtected = best[keep - 1] == 0 || entry.fastest[0] <= best[keep - 1];
+    }
+    ranked = true;
+}
+
+LogRetention::Entry* LogRetention::lookup(uint32_t id) {
+    for (Entry& entry : entries) {
+        if (entry.id == id) return &entry;
+    }
+    return nullptr;
+}
+
+// Frees the oldest session that may go, or starts compacting it
+bool LogRetention::relieve() {
+    for (size_t i = 0; i < entries.size(); i++) {
+        Entry& entry = entries[i];
+        if (log.isRecording() && i + 1 == entries.size()) {
+            break;
+        }
+        LogSessionInfo info;
+        if (!log.find(entry.id, &info) || info.starred) {
+            continue;
+        }
+        if (entry.isProtected) {
+            // Rewrites wait for the pits; meanwhile a newer session goes
+            if (info.compacted || entry.stuck || log.isRecording()) {
+                continue;
+            }
+            startJob(JobKind::Compact, entry.id);
+            return true;
+        }
+        if (log.evict(entry.id)) {
+            LOG_INFO("Session %u evicted", (unsigned int)entry.id);
+            entries.erase(entries.begin() + i);
+            ranked = false;
+            evicted++;
+            return true;
+        }
+    }
+    if (!full) {
+        LOG_WARN("Session log nearly full, nothing left to evict");
+        full = true;
+    }
+    return false;
+}
+
+// Moves the session on the least worn sectors once they lag the ring
+bool LogRetention::level() {
+    if (log.isRecording() || log.isCopying()) {
+        return false;
+    }
+    SessionLog::WearStats wear = log.getWear();
+    LogSessionInfo info;
+    if (!wear.hasCold || wear.coldErases + policy.wearSpread >= wear.freeMeanErases ||
+        !log.find(wear.coldSession, &info)) {
+        return false;
+    }
+    uint32_t reserve = policy.reserveSectors ? policy.reserveSectors : log.getSectorCount() / 8;
+    if (log.getFreeSectors() < info.size / BLOCK_SIZE + 1 + reserve) {
+        return false;
+    }
+    startJob(JobKind::Relocate, wear.coldSession);
+    return job != nullptr;
+}
+
+void LogRetention::startJob(JobKind kind, uint32_t id) {
+    job = new Job(log, kind, id);
+    // A move copies everything, so it needs no first pass
+    if (kind == JobKind::Relocate) {
+        if (!log.openCopy(id, false)) {
+            endJob();
+            return;
+        }
+        job->copying = true;
+    }
+}
+
+// One chunk: read it on a first pass, copy it on the second
+bool LogRetention::stepJob() {
+    Entry* entry = lookup(job->id);
+    if (!entry) {
+        endJob();
+        return true;
+    }
+    if (job->copying && !log.isCopying()) {
+        // Abandoned for a recording, or the log filled up
+        if (!log.isRecording() && job->kind == JobKind::Compact) {
+            entry->stuck = true;
+        }
+        endJob();
+        return true;
+    }
+
+    uint8_t type;
+    if (!job->reader.next(&type)) {
+        if (job->kind == JobKind::Scan) {
+            entry->scanned = true;
+            ranked = false;
+        } else if (!job->copying) {
+            if (log.openCopy(job->id, true)) {
+                job->copying = true;
+                job->rewind();
+                return true;
+            }
+            if (!log.isRecording()) {
+                entry->stuck = true;
+            }
+        } else if (log.commitCopy()) {
+            if (job->kind == JobKind::Compact) {
+                LOG_INFO("Session %u compacted to its laps", (unsigned int)job->id);
+                compacted++;
+            } else {
+                relocated++;
+            }
+        } else if (job->kind == JobKind::Compact) {
+            entry->stuck = true;
+        }
+        endJob();
+        return true;
+    }
+
+    const uint8_t* payload = job->reader.payload();
+    size_t size = job->reader.size();
+    if (!job->copying) {
+        if (type == CHUNK_SAMPLES && size >= 4) {
+            job->unwrap(getU32(payload));
+        } else if (type == CHUNK_LAP && size >= 10) {
+            int64_t endUs = job->unwrap(getU32(payload));
+            uint32_t lapTimeMs = getU32(payload + 6);
+            if (job->kind == JobKind::Scan) {
+                addLap(*entry, lapTimeMs);
+            } else if (lapTimeMs > 0) {
+                Lap lap = { endUs - (int64_t)lapTimeMs * 1000, endUs };
+                job->laps.push_back(lap);
+            }
+        }
+        return true;
+    }
+
+    bool keep = true;
+    if (type == CHUNK_SAMPLES && job->kind == JobKind::Compact) {
+        keep = size >= 4 && job->inLap(job->unwrap(getU32(payload)));
+    } else if (type == CHUNK_LAP && size >= 4 && job->kind == JobKind::Compact) {
+        job->unwrap(getU32(payload));
+    }
+    // A failed append abandons the copy; the next step notices
+    if (keep) {
+        log.append(type, payload, size);
+    }
+    return true;
+}
+
+void LogRetention::endJob() {
+    delete job;
+    job = nullptr;
+}
+
+void LogRetention::addLap(Entry& entry, uint32_t lapTimeMs) {
+    size_t keep = policy.keepFastestLaps;
+    if (lapTimeMs == 0) {
+        return;
+    }
+    for (size_t i = 0; i < keep; i++) {
+        if (entry.fastest[i] == 0 || lapTimeMs < entry.fastest[i]) {
+            memmove(entry.fastest + i + 1, entry.fastest + i, (keep - i - 1) * sizeof(entry.fastest[0]));
+            entry.fastest[i] = lapTimeMs;
+            return;
+        }
+    }
+}
@@ -0,0 +1,298 @@
+#include "session/offload_server.h"
+#include <string.h>
+#include "util/crc.h"
+
+using logfmt::getU32;
+using logfmt::putU16;
+using logfmt::putU32;
+
+OffloadServer::OffloadServer(SessionLog& log, ByteLink& link, uint32_t (*clock)())
+    : log(log)
+    , link(link)
+    , clock(clock)
+    , active(false)
+    , lastRequestMs(0)
+    , rxLength(0)
+    , rxOverflow(false)
+    , txLength(0)
+    , txOffset(0)
+    , controlType(0)
+    , controlTag(0)
+    , controlLength(0)
+    , hasControl(false)
+    , listing(false)
+    , listTag(0)
+    , listIndex(0)
+    , transfer()
+    , checksum()
+    , bytesSent(0)
+    , retransmits(0)
+    , badFrames(0)
+{}
+
+void OffloadServer::begin() {
+    active = true;
+    lastRequestMs = clock();
+    rxLength = 0;
+    rxOverflow = false;
+    // A lone delimiter first, so READY is not glued to text still on the port
+    tx[0] = 0;
+    txLength = 1;
+    txOffset = 0;
+    listing = false;
+    transfer.active = false;
+    checksum.active = false;
+    bytesSent = retransmits = badFrames = 0;
+
+    uint8_t ready[6];
+    ready[0] = PROTOCOL_VERSION;
+    putU16(ready + 1, DATA_SIZE);
+    ready[3] = MAX_WINDOW;
+    putU16(ready + 4, (uint16_t)log.count());
+    reply(RSP_READY, 0, ready, sizeof(ready));
+}
+
+bool OffloadServer::service() {
+    if (!active) {
+        return false;
+    }
+    receive();
+    if (!active) {
+        return false;
+    }
+    if (clock() - lastRequestMs > IDLE_TIMEOUT_MS) {
+        active = false;
+        return false;
+    }
+
+    // A few frames per call; stops as soon as the link is full
+    for (int i = 0; i < 8; i++) {
+        if (txOffset < txLength) {
+            txOffset += link.write(tx + txOffset, txLength - txOffset);
+            if (txOffset < txLength) {
+                break;
+            }
+        }
+        if (!nextFrame()) {
+            break;
+        }
+    }
+    return true;
+}
+
+void OffloadServer::receive() {
+    uint8_t buffer[64];
+    size_t n;
+    do {
+        n = link.read(buffer, sizeof(buffer));
+        for (size_t i = 0; i < n && active; i++) {
+            if (buffer[i] != 0) {
+                if (rxLength < sizeof(rx)) {
+                    rx[rxLength++] = buffer[i];
+                } else {
+                    rxOverflow = true;
+                }
+                continue;
+            }
+            // Text and torn frames fail here and are skipped
+            uint8_t body[MAX_REQUEST];
+            size_t length = rxOverflow || rxLength == 0 ? 0 : cobs::decode(rx, rxLength, body);
+            if (length >= 4 && crc::crc16(body, length - 2) == (body[length - 2] | body[length - 1] << 8)) {
+                handle(body, length - 2);
+            } else if (rxLength > 0) {
+                badFrames++;
+            }
+            rxLength = 0;
+            rxOverflow = false;
+        }
+    } while (n == sizeof(buffer) && active);
+}
+
+void OffloadServer::handle(const uint8_t* body, size_t length) {
+    uint8_t type = body[0];
+    uint8_t tag = body[1];
+    const uint8_t* p = body + 2;
+    size_t payload = length - 2;
+    uint32_t now = clock();
+    lastRequestMs = now;
+
+    LogSessionInfo info;
+    switch (type) {
+        case REQ_LIST:
+            listing = true;
+            listTag = tag;
+            listIndex = 0;
+            break;
+
+        case REQ_READ: {
+            if (payload < 13) {
+                error(tag, ERR_MALFORMED);
+                break;
+            }
+            if (!log.find(getU32(p), &info)) {
+                error(tag, ERR_NO_SESSION);
+                break;
+            }
+            uint32_t offset = getU32(p + 4);
+            uint32_t count = getU32(p + 8);
+            if (offset > info.size) {
+                error(tag, ERR_RANGE);
+                break;
+            }
+            uint8_t window = p[12] == 0 ? 1 : (p[12] > MAX_WINDOW ? MAX_WINDOW : p[12]);
+            transfer.active = true;
+            transfer.tag = tag;
+            transfer.id = info.id;
+            transfer.end = count > info.size - offset ? info.size : offset + count;
+            transfer.next = offset;
+            transfer.acked = offset;
+            transfer.window = window * DATA_SIZE;
+            transfer.lastProgressMs = now;
+            break;
+        }
+
+        case REQ_ACK:
+            if (payload >= 4 && transfer.active && tag == transfer.tag) {
+                uint32_t offset = getU32(p);
+                if (offset > transfer.acked && offset <= transfer.next) {
+                    transfer.acked = offset;
+                    transfer.lastProgressMs = now;
+                }
+            }
+            break;
+
+        case REQ_CRC:
+            if (payload < 8) {
+                error(tag, ERR_MALFORMED);
+                break;
+            }
+            if (!log.find(getU32(p), &info)) {
+                error(tag, ERR_NO_SESSION);
+                break;
+            }
+            checksum.active = true;
+            checksum.tag = tag;
+            checksum.id = info.id;
+            checksum.length = getU32(p + 4) < info.size ? getU32(p + 4) : info.size;
+            checksum.done = 0;
+            checksum.crc = 0;
+            break;
+
+        case REQ_BYE:
+            active = false;
+            break;
+
+        default:
+            error(tag, ERR_MALFORMED);
+            break;
+    }
+}
+
+void OffloadServer::reply(uint8_t type, uint8_t tag, const uint8_t* payload, size_t length) {
+    controlType = type;
+    controlTag = tag;
+    memcpy(control, payload, length);
+    controlLength = length;
+    hasControl = true;
+}
+
+void OffloadServer::error(uint8_t tag, Error code) {
+    uint8_t payload = code;
+    reply(RSP_ERROR, tag, &payload, 1);
+}
+
+// Puts the next frame into tx. False if there is nothing to send now.
+bool OffloadServer::nextFrame() {
+    uint8_t* payload = packet + 2;
+
+    if (hasControl) {
+        hasControl = false;
+        memcpy(payload, control, controlLength);
+        frame(controlType, controlTag, controlLength);
+        return true;
+    }
+
+    if (listing) {
+        if (listIndex < log.count()) {
+            LogSessionInfo info = log.getInfo(listIndex++);
+            size_t nameLength = strnlen(info.track, sizeof(info.track));
+            putU32(payload, info.id);
+            putU32(payload + 4, info.size);
+            payload[8] = (uint8_t)nameLength;
+            memcpy(payload + 9, info.track, nameLength);
+            frame(RSP_ENTRY, listTag, 9 + nameLength);
+        } else {
+            putU16(payload, (uint16_t)log.count());
+            frame(RSP_LIST_END, listTag, 2);
+            listing = false;
+        }
+        return true;
+    }
+
+    if (checksum.active) {
+        if (checksum.done < checksum.length) {
+            // Bounded step; the packet buffer is free while tx is empty
+            for (uint32_t step = 0; step < CRC_STEP && checksum.done < checksum.length;) {
+                uint32_t want = checksum.length - checksum.done < DATA_SIZE ? checksum.length - checksum.done : DATA_SIZE;
+                size_t n = log.read(checksum.id, checksum.done, payload, want);
+                if (n == 0) {
+                    checksum.length = checksum.done;
+                    break;
+                }
+                checksum.crc = crc::crc32(payload, n, checksum.crc);
+                checksum.done += n;
+                step += n;
+            }
+            return false;
+        }
+        putU32(payload, checksum.id);
+        putU32(payload + 4, checksum.length);
+        putU32(payload + 8, checksum.crc);
+        frame(RSP_CRC, checksum.tag, 12);
+        checksum.active = false;
+        return true;
+    }
+
+    if (transfer.active) {
+        if (transfer.acked >= transfer.end) {
+            putU32(payload, transfer.id);
+            putU32(payload + 4, transfer.end);
+            frame(RSP_DONE, transfer.tag, 8);
+            transfer.active = false;
+            return true;
+        }
+        if (transfer.next < transfer.end && transfer.next - transfer.acked < transfer.window) {
+            uint32_t want = transfer.end - transfer.next < DATA_SIZE ? transfer.end - transfer.next : DATA_SIZE;
+            size_t n = log.read(transfer.id, transfer.next, payload + 4, want);
+            if (n == 0) {
+                transfer.active = false;
+                error(transfer.tag, ERR_RANGE);
+                return false;
+            }
+            putU32(payload, transfer.next);
+            frame(RSP_DATA, transfer.tag, 4 + n);
+            transfer.next += n;
+            bytesSent += n;
+            return true;
+        }
+        if (clock() - transfer.lastProgressMs >= RETRY_MS) {
+            // Nothing acknowledged for a while: something got lost
+            transfer.next = transfer.acked;
+            transfer.lastProgressMs = clock();
+            retransmits++;
+        }
+    }
+    return false;
+}
+
+void OffloadServer::frame(uint8_t type, uint8_t tag, size_t payloadLength) {
+    packet[0] = type;
+    packet[1] = tag;
+    size_t length = 2 + payloadLength;
+    uint16_t crc = crc::crc16(packet, length);
+    packet[length] = crc & 0xFF;
+    packet[length + 1] = crc >> 8;
+    txLength = cobs::encode(packet, length + 2, tx);
+    tx[txLength++] = 0;
+    txOffset = 0;
+}
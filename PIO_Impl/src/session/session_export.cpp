@@ -0,0 +1,316 @@
+#include "session/session_export.h"
+#include <math.h>
+#include <string.h>
+#include "channels/channel_registry.h"
+
+using logfmt::REC_FIX;
+
+namespace {
+    enum FixField : uint8_t { FIX_LATITUDE, FIX_LONGITUDE, FIX_SPEED, FIX_HEADING };
+
+    // Digits after the point that show a resolution exactly, at most 6
+    uint8_t decimalsFor(float resolution) {
+        double scaled = resolution;
+        uint8_t decimals = 0;
+        while (decimals < 6 && fabs(scaled - round(scaled)) > 1e-4 * scaled) {
+            scaled *= 10.0;
+            decimals++;
+        }
+        return decimals;
+    }
+}
+
+SessionExporter::SessionExporter(LogStreamSource& source, ExportSink& sink)
+    : chunks(source)
+    , sink(sink)
+    , header()
+    , decoder()
+    , format(Format::Csv)
+    , selectedCount(0)
+    , columnCount(0)
+    , startUs(0)
+    , latestUs(0)
+    , rowUs(0)
+    , periodUs(0)
+    , started(false)
+    , lap(0)
+    , nextLapUs(0)
+    , nextLap(0)
+    , outputLength(0)
+    , rows(0)
+    , finished(false)
+    , failed(false)
+{}
+
+bool SessionExporter::selectChannel(uint8_t id) {
+    if (selectedCount == LogSessionHeader::MAX_CHANNELS) {
+        return false;
+    }
+    selected[selectedCount++] = id;
+    return true;
+}
+
+bool SessionExporter::begin(Format exportFormat, uint16_t rateHz) {
+    uint8_t type;
+    chunks.rewind();
+    if (rateHz == 0 || !chunks.next(&type) || type != logfmt::CHUNK_SESSION ||
+        !header.parse(chunks.payload(), chunks.size())) {
+        finished = true;
+        return false;
+    }
+    format = exportFormat;
+    periodUs = 1000000 / rateHz;
+    started = false;
+    lap = nextLap = 0;
+    rows = 0;
+    outputLength = 0;
+    finished = failed = false;
+
+    // Position in 1e-7 deg, speed in mm/s, heading in 0.01 deg
+    columnCount = 0;
+    bool vbo = format == Format::Vbo;
+    addColumn(REC_FIX, FIX_LATITUDE, true, vbo ? 5 : 7, vbo ? 0.6 : 1.0);
+    addColumn(REC_FIX, FIX_LONGITUDE, true, vbo ? 5 : 7, vbo ? -0.6 : 1.0);
+    addColumn(REC_FIX, FIX_SPEED, true, 3, vbo ? 3.6 : 1.0);
+    addColumn(REC_FIX, FIX_HEADING, false, 2, 1.0);
+    for (uint8_t i = 0; i < header.channelCount; i++) {
+        const LogChannelInfo& channel = header.channels[i];
+        bool wanted = selectedCount == 0;
+        for (size_t j = 0; j < selectedCount && !wanted; j++) {
+            wanted = selected[j] == channel.id;
+        }
+        if (!wanted) {
+            continue;
+        }
+        uint8_t decimals = decimalsFor(channel.resolution);
+        bool analog = channel.type != (uint8_t)ChannelType::Discrete;
+        addColumn(channel.id, 0, analog, decimals, channel.resolution * pow(10.0, decimals));
+    }
+    writeHeader();
+    return !failed;
+}
+
+bool SessionExporter::step() {
+    if (finished) {
+        return false;
+    }
+    uint8_t type;
+    if (!chunks.next(&type)) {
+        // Everything is in: the rows up to the last sample are final
+        writeRows(latestUs);
+        flush();
+        finished = true;
+        return false;
+    }
+
+    if (type == logfmt::CHUNK_SAMPLES && decoder.begin(chunks.payload(), chunks.size())) {
+        logfmt::SampleRecord record;
+        while (decoder.next(&record)) {
+            int64_t timeUs = unwrap(record.timeUs);
+            for (size_t i = 0; i < columnCount; i++) {
+                Column& column = columns[i];
+                if (column.channel == record.channel) {
+                    addSample(column, (uint32_t)timeUs, record.channel == REC_FIX ? record.fix[column.field] : record.value);
+                }
+            }
+            // A chunk spans up to two seconds, more than the columns keep
+            writeRows(latestUs - LAG_US);
+        }
+    } else if (type == logfmt::CHUNK_LAP && chunks.size() >= 6) {
+        // Written after the samples before it, so the rows are not there yet
+        nextLapUs = unwrap(logfmt::getU32(chunks.payload()));
+        nextLap = logfmt::getU16(chunks.payload() + 4) + 1;
+    }
+    flush();
+    return !failed;
+}
+
+void SessionExporter::addColumn(uint8_t channel, uint8_t field, bool interpolate, uint8_t decimals, double factor) {
+    Column& column = columns[columnCount++];
+    column.channel = channel;
+    column.field = field;
+    column.interpolate = interpolate;
+    column.decimals = decimals;
+    column.factor = factor;
+    column.first = 0;
+    column.count = 0;
+}
+
+void SessionExporter::addSample(Column& column, uint32_t timeUs, int32_t value) {
+    if (column.count == HISTORY) {
+        column.first = (column.first + 1) % HISTORY;
+        column.count--;
+    }
+    size_t slot = (column.first + column.count) % HISTORY;
+    column.times[slot] = timeUs;
+    column.values[slot] = value;
+    column.count++;
+}
+
+// Value at timeUs in printed fixed point; false if the column has no data
+bool SessionExporter::valueAt(Column& column, int64_t timeUs, int64_t* value) {
+    if (column.count == 0) {
+        return false;
+    }
+    // Samples before the one at or before timeUs are not needed again
+    uint32_t now = (uint32_t)timeUs;
+    while (column.count > 1 && (int32_t)(column.times[(column.first + 1) % HISTORY] - now) <= 0) {
+        column.first = (column.first + 1) % HISTORY;
+        column.count--;
+    }
+    size_t a = column.first;
+    double result = column.values[a];
+    int32_t since = (int32_t)(now - column.times[a]);
+    if (column.interpolate && column.count > 1 && since >= 0) {
+        size_t b = (a + 1) % HISTORY;
+        double span = (double)(int32_t)(column.times[b] - column.times[a]);
+        result += (column.values[b] - result) * since / span;
+    }
+    *value = llround(result * column.factor);
+    return true;
+}
+
+// Log times are micros() and wrap; records are close enough in time that
+// the signed distance to the newest one is always right
+int64_t SessionExporter::unwrap(uint32_t timeUs) {
+    if (!started) {
+        started = true;
+        startUs = rowUs = latestUs = timeUs;
+        return timeUs;
+    }
+    int64_t unwrapped = latestUs + (int32_t)(timeUs - (uint32_t)latestUs);
+    if (unwrapped > latestUs) {
+        latestUs = unwrapped;
+    }
+    return unwrapped;
+}
+
+void SessionExporter::writeRows(int64_t untilUs) {
+    if (!started) {
+        return;
+    }
+    bool vbo = format == Format::Vbo;
+    char separator = vbo ? ' ' : ',';
+    while (rowUs <= untilUs && !failed) {
+        if (nextLap && rowUs >= nextLapUs) {
+            lap = nextLap;
+            nextLap = 0;
+        }
+        int64_t elapsedUs = rowUs - startUs;
+        if (vbo) {
+            // hhmmss.ss
+            uint32_t centis = (uint32_t)(elapsedUs / 10000);
+            uint32_t seconds = centis / 100;
+            char time[16];
+            time[0] = '0' + seconds / 36000 % 10;
+            time[1] = '0' + seconds / 3600 % 10;
+            time[2] = '0' + seconds / 600 % 6;
+            time[3] = '0' + seconds / 60 % 10;
+            time[4] = '0' + seconds / 10 % 6;
+            time[5] = '0' + seconds % 10;
+            time[6] = '.';
+            time[7] = '0' + centis / 10 % 10;
+            time[8] = '0' + centis % 10;
+            time[9] = '\0';
+            put(time);
+        } else {
+            putFixed(elapsedUs / 1000, 3, false);
+            put(separator);
+            putFixed(lap, 0, false);
+        }
+        for (size_t i = 0; i < columnCount; i++) {
+            int64_t value;
+            put(separator);
+            if (valueAt(columns[i], rowUs, &value)) {
+                bool position = columns[i].channel == REC_FIX && columns[i].field <= FIX_LONGITUDE;
+                putFixed(value, columns[i].decimals, vbo && position);
+            } else if (vbo) {
+                put('0');
+            }
+        }
+        put('\n');
+        rows++;
+        rowUs += periodUs;
+    }
+}
+
+void SessionExporter::writeHeader() {
+    if (format == Format::Csv) {
+        put("time,lap,latitude,longitude,speed [m/s],heading [deg]");
+        for (size_t i = 4; i < columnCount; i++) {
+            const LogChannelInfo* channel = header.find(columns[i].channel);
+            put(',');
+            put(channel->name);
+            if (channel->unit[0]) {
+                put(" [");
+                put(channel->unit);
+                put(']');
+            }
+        }
+        put('\n');
+        return;
+    }
+
+    put("File created by the logger's session export\n\n[header]\ntime\nlatitude\nlongitude\nvelocity kmh\nheading\n");
+    for (size_t i = 4; i < columnCount; i++) {
+        put(header.find(columns[i].channel)->name);
+        put('\n');
+    }
+    put("\n[channel units]\n");
+    for (size_t i = 4; i < columnCount; i++) {
+        put(header.find(columns[i].channel)->unit);
+        put('\n');
+    }
+    put("\n[comments]\nSession ");
+    putFixed(header.id, 0, false);
+    put(" at ");
+    put(header.track);
+    put("\nTime is from the session start, not UTC\n\n[column names]\ntime lat long velocity heading");
+    for (size_t i = 4; i < columnCount; i++) {
+        put(' ');
+        put(header.find(columns[i].channel)->name);
+    }
+    put("\n\n[data]\n");
+}
+
+void SessionExporter::put(const char* text) {
+    while (*text) {
+        put(*text++);
+    }
+}
+
+void SessionExporter::put(char c) {
+    if (outputLength == OUTPUT_SIZE) {
+        flush();
+    }
+    output[outputLength++] = c;
+}
+
+void SessionExporter::putFixed(int64_t value, uint8_t decimals, bool sign) {
+    char digits[24];
+    size_t n = 0;
+    bool negative = value < 0;
+    uint64_t magnitude = negative ? -(uint64_t)value : (uint64_t)value;
+    do {
+        digits[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude || n <= decimals);
+    if (negative) {
+        put('-');
+    } else if (sign) {
+        put('+');
+    }
+    while (n > 0) {
+        if (n == decimals) {
+            put('.');
+        }
+        put(digits[--n]);
+    }
+}
+
+void SessionExporter::flush() {
+    if (outputLength > 0 && !failed) {
+        failed = !sink.write(output, outputLength);
+    }
+    outputLength = 0;
+}
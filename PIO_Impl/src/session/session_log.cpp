@@ -0,0 +1,525 @@
+#include "session/session_log.h"
+#include <string.h>
+#include <algorithm>
+#include "util/crc.h"
+#include "util/log.h"
+
+using namespace logfmt;
+
+namespace {
+    // magic u32, session u32, seq u32, birth u32, erases u32, index u16,
+    // generation u8, 0xFF, CRC-16 of the above, 0xFFFF, flags u32
+    const uint32_t HEADER_CRC_OFFSET = 24;
+    const uint32_t HEADER_FLAGS_OFFSET = 28;
+
+    struct SectorHeader {
+        uint32_t session;
+        uint32_t seq;
+        uint32_t birth;
+        uint32_t erases;
+        uint16_t index;
+        uint8_t generation;
+        uint32_t flags;
+    };
+
+    void encodeHeader(uint8_t* out, uint32_t magic, const SectorHeader& header) {
+        memset(out, 0xFF, SECTOR_HEADER_SIZE);
+        putU32(out, magic);
+        putU32(out + 4, header.session);
+        putU32(out + 8, header.seq);
+        putU32(out + 12, header.birth);
+        putU32(out + 16, header.erases);
+        putU16(out + 20, header.index);
+        out[22] = header.generation;
+        putU16(out + HEADER_CRC_OFFSET, crc::crc16(out, HEADER_CRC_OFFSET));
+    }
+
+    bool decodeHeader(const uint8_t* raw, uint32_t magic, SectorHeader* header) {
+        if (getU32(raw) != magic || getU16(raw + HEADER_CRC_OFFSET) != crc::crc16(raw, HEADER_CRC_OFFSET)) {
+            return false;
+        }
+        header->session = getU32(raw + 4);
+        header->seq = getU32(raw + 8);
+        header->birth = getU32(raw + 12);
+        header->erases = getU32(raw + 16);
+        header->index = getU16(raw + 20);
+        header->generation = raw[22];
+        header->flags = getU32(raw + HEADER_FLAGS_OFFSET);
+        return true;
+    }
+}
+
+SessionLog::SessionLog(LogFlash& flash)
+    : flash(flash)
+    , sectorCount(0)
+    , head(0)
+    , erasedAhead(NO_SECTOR)
+    , nextSeq(1)
+    , recording(false)
+    , copying(false)
+    , copy()
+    , blockUsed(0)
+{}
+
+bool SessionLog::begin() {
+    sectorCount = flash.size() / LogFlash::SECTOR_SIZE;
+    if (sectorCount < 2 || sectorCount > NO_SECTOR) {
+        LOG_ERROR("Session log needs 2 to 65535 sectors, has %u", (unsigned int)sectorCount);
+        return false;
+    }
+    sessions.clear();
+    used.assign(sectorCount, false);
+    erases.assign(sectorCount, 0);
+    recording = copying = false;
+    erasedAhead = NO_SECTOR;
+
+    struct Found {
+        SectorHeader header;
+        uint16_t sector;
+    };
+    std::vector<Found> found;
+    std::vector<bool> known(sectorCount, false);
+    uint64_t knownErases = 0;
+    for (uint32_t s = 0; s < sectorCount; s++) {
+        uint8_t raw[SECTOR_HEADER_SIZE];
+        Found f;
+        if (!flash.read(s * LogFlash::SECTOR_SIZE, raw, sizeof(raw)) || !decodeHeader(raw, MAGIC, &f.header)) {
+            continue;
+        }
+        f.sector = (uint16_t)s;
+        found.push_back(f);
+        erases[s] = f.header.erases;
+        known[s] = true;
+        knownErases += f.header.erases;
+    }
+    // Sectors erased but never written since, or never used: assume average wear
+    uint32_t meanErases = found.empty() ? 0 : (uint32_t)(knownErases / found.size());
+    for (uint32_t s = 0; s < sectorCount; s++) {
+        if (!known[s]) erases[s] = meanErases;
+    }
+    std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) {
+        return a.header.seq < b.header.seq;
+    });
+
+    // Every generation of every session, from its first sector on; a gap in
+    // the indices (an erased or torn sector) ends what is readable of it. A
+    // newer first sector restarts a generation: an abandoned copy retried.
+    std::vector<Session> generations;
+    for (const Found& f : found) {
+        Session* session = nullptr;
+        for (Session& g : generations) {
+            if (g.id == f.header.session && g.generation == f.header.generation) session = &g;
+        }
+        if (f.header.index == 0) {
+            if (!session) {
+                generations.push_back(Session());
+                session = &generations.back();
+            }
+            session->sectors.clear();
+            session->id = f.header.session;
+            session->size = 0;
+            session->birth = f.header.birth;
+            session->generation = f.header.generation;
+            session->flags = f.header.flags;
+            session->track[0] = '\0';
+        }
+        if (!session || f.header.index != session->sectors.size()) continue;
+        session->sectors.push_back(f.sector);
+    }
+
+    // The newest complete generation of a session is the session, unless
+    // it was evicted; anything else is free space
+    for (const Session& g : generations) {
+        bool complete = g.generation == 0 || !(g.flags & FLAG_COMPLETE);
+        if (!complete) continue;
+        Session* current = lookup(g.id);
+        if (!current) {
+            sessions.push_back(g);
+        } else if (g.generation > current->generation) {
+            *current = g;
+        }
+    }
+    sessions.erase(std::remove_if(sessions.begin(), sessions.end(), [](const Session& s) {
+        return !(s.flags & FLAG_EVICTED);
+    }), sessions.end());
+    std::sort(sessions.begin(), sessions.end(), [](const Session& a, const Session& b) {
+        return a.birth < b.birth;
+    });
+    if (!found.empty()) {
+        head = (found.back().sector + 1) % sectorCount;
+        nextSeq = found.back().header.seq + 1;
+    }
+
+    for (Session& session : sessions) {
+        for (uint16_t sector : session.sectors) {
+            used[sector] = true;
+        }
+        session.size = (session.sectors.size() - 1) * BLOCK_SIZE + usedInBlock(session.sectors.back());
+        readTrack(session);
+    }
+    LOG_INFO("Session log holds %u sessions, %u of %u sectors free", (unsigned int)sessions.size(),
+             (unsigned int)getFreeSectors(), (unsigned int)sectorCount);
+    return true;
+}
+
+bool SessionLog::open(uint32_t id, const char* track) {
+    if (recording || sectorCount == 0 || lookup(id)) {
+        return false;
+    }
+    if (copying) {
+        LOG_INFO("Rewrite of session %u abandoned for recording", (unsigned int)copy.id);
+        abortCopy();
+    }
+    Session session;
+    session.id = id;
+    session.size = 0;
+    session.birth = nextSeq;
+    session.generation = 0;
+    session.flags = 0xFFFFFFFF;
+    strncpy(session.track, track, sizeof(session.track) - 1);
+    session.track[sizeof(session.track) - 1] = '\0';
+    if (!startSector(session)) {
+        return false;
+    }
+    sessions.push_back(session);
+    recording = true;
+    return true;
+}
+
+bool SessionLog::append(uint8_t type, const uint8_t* payload, size_t length) {
+    if ((!recording && !copying) || length > MAX_CHUNK_PAYLOAD) {
+        return false;
+    }
+    Session& session = copying ? copy : sessions.back();
+    if (blockUsed + CHUNK_HEADER_SIZE + length > BLOCK_SIZE) {
+        // The rest of the block stays erased, readers skip it
+        if (!startSector(session)) {
+            if (copying) {
+                LOG_WARN("Session log full, rewrite of session %u abandoned", (unsigned int)copy.id);
+                abortCopy();
+            } else {
+                LOG_WARN("Session log full, recording stopped");
+                close();
+            }
+            return false;
+        }
+        session.size = (session.sectors.size() - 1) * BLOCK_SIZE;
+    }
+
+    uint32_t offset = session.sectors.back() * LogFlash::SECTOR_SIZE + SECTOR_HEADER_SIZE + blockUsed;
+    uint8_t header[CHUNK_HEADER_SIZE];
+    header[0] = type;
+    header[1] = 0;
+    putU16(header + 2, (uint16_t)length);
+    putU32(header + 4, crc::crc32(payload, length));
+    // Payload first: without its header a torn chunk reads as erased space
+    if (!flash.write(offset + CHUNK_HEADER_SIZE, payload, length) || !flash.write(offset, header, sizeof(header))) {
+        LOG_ERROR("Session log write failed");
+        if (copying) {
+            abortCopy();
+        } else {
+            close();
+        }
+        return false;
+    }
+    blockUsed += CHUNK_HEADER_SIZE + length;
+    session.size = (session.sectors.size() - 1) * BLOCK_SIZE + blockUsed;
+    return true;
+}
+
+void SessionLog::close() {
+    recording = false;
+}
+
+size_t SessionLog::room() const {
+    if ((!recording && !copying) || blockUsed + CHUNK_HEADER_SIZE >= BLOCK_SIZE) {
+        return MAX_CHUNK_PAYLOAD;
+    }
+    return BLOCK_SIZE - blockUsed - CHUNK_HEADER_SIZE;
+}
+
+bool SessionLog::maintain() {
+    if (!recording && !copying) {
+        return false;
+    }
+    uint16_t sector = nextFree();
+    if (sector == NO_SECTOR || sector == erasedAhead || !flash.erase(sector * LogFlash::SECTOR_SIZE)) {
+        return false;
+    }
+    erases[sector]++;
+    erasedAhead = sector;
+    return true;
+}
+
+bool SessionLog::setStarred(uint32_t id, bool starred) {
+    Session* session = lookup(id);
+    if (!session) {
+        return false;
+    }
+    uint32_t toggles = __builtin_popcount(~session->flags & FLAG_STAR_TOGGLES);
+    if ((toggles & 1) == (starred ? 1u : 0u)) {
+        return true;
+    }
+    if (toggles == 16) {
+        return false;
+    }
+    uint32_t flags = session->flags & ~(1u << toggles);
+    if (!writeFlags(*session, flags)) {
+        return false;
+    }
+    session->flags = flags;
+    return true;
+}
+
+bool SessionLog::evict(uint32_t id) {
+    Session* session = lookup(id);
+    if (!session || (recording && session == &sessions.back()) || (copying && copy.id == id)) {
+        return false;
+    }
+    // The flag makes begin() skip it; the sectors are simply reused
+    if (!writeFlags(*session, session->flags & ~FLAG_EVICTED)) {
+        return false;
+    }
+    release(*session);
+    sessions.erase(sessions.begin() + (session - sessions.data()));
+    return true;
+}
+
+bool SessionLog::openCopy(uint32_t id, bool compacted) {
+    const Session* source = lookup(id);
+    if (recording || copying || !source || source->generation == 0xFF) {
+        return false;
+    }
+    copy = Session();
+    copy.id = id;
+    copy.size = 0;
+    copy.birth = source->birth;
+    copy.generation = source->generation + 1;
+    // Written at commit; a compacted session stays compacted
+    copy.flags = source->flags | FLAG_STAR_TOGGLES | FLAG_COMPLETE | FLAG_EVICTED;
+    if (compacted) {
+        copy.flags &= ~FLAG_COMPACTED;
+    }
+    memcpy(copy.track, source->track, sizeof(copy.track));
+    if (!startSector(copy)) {
+        copy.sectors.clear();
+        return false;
+    }
+    copying = true;
+    return true;
+}
+
+bool SessionLog::commitCopy() {
+    Session* source = copying ? lookup(copy.id) : nullptr;
+    if (!source) {
+        return false;
+    }
+    // One write switches generations; the star carries over as one toggle
+    uint32_t flags = copy.flags & ~FLAG_COMPLETE;
+    if (__builtin_popcount(~source->flags & FLAG_STAR_TOGGLES) & 1) {
+        flags &= ~1u;
+    }
+    if (!writeFlags(copy, flags)) {
+        abortCopy();
+        return false;
+    }
+    copy.flags = flags;
+    // So the old generation cannot come back once the new one is evicted
+    // and its first sector reused
+    writeFlags(*source, source->flags & ~FLAG_EVICTED);
+    release(*source);
+    *source = copy;
+    copy.sectors.clear();
+    copying = false;
+    return true;
+}
+
+void SessionLog::abortCopy() {
+    if (copying) {
+        release(copy);
+        copy.sectors.clear();
+        copying = false;
+    }
+}
+
+SessionLog::WearStats SessionLog::getWear() const {
+    WearStats stats = { UINT32_MAX, 0, 0, UINT32_MAX, 0, false };
+    uint64_t freeErases = 0;
+    uint32_t freeCount = 0;
+    for (uint32_t s = 0; s < sectorCount; s++) {
+        stats.minErases = std::min(stats.minErases, erases[s]);
+        stats.maxErases = std::max(stats.maxErases, erases[s]);
+        if (!used[s]) {
+            freeErases += erases[s];
+            freeCount++;
+        }
+    }
+    stats.freeMeanErases = freeCount ? (uint32_t)(freeErases / freeCount) : 0;
+    for (size_t i = 0; i < sessions.size(); i++) {
+        if (recording && i + 1 == sessions.size()) {
+            break;
+        }
+        for (uint16_t sector : sessions[i].sectors) {
+            if (erases[sector] < stats.coldErases) {
+                stats.coldErases = erases[sector];
+                stats.coldSession = sessions[i].id;
+                stats.hasCold = true;
+            }
+        }
+    }
+    return stats;
+}
+
+LogSessionInfo SessionLog::getInfo(size_t index) const {
+    LogSessionInfo info;
+    info.id = sessions[index].id;
+    info.size = sessions[index].size;
+    memcpy(info.track, sessions[index].track, sizeof(info.track));
+    info.starred = __builtin_popcount(~sessions[index].flags & FLAG_STAR_TOGGLES) & 1;
+    info.compacted = !(sessions[index].flags & FLAG_COMPACTED);
+    return info;
+}
+
+bool SessionLog::find(uint32_t id, LogSessionInfo* info) const {
+    for (size_t i = 0; i < sessions.size(); i++) {
+        if (sessions[i].id == id) {
+            *info = getInfo(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t SessionLog::read(uint32_t id, uint32_t offset, uint8_t* out, size_t length) {
+    const Session* session = lookup(id);
+    if (!session || offset >= session->size) {
+        return 0;
+    }
+    if (length > session->size - offset) {
+        length = session->size - offset;
+    }
+    size_t copied = 0;
+    while (copied < length) {
+        uint32_t block = offset / BLOCK_SIZE;
+        uint32_t within = offset % BLOCK_SIZE;
+        size_t n = std::min<size_t>(length - copied, BLOCK_SIZE - within);
+        uint32_t address = session->sectors[block] * LogFlash::SECTOR_SIZE + SECTOR_HEADER_SIZE + within;
+        if (!flash.read(address, out + copied, n)) {
+            break;
+        }
+        copied += n;
+        offset += n;
+    }
+    return copied;
+}
+
+uint32_t SessionLog::getFreeSectors() const {
+    return (uint32_t)std::count(used.begin(), used.end(), false);
+}
+
+const SessionLog::Session* SessionLog::lookup(uint32_t id) const {
+    for (const Session& s : sessions) {
+        if (s.id == id) return &s;
+    }
+    return nullptr;
+}
+
+SessionLog::Session* SessionLog::lookup(uint32_t id) {
+    for (Session& s : sessions) {
+        if (s.id == id) return &s;
+    }
+    return nullptr;
+}
+
+// The ring's next sector, stepping over sectors in use
+uint16_t SessionLog::nextFree() const {
+    for (uint32_t i = 0; i < sectorCount; i++) {
+        uint16_t sector = (head + i) % sectorCount;
+        if (!used[sector]) return sector;
+    }
+    return NO_SECTOR;
+}
+
+bool SessionLog::startSector(Session& session) {
+    uint16_t sector = nextFree();
+    if (sector == NO_SECTOR) {
+        return false;
+    }
+    uint32_t address = sector * LogFlash::SECTOR_SIZE;
+    if (erasedAhead != sector) {
+        if (!flash.erase(address)) {
+            return false;
+        }
+        erases[sector]++;
+    }
+    uint8_t raw[SECTOR_HEADER_SIZE];
+    SectorHeader header = { session.id, nextSeq++, session.birth, erases[sector],
+                            (uint16_t)session.sectors.size(), session.generation, 0xFFFFFFFF };
+    encodeHeader(raw, MAGIC, header);
+    erasedAhead = NO_SECTOR;
+    if (!flash.write(address, raw, sizeof(raw))) {
+        return false;
+    }
+    used[sector] = true;
+    session.sectors.push_back(sector);
+    head = (sector + 1) % sectorCount;
+    blockUsed = 0;
+    return true;
+}
+
+bool SessionLog::writeFlags(const Session& session, uint32_t flags) {
+    uint8_t raw[4];
+    putU32(raw, flags);
+    return flash.write(session.sectors[0] * LogFlash::SECTOR_SIZE + HEADER_FLAGS_OFFSET, raw, sizeof(raw));
+}
+
+void SessionLog::release(const Session& session) {
+    for (uint16_t sector : session.sectors) {
+        used[sector] = false;
+    }
+}
+
+// Stream bytes in a sector up to the end of its last complete chunk
+uint32_t SessionLog::usedInBlock(uint16_t sector) {
+    uint32_t base = sector * LogFlash::SECTOR_SIZE + SECTOR_HEADER_SIZE;
+    uint32_t position = 0;
+    while (position + CHUNK_HEADER_SIZE <= BLOCK_SIZE) {
+        uint8_t header[CHUNK_HEADER_SIZE];
+        if (!flash.read(base + position, header, sizeof(header)) || header[0] == CHUNK_NONE) {
+            break;
+        }
+        uint32_t length = getU16(header + 2);
+        if (position + CHUNK_HEADER_SIZE + length > BLOCK_SIZE) {
+            break;
+        }
+        uint32_t crc = 0;
+        uint8_t piece[256];
+        for (uint32_t done = 0; done < length;) {
+            uint32_t n = std::min<uint32_t>(sizeof(piece), length - done);
+            if (!flash.read(base + position + CHUNK_HEADER_SIZE + done, piece, n)) {
+                return position;
+            }
+            crc = crc::crc32(piece, n, crc);
+            done += n;
+        }
+        if (crc != getU32(header + 4)) {
+            break;
+        }
+        position += CHUNK_HEADER_SIZE + length;
+    }
+    return position;
+}
+
+// The track name from the session's first chunk
+void SessionLog::readTrack(Session& session) {
+    uint8_t raw[CHUNK_HEADER_SIZE + 6 + MAX_TRACK_NAME];
+    uint32_t address = session.sectors[0] * LogFlash::SECTOR_SIZE + SECTOR_HEADER_SIZE;
+    size_t length = std::min<size_t>(session.size, sizeof(raw));
+    if (length < CHUNK_HEADER_SIZE + 6 || !flash.read(address, raw, length) || raw[0] != CHUNK_SESSION) {
+        return;
+    }
+    size_t nameLength = std::min<size_t>(raw[CHUNK_HEADER_SIZE + 5], length - CHUNK_HEADER_SIZE - 6);
+    nameLength = std::min<size_t>(nameLength, MAX_TRACK_NAME - 1);
+    memcpy(session.track, raw + CHUNK_HEADER_SIZE + 6, nameLength);
+    session.track[nameLength] = '\0';
+}
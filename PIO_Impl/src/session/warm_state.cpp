@@ -0,0 +1,111 @@
+#include "session/warm_state.h"
+#include <string.h>
+#include "session/log_format.h"
+#include "util/crc.h"
+
+using namespace logfmt;
+
+// Layout: magic, sequence, saved time (u64), flags (bit 0 stint active),
+// delta reference, lap count (u16), stint elapsed, three sector bests,
+// theoretical best, reference lap, track name, CRC-32 of all before it
+static const size_t TRACK_OFFSET = 44;
+static const size_t CRC_OFFSET = TRACK_OFFSET + MAX_TRACK_NAME;
+static_assert(CRC_OFFSET + 4 == WarmStore::ENCODED_SIZE, "Warm state layout");
+
+WarmState::WarmState()
+    : stintActive(false)
+    , stintElapsedMs(0)
+    , theoreticalBest(0)
+    , referenceLap(0)
+    , lapCount(0)
+    , deltaReference(0)
+{
+    memset(track, 0, sizeof(track));
+    for (int i = 0; i < 3; i++) {
+        sectorBest[i] = UINT32_MAX;
+    }
+}
+
+WarmStore::WarmStore(uint8_t* memory, uint64_t (*clock)())
+    : memory(memory)
+    , clock(clock)
+{}
+
+void WarmStore::save(const WarmState& state) {
+    uint32_t sequence = 0;
+    int slot = newest(&sequence);
+    int next = slot == 0 ? 1 : 0;
+    encode(state, sequence + 1, clock(), memory + next * ENCODED_SIZE);
+}
+
+bool WarmStore::load(WarmState* state, uint32_t* ageMs) const {
+    uint32_t sequence;
+    int slot = newest(&sequence);
+    uint64_t savedUs;
+    if (slot < 0 || !decode(memory + slot * ENCODED_SIZE, state, &sequence, &savedUs)) {
+        return false;
+    }
+    uint64_t now = clock();
+    *ageMs = now >= savedUs ? (uint32_t)((now - savedUs) / 1000) : 0;
+    return true;
+}
+
+void WarmStore::clear() {
+    memset(memory, 0, MEMORY_SIZE);
+}
+
+void WarmStore::encode(const WarmState& state, uint32_t sequence, uint64_t savedUs, uint8_t* out) {
+    putU32(out, MAGIC);
+    putU32(out + 4, sequence);
+    putU32(out + 8, (uint32_t)savedUs);
+    putU32(out + 12, (uint32_t)(savedUs >> 32));
+    out[16] = state.stintActive ? 1 : 0;
+    out[17] = state.deltaReference;
+    putU16(out + 18, state.lapCount);
+    putU32(out + 20, state.stintElapsedMs);
+    for (int i = 0; i < 3; i++) {
+        putU32(out + 24 + 4 * i, state.sectorBest[i]);
+    }
+    putU32(out + 36, state.theoreticalBest);
+    putU32(out + 40, state.referenceLap);
+    memcpy(out + TRACK_OFFSET, state.track, MAX_TRACK_NAME);
+    out[TRACK_OFFSET + MAX_TRACK_NAME - 1] = '\0';
+    putU32(out + CRC_OFFSET, crc::crc32(out, CRC_OFFSET));
+}
+
+bool WarmStore::decode(const uint8_t* data, WarmState* state, uint32_t* sequence, uint64_t* savedUs) {
+    if (getU32(data) != MAGIC || getU32(data + CRC_OFFSET) != crc::crc32(data, CRC_OFFSET)) {
+        return false;
+    }
+    *sequence = getU32(data + 4);
+    *savedUs = (uint64_t)getU32(data + 8) | (uint64_t)getU32(data + 12) << 32;
+    state->stintActive = (data[16] & 1) != 0;
+    state->deltaReference = data[17];
+    state->lapCount = getU16(data + 18);
+    state->stintElapsedMs = getU32(data + 20);
+    for (int i = 0; i < 3; i++) {
+        state->sectorBest[i] = getU32(data + 24 + 4 * i);
+    }
+    state->theoreticalBest = getU32(data + 36);
+    state->referenceLap = getU32(data + 40);
+    memcpy(state->track, data + TRACK_OFFSET, MAX_TRACK_NAME);
+    state->track[MAX_TRACK_NAME - 1] = '\0';
+    return true;
+}
+
+int WarmStore::newest(uint32_t* sequence) const {
+    int best = -1;
+    *sequence = 0;
+    for (int slot = 0; slot < 2; slot++) {
+        const uint8_t* data = memory + slot * ENCODED_SIZE;
+        if (getU32(data) != MAGIC || getU32(data + CRC_OFFSET) != crc::crc32(data, CRC_OFFSET)) {
+            continue;
+        }
+        uint32_t s = getU32(data + 4);
+        if (best < 0 || (int32_t)(s - *sequence) > 0) {
+            best = slot;
+            *sequence = s;
+        }
+    }
+    return best;
+}
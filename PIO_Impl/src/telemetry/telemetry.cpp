@@ -0,0 +1,224 @@
+#include "telemetry/telemetry.h"
+#include <string.h>
+#include <math.h>
+#include "util/crc.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+namespace {
+    uint32_t nowMs() {
+#ifdef ARDUINO
+        return millis();
+#else
+        return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    uint32_t freeHeap() {
+#ifdef ARDUINO
+        return ESP.getFreeHeap();
+#else
+        return 0;
+#endif
+    }
+
+    // Little-endian packet writer
+    struct Writer {
+        uint8_t* data;
+        size_t length;
+
+        void u8(uint8_t v) { data[length++] = v; }
+        void u16(uint16_t v) { u8(v & 0xFF); u8(v >> 8); }
+        void u32(uint32_t v) { u16(v & 0xFFFF); u16(v >> 16); }
+        void i16(int16_t v) { u16((uint16_t)v); }
+        void i32(int32_t v) { u32((uint32_t)v); }
+        void f32(float v) { uint32_t bits; memcpy(&bits, &v, 4); u32(bits); }
+    };
+
+    int16_t clamp16(float v) {
+        return v > 32767.0f ? 32767 : (v < -32768.0f ? -32768 : (int16_t)lroundf(v));
+    }
+}
+
+Telemetry::Telemetry(ByteLink& link)
+    : link(link)
+    , enabled(false)
+    , sequence(0)
+    , framesSent(0)
+    , oversized(0)
+    , inFlightOffset(0)
+    , hasInFlight(false)
+{
+    // State samples are superseded quickly, keep only a few
+    const uint8_t capacities[PRIORITY_COUNT] = { 4, 6, QUEUE_DEPTH };
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        queues[i].head = 0;
+        queues[i].count = 0;
+        queues[i].capacity = capacities[i];
+        queues[i].dropped = 0;
+    }
+}
+
+void Telemetry::setEnabled(bool enable) {
+    enabled = enable;
+    if (!enable) {
+        for (auto& queue : queues) {
+            queue.count = 0;
+        }
+        hasInFlight = false;
+    }
+}
+
+void Telemetry::sendState(const TelemetryState& state) {
+    uint8_t payload[MAX_PACKET];
+    Writer w = { payload, 0 };
+    w.u32(state.timestamp);
+    w.i32((int32_t)lround(state.latitude * 1e7));
+    w.i32((int32_t)lround(state.longitude * 1e7));
+    w.i32((int32_t)lround(state.speed * 1000.0));   // mm/s
+    w.i16(clamp16(state.accelX * 1000.0f / 9.80665f));  // mg
+    w.i16(clamp16(state.accelY * 1000.0f / 9.80665f));
+    w.i16(clamp16(state.accelZ * 1000.0f / 9.80665f));
+    w.i16(clamp16(state.gyroZ * 5729.578f));  // 0.01 deg/s
+    w.u32(state.lapTime);
+    w.i32(state.delta);
+    w.u8(state.fixType);
+    w.u8(state.satellites);
+    enqueue(PRIORITY_STATE, PACKET_STATE, payload, w.length);
+}
+
+void Telemetry::sendLap(uint16_t lapNumber, uint32_t lapTime, bool isBest) {
+    uint8_t payload[MAX_PACKET];
+    Writer w = { payload, 0 };
+    w.u32(nowMs());
+    w.u16(lapNumber);
+    w.u32(lapTime);
+    w.u8(isBest ? 1 : 0);
+    enqueue(PRIORITY_EVENT, PACKET_LAP, payload, w.length);
+}
+
+void Telemetry::sendSector(uint8_t sector, uint32_t sectorTime) {
+    uint8_t payload[MAX_PACKET];
+    Writer w = { payload, 0 };
+    w.u32(nowMs());
+    w.u8(sector);
+    w.u32(sectorTime);
+    enqueue(PRIORITY_EVENT, PACKET_SECTOR, payload, w.length);
+}
+
+void Telemetry::sendHealth() {
+    uint8_t payload[MAX_PACKET];
+    Writer w = { payload, 0 };
+    w.u32(nowMs());
+    w.u32(framesSent);
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        w.u32(queues[i].dropped);
+    }
+    w.u32(freeHeap());
+    enqueue(PRIORITY_HEALTH, PACKET_HEALTH, payload, w.length);
+}
+
+static_assert(9 + logging::MAX_ARGS <= Telemetry::MAX_PACKET, "Log record does not fit a packet");
+static_assert(6 + 6 * Telemetry::MAX_CHANNEL_SAMPLES <= Telemetry::MAX_PACKET, "Channel samples do not fit a packet");
+
+void Telemetry::sendLog(const logging::Record& record) {
+    uint8_t payload[MAX_PACKET];
+    Writer w = { payload, 0 };
+    w.u32(record.micros);
+    w.u32((uint32_t)(uintptr_t)record.format);
+    w.u8(record.level);
+    memcpy(payload + w.length, record.args, record.length);
+    w.length += record.length;
+    enqueue(PRIORITY_HEALTH, PACKET_LOG, payload, w.length);
+}
+
+void Telemetry::sendChannel(uint8_t id, const ChannelSample* samples, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (count > MAX_CHANNEL_SAMPLES) {
+        count = MAX_CHANNEL_SAMPLES;
+    }
+    uint8_t payload[MAX_PACKET];
+    Writer w = { payload, 0 };
+    w.u8(id);
+    w.u8(count);
+    w.u32(samples[0].timeUs);
+    for (size_t i = 0; i < count; i++) {
+        // 100 us steps from the first sample, 6.5 s at most
+        uint32_t offset = (samples[i].timeUs - samples[0].timeUs) / 100;
+        w.u16(offset > 0xFFFF ? 0xFFFF : offset);
+        w.f32(samples[i].value);
+    }
+    enqueue(PRIORITY_STATE, PACKET_CHANNEL, payload, w.length);
+}
+
+void Telemetry::service() {
+    while (enabled) {
+        if (!hasInFlight) {
+            // Highest priority first; a started frame is never interrupted
+            int priority = PRIORITY_COUNT - 1;
+            while (priority >= 0 && queues[priority].count == 0) {
+                priority--;
+            }
+            if (priority < 0) {
+                return;
+            }
+
+            Queue& queue = queues[priority];
+            inFlight = queue.frames[queue.head];
+            queue.head = (queue.head + 1) % queue.capacity;
+            queue.count--;
+            inFlightOffset = 0;
+            hasInFlight = true;
+        }
+
+        size_t written = link.write(inFlight.data + inFlightOffset, inFlight.length - inFlightOffset);
+        if (written == 0) {
+            return;
+        }
+        inFlightOffset += written;
+
+        if (inFlightOffset >= inFlight.length) {
+            hasInFlight = false;
+            framesSent++;
+        }
+    }
+}
+
+void Telemetry::enqueue(Priority priority, PacketType type, const uint8_t* payload, size_t length) {
+    if (!enabled) {
+        return;
+    }
+    if (length > MAX_PACKET) {
+        oversized++;
+        return;
+    }
+
+    uint8_t packet[MAX_PACKET + 4];
+    packet[0] = type;
+    packet[1] = sequence++;
+    memcpy(packet + 2, payload, length);
+    uint16_t crc = crc::crc16(packet, length + 2);
+    packet[length + 2] = crc & 0xFF;
+    packet[length + 3] = crc >> 8;
+
+    Queue& queue = queues[priority];
+    if (queue.count == queue.capacity) {
+        // Drop the oldest frame of this priority to make room
+        queue.head = (queue.head + 1) % queue.capacity;
+        queue.count--;
+        queue.dropped++;
+    }
+
+    Frame& frame = queue.frames[(queue.head + queue.count) % queue.capacity];
+    size_t encoded = cobs::encode(packet, length + 4, frame.data);
+    frame.data[encoded] = 0;  // Frame delimiter
+    frame.length = encoded + 1;
+    queue.count++;
+}
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include "track/reference_store.h"
+#include "track/track_store.h"
+#include "util/crc.h"
+#include "util/log.h"
+
+ReferenceStore::ReferenceStore()
+    : partition(nullptr)
+    , nextSeq(1)
+    , mappedSlot(-1)
+    , mapHandle(0)
+    , state(State::Idle)
+    , pendingSlot(-1)
+    , pendingHeader()
+    , progress(0)
+{}
+
+ReferenceStore::~ReferenceStore() {
+    release();
+}
+
+bool ReferenceStore::begin(const char* partitionLabel) {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+    if (!partition) {
+        LOG_ERROR("Reference lap partition not found");
+        return false;
+    }
+
+    // Only the slot headers are read at boot
+    slots.assign(partition->size / SLOT_SIZE, SlotInfo());
+    for (size_t i = 0; i < slots.size(); i++) {
+        SlotHeader header;
+        slots[i].used = false;
+        if (esp_partition_read(partition, i * SLOT_SIZE, &header, sizeof(header)) != ESP_OK) {
+            continue;
+        }
+        if (header.magic != MAGIC || header.version != VERSION || header.crc != headerCrc(header) ||
+            header.pointCount > MAX_POINTS) {
+            continue;
+        }
+
+        slots[i].used = true;
+        slots[i].nameHash = header.nameHash;
+        slots[i].configHash = header.configHash;
+        slots[i].seq = header.seq;
+        if (header.seq >= nextSeq) {
+            nextSeq = header.seq + 1;
+        }
+    }
+
+    return true;
+}
+
+bool ReferenceStore::load(const TrackConfig& track, ReferenceTrace* trace) {
+    release();
+    if (!partition) {
+        return false;
+    }
+
+    int slot = findSlot(track, configHash(track));
+    if (slot < 0) {
+        return false;
+    }
+
+    const void* mapped = nullptr;
+    if (esp_partition_mmap(partition, slot * SLOT_SIZE, SLOT_SIZE, SPI_FLASH_MMAP_DATA,
+                           &mapped, &mapHandle) != ESP_OK) {
+        LOG_ERROR("Failed to map reference lap");
+        return false;
+    }
+    mappedSlot = slot;
+
+    const SlotHeader* header = (const SlotHeader*)mapped;
+    const TracePoint* points = (const TracePoint*)((const uint8_t*)mapped + HEADER_SIZE);
+    *trace = ReferenceTrace(points, header->pointCount, header->lapTime);
+    return true;
+}
+
+void ReferenceStore::release() {
+    if (mappedSlot >= 0) {
+        spi_flash_munmap(mapHandle);
+        mappedSlot = -1;
+    }
+}
+
+bool ReferenceStore::save(const TrackConfig& track, const ReferenceTrace& trace) {
+    if (!partition || !trace.isValid) {
+        return false;
+    }
+
+    // A newer lap replaces one that is still being written
+    state = State::Idle;
+
+    int slot = chooseSlot();
+    if (slot < 0) {
+        return false;
+    }
+
+    size_t count = trace.count < MAX_POINTS ? trace.count : MAX_POINTS;
+    pendingPoints.assign(trace.points, trace.points + count);
+
+    memset(&pendingHeader, 0, sizeof(pendingHeader));
+    pendingHeader.magic = MAGIC;
+    pendingHeader.version = VERSION;
+    pendingHeader.seq = nextSeq++;
+    pendingHeader.configHash = configHash(track);
+    pendingHeader.lapTime = trace.lapTime;
+    pendingHeader.pointCount = count;
+    pendingHeader.nameHash = nameHash(track.name);
+    strncpy(pendingHeader.name, track.name, MAX_TRACK_NAME_LENGTH - 1);
+    pendingHeader.crc = headerCrc(pendingHeader);
+
+    // The slot's old contents are gone as soon as the first erase runs
+    slots[slot].used = false;
+    pendingSlot = slot;
+    progress = 0;
+    state = State::Erasing;
+    return true;
+}
+
+bool ReferenceStore::maintain() {
+    if (state == State::Idle) {
+        return false;
+    }
+
+    uint32_t base = pendingSlot * SLOT_SIZE;
+    uint32_t dataSize = pendingPoints.size() * sizeof(TracePoint);
+
+    if (state == State::Erasing) {
+        if (esp_partition_erase_range(partition, base + progress, SECTOR_SIZE) != ESP_OK) {
+            state = State::Idle;
+            return false;
+        }
+        progress += SECTOR_SIZE;
+        if (progress >= HEADER_SIZE + dataSize) {
+            state = State::Writing;
+            progress = 0;
+        }
+        return true;
+    }
+
+    if (state == State::Writing) {
+        if (progress < dataSize) {
+            uint32_t chunk = dataSize - progress;
+            if (chunk > SECTOR_SIZE) {
+                chunk = SECTOR_SIZE;
+            }
+            const uint8_t* data = (const uint8_t*)pendingPoints.data();
+            if (esp_partition_write(partition, base + HEADER_SIZE + progress, data + progress, chunk) != ESP_OK) {
+                state = State::Idle;
+                return false;
+            }
+            progress += chunk;
+            return true;
+        }
+
+        // Header last: this is the commit point
+        state = State::Idle;
+        if (esp_partition_write(partition, base, &pendingHeader, sizeof(pendingHeader)) != ESP_OK) {
+            return false;
+        }
+        slots[pendingSlot].used = true;
+        slots[pendingSlot].nameHash = pendingHeader.nameHash;
+        slots[pendingSlot].configHash = pendingHeader.configHash;
+        slots[pendingSlot].seq = pendingHeader.seq;
+
+        pendingPoints.clear();
+        pendingPoints.shrink_to_fit();
+        return false;
+    }
+
+    return false;
+}
+
+uint32_t ReferenceStore::configHash(const TrackConfig& track) {
+    // Hash of the stored form, so any change to the gates invalidates the lap
+    uint8_t payload[TrackStore::MAX_PAYLOAD_SIZE];
+    size_t length = TrackStore::encode(track, payload, sizeof(payload));
+    return crc::crc32(payload, length);
+}
+
+uint32_t ReferenceStore::nameHash(const char* name) {
+    return crc::crc32((const uint8_t*)name, strnlen(name, MAX_TRACK_NAME_LENGTH - 1));
+}
+
+uint32_t ReferenceStore::headerCrc(const SlotHeader& header) {
+    return crc::crc32((const uint8_t*)&header, offsetof(SlotHeader, crc));
+}
+
+int ReferenceStore::findSlot(const TrackConfig& track, uint32_t hash) {
+    uint32_t name = nameHash(track.name);
+    int best = -1;
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (!slots[i].used || slots[i].nameHash != name || slots[i].configHash != hash) {
+            continue;
+        }
+        if (best < 0 || slots[i].seq > slots[best].seq) {
+            // Confirm the full name on hash match
+            SlotHeader header;
+            if (esp_partition_read(partition, i * SLOT_SIZE, &header, sizeof(header)) == ESP_OK &&
+                strncmp(header.name, track.name, MAX_TRACK_NAME_LENGTH) == 0) {
+                best = i;
+            }
+        }
+    }
+    return best;
+}
+
+int ReferenceStore::chooseSlot() {
+    // Prefer empty slots, then superseded ones, then evict the oldest track
+    int superseded = -1;
+    int oldest = -1;
+    for (size_t i = 0; i < slots.size(); i++) {
+        if ((int)i == mappedSlot) {
+            continue;
+        }
+        if (!slots[i].used) {
+            return i;
+        }
+        if (superseded < 0 && !isLatest(i)) {
+            superseded = i;
+        }
+        if (oldest < 0 || slots[i].seq < slots[oldest].seq) {
+            oldest = i;
+        }
+    }
+    return superseded >= 0 ? superseded : oldest;
+}
+
+bool ReferenceStore::isLatest(size_t slot) const {
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (i != slot && slots[i].used && slots[i].nameHash == slots[slot].nameHash &&
+            slots[i].seq > slots[slot].seq) {
+            return false;
+        }
+    }
+    return true;
+}
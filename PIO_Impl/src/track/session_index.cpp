@@ -0,0 +1,255 @@
+#include "track/session_index.h"
+#include "util/crc.h"
+#include "util/log.h"
+
+namespace {
+    const size_t SERIES_SIZE = 38;
+
+    void putU16(uint8_t* p, uint16_t v) {
+        p[0] = v & 0xFF;
+        p[1] = v >> 8;
+    }
+
+    void putU32(uint8_t* p, uint32_t v) {
+        p[0] = v & 0xFF;
+        p[1] = (v >> 8) & 0xFF;
+        p[2] = (v >> 16) & 0xFF;
+        p[3] = v >> 24;
+    }
+
+    uint16_t getU16(const uint8_t* p) {
+        return p[0] | (p[1] << 8);
+    }
+
+    uint32_t getU32(const uint8_t* p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    size_t encodeSeries(const SeriesSummary& s, uint8_t* out) {
+        putU16(out, s.count);
+        putU16(out + 2, s.cleanCount);
+        putU32(out + 4, s.best);
+        putU32(out + 8, s.mean);
+        putU32(out + 12, s.stddev);
+        putU32(out + 16, s.p10);
+        putU32(out + 20, s.p50);
+        putU32(out + 24, s.p90);
+        putU32(out + 28, s.bestAverage3);
+        putU32(out + 32, s.bestAverage5);
+        putU16(out + 36, s.consistency);
+        return SERIES_SIZE;
+    }
+
+    size_t decodeSeries(const uint8_t* data, SeriesSummary* s) {
+        s->count = getU16(data);
+        s->cleanCount = getU16(data + 2);
+        s->best = getU32(data + 4);
+        s->mean = getU32(data + 8);
+        s->stddev = getU32(data + 12);
+        s->p10 = getU32(data + 16);
+        s->p50 = getU32(data + 20);
+        s->p90 = getU32(data + 24);
+        s->bestAverage3 = getU32(data + 28);
+        s->bestAverage5 = getU32(data + 32);
+        s->consistency = getU16(data + 36);
+        return SERIES_SIZE;
+    }
+}
+
+SessionIndex::SessionIndex()
+    : partition(nullptr)
+    , writeOffset(0)
+    , sectorErased(false)
+    , nextSeq(1)
+    , nextSession(1)
+    , state(State::Idle)
+    , pendingId(0)
+{}
+
+bool SessionIndex::begin(const char* partitionLabel) {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+    if (!partition) {
+        LOG_ERROR("Session index partition not found");
+        return false;
+    }
+
+    // Every record is read once at boot: 512 of them for 128 KB
+    uint32_t slots = (partition->size & ~(SECTOR_SIZE - 1)) / RECORD_SIZE;
+    uint32_t latest = UINT32_MAX;
+    uint32_t latestSeq = 0;
+    uint8_t raw[RECORD_SIZE];
+    SessionRecord record;
+    for (uint32_t i = 0; i < slots; i++) {
+        uint32_t seq;
+        size_t length;
+        if (esp_partition_read(partition, i * RECORD_SIZE, raw, RECORD_SIZE) != ESP_OK ||
+            !validRecord(raw, &seq, &length) || !decode(raw + HEADER_SIZE, length, &record)) {
+            continue;
+        }
+        remember(record.id, i * RECORD_SIZE, seq);
+        if (seq >= nextSeq) nextSeq = seq + 1;
+        if (record.id >= nextSession) nextSession = record.id + 1;
+        if (latest == UINT32_MAX || seq > latestSeq) {
+            latest = i;
+            latestSeq = seq;
+        }
+    }
+
+    // Continue after the newest record, past any torn write in its sector
+    uint32_t slot = latest == UINT32_MAX ? 0 : (latest + 1) % slots;
+    sectorErased = false;
+    while (slot % (SECTOR_SIZE / RECORD_SIZE) != 0) {
+        bool blank = esp_partition_read(partition, slot * RECORD_SIZE, raw, RECORD_SIZE) == ESP_OK;
+        for (size_t i = 0; blank && i < RECORD_SIZE; i++) {
+            blank = raw[i] == 0xFF;
+        }
+        if (blank) {
+            sectorErased = true;
+            break;
+        }
+        slot = (slot + 1) % slots;
+    }
+    writeOffset = slot * RECORD_SIZE;
+
+    LOG_INFO("Session index holds %u sessions", (unsigned int)entries.size());
+    return true;
+}
+
+bool SessionIndex::save(const SessionRecord& record) {
+    if (!partition) {
+        return false;
+    }
+
+    memset(pending, 0xFF, sizeof(pending));
+    size_t length = encode(record, pending + HEADER_SIZE, MAX_PAYLOAD_SIZE);
+    if (length == 0) {
+        return false;
+    }
+    putU32(pending, MAGIC);
+    putU32(pending + 4, nextSeq++);
+    putU16(pending + 8, (uint16_t)length);
+    putU16(pending + 10, 0);
+    putU32(pending + RECORD_SIZE - 4, crc::crc32(pending, RECORD_SIZE - 4));
+    pendingId = record.id;
+
+    state = sectorErased ? State::Writing : State::Erasing;
+    return true;
+}
+
+bool SessionIndex::maintain() {
+    if (state == State::Idle) {
+        return false;
+    }
+
+    if (state == State::Erasing) {
+        if (esp_partition_erase_range(partition, writeOffset, SECTOR_SIZE) != ESP_OK) {
+            state = State::Idle;
+            return false;
+        }
+        forgetSector(writeOffset);
+        sectorErased = true;
+        state = State::Writing;
+        return true;
+    }
+
+    state = State::Idle;
+    if (esp_partition_write(partition, writeOffset, pending, RECORD_SIZE) != ESP_OK) {
+        return false;
+    }
+    remember(pendingId, writeOffset, getU32(pending + 4));
+
+    uint32_t size = partition->size & ~(SECTOR_SIZE - 1);
+    writeOffset = (writeOffset + RECORD_SIZE) % size;
+    if (writeOffset % SECTOR_SIZE == 0) {
+        sectorErased = false;
+    }
+    return false;
+}
+
+size_t SessionIndex::encode(const SessionRecord& record, uint8_t* out, size_t capacity) {
+    size_t nameLength = strnlen(record.track, MAX_TRACK_NAME_LENGTH - 1);
+    size_t length = 1 + 4 + 4 + 1 + nameLength + 4 * SERIES_SIZE;
+    if (length > capacity) {
+        return 0;
+    }
+
+    size_t p = 0;
+    out[p++] = SCHEMA_VERSION;
+    putU32(out + p, record.id);
+    p += 4;
+    putU32(out + p, record.duration);
+    p += 4;
+    out[p++] = (uint8_t)nameLength;
+    memcpy(out + p, record.track, nameLength);
+    p += nameLength;
+    p += encodeSeries(record.laps, out + p);
+    for (uint8_t s = 0; s < 3; s++) {
+        p += encodeSeries(record.sectors[s], out + p);
+    }
+    return p;
+}
+
+bool SessionIndex::decode(const uint8_t* data, size_t length, SessionRecord* record) {
+    if (length < 10 || data[0] != SCHEMA_VERSION) {
+        return false;
+    }
+    size_t nameLength = data[9];
+    if (nameLength >= MAX_TRACK_NAME_LENGTH || length < 10 + nameLength + 4 * SERIES_SIZE) {
+        return false;
+    }
+
+    record->id = getU32(data + 1);
+    record->duration = getU32(data + 5);
+    memcpy(record->track, data + 10, nameLength);
+    record->track[nameLength] = '\0';
+    size_t p = 10 + nameLength;
+    p += decodeSeries(data + p, &record->laps);
+    for (uint8_t s = 0; s < 3; s++) {
+        p += decodeSeries(data + p, &record->sectors[s]);
+    }
+    return true;
+}
+
+bool SessionIndex::readRecord(uint32_t offset, SessionRecord* record) {
+    uint8_t raw[RECORD_SIZE];
+    uint32_t seq;
+    size_t length;
+    return esp_partition_read(partition, offset, raw, RECORD_SIZE) == ESP_OK &&
+           validRecord(raw, &seq, &length) && decode(raw + HEADER_SIZE, length, record);
+}
+
+bool SessionIndex::validRecord(const uint8_t* raw, uint32_t* seq, size_t* length) const {
+    if (getU32(raw) != MAGIC || getU32(raw + RECORD_SIZE - 4) != crc::crc32(raw, RECORD_SIZE - 4)) {
+        return false;
+    }
+    *seq = getU32(raw + 4);
+    *length = getU16(raw + 8);
+    return *length <= MAX_PAYLOAD_SIZE;
+}
+
+void SessionIndex::forgetSector(uint32_t sectorOffset) {
+    for (size_t i = 0; i < entries.size();) {
+        if (entries[i].offset >= sectorOffset && entries[i].offset < sectorOffset + SECTOR_SIZE) {
+            entries.erase(entries.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+void SessionIndex::remember(uint32_t id, uint32_t offset, uint32_t seq) {
+    // Sessions are few and ids increase, so a scan from the back is short
+    for (size_t i = entries.size(); i-- > 0;) {
+        if (entries[i].id == id) {
+            if (seq > entries[i].seq) {
+                entries[i].offset = offset;
+                entries[i].seq = seq;
+            }
+            return;
+        }
+    }
+    Entry entry = { id, offset, seq };
+    size_t at = entries.size();
+    while (at > 0 && entries[at - 1].id > id) at--;
+    entries.insert(entries.begin() + at, entry);
+}
@@ -0,0 +1,59 @@
+#include "track/track_database.h"
+#include "util/log.h"
+
+TrackDatabase::TrackDatabase()
+    : data(nullptr)
+    , dataSize(0)
+    , trackCount(0)
+    , mapHandle(0)
+{}
+
+TrackDatabase::~TrackDatabase() {
+    if (data) {
+        spi_flash_munmap(mapHandle);
+    }
+}
+
+bool TrackDatabase::begin(const char* partitionLabel) {
+    const esp_partition_t* partition =
+        esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+    if (!partition) {
+        return false;
+    }
+
+    const void* mapped = nullptr;
+    if (esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA,
+                           &mapped, &mapHandle) != ESP_OK) {
+        LOG_ERROR("Failed to map track database");
+        return false;
+    }
+
+    const uint8_t* header = (const uint8_t*)mapped;
+    uint32_t magic, size;
+    memcpy(&magic, header, 4);
+    memcpy(&trackCount, header + 8, 4);
+    memcpy(&size, header + 12, 4);
+
+    if (magic != MAGIC || header[4] != TrackStore::SCHEMA_VERSION ||
+        size > partition->size - HEADER_SIZE) {
+        // Not flashed or built for another schema
+        spi_flash_munmap(mapHandle);
+        trackCount = 0;
+        return false;
+    }
+
+    data = header + HEADER_SIZE;
+    dataSize = size;
+    return true;
+}
+
+bool TrackDatabase::read(uint32_t offset, TrackConfig* config) const {
+    if (!data || offset >= dataSize) {
+        return false;
+    }
+    uint8_t length = data[offset];
+    if (offset + 1 + length > dataSize) {
+        return false;
+    }
+    return TrackStore::decode(data + offset + 1, length, config);
+}
\ No newline at end of file
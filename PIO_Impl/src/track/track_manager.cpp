@@ -1,112 +1,86 @@
 #include "track/track_manager.h"
+#include <Preferences.h>
+#include "util/log.h"
 
-const char* TrackManager::STORAGE_NAMESPACE = "trackmgr";
+// Namespace used by the original one-blob-per-track NVS storage
+const char* TrackManager::LEGACY_NAMESPACE = "trackmgr";
 
-TrackManager::TrackManager() : currentTrackIndex(0) {
-    tracks.reserve(MAX_TRACKS);
-}
+TrackManager::TrackManager() : hasCurrentTrack(false), userLocatorDirty(true) {}
 
-TrackManager::~TrackManager() {
-    preferences.end();
-}
+TrackManager::~TrackManager() {}
 
 bool TrackManager::init() {
-    if (!preferences.begin(STORAGE_NAMESPACE, true)) {
-        Serial.println("Failed to open preferences");
+    if (!store.begin()) {
+        LOG_ERROR("Failed to open track store");
         return false;
     }
-    
-    // Load track count
-    size_t count = preferences.getUInt("track_count", 0);
-    preferences.end();
-    
-    // Load all stored tracks
-    for (size_t i = 0; i < count && i < MAX_TRACKS; i++) {
-        TrackConfig track;
-        if (loadTrackByIndex(i, &track)) {
-            tracks.push_back(track);
-        }
+
+    if (store.count() == 0) {
+        migrateLegacyStorage();
+    }
+
+    if (!references.begin()) {
+        LOG_WARN("Reference laps will not be kept across power cycles");
+    }
+
+    if (!sessions.begin()) {
+        LOG_WARN("Session statistics will not be kept across power cycles");
+    }
+
+    // The bundled database is optional and never changes, index it once
+    if (database.begin()) {
+        bundledLocator.reserve(database.count());
+        database.forEach([this](uint32_t offset, const TrackConfig& track) {
+            if (track.startFinish.isSet) {
+                bundledLocator.add(track.startFinish.latitude, track.startFinish.longitude, offset);
+            }
+        });
+        bundledLocator.build();
+        LOG_INFO("Indexed %u bundled tracks", (unsigned int)bundledLocator.size());
     }
     
     return true;
 }
 
 bool TrackManager::saveTrack(const char* name, const TrackConfig& config) {
-    // Check if track with this name already exists
-    for (size_t i = 0; i < tracks.size(); i++) {
-        if (strcmp(tracks[i].name, name) == 0) {
-            // Update existing track
-            tracks[i] = config;
-            return saveTrackByIndex(i, config);
-        }
-    }
-    
-    // Add new track
-    if (tracks.size() >= MAX_TRACKS) {
-        Serial.println("Maximum number of tracks reached");
+    TrackConfig named = config;
+    strncpy(named.name, name, MAX_TRACK_NAME_LENGTH - 1);
+    named.name[MAX_TRACK_NAME_LENGTH - 1] = '\0';
+
+    if (!store.put(named)) {
         return false;
     }
-    
-    tracks.push_back(config);
-    size_t index = tracks.size() - 1;
-    
-    if (!preferences.begin(STORAGE_NAMESPACE, false)) {
-        Serial.println("Failed to open preferences");
-        return false;
+    userLocatorDirty = true;
+
+    // Keep the cached current track in sync with storage
+    if (hasCurrentTrack && strcmp(currentTrack.name, named.name) == 0) {
+        currentTrack = named;
     }
-    
-    // Update track count
-    preferences.putUInt("track_count", tracks.size());
-    preferences.end();
-    
-    return saveTrackByIndex(index, config);
+    return true;
 }
 
 bool TrackManager::loadTrackByName(const char* name, TrackConfig* config) {
-    for (const auto& track : tracks) {
-        if (strcmp(track.name, name) == 0) {
-            *config = track;
-            return true;
-        }
-    }
-    return false;
+    return store.get(name, config);
 }
 
 bool TrackManager::deleteTrack(const char* name) {
-    for (auto it = tracks.begin(); it != tracks.end(); ++it) {
-        if (strcmp(it->name, name) == 0) {
-            tracks.erase(it);
-            
-            // Update storage
-            if (!preferences.begin(STORAGE_NAMESPACE, false)) {
-                return false;
-            }
-            
-            preferences.putUInt("track_count", tracks.size());
-            
-            // Resave all tracks to remove gaps
-            for (size_t i = 0; i < tracks.size(); i++) {
-                saveTrackByIndex(i, tracks[i]);
-            }
-            
-            preferences.end();
-            return true;
-        }
+    if (!store.remove(name)) {
+        return false;
     }
-    return false;
+    userLocatorDirty = true;
+
+    if (hasCurrentTrack && strcmp(currentTrack.name, name) == 0) {
+        hasCurrentTrack = false;
+    }
+    return true;
 }
 
 bool TrackManager::resetStorage() {
-    if (!preferences.begin(STORAGE_NAMESPACE, false)) {
-        return false;
-    }
-    
-    bool success = preferences.clear();
-    preferences.end();
+    bool success = store.erase();
     
     if (success) {
-        tracks.clear();
-        currentTrackIndex = 0;
+        hasCurrentTrack = false;
+        userLocatorDirty = true;
     }
     
     return success;
@@ -114,53 +88,100 @@ bool TrackManager::resetStorage() {
 
 std::vector<std::string> TrackManager::getTrackNames() {
     std::vector<std::string> names;
-    names.reserve(tracks.size());
-    for (const auto& track : tracks) {
+    names.reserve(store.count());
+    store.forEach([&names](const TrackConfig& track) {
         names.push_back(track.name);
-    }
+    });
     return names;
 }
 
 bool TrackManager::getCurrentTrack(TrackConfig* config) {
-    if (tracks.empty() || currentTrackIndex >= tracks.size()) {
+    if (!hasCurrentTrack) {
         return false;
     }
-    *config = tracks[currentTrackIndex];
+    *config = currentTrack;
     return true;
 }
 
 bool TrackManager::setCurrentTrack(const char* name) {
-    for (size_t i = 0; i < tracks.size(); i++) {
-        if (strcmp(tracks[i].name, name) == 0) {
-            currentTrackIndex = i;
-            return true;
-        }
+    TrackConfig track;
+    if (!store.get(name, &track)) {
+        return false;
     }
-    return false;
+    currentTrack = track;
+    hasCurrentTrack = true;
+    return true;
 }
 
-bool TrackManager::saveTrackByIndex(size_t index, const TrackConfig& config) {
-    if (!preferences.begin(STORAGE_NAMESPACE, false)) {
-        return false;
+bool TrackManager::detectTrack(double latitude, double longitude, float maxDistance) {
+    if (userLocatorDirty) {
+        rebuildUserLocator();
     }
-    
-    char key[16];
-    snprintf(key, sizeof(key), "track_%u", (unsigned int)index);
-    size_t written = preferences.putBytes(key, &config, sizeof(TrackConfig));
-    preferences.end();
-    
-    return written == sizeof(TrackConfig);
+
+    uint32_t ref;
+    TrackConfig track;
+    if (userLocator.findNearest(latitude, longitude, maxDistance, &ref) &&
+        store.get(userTrackNames[ref].c_str(), &track)) {
+        currentTrack = track;
+        hasCurrentTrack = true;
+        return true;
+    }
+
+    if (bundledLocator.findNearest(latitude, longitude, maxDistance, &ref) &&
+        database.read(ref, &track)) {
+        currentTrack = track;
+        hasCurrentTrack = true;
+        return true;
+    }
+
+    return false;
 }
 
-bool TrackManager::loadTrackByIndex(size_t index, TrackConfig* config) {
-    if (!preferences.begin(STORAGE_NAMESPACE, true)) {
+void TrackManager::rebuildUserLocator() {
+    userLocator.clear();
+    userTrackNames.clear();
+    userLocator.reserve(store.count());
+    userTrackNames.reserve(store.count());
+
+    store.forEach([this](const TrackConfig& track) {
+        if (track.startFinish.isSet) {
+            userLocator.add(track.startFinish.latitude, track.startFinish.longitude, userTrackNames.size());
+            userTrackNames.push_back(track.name);
+        }
+    });
+
+    userLocator.build();
+    userLocatorDirty = false;
+}
+
+bool TrackManager::migrateLegacyStorage() {
+    Preferences preferences;
+    if (!preferences.begin(LEGACY_NAMESPACE, false)) {
         return false;
     }
-    
-    char key[16];
-    snprintf(key, sizeof(key), "track_%u", (unsigned int)index);
-    size_t read = preferences.getBytes(key, config, sizeof(TrackConfig));
+
+    size_t count = preferences.getUInt("track_count", 0);
+    size_t migrated = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "track_%u", (unsigned int)i);
+
+        TrackConfig track;
+        if (preferences.getBytes(key, &track, sizeof(TrackConfig)) == sizeof(TrackConfig)) {
+            track.name[MAX_TRACK_NAME_LENGTH - 1] = '\0';
+            if (store.put(track)) {
+                migrated++;
+            }
+        }
+    }
+
+    // Only drop the old blobs once everything made it into the store
+    if (count > 0 && migrated == count) {
+        preferences.clear();
+        LOG_INFO("Migrated %u tracks from NVS", (unsigned int)migrated);
+    }
+
     preferences.end();
-    
-    return read == sizeof(TrackConfig);
-}
+    return migrated == count;
+}
\ No newline at end of file
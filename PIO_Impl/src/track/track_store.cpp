@@ -0,0 +1,570 @@
+#include "track/track_store.h"
+#include "util/crc.h"
+#include "util/log.h"
+
+namespace {
+    const uint32_t SECTOR_SIZE = 4096;
+
+    // Point flags in the put payload
+    const uint8_t POINT_START_FINISH = 0x01;
+    const uint8_t POINT_SECTOR2 = 0x02;
+    const uint8_t POINT_SECTOR3 = 0x04;
+    const uint8_t TRACK_VALID = 0x80;
+
+    void putU16(uint8_t* p, uint16_t v) {
+        p[0] = v & 0xFF;
+        p[1] = v >> 8;
+    }
+
+    void putU32(uint8_t* p, uint32_t v) {
+        p[0] = v & 0xFF;
+        p[1] = (v >> 8) & 0xFF;
+        p[2] = (v >> 16) & 0xFF;
+        p[3] = v >> 24;
+    }
+
+    uint16_t getU16(const uint8_t* p) {
+        return p[0] | (p[1] << 8);
+    }
+
+    uint32_t getU32(const uint8_t* p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    // Coordinates are stored as 1e-7 degree fixed point (~1 cm), radius in cm
+    size_t encodePoint(const GpsPoint& point, uint8_t* out) {
+        putU32(out, (uint32_t)(int32_t)lround(point.latitude * 1e7));
+        putU32(out + 4, (uint32_t)(int32_t)lround(point.longitude * 1e7));
+        float radiusCm = point.radius * 100.0f;
+        putU16(out + 8, radiusCm > 65535.0f ? 65535 : (uint16_t)(radiusCm + 0.5f));
+        return 10;
+    }
+
+    size_t decodePoint(const uint8_t* data, GpsPoint* point) {
+        point->latitude = (int32_t)getU32(data) / 1e7;
+        point->longitude = (int32_t)getU32(data + 4) / 1e7;
+        point->radius = getU16(data + 8) / 100.0f;
+        point->isSet = true;
+        return 10;
+    }
+
+    // Extracts the track name from a put or tombstone payload
+    bool payloadName(uint8_t type, const uint8_t* payload, size_t length, char* name) {
+        size_t start = (type == 1) ? 1 : 0;  // Puts carry the schema version first
+        if (length < start + 1) return false;
+        size_t nameLength = payload[start];
+        if (nameLength >= MAX_TRACK_NAME_LENGTH || start + 1 + nameLength > length) return false;
+        memcpy(name, payload + start + 1, nameLength);
+        name[nameLength] = '\0';
+        return true;
+    }
+}
+
+TrackStore::TrackStore()
+    : partition(nullptr)
+    , halfSize(0)
+    , activeHalf(0)
+    , generation(0)
+    , writeOffset(0)
+    , liveBytes(0)
+    , nextSeq(1)
+    , state(State::Idle)
+    , eraseOffset(0)
+    , copyRemaining(0)
+    , shadowWriteOffset(0)
+{}
+
+bool TrackStore::begin(const char* partitionLabel) {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+    if (!partition) {
+        LOG_ERROR("Track store partition not found");
+        return false;
+    }
+
+    halfSize = (partition->size / 2) & ~(SECTOR_SIZE - 1);
+    if (halfSize < 2 * SECTOR_SIZE) {
+        LOG_ERROR("Track store partition too small");
+        return false;
+    }
+
+    uint32_t gen0 = 0, gen1 = 0;
+    bool valid0 = readHalfHeader(0, &gen0);
+    bool valid1 = readHalfHeader(1, &gen1);
+
+    if (!valid0 && !valid1) {
+        // Blank partition, start a fresh log
+        if (!formatHalf(0, 1)) {
+            LOG_ERROR("Failed to format track store");
+            return false;
+        }
+        activeHalf = 0;
+        generation = 1;
+    } else if (valid0 && (!valid1 || gen0 > gen1)) {
+        activeHalf = 0;
+        generation = gen0;
+    } else {
+        activeHalf = 1;
+        generation = gen1;
+    }
+
+    return replay();
+}
+
+bool TrackStore::put(const TrackConfig& config) {
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    size_t length = encode(config, payload, sizeof(payload));
+    if (length == 0) {
+        return false;
+    }
+
+    uint32_t hash = hashName(config.name);
+    int index = findEntry(config.name, hash);
+    if (index < 0 && entries.size() >= MAX_TRACKS) {
+        LOG_WARN("Maximum number of tracks reached");
+        return false;
+    }
+
+    IndexEntry entry;
+    entry.nameHash = hash;
+    if (!write(RECORD_PUT, payload, length, &entry)) {
+        return false;
+    }
+
+    if (index >= 0) {
+        liveBytes -= recordSize(entries[index].length);
+        entries[index] = entry;
+    } else {
+        entries.push_back(entry);
+    }
+    liveBytes += recordSize(entry.length);
+    return true;
+}
+
+bool TrackStore::remove(const char* name) {
+    int index = findEntry(name, hashName(name));
+    if (index < 0) {
+        return false;
+    }
+
+    uint8_t payload[MAX_TRACK_NAME_LENGTH];
+    size_t nameLength = strnlen(name, MAX_TRACK_NAME_LENGTH - 1);
+    payload[0] = nameLength;
+    memcpy(payload + 1, name, nameLength);
+
+    IndexEntry tombstone;
+    if (!write(RECORD_TOMBSTONE, payload, nameLength + 1, &tombstone)) {
+        return false;
+    }
+
+    liveBytes -= recordSize(entries[index].length);
+    entries[index] = entries.back();
+    entries.pop_back();
+
+    // Entries still waiting to be copied live in [0, copyRemaining). A swap
+    // from the back can at worst cause one harmless duplicate copy.
+    if (copyRemaining > entries.size()) {
+        copyRemaining = entries.size();
+    }
+    return true;
+}
+
+bool TrackStore::get(const char* name, TrackConfig* config) {
+    int index = findEntry(name, hashName(name));
+    return index >= 0 && readTrack(entries[index].offset, config);
+}
+
+bool TrackStore::erase() {
+    if (!partition || esp_partition_erase_range(partition, 0, 2 * halfSize) != ESP_OK) {
+        return false;
+    }
+
+    entries.clear();
+    state = State::Idle;
+    activeHalf = 0;
+    generation = 1;
+    writeOffset = HALF_HEADER_SIZE;
+    liveBytes = 0;
+    return writeHalfHeader(0, generation);
+}
+
+bool TrackStore::maintain() {
+    if (state == State::Idle) {
+        if (!partition || !needsCompaction()) {
+            return false;
+        }
+        startCompaction();
+    }
+    return step();
+}
+
+size_t TrackStore::encode(const TrackConfig& config, uint8_t* out, size_t capacity) {
+    const GpsPoint* points[3] = { &config.startFinish, &config.sector2Start, &config.sector3Start };
+    const uint8_t pointFlags[3] = { POINT_START_FINISH, POINT_SECTOR2, POINT_SECTOR3 };
+
+    size_t nameLength = strnlen(config.name, MAX_TRACK_NAME_LENGTH - 1);
+    uint8_t flags = config.isValid ? TRACK_VALID : 0;
+    size_t needed = 3 + nameLength;  // Schema version, name length, flags
+    for (int i = 0; i < 3; i++) {
+        if (points[i]->isSet) {
+            flags |= pointFlags[i];
+            needed += 10;
+        }
+    }
+    if (needed > capacity) {
+        return 0;
+    }
+
+    size_t pos = 0;
+    out[pos++] = SCHEMA_VERSION;
+    out[pos++] = nameLength;
+    memcpy(out + pos, config.name, nameLength);
+    pos += nameLength;
+    out[pos++] = flags;
+    for (int i = 0; i < 3; i++) {
+        if (points[i]->isSet) {
+            pos += encodePoint(*points[i], out + pos);
+        }
+    }
+    return pos;
+}
+
+bool TrackStore::decode(const uint8_t* data, size_t length, TrackConfig* config) {
+    if (length < 3 || data[0] != SCHEMA_VERSION) {
+        return false;
+    }
+
+    TrackConfig result;
+    if (!payloadName(RECORD_PUT, data, length, result.name)) {
+        return false;
+    }
+
+    size_t pos = 2 + data[1];
+    if (pos >= length) {
+        return false;
+    }
+    uint8_t flags = data[pos++];
+
+    GpsPoint* points[3] = { &result.startFinish, &result.sector2Start, &result.sector3Start };
+    const uint8_t pointFlags[3] = { POINT_START_FINISH, POINT_SECTOR2, POINT_SECTOR3 };
+    for (int i = 0; i < 3; i++) {
+        if (flags & pointFlags[i]) {
+            if (pos + 10 > length) {
+                return false;
+            }
+            pos += decodePoint(data + pos, points[i]);
+        }
+    }
+
+    result.isValid = (flags & TRACK_VALID) != 0;
+    *config = result;
+    return true;
+}
+
+uint32_t TrackStore::hashName(const char* name) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < MAX_TRACK_NAME_LENGTH - 1 && name[i]; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+uint32_t TrackStore::recordSize(size_t payloadLength) {
+    return (RECORD_HEADER_SIZE + payloadLength + 3) & ~3u;
+}
+
+bool TrackStore::readHalfHeader(uint8_t half, uint32_t* gen) {
+    uint8_t header[HALF_HEADER_SIZE];
+    if (esp_partition_read(partition, halfBase(half), header, sizeof(header)) != ESP_OK) {
+        return false;
+    }
+    if (getU32(header) != HALF_MAGIC || header[8] != SCHEMA_VERSION ||
+        getU32(header + 12) != crc::crc32(header, 12)) {
+        return false;
+    }
+    *gen = getU32(header + 4);
+    return true;
+}
+
+bool TrackStore::writeHalfHeader(uint8_t half, uint32_t gen) {
+    uint8_t header[HALF_HEADER_SIZE];
+    memset(header, 0xFF, sizeof(header));
+    putU32(header, HALF_MAGIC);
+    putU32(header + 4, gen);
+    header[8] = SCHEMA_VERSION;
+    putU32(header + 12, crc::crc32(header, 12));
+    return esp_partition_write(partition, halfBase(half), header, sizeof(header)) == ESP_OK;
+}
+
+bool TrackStore::formatHalf(uint8_t half, uint32_t gen) {
+    if (esp_partition_erase_range(partition, halfBase(half), halfSize) != ESP_OK) {
+        return false;
+    }
+    return writeHalfHeader(half, gen);
+}
+
+bool TrackStore::replay() {
+    entries.clear();
+    liveBytes = 0;
+
+    uint32_t offset = HALF_HEADER_SIZE;
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    char name[MAX_TRACK_NAME_LENGTH];
+
+    while (offset + RECORD_HEADER_SIZE <= halfSize) {
+        uint8_t header[RECORD_HEADER_SIZE];
+        if (esp_partition_read(partition, halfBase(activeHalf) + offset, header, sizeof(header)) != ESP_OK) {
+            return false;
+        }
+
+        uint16_t magic = getU16(header);
+        if (magic == 0xFFFF) {
+            break;  // Erased flash, end of log
+        }
+
+        size_t length = header[3];
+        if (magic != RECORD_MAGIC || length > MAX_PAYLOAD_SIZE || offset + recordSize(length) > halfSize) {
+            // Torn write: the rest of the half cannot be trusted or appended to.
+            // Treat it as full so the next maintain() compacts it away.
+            LOG_WARN("Track store: corrupt record, compaction scheduled");
+            offset = halfSize;
+            break;
+        }
+
+        RecordType type;
+        uint32_t seq;
+        size_t payloadLength;
+        uint32_t size = recordSize(length);
+        if (!readRecord(activeHalf, offset, &type, &seq, payload, &payloadLength) ||
+            !payloadName(type, payload, payloadLength, name)) {
+            offset += size;  // Bad checksum, skip the record
+            continue;
+        }
+
+        if (seq >= nextSeq) {
+            nextSeq = seq + 1;
+        }
+
+        uint32_t hash = hashName(name);
+        int index = findEntry(name, hash);
+        if (index >= 0 && entries[index].seq > seq) {
+            offset += size;  // Superseded by a newer record already seen
+            continue;
+        }
+
+        if (type == RECORD_PUT) {
+            IndexEntry entry = { hash, offset, NO_OFFSET, seq, (uint8_t)payloadLength };
+            if (index >= 0) {
+                liveBytes -= recordSize(entries[index].length);
+                entries[index] = entry;
+            } else {
+                entries.push_back(entry);
+            }
+            liveBytes += size;
+        } else if (index >= 0) {
+            liveBytes -= recordSize(entries[index].length);
+            entries[index] = entries.back();
+            entries.pop_back();
+        }
+
+        offset += size;
+    }
+
+    writeOffset = offset;
+    return true;
+}
+
+bool TrackStore::appendRecord(uint8_t half, uint32_t offset, RecordType type, uint32_t seq,
+                              const uint8_t* payload, size_t length) {
+    uint8_t buffer[RECORD_HEADER_SIZE + MAX_PAYLOAD_SIZE + 4];
+    uint32_t size = recordSize(length);
+    memset(buffer, 0xFF, size);
+
+    putU16(buffer, RECORD_MAGIC);
+    buffer[2] = type;
+    buffer[3] = length;
+    putU32(buffer + 4, seq);
+    memcpy(buffer + RECORD_HEADER_SIZE, payload, length);
+    uint16_t crc = crc::crc16(buffer + 2, 6);
+    putU16(buffer + 8, crc::crc16(payload, length, crc));
+
+    return esp_partition_write(partition, halfBase(half) + offset, buffer, size) == ESP_OK;
+}
+
+bool TrackStore::readRecord(uint8_t half, uint32_t offset, RecordType* type, uint32_t* seq,
+                            uint8_t* payload, size_t* length) {
+    uint8_t header[RECORD_HEADER_SIZE];
+    if (esp_partition_read(partition, halfBase(half) + offset, header, sizeof(header)) != ESP_OK) {
+        return false;
+    }
+    if (getU16(header) != RECORD_MAGIC || header[3] > MAX_PAYLOAD_SIZE) {
+        return false;
+    }
+
+    *length = header[3];
+    if (esp_partition_read(partition, halfBase(half) + offset + RECORD_HEADER_SIZE, payload, *length) != ESP_OK) {
+        return false;
+    }
+
+    uint16_t crc = crc::crc16(header + 2, 6);
+    if (crc::crc16(payload, *length, crc) != getU16(header + 8)) {
+        return false;
+    }
+
+    *type = (RecordType)header[2];
+    *seq = getU32(header + 4);
+    return *type == RECORD_PUT || *type == RECORD_TOMBSTONE;
+}
+
+bool TrackStore::readTrack(uint32_t offset, TrackConfig* config) {
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    RecordType type;
+    uint32_t seq;
+    size_t length;
+    return readRecord(activeHalf, offset, &type, &seq, payload, &length) &&
+           type == RECORD_PUT && decode(payload, length, config);
+}
+
+int TrackStore::findEntry(const char* name, uint32_t hash) {
+    TrackConfig stored;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].nameHash != hash) {
+            continue;
+        }
+        // Hash match, confirm against the stored name
+        if (readTrack(entries[i].offset, &stored) &&
+            strncmp(stored.name, name, MAX_TRACK_NAME_LENGTH - 1) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool TrackStore::write(RecordType type, const uint8_t* payload, size_t length, IndexEntry* entry) {
+    if (!partition) {
+        return false;
+    }
+
+    uint32_t size = recordSize(length);
+    if (writeOffset + size > halfSize) {
+        // Out of room: finish (or run) a compaction synchronously
+        compactAll();
+        if (writeOffset + size > halfSize) {
+            LOG_WARN("Track store full");
+            return false;
+        }
+    }
+
+    uint32_t seq = nextSeq++;
+    if (!appendRecord(activeHalf, writeOffset, type, seq, payload, length)) {
+        return false;
+    }
+
+    entry->offset = writeOffset;
+    entry->shadowOffset = NO_OFFSET;
+    entry->seq = seq;
+    entry->length = length;
+    writeOffset += size;
+
+    // Mirror into the half being compacted so the copy stays consistent
+    if (state == State::Copying) {
+        if (shadowWriteOffset + size <= halfSize &&
+            appendRecord(otherHalf(), shadowWriteOffset, type, seq, payload, length)) {
+            entry->shadowOffset = shadowWriteOffset;
+            shadowWriteOffset += size;
+        } else {
+            state = State::Idle;  // Abandon, the next maintain() restarts it
+        }
+    }
+    return true;
+}
+
+bool TrackStore::needsCompaction() const {
+    uint32_t capacity = halfSize - HALF_HEADER_SIZE;
+    uint32_t used = writeOffset - HALF_HEADER_SIZE;
+    uint32_t dead = used - liveBytes;
+    uint32_t remaining = halfSize - writeOffset;
+    return dead >= capacity / 4 || (remaining < capacity / 8 && dead >= remaining);
+}
+
+void TrackStore::startCompaction() {
+    for (auto& entry : entries) {
+        entry.shadowOffset = NO_OFFSET;
+    }
+    state = State::Erasing;
+    eraseOffset = 0;
+}
+
+bool TrackStore::step() {
+    if (state == State::Erasing) {
+        // One sector per step keeps each call to a single flash erase
+        if (esp_partition_erase_range(partition, halfBase(otherHalf()) + eraseOffset, SECTOR_SIZE) != ESP_OK) {
+            state = State::Idle;
+            return false;
+        }
+        eraseOffset += SECTOR_SIZE;
+        if (eraseOffset >= halfSize) {
+            state = State::Copying;
+            copyRemaining = entries.size();
+            shadowWriteOffset = HALF_HEADER_SIZE;
+        }
+        return true;
+    }
+
+    if (state == State::Copying) {
+        uint8_t payload[MAX_PAYLOAD_SIZE];
+        for (size_t n = 0; n < COPIES_PER_STEP && copyRemaining > 0; n++) {
+            IndexEntry& entry = entries[--copyRemaining];
+            RecordType type;
+            uint32_t seq;
+            size_t length;
+            uint32_t size = recordSize(entry.length);
+            if (!readRecord(activeHalf, entry.offset, &type, &seq, payload, &length) ||
+                shadowWriteOffset + size > halfSize ||
+                !appendRecord(otherHalf(), shadowWriteOffset, type, seq, payload, length)) {
+                state = State::Idle;
+                return false;
+            }
+            entry.shadowOffset = shadowWriteOffset;
+            shadowWriteOffset += size;
+        }
+
+        if (copyRemaining == 0) {
+            finishCompaction();
+            return false;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+bool TrackStore::finishCompaction() {
+    state = State::Idle;
+    for (const auto& entry : entries) {
+        if (entry.shadowOffset == NO_OFFSET) {
+            return false;
+        }
+    }
+
+    // The header write is the commit point
+    if (!writeHalfHeader(otherHalf(), generation + 1)) {
+        return false;
+    }
+
+    activeHalf = otherHalf();
+    generation++;
+    for (auto& entry : entries) {
+        entry.offset = entry.shadowOffset;
+        entry.shadowOffset = NO_OFFSET;
+    }
+    writeOffset = shadowWriteOffset;
+    return true;
+}
+
+void TrackStore::compactAll() {
+    if (state == State::Idle) {
+        startCompaction();
+    }
+    while (step()) {}
+}
@@ -0,0 +1,221 @@
+#include "util/log.h"
+
+namespace logging {
+
+    namespace {
+        // Bounded lock-free queue (Vyukov). Producers on either core claim a
+        // slot with a CAS on head; a slot's sequence tells the single
+        // consumer when its record is complete.
+        struct Slot {
+            std::atomic<uint32_t> sequence;
+            Record record;
+        };
+
+        struct Ring {
+            Slot slots[RING_SIZE];
+            std::atomic<uint32_t> head;
+            uint32_t tail;
+            std::atomic<uint32_t> dropped;
+
+            Ring() : head(0), tail(0), dropped(0) {
+                for (uint32_t i = 0; i < RING_SIZE; i++) {
+                    slots[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+        };
+
+        Ring& ring() {
+            static Ring instance;
+            return instance;
+        }
+
+        struct ArgReader {
+            const uint8_t* data;
+            size_t length;
+            size_t offset;
+
+            bool read(void* value, size_t n) {
+                if (offset + n > length) {
+                    return false;
+                }
+                memcpy(value, data + offset, n);
+                offset += n;
+                return true;
+            }
+        };
+    }
+
+    bool push(uint8_t level, const char* format, const uint8_t* args, size_t length) {
+        Ring& r = ring();
+        uint32_t pos = r.head.load(std::memory_order_relaxed);
+        Slot* slot;
+
+        for (;;) {
+            slot = &r.slots[pos & (RING_SIZE - 1)];
+            int32_t diff = (int32_t)(slot->sequence.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (r.head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // Full, the newest message is the one that goes
+                r.dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = r.head.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->record.format = format;
+        slot->record.micros = now();
+        slot->record.level = level;
+        slot->record.length = (uint8_t)length;
+        if (length) {
+            memcpy(slot->record.args, args, length);
+        }
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(Record& record) {
+        Ring& r = ring();
+        Slot& slot = r.slots[r.tail & (RING_SIZE - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != r.tail + 1) {
+            return false;
+        }
+
+        record = slot.record;
+        slot.sequence.store(r.tail + RING_SIZE, std::memory_order_release);
+        r.tail++;
+        return true;
+    }
+
+    uint32_t dropped() {
+        return ring().dropped.load(std::memory_order_relaxed);
+    }
+
+    size_t format(const Record& record, char* out, size_t size) {
+        ArgReader args = { record.args, record.length, 0 };
+        const char* f = record.format;
+        size_t length = 0;
+
+        auto append = [&](int n) {
+            if (n > 0) {
+                length += n;
+                if (length >= size) {
+                    length = size ? size - 1 : 0;
+                }
+            }
+        };
+
+        while (*f && length + 1 < size) {
+            if (*f != '%') {
+                out[length++] = *f++;
+                continue;
+            }
+            if (f[1] == '%') {
+                out[length++] = '%';
+                f += 2;
+                continue;
+            }
+
+            // Copy flags, width and precision into a spec we rebuild below
+            char spec[16];
+            size_t specLength = 0;
+            spec[specLength++] = *f++;
+            while (*f && strchr("-+ #0123456789.", *f) && specLength < sizeof(spec) - 4) {
+                spec[specLength++] = *f++;
+            }
+
+            // Length modifiers only decide how many bytes the argument took
+            size_t width = 4;
+            while (*f && strchr("hlLqjzt", *f)) {
+                if (*f == 'j' || *f == 'q' || *f == 'L' || (f[0] == 'l' && f[1] == 'l')) {
+                    width = 8;
+                } else if (*f == 'l') {
+                    width = sizeof(long);
+                } else if (*f == 'z' || *f == 't') {
+                    width = sizeof(size_t);
+                }
+                f += (f[0] == 'l' && f[1] == 'l') || (f[0] == 'h' && f[1] == 'h') ? 2 : 1;
+            }
+
+            char conversion = *f;
+            if (!conversion) {
+                break;
+            }
+            f++;
+
+            bool ok;
+            char* dest = out + length;
+            size_t room = size - length;
+            switch (conversion) {
+                case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c': {
+                    spec[specLength++] = 'l';
+                    spec[specLength++] = 'l';
+                    spec[specLength++] = conversion;
+                    spec[specLength] = '\0';
+                    long long value = 0;
+                    if (width == 8) {
+                        int64_t v = 0;
+                        ok = args.read(&v, 8);
+                        value = v;
+                    } else {
+                        uint32_t v = 0;
+                        ok = args.read(&v, 4);
+                        value = (conversion == 'd' || conversion == 'i') ? (long long)(int32_t)v : (long long)v;
+                    }
+                    if (conversion == 'c') {
+                        spec[specLength - 3] = 'c';
+                        spec[specLength - 2] = '\0';
+                        if (ok) append(snprintf(dest, room, spec, (int)value));
+                    } else if (ok) {
+                        append(snprintf(dest, room, spec, value));
+                    }
+                    break;
+                }
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                    spec[specLength++] = conversion;
+                    spec[specLength] = '\0';
+                    double value;
+                    ok = args.read(&value, 8);
+                    if (ok) append(snprintf(dest, room, spec, value));
+                    break;
+                }
+                case 's': {
+                    spec[specLength++] = 's';
+                    spec[specLength] = '\0';
+                    char text[MAX_STRING + 1];
+                    uint8_t n = 0;
+                    ok = args.read(&n, 1) && n <= MAX_STRING && args.read(text, n);
+                    if (ok) {
+                        text[n] = '\0';
+                        append(snprintf(dest, room, spec, text));
+                    }
+                    break;
+                }
+                case 'p': {
+                    uint32_t value;
+                    ok = args.read(&value, 4);
+                    if (ok) append(snprintf(dest, room, "0x%08lx", (unsigned long)value));
+                    break;
+                }
+                default:
+                    ok = false;
+                    break;
+            }
+
+            if (!ok) {
+                // Truncated or unsupported argument, mark it and stop
+                append(snprintf(out + length, size - length, "<?>"));
+                break;
+            }
+        }
+
+        if (size) {
+            out[length] = '\0';
+        }
+        return length;
+    }
+
+}
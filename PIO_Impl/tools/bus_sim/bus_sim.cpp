@@ -0,0 +1,194 @@
+/**
+ * BusScheduler on a simulated I2C bus shared by the IMU and a u-blox
+ * receiver on its DDC port.
+ *
+ * The mock port turns each transaction into bus time from its byte count
+ * and the bus clock, plus a fixed driver overhead, and advances a simulated
+ * clock. The IMU is a 104 Hz periodic 12-byte burst read. The receiver is
+ * polled every 40 ms: a 2-byte "bytes available" read, then the PVT (and
+ * once a second the NAV-SAT) read from the stream register in chunks, each
+ * chunk submitted when the previous one completes, like the vendor
+ * library does.
+ *
+ * Every configuration runs the same load and reports bus utilization,
+ * per-device wait time from release to start of transfer, and missed
+ * deadlines. The "blocking" rows rank the receiver above the IMU, so a
+ * started message is read to the end before the IMU gets the bus. That is
+ * how sequential blocking Wire calls behave.
+ *
+ * Build from PIO_Impl/:
+ *   g++ -std=gnu++17 -O2 -Iinclude tools/bus_sim/bus_sim.cpp -o bus_sim
+ *
+ * Usage:
+ *   bus_sim [--seconds N]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sensors/bus_scheduler.h"
+
+namespace {
+
+    uint32_t simNow = 0;
+
+    uint32_t simClock() {
+        return simNow;
+    }
+
+    class MockPort : public BusPort {
+    public:
+        MockPort(uint32_t clockHz, uint32_t overheadUs) : clockHz(clockHz), overheadUs(overheadUs) {}
+
+        bool transfer(uint8_t /*address*/, const uint8_t* /*tx*/, size_t txLength, uint8_t* rx, size_t rxLength) override {
+            // 9 clocks per byte including ACK, address bytes, start/stop
+            uint32_t bits = 9 * (1 + txLength) + 2;
+            if (rxLength) {
+                bits += 9 * (1 + rxLength) + 1;
+                memset(rx, 0, rxLength);
+            }
+            simNow += overheadUs + (uint32_t)((uint64_t)bits * 1000000 / clockHz);
+            return true;
+        }
+
+    private:
+        uint32_t clockHz;
+        uint32_t overheadUs;
+    };
+
+    enum Client : uint8_t { CLIENT_IMU, CLIENT_GNSS };
+
+    const uint8_t GNSS_ADDRESS = 0x42;
+    const uint32_t GNSS_POLL_US = 40000;
+    const uint32_t IMU_PERIOD_US = 9615;
+
+    struct Config {
+        const char* name;
+        uint32_t clockHz;
+        size_t chunk;              // GNSS stream read size
+        bool prioritised;
+    };
+
+    // Receiver side: follows the available read with chunked stream reads
+    struct Gnss {
+        BusScheduler* scheduler;
+        const Config* config;
+        uint8_t buffer[512];
+        size_t remaining;
+        uint32_t polls;
+        uint32_t messageStart;
+        uint32_t worstMessageUs;
+
+        void submitChunk() {
+            BusTransaction t = {};
+            t.address = GNSS_ADDRESS;
+            t.client = CLIENT_GNSS;
+            t.priority = config->prioritised ? 1 : 0;
+            t.txLength = 1;
+            t.tx[0] = 0xFF;           // Stream register
+            t.rx = buffer;
+            t.rxLength = (uint16_t)(remaining < config->chunk ? remaining : config->chunk);
+            t.deadline = config->prioritised ? messageStart + GNSS_POLL_US : 0;
+            t.done = onChunk;
+            t.context = this;
+            remaining -= t.rxLength;
+            scheduler->submit(t);
+        }
+
+        static void onAvailable(void* context, const BusTransaction&, bool) {
+            Gnss* g = (Gnss*)context;
+            g->messageStart = simNow;
+            g->remaining = 100 + (++g->polls % 25 == 0 ? 8 + 12 * 30 + 8 : 0);  // PVT, NAV-SAT once a second
+            g->submitChunk();
+        }
+
+        static void onChunk(void* context, const BusTransaction&, bool) {
+            Gnss* g = (Gnss*)context;
+            if (g->remaining) {
+                g->submitChunk();
+            } else if (simNow - g->messageStart > g->worstMessageUs) {
+                g->worstMessageUs = simNow - g->messageStart;
+            }
+        }
+    };
+
+    void run(const Config& config, uint32_t seconds) {
+        simNow = 0;
+        BusScheduler scheduler(simClock);
+        MockPort port(config.clockHz, 25);
+        uint8_t imuRaw[12];
+
+        BusTransaction imu = {};
+        imu.address = 0x6A;
+        imu.client = CLIENT_IMU;
+        imu.priority = config.prioritised ? 0 : 1;
+        imu.txLength = 1;
+        imu.tx[0] = 0x22;
+        imu.rx = imuRaw;
+        imu.rxLength = sizeof(imuRaw);
+        scheduler.addPeriodic(imu, IMU_PERIOD_US);
+
+        Gnss gnss = {};
+        gnss.scheduler = &scheduler;
+        gnss.config = &config;
+        uint8_t available[2];
+        BusTransaction poll = {};
+        poll.address = GNSS_ADDRESS;
+        poll.client = CLIENT_GNSS;
+        poll.priority = config.prioritised ? 1 : 0;
+        poll.txLength = 1;
+        poll.tx[0] = 0xFD;            // Bytes available, high byte first
+        poll.rx = available;
+        poll.rxLength = sizeof(available);
+        poll.done = Gnss::onAvailable;
+        poll.context = &gnss;
+        simNow = 3000;                // Out of phase with the IMU
+        scheduler.addPeriodic(poll, GNSS_POLL_US);
+        simNow = 0;
+        scheduler.resetStats();
+
+        // The bus task: release, transfer, or sleep until the next release
+        while (simNow < seconds * 1000000u) {
+            uint32_t sleep = scheduler.release();
+            if (!scheduler.runNext(port)) {
+                simNow += sleep;
+            }
+        }
+
+        BusScheduler::ClientStats i = scheduler.getStats(CLIENT_IMU);
+        BusScheduler::ClientStats g = scheduler.getStats(CLIENT_GNSS);
+        printf("%-24s %5.1f%% | %6u %5u %5u %5u %5u | %6u %5u %5u | %6.1f\n", config.name,
+               scheduler.utilization() * 100.0f, i.transactions, i.waitUs.percentile(50), i.waitUs.percentile(99),
+               i.waitUs.getMax(), i.deadlineMisses, g.transactions, g.waitUs.percentile(99), g.waitUs.getMax(),
+               gnss.worstMessageUs / 1000.0f);
+    }
+
+}
+
+int main(int argc, char** argv) {
+    uint32_t seconds = 10;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+            seconds = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--seconds N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const Config configs[] = {
+        { "blocking 400k", 400000, 255, false },
+        { "blocking 400k chunk 32", 400000, 32, false },
+        { "prio 400k", 400000, 255, true },
+        { "prio 400k chunk 32", 400000, 32, true },
+        { "prio 1M", 1000000, 255, true },
+        { "prio 1M chunk 32", 1000000, 32, true },
+    };
+
+    printf("%u s simulated; IMU 104 Hz 12-byte reads, GNSS polled at 25 Hz; waits in us\n\n", seconds);
+    printf("%-24s %6s | %6s %5s %5s %5s %5s | %6s %5s %5s | %6s\n", "config", "busy", "imu", "p50", "p99", "max",
+           "late", "gnss", "p99", "max", "msg ms");
+    for (const Config& config : configs) {
+        run(config, seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,417 @@
+/**
+ * Channel registry and CAN decoder on the host.
+ *
+ * The default run generates an ECU's broadcast in simulated time (RPM and
+ * throttle at 100 Hz, gear at 50 Hz, coolant at 10 Hz, and a 2 kHz
+ * pressure stream standing in for an ADC input), feeds the frames through
+ * CanSource and drains the channels with two subscribers at different
+ * rates, like a logger and the live telemetry. It checks that every value
+ * comes back as encoded, that no subscriber loses samples, and reports
+ * decode plus publish time per frame. A second pass runs the publisher and
+ * a reader on separate threads and checks that a reader never sees a torn
+ * or reordered sample.
+ *
+ * With --vcan the same CanSource reads a Linux SocketCAN interface
+ * instead, so frames from a real adapter, candump replays or a second
+ * can_bench --send can be decoded:
+ *
+ *   sudo ip link add dev vcan0 type vcan && sudo ip link set up vcan0
+ *   can_bench --vcan vcan0 --seconds 10 &
+ *   can_bench --vcan vcan0 --send --seconds 10
+ *
+ * Build from PIO_Impl/:
+ *   g++ -std=gnu++17 -O2 -pthread -Iinclude tools/can_bench/can_bench.cpp -o can_bench
+ *
+ * Usage:
+ *   can_bench [--seconds N] [--vcan IFNAME [--send]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include "channels/can_decoder.h"
+
+namespace {
+
+    enum ChannelId : uint8_t { CH_RPM = 1, CH_THROTTLE = 2, CH_COOLANT = 3, CH_GEAR = 4, CH_PRESSURE = 16 };
+
+    const ChannelDef CHANNELS[] = {
+        { CH_RPM,      "rpm",      "1/min", ChannelType::Analog,   100,  1, 1.0f },
+        { CH_THROTTLE, "throttle", "%",     ChannelType::Analog,   100,  1, 0.1f },
+        { CH_COOLANT,  "coolant",  "C",     ChannelType::Analog,   10,   1, 0.1f },
+        { CH_GEAR,     "gear",     "",      ChannelType::Discrete, 50,   1, 1.0f },
+        { CH_PRESSURE, "pressure", "bar",   ChannelType::Analog,   2000, 1, 0.05f },
+    };
+
+    // Same layout as the table in src/main.cpp, plus a Motorola pressure
+    // signal so both byte orders are exercised
+    const CanSignal SIGNALS[] = {
+        { 0x360, 0,  16, false, false, 1.0f,  0.0f,   CH_RPM },
+        { 0x360, 16, 16, false, false, 0.1f,  0.0f,   CH_THROTTLE },
+        { 0x3E0, 7,  16, true,  true,  0.1f,  -50.0f, CH_COOLANT },
+        { 0x470, 0,  4,  false, false, 1.0f,  0.0f,   CH_GEAR },
+        { 0x500, 23, 12, true,  false, 0.05f, 0.0f,   CH_PRESSURE },
+    };
+
+    struct Stream {
+        uint32_t frameId;
+        uint32_t periodUs;
+    };
+
+    const Stream STREAMS[] = { { 0x360, 10000 }, { 0x3E0, 100000 }, { 0x470, 20000 }, { 0x500, 500 } };
+
+    uint32_t simNow = 0;
+
+    uint32_t simClock() {
+        return simNow;
+    }
+
+    uint32_t wallClock() {
+        using namespace std::chrono;
+        return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Inverse of CanDecoder::extract()
+    void insert(CanFrame& frame, const CanSignal& s, uint32_t raw) {
+        uint64_t mask = s.length == 32 ? 0xFFFFFFFFull : ((1ull << s.length) - 1);
+        uint64_t bits = 0;
+        if (!s.bigEndian) {
+            for (int i = 8; i-- > 0;) bits = bits << 8 | frame.data[i];
+            bits = (bits & ~(mask << s.startBit)) | ((raw & mask) << s.startBit);
+            for (int i = 0; i < 8; i++) frame.data[i] = (uint8_t)(bits >> (8 * i));
+        } else {
+            uint32_t msb = (s.startBit / 8) * 8 + (7 - s.startBit % 8);
+            int shift = 64 - msb - s.length;
+            for (int i = 0; i < 8; i++) bits = bits << 8 | frame.data[i];
+            bits = (bits & ~(mask << shift)) | ((raw & mask) << shift);
+            for (int i = 0; i < 8; i++) frame.data[i] = (uint8_t)(bits >> (56 - 8 * i));
+        }
+    }
+
+    // Physical value of a signal at time t, already on its raw grid
+    float signalValue(const CanSignal& s, uint32_t t) {
+        double phase = t / 1e6;
+        double value;
+        switch (s.channel) {
+            case CH_RPM:      value = 7000 + 4000 * sin(phase * 0.9); break;
+            case CH_THROTTLE: value = 50 + 50 * sin(phase * 1.3); break;
+            case CH_COOLANT:  value = -20 + 130 * (0.5 + 0.5 * sin(phase * 0.05)); break;
+            case CH_GEAR:     value = 1 + ((t / 3000000) % 6); break;
+            default:          value = 80 + 80 * sin(phase * 7.0); break;
+        }
+        long raw = lround((value - s.offset) / s.scale);
+        return raw * s.scale + s.offset;
+    }
+
+    CanFrame buildFrame(uint32_t frameId, uint32_t t) {
+        CanFrame frame = {};
+        frame.id = frameId;
+        frame.length = 8;
+        for (const CanSignal& s : SIGNALS) {
+            if (s.frameId == frameId) {
+                insert(frame, s, (uint32_t)lround((signalValue(s, t) - s.offset) / s.scale));
+            }
+        }
+        return frame;
+    }
+
+    bool setup(ChannelRegistry& registry, CanDecoder& decoder) {
+        for (const ChannelDef& def : CHANNELS) {
+            if (!registry.add(def)) return false;
+        }
+        for (const CanSignal& s : SIGNALS) {
+            if (!decoder.add(s)) return false;
+        }
+        return true;
+    }
+
+    // Frames queued in simulated time order
+    class QueuePort : public CanPort {
+    public:
+        std::vector<CanFrame> frames;
+        std::vector<uint32_t> times;
+        size_t next = 0;
+
+        bool receive(CanFrame* frame, uint32_t) override {
+            if (next == frames.size()) return false;
+            simNow = times[next];
+            *frame = frames[next++];
+            return true;
+        }
+    };
+
+    // A subscriber draining every periodUs, checking each value
+    struct Consumer {
+        const char* name;
+        uint32_t periodUs;
+        uint32_t nextDrain = 0;
+        ChannelReader readers[sizeof(CHANNELS) / sizeof(CHANNELS[0])];
+        uint64_t samples = 0;
+        uint64_t mismatches = 0;
+
+        Consumer(const char* name, uint32_t periodUs) : name(name), periodUs(periodUs) {}
+
+        void drain() {
+            ChannelSample out[64];
+            for (ChannelReader& reader : readers) {
+                const CanSignal* signal = nullptr;
+                for (const CanSignal& s : SIGNALS) {
+                    if (s.channel == reader.getId()) signal = &s;
+                }
+                size_t n;
+                while ((n = reader.read(out, 64)) > 0) {
+                    for (size_t i = 0; i < n; i++) {
+                        float expected = signalValue(*signal, out[i].timeUs);
+                        if (fabsf(out[i].value - expected) > signal->scale * 0.01f + 1e-3f) mismatches++;
+                    }
+                    samples += n;
+                }
+            }
+        }
+    };
+
+    int runSimulated(double seconds) {
+        ChannelRegistry registry;
+        CanDecoder decoder;
+        if (!setup(registry, decoder)) {
+            fprintf(stderr, "setup failed\n");
+            return 1;
+        }
+
+        QueuePort port;
+        uint32_t end = (uint32_t)(seconds * 1e6);
+        for (uint32_t t = 0; t < end; t += 500) {
+            for (const Stream& stream : STREAMS) {
+                if (t % stream.periodUs == 0) {
+                    port.frames.push_back(buildFrame(stream.frameId, t));
+                    port.times.push_back(t);
+                }
+            }
+        }
+        // A frame nobody decodes
+        CanFrame foreign = {};
+        foreign.id = 0x7DF;
+        foreign.length = 8;
+        port.frames.push_back(foreign);
+        port.times.push_back(end);
+
+        Consumer consumers[2] = { Consumer("logger", 100000), Consumer("telemetry", 50000) };
+        for (Consumer& c : consumers) {
+            for (size_t i = 0; i < registry.size(); i++) c.readers[i] = registry.subscribe(registry.getDef(i).id);
+        }
+
+        CanSource source(port, decoder, registry, simClock);
+        uint64_t decodeNs = 0;
+        while (true) {
+            auto start = std::chrono::steady_clock::now();
+            bool got = source.poll(0);
+            decodeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            if (!got) break;
+            for (Consumer& c : consumers) {
+                if (simNow >= c.nextDrain) {
+                    c.drain();
+                    c.nextDrain += c.periodUs;
+                }
+            }
+        }
+        for (Consumer& c : consumers) c.drain();
+
+        uint64_t published = 0;
+        printf("%-10s %6s %8s %6s\n", "channel", "rate", "samples", "Hz");
+        for (size_t i = 0; i < registry.size(); i++) {
+            const ChannelDef& def = registry.getDef(i);
+            published += registry.getPublished(def.id);
+            printf("%-10s %6u %8u %6.0f\n", def.name, def.rateHz, (unsigned)registry.getPublished(def.id),
+                   registry.getPublished(def.id) / seconds);
+        }
+        printf("%zu frames (%u unknown), %llu samples = %.0f samples/s, decode+publish %.0f ns/frame\n",
+               port.frames.size(), (unsigned)decoder.getUnknownFrames(), (unsigned long long)published,
+               published / seconds, (double)decodeNs / port.frames.size());
+
+        int failures = 0;
+        for (Consumer& c : consumers) {
+            uint32_t lost = 0;
+            for (ChannelReader& r : c.readers) lost += r.getLost();
+            printf("%-10s drains every %3u ms: %llu samples, %u lost, %llu mismatched\n", c.name,
+                   (unsigned)(c.periodUs / 1000), (unsigned long long)c.samples, (unsigned)lost,
+                   (unsigned long long)c.mismatches);
+            if (c.samples != published || lost || c.mismatches) failures++;
+        }
+        if (decoder.getUnknownFrames() != 1) failures++;
+        return failures;
+    }
+
+    // One writer, one reader, real threads: the reader must see a gapless
+    // sequence apart from reported losses, and never a torn sample
+    int runThreaded(double seconds) {
+        ChannelRegistry registry;
+        ChannelDef def = { 9, "seq", "", ChannelType::Discrete, 2000, 1, 1.0f };
+        registry.add(def);
+        ChannelReader reader = registry.subscribe(9);
+        volatile bool done = false;
+
+        std::thread writer([&]() {
+            uint32_t end = wallClock() + (uint32_t)(seconds * 1e6);
+            for (uint32_t n = 1; wallClock() < end; n++) {
+                // value and time carry the same count, a torn copy mixes them
+                registry.publish(9, n, (float)(n & 0xFFFFFF));
+            }
+            done = true;
+        });
+
+        uint64_t samples = 0, torn = 0, gaps = 0;
+        uint32_t last = 0;
+        ChannelSample out[32];
+        while (!done || reader.available()) {
+            size_t n = reader.read(out, 32);
+            for (size_t i = 0; i < n; i++) {
+                if ((float)(out[i].timeUs & 0xFFFFFF) != out[i].value) torn++;
+                if (out[i].timeUs != last + 1) gaps += out[i].timeUs - last - 1;
+                last = out[i].timeUs;
+            }
+            samples += n;
+            if (n < 32) std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        writer.join();
+
+        printf("threaded: %u published, %llu read, %u reported lost, %llu missing, %llu torn\n",
+               (unsigned)registry.getPublished(9), (unsigned long long)samples, (unsigned)reader.getLost(),
+               (unsigned long long)gaps, (unsigned long long)torn);
+        return torn || gaps != reader.getLost() || samples + reader.getLost() != registry.getPublished(9);
+    }
+
+    class SocketCanPort : public CanPort {
+    public:
+        bool open(const char* name) {
+            fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+            if (fd < 0) {
+                perror("socket");
+                return false;
+            }
+            struct ifreq ifr = {};
+            strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+            if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0) {
+                perror(name);
+                return false;
+            }
+            struct sockaddr_can address = {};
+            address.can_family = AF_CAN;
+            address.can_ifindex = ifr.ifr_ifindex;
+            if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+                perror("bind");
+                return false;
+            }
+            return true;
+        }
+
+        bool receive(CanFrame* frame, uint32_t timeoutMs) override {
+            struct pollfd p = { fd, POLLIN, 0 };
+            struct can_frame raw;
+            if (poll(&p, 1, timeoutMs) <= 0 || read(fd, &raw, sizeof(raw)) != sizeof(raw) ||
+                (raw.can_id & (CAN_RTR_FLAG | CAN_ERR_FLAG))) {
+                return false;
+            }
+            frame->extended = raw.can_id & CAN_EFF_FLAG;
+            frame->id = raw.can_id & (frame->extended ? CAN_EFF_MASK : CAN_SFF_MASK);
+            frame->length = raw.can_dlc > 8 ? 8 : raw.can_dlc;
+            memcpy(frame->data, raw.data, frame->length);
+            return true;
+        }
+
+        bool send(const CanFrame& frame) {
+            struct can_frame raw = {};
+            raw.can_id = frame.id | (frame.extended ? CAN_EFF_FLAG : 0);
+            raw.can_dlc = frame.length;
+            memcpy(raw.data, frame.data, frame.length);
+            return write(fd, &raw, sizeof(raw)) == sizeof(raw);
+        }
+
+        ~SocketCanPort() {
+            if (fd >= 0) close(fd);
+        }
+
+    private:
+        int fd = -1;
+    };
+
+    int runVcan(const char* name, bool send, double seconds) {
+        SocketCanPort port;
+        if (!port.open(name)) {
+            return 1;
+        }
+        uint32_t start = wallClock();
+        uint32_t end = start + (uint32_t)(seconds * 1e6);
+
+        if (send) {
+            unsigned long sent = 0;
+            for (uint32_t t = 0; wallClock() < end; t += 500) {
+                for (const Stream& stream : STREAMS) {
+                    if (t % stream.periodUs == 0) sent += port.send(buildFrame(stream.frameId, t));
+                }
+                while (wallClock() - start < t) std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            printf("%lu frames sent on %s\n", sent, name);
+            return 0;
+        }
+
+        ChannelRegistry registry;
+        CanDecoder decoder;
+        setup(registry, decoder);
+        Consumer logger("logger", 100000);
+        for (size_t i = 0; i < registry.size(); i++) logger.readers[i] = registry.subscribe(registry.getDef(i).id);
+
+        CanSource source(port, decoder, registry, wallClock);
+        uint32_t nextReport = start + 1000000;
+        while (wallClock() < end) {
+            source.poll(100);
+            // Values only: sender and receiver clocks differ, skip the check
+            ChannelSample out[64];
+            for (ChannelReader& r : logger.readers) {
+                while (size_t n = r.read(out, 64)) logger.samples += n;
+            }
+            if (wallClock() >= nextReport) {
+                ChannelSample rpm = {};
+                registry.latest(CH_RPM, &rpm);
+                printf("%u frames, %u unknown, %llu samples read, rpm %.0f\n", (unsigned)source.getFrames(),
+                       (unsigned)decoder.getUnknownFrames(), (unsigned long long)logger.samples, rpm.value);
+                nextReport += 1000000;
+            }
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    double seconds = 60;
+    const char* vcan = nullptr;
+    bool send = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--vcan") == 0 && i + 1 < argc) {
+            vcan = argv[++i];
+        } else if (strcmp(argv[i], "--send") == 0) {
+            send = true;
+        } else {
+            fprintf(stderr, "usage: %s [--seconds N] [--vcan IFNAME [--send]]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (vcan) {
+        return runVcan(vcan, send, seconds);
+    }
+    int failures = runSimulated(seconds);
+    failures += runThreaded(seconds < 2 ? seconds : 2);
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
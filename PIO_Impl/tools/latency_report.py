@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Fix-to-pixel latency report from a dumped latency trace.
+
+Capture the output of the "trace" serial command (firmware built with
+-D DATALOGGER_LATENCY_TRACE) into a file, then run:
+
+    python3 tools/latency_report.py capture.txt
+
+Lines of the form "L,<sequence>,<stage>,<micros>" are grouped by sequence.
+For every fix the time between consecutive stages and the total from
+FixReceived to Displayed are collected and summarised.
+"""
+
+import sys
+
+STAGES = ["received", "read", "delta", "displayed"]
+
+
+def parse(lines):
+    fixes = {}
+    for line in lines:
+        line = line.strip()
+        if not line.startswith("L,"):
+            continue
+        try:
+            _, seq, stage, micros = line.split(",")
+            fixes.setdefault(int(seq), {})[int(stage)] = int(micros)
+        except ValueError:
+            continue  # Torn line
+    return fixes
+
+
+def elapsed(start, end):
+    # micros() wraps at 2^32
+    return (end - start) & 0xFFFFFFFF
+
+
+def percentile(values, pct):
+    index = min(len(values) - 1, int(len(values) * pct / 100.0))
+    return values[index]
+
+
+def summarise(name, values):
+    if not values:
+        return
+    values.sort()
+    print("%-20s %6d %9d %9d %9d %9d %9d" % (
+        name, len(values), values[0], percentile(values, 50),
+        percentile(values, 90), percentile(values, 99), values[-1]))
+
+
+def histogram(values, width=50, bins=12):
+    if not values:
+        return
+    low, high = values[0], values[-1]
+    step = max(1, (high - low + bins) // bins)
+    counts = [0] * bins
+    for v in values:
+        counts[min(bins - 1, (v - low) // step)] += 1
+    peak = max(counts)
+    print("\nTotal fix-to-pixel distribution (us):")
+    for i, count in enumerate(counts):
+        bar = "#" * (count * width // peak) if peak else ""
+        print("%9d-%-9d %6d %s" % (low + i * step, low + (i + 1) * step - 1, count, bar))
+
+
+def main():
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    fixes = parse(source)
+
+    # Stages a path does not pass through are skipped, e.g. no delta
+    # stage when the fix is not part of a timed lap
+    per_stage = {}
+    totals = []
+    for marks in fixes.values():
+        present = sorted(marks)
+        for prev, cur in zip(present, present[1:]):
+            per_stage.setdefault((prev, cur), []).append(elapsed(marks[prev], marks[cur]))
+        if 0 in marks and 3 in marks:
+            totals.append(elapsed(marks[0], marks[3]))
+
+    print("%d fixes traced\n" % len(fixes))
+    print("%-20s %6s %9s %9s %9s %9s %9s" % ("stage (us)", "count", "min", "p50", "p90", "p99", "max"))
+    for (prev, cur) in sorted(per_stage):
+        summarise("%s->%s" % (STAGES[prev], STAGES[cur]), per_stage[(prev, cur)])
+    summarise("total", totals)
+    histogram(totals)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,202 @@
+/**
+ * Per-call cost of a deferred log message against Serial.printf.
+ *
+ * Each message is logged three ways: LOG_INFO, which pushes a token and
+ * the argument bytes into the ring; a LOG_DEBUG below the build's level,
+ * which must compile to nothing; and the printf path Serial.printf takes
+ * on the device, formatting into a buffer and copying the text into the
+ * driver's transmit ring. That copy never blocks here, which is the best
+ * case for printf: on the device a full UART buffer stalls the caller for
+ * the wire time of the line, printed as the last column at the debug
+ * port's 115200 baud.
+ *
+ * The work taken off the caller still has to be done somewhere: the drain
+ * columns are what the main loop spends per record, formatting it as text
+ * (logging::drain) or only taking it out of the ring for the telemetry
+ * stream, where the host formats it.
+ *
+ * Build from PIO_Impl/:
+ *   g++ -std=gnu++17 -O2 -Iinclude tools/log_bench/log_bench.cpp src/util/log.cpp -o log_bench
+ *
+ * Usage:
+ *   log_bench [--calls N]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <chrono>
+#include "util/log.h"
+
+#if DATALOGGER_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#error "log_bench measures LOG_DEBUG compiled out; build it at the default level"
+#endif
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    const double BAUD = 115200;
+    const size_t BATCH = logging::RING_SIZE / 2;
+
+    // Stand-in for the UART driver's transmit ring: the copy, no waiting
+    struct Sink {
+        uint8_t ring[4096];
+        size_t head = 0;
+        size_t bytes = 0;
+
+        void write(const uint8_t* data, size_t length) {
+            for (size_t i = 0; i < length; i++) {
+                ring[head++ & (sizeof(ring) - 1)] = data[i];
+            }
+            bytes += length;
+        }
+    };
+
+    Sink sink;
+
+    // What HardwareSerial::printf does with a message that fits its buffer
+    __attribute__((noinline, format(printf, 1, 2))) void serialPrintf(const char* format, ...) {
+        char buffer[64];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (length > 0) {
+            sink.write((const uint8_t*)buffer, (size_t)length < sizeof(buffer) ? length : sizeof(buffer) - 1);
+        }
+    }
+
+    double elapsedNs(Clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    void discard() {
+        logging::Record record;
+        while (logging::pop(record)) {
+        }
+    }
+
+    struct Row {
+        double logNs = 0;
+        double disabledNs = 0;
+        double printfNs = 0;
+        double drainTextNs = 0;
+        double drainPopNs = 0;
+        double lineBytes = 0;
+    };
+
+    // Times one message through every path; call(path, i) logs it once.
+    // Paths: 0 LOG_INFO, 1 LOG_DEBUG (compiled out), 2 printf
+    template<typename Call>
+    Row measure(size_t calls, Call call) {
+        Row row;
+        size_t batches = calls / BATCH;
+
+        // The ring holds RING_SIZE records, so push in batches and empty
+        // it between them, off the clock
+        for (size_t b = 0; b < batches; b++) {
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < BATCH; i++) {
+                call(0, b * BATCH + i);
+            }
+            row.logNs += elapsedNs(start);
+            discard();
+
+            start = Clock::now();
+            for (size_t i = 0; i < BATCH; i++) {
+                call(1, b * BATCH + i);
+            }
+            row.disabledNs += elapsedNs(start);
+
+            size_t before = sink.bytes;
+            start = Clock::now();
+            for (size_t i = 0; i < BATCH; i++) {
+                call(2, b * BATCH + i);
+            }
+            row.printfNs += elapsedNs(start);
+            row.lineBytes += sink.bytes - before;
+
+            for (size_t i = 0; i < BATCH; i++) {
+                call(0, b * BATCH + i);
+            }
+            start = Clock::now();
+            logging::drain(sink, BATCH);
+            row.drainTextNs += elapsedNs(start);
+
+            for (size_t i = 0; i < BATCH; i++) {
+                call(0, b * BATCH + i);
+            }
+            start = Clock::now();
+            logging::Record record;
+            while (logging::pop(record)) {
+            }
+            row.drainPopNs += elapsedNs(start);
+        }
+
+        double n = (double)batches * BATCH;
+        row.logNs /= n;
+        row.disabledNs /= n;
+        row.printfNs /= n;
+        row.drainTextNs /= n;
+        row.drainPopNs /= n;
+        row.lineBytes /= n;
+        return row;
+    }
+
+    void print(const char* name, const Row& row) {
+        double wireUs = (row.lineBytes + 2) * 10 / BAUD * 1e6;   // With "\r\n", 10 bits a byte
+        printf("%-22s %7.1f %9.1f %8.1f %5.1fx | %9.1f %7.1f | %5.0f %8.0f\n", name, row.logNs, row.disabledNs,
+               row.printfNs, row.printfNs / row.logNs, row.drainTextNs, row.drainPopNs, row.lineBytes, wireUs);
+    }
+
+}
+
+int main(int argc, char** argv) {
+    size_t calls = 1000000;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--calls") && i + 1 < argc) {
+            calls = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--calls N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (calls < BATCH) {
+        calls = BATCH;
+    }
+
+    printf("%zu calls per message, ns per call; printf copies into a never-full buffer\n\n", calls);
+    printf("%-22s %7s %9s %8s %6s | %9s %7s | %5s %8s\n", "message", "LOG", "disabled", "printf", "ratio", "drain txt",
+           "pop", "bytes", "wire us");
+
+    print("no arguments", measure(calls, [](int path, size_t) {
+        if (path == 0) LOG_INFO("Sensor manager ready");
+        else if (path == 1) LOG_DEBUG("Sensor manager ready");
+        else serialPrintf("Sensor manager ready");
+    }));
+
+    print("three integers", measure(calls, [](int path, size_t i) {
+        int rate = 25 + (i & 7);
+        unsigned int sats = i & 31;
+        unsigned int heap = 180000 + (i & 1023);
+        if (path == 0) LOG_INFO("GNSS %dHz, %u satellites, heap %u", rate, sats, heap);
+        else if (path == 1) LOG_DEBUG("GNSS %dHz, %u satellites, heap %u", rate, sats, heap);
+        else serialPrintf("GNSS %dHz, %u satellites, heap %u", rate, sats, heap);
+    }));
+
+    print("integer, float, string", measure(calls, [](int path, size_t i) {
+        unsigned int lap = i & 63;
+        double lapTime = 90.0 + (i & 255) * 0.013;
+        const char* track = (i & 1) ? "Silverstone GP" : "Brands Hatch Indy";
+        if (path == 0) LOG_INFO("Lap %u %.3f s at %s", lap, lapTime, track);
+        else if (path == 1) LOG_DEBUG("Lap %u %.3f s at %s", lap, lapTime, track);
+        else serialPrintf("Lap %u %.3f s at %s", lap, lapTime, track);
+    }));
+
+    if (logging::dropped() != 0) {
+        fprintf(stderr, "ring dropped %u records\n", (unsigned)logging::dropped());
+        return 1;
+    }
+    return 0;
+}
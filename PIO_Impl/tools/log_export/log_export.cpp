@@ -0,0 +1,171 @@
+/**
+ * Session export on the host: the firmware's SessionExporter over a file
+ * downloaded with tools/offload/offload.py.
+ *
+ * The file is read through the same chunk-at-a-time reader the device
+ * uses, so memory does not grow with the session. Reports rows written,
+ * damaged chunks skipped and export throughput in rows/s on stderr;
+ * --repeat N exports N times to /dev/null first for a steadier figure.
+ *
+ * Build from PIO_Impl/:
+ *   g++ -std=gnu++17 -O2 -Iinclude tools/log_export/log_export.cpp src/session/session_export.cpp \
+ *       -o log_export
+ *
+ * Usage:
+ *   log_export session.bin [--vbo] [--rate HZ] [--channels rpm,brake,...] [-o out.csv] [--repeat N]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "session/session_export.h"
+
+namespace {
+
+    class FileSource : public LogStreamSource {
+    public:
+        explicit FileSource(FILE* file) : file(file) {}
+
+        size_t read(uint32_t offset, uint8_t* data, size_t length) override {
+            if (fseek(file, offset, SEEK_SET) != 0) {
+                return 0;
+            }
+            return fread(data, 1, length, file);
+        }
+
+    private:
+        FILE* file;
+    };
+
+    class FileSink : public ExportSink {
+    public:
+        explicit FileSink(FILE* file) : file(file), bytes(0) {}
+
+        bool write(const char* text, size_t length) override {
+            bytes += length;
+            return !file || fwrite(text, 1, length, file) == length;
+        }
+
+        FILE* file;     // nullptr discards
+        uint64_t bytes;
+    };
+
+    // Names to ids, through the session's own channel table
+    bool selectChannels(SessionExporter& exporter, FileSource& source, const char* list) {
+        ChunkReader chunks(source);
+        LogSessionHeader header;
+        uint8_t type;
+        if (!chunks.next(&type) || type != logfmt::CHUNK_SESSION || !header.parse(chunks.payload(), chunks.size())) {
+            return false;
+        }
+        std::string names(list);
+        size_t start = 0;
+        while (start <= names.size()) {
+            size_t end = names.find(',', start);
+            std::string name = names.substr(start, end == std::string::npos ? std::string::npos : end - start);
+            bool found = false;
+            for (uint8_t i = 0; i < header.channelCount; i++) {
+                if (name == header.channels[i].name) {
+                    exporter.selectChannel(header.channels[i].id);
+                    found = true;
+                }
+            }
+            if (!found) {
+                fprintf(stderr, "no channel %s in this session\n", name.c_str());
+                return false;
+            }
+            if (end == std::string::npos) {
+                break;
+            }
+            start = end + 1;
+        }
+        return true;
+    }
+
+    bool run(FileSource& source, FileSink& sink, SessionExporter::Format format, uint16_t rate,
+             const char* channels, uint32_t* rows, uint32_t* badChunks) {
+        SessionExporter exporter(source, sink);
+        if (channels && !selectChannels(exporter, source, channels)) {
+            return false;
+        }
+        if (!exporter.begin(format, rate)) {
+            fprintf(stderr, "not a session stream\n");
+            return false;
+        }
+        while (exporter.step()) {}
+        *rows = exporter.getRows();
+        *badChunks = exporter.getBadChunks();
+        return !exporter.hasFailed();
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* input = nullptr;
+    const char* output = nullptr;
+    const char* channels = nullptr;
+    SessionExporter::Format format = SessionExporter::Format::Csv;
+    uint16_t rate = 10;
+    int repeat = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--vbo")) format = SessionExporter::Format::Vbo;
+        else if (!strcmp(argv[i], "--rate") && i + 1 < argc) rate = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--channels") && i + 1 < argc) channels = argv[++i];
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc) output = argv[++i];
+        else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) repeat = atoi(argv[++i]);
+        else if (argv[i][0] != '-' && !input) input = argv[i];
+        else {
+            fprintf(stderr, "usage: %s session.bin [--vbo] [--rate HZ] [--channels a,b] [-o FILE] [--repeat N]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (!input || rate == 0) {
+        fprintf(stderr, "usage: %s session.bin [--vbo] [--rate HZ] [--channels a,b] [-o FILE] [--repeat N]\n",
+                argv[0]);
+        return 2;
+    }
+    FILE* in = fopen(input, "rb");
+    if (!in) {
+        perror(input);
+        return 1;
+    }
+    FileSource source(in);
+    uint32_t rows = 0;
+    uint32_t badChunks = 0;
+
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point begin = Clock::now();
+    for (int i = 0; i < repeat; i++) {
+        FileSink discard(nullptr);
+        if (!run(source, discard, format, rate, channels, &rows, &badChunks)) {
+            return 1;
+        }
+    }
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+    FileSink sink(out);
+    Clock::time_point last = Clock::now();
+    if (!run(source, sink, format, rate, channels, &rows, &badChunks)) {
+        return 1;
+    }
+    Clock::time_point end = Clock::now();
+    if (output) {
+        fclose(out);
+    }
+    fclose(in);
+
+    double seconds = std::chrono::duration<double>(end - last).count();
+    fprintf(stderr, "%u rows, %llu bytes, %u damaged chunks skipped, %.0f rows/s\n", (unsigned)rows,
+            (unsigned long long)sink.bytes, (unsigned)badChunks, rows / seconds);
+    if (repeat > 0) {
+        double total = std::chrono::duration<double>(last - begin).count();
+        fprintf(stderr, "to /dev/null: %.0f rows/s over %d runs\n", rows * repeat / total, repeat);
+    }
+    return 0;
+}
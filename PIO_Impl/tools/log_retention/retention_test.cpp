@@ -0,0 +1,381 @@
+/**
+ * Season-long retention run on the host: the firmware's SessionRecorder,
+ * SessionLog and LogRetention over a RAM flash that counts erases.
+ *
+ * Records sessions at three tracks, weekend after weekend, with the main
+ * loop's order of work (poll the recorder, erase ahead, else one retention
+ * step) and idle loops in the pits. Some sessions are starred, one is
+ * starred and unstarred again, and the device reboots at random points,
+ * mid-recording and mid-rewrite included.
+ *
+ * Fails (exit 1) if:
+ *   - a recording could not start or stopped for lack of space
+ *   - a starred session is gone or its stream changed
+ *   - one of a track's fastest laps ever recorded is gone
+ *   - a session is evicted while an older one that may go is kept
+ *   - a stored session has damaged chunks or lost a lap event
+ *   - a loop step erased more than once or wrote more than 8 KB
+ *   - any write went to unerased flash
+ * and reports the erase spread over the log.
+ *
+ * Build from PIO_Impl/:
+ *   g++ -std=gnu++17 -O2 -Iinclude tools/log_retention/retention_test.cpp src/session/session_log.cpp \
+ *       src/session/log_retention.cpp src/util/log.cpp -o retention_test
+ *
+ * Usage:
+ *   retention_test [--sessions N] [--seed S] [--spread ERASES]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+#include "session/session_recorder.h"
+#include "session/log_retention.h"
+#include "util/crc.h"
+#include "../offload/ram_flash.h"
+
+namespace {
+
+    const uint32_t FLASH_SIZE = 8 * 1024 * 1024;
+    const uint32_t STEP_US = 10000;
+    const uint32_t MAX_STEP_WRITE = 8192;
+
+    enum ChannelId : uint8_t { CH_RPM = 1, CH_THROTTLE = 2, CH_COOLANT = 3, CH_GEAR = 4, CH_BRAKE = 16 };
+
+    const ChannelDef CHANNELS[] = {
+        { CH_RPM,      "rpm",      "1/min", ChannelType::Analog,   100,  1, 1.0f },
+        { CH_THROTTLE, "throttle", "%",     ChannelType::Analog,   100,  1, 0.1f },
+        { CH_COOLANT,  "coolant",  "C",     ChannelType::Analog,   10,   1, 0.1f },
+        { CH_GEAR,     "gear",     "",      ChannelType::Discrete, 50,   1, 1.0f },
+        { CH_BRAKE,    "brake",    "bar",   ChannelType::Analog,   100,  1, 0.05f },
+    };
+    const uint16_t LOG_RATES[] = { 50, 50, 1, 10, 100 };
+
+    struct Track {
+        const char* name;
+        uint32_t lapMs;     // Typical lap
+    };
+    const Track TRACKS[] = { { "Ring North", 52000 }, { "Harbour Loop", 61000 }, { "Hill Circuit", 74000 } };
+
+    class CountingFlash : public RamFlash {
+    public:
+        explicit CountingFlash(uint32_t bytes) : RamFlash(bytes), written(0), erased(0) {}
+
+        bool write(uint32_t offset, const void* data, size_t length) override {
+            written += length;
+            return RamFlash::write(offset, data, length);
+        }
+
+        bool erase(uint32_t offset) override {
+            erased++;
+            return RamFlash::erase(offset);
+        }
+
+        uint64_t written;
+        uint64_t erased;
+    };
+
+    // What the test knows about every session it recorded
+    struct Recorded {
+        uint32_t id;
+        size_t track;
+        std::vector<uint32_t> laps;     // Lap times in ms as written
+        bool starred;
+        uint32_t crc;                   // Of the stream, for starred sessions
+    };
+
+    struct Device {
+        std::unique_ptr<SessionLog> log;
+        std::unique_ptr<LogRetention> retention;
+    };
+
+    CountingFlash flash(FLASH_SIZE);
+    RetentionPolicy policy;
+    std::map<uint32_t, Recorded> recorded;
+    std::mt19937 rng;
+    uint32_t now = 0x80000000u;     // micros(), wraps during the season
+    uint32_t failures = 0;
+    uint32_t loopSteps = 0;
+    uint32_t maxStepWrite = 0;
+    uint32_t evicted = 0, compacted = 0, relocated = 0;
+    uint32_t reboots = 0, rebootsMidCopy = 0;
+
+    void fail(const char* what, uint32_t id) {
+        if (failures++ < 20) fprintf(stderr, "FAIL: %s (session %u)\n", what, (unsigned)id);
+    }
+
+    void boot(Device& device) {
+        if (device.retention) {
+            evicted += device.retention->getEvicted();
+            compacted += device.retention->getCompacted();
+            relocated += device.retention->getRelocated();
+        }
+        device.retention.reset();
+        device.log.reset(new SessionLog(flash));
+        if (!device.log->begin()) fail("log begin", 0);
+        device.retention.reset(new LogRetention(*device.log, policy));
+    }
+
+    void reboot(Device& device) {
+        reboots++;
+        if (device.log->isCopying()) rebootsMidCopy++;
+        boot(device);
+    }
+
+    uint32_t streamCrc(SessionLog& log, uint32_t id) {
+        LogSessionInfo info;
+        if (!log.find(id, &info)) return 0;
+        std::vector<uint8_t> data(info.size);
+        log.read(id, 0, data.data(), data.size());
+        return crc::crc32(data.data(), data.size());
+    }
+
+    // Sessions holding one of their track's fastest laps, from what the
+    // test recorded, over the stored sessions but the open one
+    bool isProtected(SessionLog& log, uint32_t id) {
+        const Recorded& session = recorded[id];
+        if (session.laps.empty()) return false;
+        std::vector<uint32_t> laps;
+        for (size_t i = 0; i < log.count(); i++) {
+            if (log.isRecording() && i + 1 == log.count()) break;
+            const Recorded& other = recorded[log.getInfo(i).id];
+            if (other.track == session.track) laps.insert(laps.end(), other.laps.begin(), other.laps.end());
+        }
+        std::sort(laps.begin(), laps.end());
+        uint32_t best = *std::min_element(session.laps.begin(), session.laps.end());
+        return laps.size() < policy.keepFastestLaps || best <= laps[policy.keepFastestLaps - 1];
+    }
+
+    // One pass of the main loop's background work, checked; false if idle
+    bool loopStep(Device& device) {
+        SessionLog& log = *device.log;
+        std::vector<uint32_t> before;
+        for (size_t i = 0; i < log.count(); i++) before.push_back(log.getInfo(i).id);
+        uint64_t written = flash.written;
+        uint64_t erased = flash.erased;
+
+        bool worked = log.maintain() || device.retention->maintain();
+        loopSteps++;
+        uint32_t stepWrite = (uint32_t)(flash.written - written);
+        maxStepWrite = std::max(maxStepWrite, stepWrite);
+        if (flash.erased - erased > 1) fail("more than one erase in a step", 0);
+        if (stepWrite > MAX_STEP_WRITE) fail("more than 8 KB written in a step", 0);
+
+        if (log.count() >= before.size()) return worked;
+        for (size_t i = 0; i < before.size(); i++) {
+            LogSessionInfo info;
+            if (log.find(before[i], &info)) continue;
+            uint32_t gone = before[i];
+            const Recorded& session = recorded[gone];
+            if (session.starred) fail("starred session evicted", gone);
+            // Nothing older could have gone instead
+            for (size_t j = 0; j < i; j++) {
+                if (!recorded[before[j]].starred && !isProtected(log, before[j])) {
+                    fail("evicted out of order", gone);
+                }
+            }
+        }
+        return worked;
+    }
+
+    // A session of out-lap, laps and in-lap, with a lap event per crossing
+    void recordSession(Device& device, uint32_t id, size_t track, bool rebootDuring) {
+        ChannelRegistry registry;
+        SessionRecorder recorder(*device.log, registry);
+        for (size_t i = 0; i < sizeof(CHANNELS) / sizeof(CHANNELS[0]); i++) {
+            registry.add(CHANNELS[i]);
+            recorder.addChannel(CHANNELS[i].id, LOG_RATES[i]);
+        }
+        Recorded& session = recorded[id];
+        session.id = id;
+        session.track = track;
+        session.starred = false;
+        session.crc = 0;
+        if (!recorder.start(id, TRACKS[track].name, now)) {
+            fail("recording did not start", id);
+            return;
+        }
+
+        std::uniform_int_distribution<uint32_t> spread(0, 4000);
+        std::uniform_int_distribution<uint32_t> stints(3, 6);
+        uint32_t laps = stints(rng);
+        uint32_t stopAt = rebootDuring ? rng() % (laps * TRACKS[track].lapMs / 10) : UINT32_MAX;
+        uint32_t lapUs = 0;
+        uint32_t thisLapUs = TRACKS[track].lapMs * 1000 + 20000000;    // Out-lap from the pits
+        uint16_t lap = 0;
+        for (uint32_t step = 0; lap <= laps; step++, now += STEP_US) {
+            if (step == stopAt) {
+                reboot(device);
+                return;
+            }
+            double s = step * (STEP_US / 1e6);
+            double phase = s * 2 * M_PI / 50.0;
+            double brake = fmax(0.0, 60 * sin(phase * 4) - 20);
+            registry.publish(CH_BRAKE, now, (float)(brake + 0.3 * sin(s * 50)));
+            registry.publish(CH_RPM, now, (float)(7000 + 3000 * sin(phase * 4 + 1)));
+            registry.publish(CH_THROTTLE, now, (float)(brake > 0 ? 0 : 100 * fabs(sin(phase * 2))));
+            if (step % 2 == 0) registry.publish(CH_GEAR, now, (float)(3 + (int)(2 * sin(phase * 4))));
+            if (step % 10 == 0) registry.publish(CH_COOLANT, now, (float)(85 + s / 60));
+            if (step % 4 == 0) {
+                recorder.addFix(now, 48.0 + 0.002 * sin(phase), 11.0 + 0.003 * cos(phase),
+                                40 + 15 * sin(phase * 4), fmod(phase * 180 / M_PI + 90, 360));
+            }
+            recorder.poll(now);
+            if (!recorder.isRecording()) {
+                fail("recording stopped", id);
+                return;
+            }
+            loopStep(device);
+
+            lapUs += STEP_US;
+            if (lapUs >= thisLapUs) {
+                // The out-lap's crossing starts timing; the last one is the in-lap's start
+                uint32_t lapMs = lap == 0 ? 0 : lapUs / 1000;
+                recorder.addLap(now, lap, lapMs, false);
+                if (lapMs) session.laps.push_back(lapMs);
+                lap++;
+                lapUs = 0;
+                thisLapUs = (TRACKS[track].lapMs + spread(rng)) * 1000;
+            }
+        }
+        recorder.stop();
+    }
+
+    // Every stored session decodes, with every lap event it was recorded with
+    void checkStored(SessionLog& log) {
+        for (size_t i = 0; i < log.count(); i++) {
+            LogSessionInfo info = log.getInfo(i);
+            StoredSession source(log, info.id);
+            ChunkReader chunks(source);
+            logfmt::SampleDecoder decoder;
+            std::vector<uint32_t> laps;
+            uint8_t type;
+            while (chunks.next(&type)) {
+                if (type == logfmt::CHUNK_LAP) {
+                    uint32_t lapMs = logfmt::getU32(chunks.payload() + 6);
+                    if (lapMs) laps.push_back(lapMs);
+                } else if (type == logfmt::CHUNK_SAMPLES) {
+                    logfmt::SampleRecord record;
+                    decoder.begin(chunks.payload(), chunks.size());
+                    while (decoder.next(&record)) {}
+                }
+            }
+            if (chunks.getBadChunks()) fail("damaged chunks", info.id);
+            // A reboot mid-recording loses what was not written yet
+            const std::vector<uint32_t>& expected = recorded[info.id].laps;
+            if (laps.size() > expected.size() || !std::equal(laps.begin(), laps.end(), expected.begin())) {
+                fail("lap events lost", info.id);
+            }
+        }
+    }
+
+    void checkStarred(SessionLog& log) {
+        for (const auto& entry : recorded) {
+            const Recorded& session = entry.second;
+            if (session.starred && streamCrc(log, session.id) != session.crc) {
+                fail("starred session changed or gone", session.id);
+            }
+        }
+    }
+
+    // The fastest laps ever recorded at each track are still stored
+    void checkFastest(SessionLog& log) {
+        for (size_t track = 0; track < sizeof(TRACKS) / sizeof(TRACKS[0]); track++) {
+            std::vector<std::pair<uint32_t, uint32_t>> laps;    // Time, session
+            for (const auto& entry : recorded) {
+                if (entry.second.track != track) continue;
+                for (uint32_t lapMs : entry.second.laps) laps.push_back(std::make_pair(lapMs, entry.first));
+            }
+            std::sort(laps.begin(), laps.end());
+            for (size_t i = 0; i < laps.size() && i < policy.keepFastestLaps; i++) {
+                LogSessionInfo info;
+                if (!log.find(laps[i].second, &info)) fail("fastest lap gone", laps[i].second);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t sessionCount = 150;
+    uint32_t seed = 1;
+    policy.keepFastestLaps = 2;
+    policy.wearSpread = 6;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--sessions") && i + 1 < argc) sessionCount = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--spread") && i + 1 < argc) policy.wearSpread = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--sessions N] [--seed S] [--spread ERASES]\n", argv[0]);
+            return 2;
+        }
+    }
+    rng.seed(seed);
+
+    Device device;
+    boot(device);
+    uint32_t id = 1000;
+    uint32_t unstarAt = 0;
+    std::uniform_int_distribution<uint32_t> chance(0, 99);
+    while (id < 1000 + sessionCount) {
+        // A weekend at one track: practice, qualifying, races
+        size_t track = (id / 5) % (sizeof(TRACKS) / sizeof(TRACKS[0]));
+        for (int n = 0; n < 5 && id < 1000 + sessionCount; n++, id++) {
+            recordSession(device, id, track, chance(rng) < 8);
+            SessionLog& log = *device.log;
+            if (id == 1003 || id == 1040) {
+                if (!log.setStarred(id, true)) fail("star", id);
+                recorded[id].starred = true;
+                recorded[id].crc = streamCrc(log, id);
+            } else if (id == 1010) {
+                // Starred for a while, then free to go
+                if (!log.setStarred(id, true)) fail("star", id);
+                recorded[id].starred = true;
+                recorded[id].crc = streamCrc(log, id);
+                unstarAt = id + 12;
+            } else if (id == unstarAt) {
+                if (!log.setStarred(1010, false)) fail("unstar", 1010);
+                recorded[1010].starred = false;
+            }
+
+            // The pits: loops until retention is idle, perhaps cut short by a reboot
+            uint32_t rebootAt = chance(rng) < 15 ? rng() % 400 : UINT32_MAX;
+            for (uint32_t step = 0; step < 200000; step++, now += 1000) {
+                if (step == rebootAt || (device.log->isCopying() && rng() % 500 == 0)) {
+                    reboot(device);
+                    checkStarred(*device.log);
+                }
+                if (!loopStep(device)) break;
+            }
+        }
+    }
+
+    boot(device);
+    SessionLog& log = *device.log;
+    checkStored(log);
+    checkStarred(log);
+    checkFastest(log);
+
+    uint32_t minErases = UINT32_MAX, maxErases = 0;
+    uint64_t total = 0;
+    for (uint32_t s = 0; s < log.getSectorCount(); s++) {
+        minErases = std::min(minErases, flash.getErases(s));
+        maxErases = std::max(maxErases, flash.getErases(s));
+        total += flash.getErases(s);
+    }
+    printf("%u sessions recorded, %u stored in %u of %u sectors\n", (unsigned)sessionCount, (unsigned)log.count(),
+           (unsigned)(log.getSectorCount() - log.getFreeSectors()), (unsigned)log.getSectorCount());
+    printf("%u evicted, %u compacted, %u moved for wear; %u reboots, %u during a rewrite\n", (unsigned)evicted,
+           (unsigned)compacted, (unsigned)relocated, (unsigned)reboots, (unsigned)rebootsMidCopy);
+    printf("erases per sector: min %u, mean %.1f, max %u\n", (unsigned)minErases,
+           (double)total / log.getSectorCount(), (unsigned)maxErases);
+    printf("%u loop steps, at most %u bytes written in one, %u bad writes\n", (unsigned)loopSteps,
+           (unsigned)maxStepWrite, (unsigned)flash.getBadWrites());
+    if (flash.getBadWrites()) fail("writes to unerased flash", 0);
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,318 @@
+#!/usr/bin/env python3
+"""Client for the session offload protocol.
+
+Lists the sessions stored on the logger and downloads them over the USB
+CDC port (or the pty of tools/offload/offload_sim.cpp):
+
+    python3 tools/offload/offload.py /dev/ttyACM0 list
+    python3 tools/offload/offload.py /dev/ttyACM0 get 12 -o session12.bin
+    python3 tools/offload/offload.py /dev/ttyACM0 get --all -d sessions/
+
+The protocol is described in include/session/offload_server.h. Downloads
+resume: if the output file already holds part of a session, the logger
+checksums that many bytes and, when they match, only the rest is read.
+A download that stalls or loses the connection reconnects and resumes the
+same way, and every finished file is checked against the logger's CRC-32.
+The Client class can be imported by other tools.
+"""
+
+import argparse
+import binascii
+import os
+import select
+import struct
+import sys
+import time
+import zlib
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+from telemetry_decode import cobs_decode  # noqa: E402
+
+REQ_LIST = 0x40
+REQ_READ = 0x41
+REQ_ACK = 0x42
+REQ_CRC = 0x43
+REQ_BYE = 0x44
+RSP_READY = 0x60
+RSP_ENTRY = 0x61
+RSP_LIST_END = 0x62
+RSP_DATA = 0x63
+RSP_DONE = 0x64
+RSP_CRC = 0x65
+RSP_ERROR = 0x6F
+
+ERRORS = {1: "malformed request", 2: "no such session", 3: "out of range"}
+
+TIMEOUT = 2.0        # Seconds without a usable frame before asking again
+RETRIES = 3          # Timeouts in a row before reconnecting
+RECONNECTS = 5
+
+
+class ConnectionLost(Exception):
+    pass
+
+
+class OffloadError(Exception):
+    pass
+
+
+def crc16(data):
+    # CRC-16/CCITT-FALSE, as crc::crc16 in include/util/crc.h
+    return binascii.crc_hqx(data, 0xFFFF)
+
+
+def cobs_encode(data):
+    out = bytearray()
+    block = bytearray()
+    for byte in data:
+        if byte == 0:
+            out.append(len(block) + 1)
+            out += block
+            block = bytearray()
+            continue
+        block.append(byte)
+        if len(block) == 0xFE:
+            out.append(0xFF)
+            out += block
+            block = bytearray()
+    out.append(len(block) + 1)
+    out += block
+    return bytes(out)
+
+
+def open_port(path):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    if os.isatty(fd):
+        import termios
+        import tty
+        tty.setraw(fd, termios.TCSANOW)
+    return fd
+
+
+class Client:
+    def __init__(self, fd, window=16, log=sys.stderr):
+        self.fd = fd
+        self.window = window
+        self.log = log
+        self.tag = 0
+        self.pending = bytearray()
+        self.frames = []
+        self.crc_errors = 0
+        self.data_size = 0
+        self.bytes_received = 0
+
+    # --- framing ---
+
+    def send(self, kind, payload=b"", tag=None):
+        """Sends a request, under a new tag unless one is given."""
+        if tag is None:
+            self.tag = tag = (self.tag + 1) & 0xFF
+        body = bytes([kind, tag]) + payload
+        body += struct.pack("<H", crc16(body))
+        os.write(self.fd, cobs_encode(body) + b"\0")
+        return tag
+
+    def receive(self, timeout):
+        """Next intact packet as (type, tag, payload), or None on timeout."""
+        deadline = time.monotonic() + timeout
+        while not self.frames:
+            left = deadline - time.monotonic()
+            if left <= 0 or not select.select([self.fd], [], [], left)[0]:
+                return None
+            try:
+                data = os.read(self.fd, 65536)
+            except OSError:
+                raise ConnectionLost("port closed")
+            if not data:
+                raise ConnectionLost("port closed")
+            self.pending += data
+            parts = self.pending.split(b"\0")
+            self.pending = parts.pop()
+            for frame in parts:
+                body = cobs_decode(frame) if frame else None
+                if body is None or len(body) < 4:
+                    # Text from the firmware, or what is left of a frame
+                    continue
+                if crc16(body[:-2]) != struct.unpack_from("<H", body, len(body) - 2)[0]:
+                    self.crc_errors += 1
+                    continue
+                self.frames.append((body[0], body[1], body[2:-2]))
+        return self.frames.pop(0)
+
+    def expect(self, tag, kinds, timeout=TIMEOUT):
+        """Waits for a response to tag, skipping stale ones."""
+        deadline = time.monotonic() + timeout
+        while True:
+            packet = self.receive(max(0.0, deadline - time.monotonic()))
+            if packet is None:
+                raise ConnectionLost("no response")
+            kind, got, payload = packet
+            if got != tag:
+                continue
+            if kind == RSP_ERROR:
+                raise OffloadError(ERRORS.get(payload[0], "error %d" % payload[0]))
+            if kind in kinds:
+                return kind, payload
+
+    # --- requests ---
+
+    def connect(self):
+        for _ in range(RETRIES):
+            self.frames = []
+            self.pending = bytearray()
+            os.write(self.fd, b"\noffload\n")
+            deadline = time.monotonic() + TIMEOUT
+            while True:
+                packet = self.receive(max(0.0, deadline - time.monotonic()))
+                if packet is None:
+                    break
+                if packet[0] == RSP_READY:
+                    version, self.data_size, max_window, count = struct.unpack("<BHBH", packet[2])
+                    self.window = min(self.window, max_window)
+                    return count
+        raise ConnectionLost("logger did not enter offload mode")
+
+    def bye(self):
+        self.send(REQ_BYE)
+
+    def list(self):
+        tag = self.send(REQ_LIST)
+        sessions = []
+        while True:
+            kind, payload = self.expect(tag, (RSP_ENTRY, RSP_LIST_END))
+            if kind == RSP_LIST_END:
+                return sessions
+            session_id, size, length = struct.unpack_from("<IIB", payload)
+            sessions.append((session_id, size, payload[9:9 + length].decode("utf-8", "replace")))
+
+    def crc(self, session_id, length):
+        tag = self.send(REQ_CRC, struct.pack("<II", session_id, length))
+        # The logger checksums about 8 KiB per loop pass
+        _, payload = self.expect(tag, (RSP_CRC,), TIMEOUT + length / 100000.0)
+        _, length, crc = struct.unpack("<III", payload)
+        return length, crc
+
+    def request_read(self, session_id, offset):
+        # Everything from offset; the file ends where the logger says DONE
+        return self.send(REQ_READ, struct.pack("<IIIB", session_id, offset, 0xFFFFFFFF, self.window))
+
+    def read(self, session_id, out, offset, size):
+        """Appends session bytes from offset to out until size. Returns the new offset."""
+        tag = self.request_read(session_id, offset)
+        unacked = 0
+        timeouts = 0
+        while True:
+            packet = self.receive(TIMEOUT)
+            if packet is None:
+                timeouts += 1
+                if timeouts == RETRIES:
+                    raise ConnectionLost("transfer stalled at %d" % offset)
+                # Lost request or lost tail: ask again from where we are
+                tag = self.request_read(session_id, offset)
+                unacked = 0
+                continue
+            kind, got, payload = packet
+            if got != tag:
+                continue
+            timeouts = 0
+            if kind == RSP_ERROR:
+                raise OffloadError(ERRORS.get(payload[0], "error %d" % payload[0]))
+            if kind == RSP_DONE:
+                return offset
+            if kind != RSP_DATA:
+                continue
+            at, = struct.unpack_from("<I", payload)
+            if at != offset:
+                # A frame went missing; the rest of the window is useless
+                if at > offset:
+                    tag = self.request_read(session_id, offset)
+                    unacked = 0
+                continue
+            out.write(payload[4:])
+            offset += len(payload) - 4
+            self.bytes_received += len(payload) - 4
+            unacked += 1
+            # Acking every half window keeps the pipe full
+            if unacked >= max(1, self.window // 2) or offset >= size:
+                self.send(REQ_ACK, struct.pack("<I", offset), tag)
+                unacked = 0
+
+    def download(self, session_id, size, path):
+        """Fetches a session into path, resuming what is there. Returns bytes transferred."""
+        received = self.bytes_received
+        for attempt in range(RECONNECTS):
+            try:
+                if attempt:
+                    self.connect()
+                have = os.path.getsize(path) if os.path.exists(path) else 0
+                if have > size:
+                    have = 0
+                if have:
+                    with open(path, "rb") as f:
+                        local = zlib.crc32(f.read(have))
+                    _, remote = self.crc(session_id, have)
+                    if remote != local:
+                        self.log.write("%s: local copy differs, starting over\n" % path)
+                        have = 0
+                    else:
+                        self.log.write("%s: resuming at %d\n" % (path, have))
+                with open(path, "r+b" if have else "wb") as f:
+                    f.truncate(have)
+                    f.seek(have)
+                    end = self.read(session_id, f, have, size)
+                with open(path, "rb") as f:
+                    local = zlib.crc32(f.read())
+                length, remote = self.crc(session_id, end)
+                if length != end or remote != local:
+                    raise OffloadError("%s: CRC mismatch after download" % path)
+                return self.bytes_received - received
+            except ConnectionLost as e:
+                self.log.write("%s: %s, reconnecting\n" % (path, e))
+        raise ConnectionLost("giving up on session %d" % session_id)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port", help="serial device or pty")
+    parser.add_argument("command", choices=["list", "get"])
+    parser.add_argument("session", nargs="?", type=int, help="session id for get")
+    parser.add_argument("--all", action="store_true", help="get every session")
+    parser.add_argument("-o", "--output", help="output file for get (default session<id>.bin)")
+    parser.add_argument("-d", "--directory", default=".", help="output directory for get --all")
+    parser.add_argument("--window", type=int, default=16, help="data packets in flight (1-32)")
+    args = parser.parse_args()
+    if args.command == "get" and args.session is None and not args.all:
+        parser.error("get needs a session id or --all")
+
+    client = Client(open_port(args.port), args.window)
+    try:
+        client.connect()
+        sessions = client.list()
+        if args.command == "list":
+            for session_id, size, track in sessions:
+                print("%6d %10d  %s" % (session_id, size, track))
+            return
+
+        wanted = [s for s in sessions if args.all or s[0] == args.session]
+        if not wanted:
+            raise OffloadError("no session %d" % args.session)
+        for session_id, size, track in wanted:
+            if args.output and not args.all:
+                path = args.output
+            else:
+                path = os.path.join(args.directory, "session%d.bin" % session_id)
+            start = time.monotonic()
+            transferred = client.download(session_id, size, path)
+            seconds = time.monotonic() - start
+            print("%s: %d bytes (%d transferred) in %.2f s, %.0f KiB/s" % (
+                path, size, transferred, seconds, transferred / 1024.0 / max(seconds, 1e-6)))
+    except (ConnectionLost, OffloadError) as e:
+        sys.exit("offload: %s" % e)
+    finally:
+        client.bye()
+        if client.crc_errors:
+            sys.stderr.write("damaged frames: %d\n" % client.crc_errors)
+
+
+if __name__ == "__main__":
+    main()
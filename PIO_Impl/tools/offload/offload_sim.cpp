@@ -0,0 +1,287 @@
+/**
+ * The logger's offload side on a pseudo-terminal.
+ *
+ * Records synthetic sessions with the firmware's SessionRecorder into a
+ * SessionLog on a RAM flash the size of the log partition, then serves
+ * the pty like the device serves its USB CDC port: text commands until
+ * "offload", then OffloadServer until the client says BYE. The pty path
+ * is printed on the first line of stdout.
+ *
+ * Faults for the client to survive:
+ *   --corrupt N       flips a byte in every Nth frame sent
+ *   --stall-after B   once B bytes were sent, stops serving as if the
+ *                     device had reset; the client must reconnect
+ *   --rate B          caps the link at B bytes/s (USB full speed CDC
+ *                     manages about 1000000)
+ *
+ * --dump DIR writes each session's stream to DIR/<id>.bin, read straight
+ * from the log, for comparison. tools/offload/offload_test.py runs it all.
+ *
+ * Build from PIO_Impl/:
+ *   g++ -std=gnu++17 -O2 -Iinclude tools/offload/offload_sim.cpp src/session/session_log.cpp
+ *       src/session/offload_server.cpp src/util/log.cpp -o offload_sim
+ *
+ * Usage:
+ *   offload_sim [--sessions N] [--minutes M] [--dump DIR] [--corrupt N]
+ *               [--stall-after BYTES] [--rate BYTES_PER_S]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include "session/session_recorder.h"
+#include "session/offload_server.h"
+#include "ram_flash.h"
+
+namespace {
+
+    const uint32_t LOG_PARTITION_SIZE = 0x870000;
+
+    enum ChannelId : uint8_t { CH_RPM = 1, CH_THROTTLE = 2, CH_COOLANT = 3, CH_GEAR = 4, CH_BRAKE = 16 };
+
+    const ChannelDef CHANNELS[] = {
+        { CH_RPM,      "rpm",      "1/min", ChannelType::Analog,   100,  1, 1.0f },
+        { CH_THROTTLE, "throttle", "%",     ChannelType::Analog,   100,  1, 0.1f },
+        { CH_COOLANT,  "coolant",  "C",     ChannelType::Analog,   10,   1, 0.1f },
+        { CH_GEAR,     "gear",     "",      ChannelType::Discrete, 50,   1, 1.0f },
+        { CH_BRAKE,    "brake",    "bar",   ChannelType::Analog,   500,  1, 0.05f },
+    };
+
+    // Logged rates, as in src/main.cpp
+    const uint16_t LOG_RATES[] = { 50, 50, 1, 10, 100 };
+
+    uint32_t wallMs() {
+        using namespace std::chrono;
+        return (uint32_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t wallUs() {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // A few laps of a 1.6 km oval at 25 Hz with engine channels to match
+    void recordSession(SessionLog& log, uint32_t id, double minutes) {
+        ChannelRegistry registry;
+        SessionRecorder recorder(log, registry);
+        for (size_t i = 0; i < sizeof(CHANNELS) / sizeof(CHANNELS[0]); i++) {
+            registry.add(CHANNELS[i]);
+            recorder.addChannel(CHANNELS[i].id, LOG_RATES[i]);
+        }
+        uint32_t t = id * 977000;   // Sessions start at different micros()
+        char track[logfmt::MAX_TRACK_NAME];
+        snprintf(track, sizeof(track), "Sim Oval %u", (unsigned)id);
+        recorder.start(id, track, t);
+        uint32_t end = t + (uint32_t)(minutes * 60e6);
+        uint32_t lapUs = 0;
+        uint16_t lap = 0;
+        for (uint32_t step = 0; t < end; t += 2000, step++) {
+            double s = t / 1e6;
+            double phase = s * 2 * M_PI / 60.0;
+            double brake = fmax(0.0, 60 * sin(phase * 4) - 20);
+            registry.publish(CH_BRAKE, t, (float)(brake + 0.3 * sin(s * 50)));
+            if (step % 5 == 0) {
+                registry.publish(CH_RPM, t, (float)(7000 + 3000 * sin(phase * 4 + 1)));
+                registry.publish(CH_THROTTLE, t, (float)(brake > 0 ? 0 : 100 * fabs(sin(phase * 2))));
+            }
+            if (step % 10 == 0) registry.publish(CH_GEAR, t, (float)(3 + (int)(2 * sin(phase * 4))));
+            if (step % 50 == 0) registry.publish(CH_COOLANT, t, (float)(85 + s / 60));
+            if (step % 20 == 0) {
+                double lat = 48.0 + 0.002 * sin(phase);
+                double lon = 11.0 + 0.003 * cos(phase);
+                recorder.addFix(t, lat, lon, 40 + 15 * sin(phase * 4), fmod(phase * 180 / M_PI + 90, 360));
+            }
+            if (step % 25 == 0) {
+                recorder.poll(t);
+                log.maintain();
+            }
+            lapUs += 2000;
+            if (lapUs >= 60000000) {
+                lap++;
+                recorder.addLap(t, lap, lapUs / 1000, lap == 2);
+                lapUs = 0;
+            }
+        }
+        recorder.stop();
+    }
+
+    class PtyLink : public ByteLink {
+    public:
+        int fd = -1;
+        uint32_t corruptEvery = 0;
+        uint32_t rate = 0;
+        uint64_t frames = 0;
+        uint64_t written = 0;
+        uint64_t startUs = 0;
+        bool blocked = false;
+
+        size_t read(uint8_t* data, size_t max) override {
+            ssize_t n = ::read(fd, data, max);
+            return n > 0 ? n : 0;
+        }
+
+        size_t write(const uint8_t* data, size_t length) override {
+            if (rate) {
+                uint64_t allowed = (wallUs() - startUs) * rate / 1000000;
+                if (written >= allowed) {
+                    blocked = true;
+                    return 0;
+                }
+                if (length > allowed - written) length = allowed - written;
+            }
+            uint8_t copy[2048];
+            if (length > sizeof(copy)) length = sizeof(copy);
+            memcpy(copy, data, length);
+            // Count frames by their delimiters; damage one byte in every Nth
+            for (size_t i = 0; i < length; i++) {
+                if (copy[i] == 0 && corruptEvery && ++frames % corruptEvery == 0 && i > 0) {
+                    copy[i - 1] ^= copy[i - 1] == 0x55 ? 0x0F : 0x55;
+                }
+            }
+            ssize_t n = ::write(fd, copy, length);
+            if (n <= 0) {
+                blocked = true;
+                return 0;
+            }
+            blocked = (size_t)n < length;
+            written += n;
+            return n;
+        }
+    };
+
+    bool readLine(int fd, std::string& line) {
+        char c;
+        while (::read(fd, &c, 1) == 1) {
+            if (c == '\n' || c == '\r') {
+                if (!line.empty()) return true;
+                continue;
+            }
+            if (c != 0 && line.size() < 64) line += c;
+        }
+        return false;
+    }
+}
+
+int main(int argc, char** argv) {
+    int sessionCount = 3;
+    double minutes = 5;
+    const char* dump = nullptr;
+    uint32_t corrupt = 0;
+    uint64_t stallAfter = 0;
+    uint32_t rate = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--sessions") && i + 1 < argc) sessionCount = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--minutes") && i + 1 < argc) minutes = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--dump") && i + 1 < argc) dump = argv[++i];
+        else if (!strcmp(argv[i], "--corrupt") && i + 1 < argc) corrupt = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--stall-after") && i + 1 < argc) stallAfter = atoll(argv[++i]);
+        else if (!strcmp(argv[i], "--rate") && i + 1 < argc) rate = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--sessions N] [--minutes M] [--dump DIR] [--corrupt N] "
+                            "[--stall-after BYTES] [--rate BYTES_PER_S]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    RamFlash flash(LOG_PARTITION_SIZE);
+    SessionLog log(flash);
+    log.begin();
+    for (int i = 0; i < sessionCount; i++) {
+        recordSession(log, 100 + i, minutes);
+    }
+    // Directory rebuilt from flash, as after a reboot
+    SessionLog stored(flash);
+    stored.begin();
+    fprintf(stderr, "%u sessions, %u of %u sectors used, %u bad writes\n", (unsigned)stored.count(),
+            (unsigned)(stored.getSectorCount() - stored.getFreeSectors()), (unsigned)stored.getSectorCount(),
+            (unsigned)flash.getBadWrites());
+    if (dump) {
+        for (size_t i = 0; i < stored.count(); i++) {
+            LogSessionInfo info = stored.getInfo(i);
+            std::string path = std::string(dump) + "/" + std::to_string(info.id) + ".bin";
+            FILE* f = fopen(path.c_str(), "wb");
+            std::vector<uint8_t> data(info.size);
+            stored.read(info.id, 0, data.data(), data.size());
+            fwrite(data.data(), 1, data.size(), f);
+            fclose(f);
+        }
+    }
+
+    PtyLink link;
+    link.fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (link.fd < 0 || grantpt(link.fd) || unlockpt(link.fd)) {
+        perror("pty");
+        return 1;
+    }
+    // Raw mode on the terminal side, held open so the pty survives clients
+    int slave = open(ptsname(link.fd), O_RDWR | O_NOCTTY);
+    struct termios mode;
+    tcgetattr(slave, &mode);
+    cfmakeraw(&mode);
+    tcsetattr(slave, TCSANOW, &mode);
+    fcntl(link.fd, F_SETFL, O_NONBLOCK);
+    link.corruptEvery = corrupt;
+    link.rate = rate;
+    printf("PTY %s\n", ptsname(link.fd));
+    fflush(stdout);
+
+    OffloadServer server(stored, link, wallMs);
+    uint64_t sentBefore = 0;
+    bool stalled = stallAfter == 0;
+    std::string line;
+    while (true) {
+        struct pollfd p = { link.fd, POLLIN, 0 };
+        poll(&p, 1, 100);
+        if (!readLine(link.fd, line)) continue;
+        std::string command = line;
+        line.clear();
+        if (command == "quit") break;
+        if (command != "offload") {
+            const char reply[] = "Unknown command\n";
+            ::write(link.fd, reply, sizeof(reply) - 1);
+            continue;
+        }
+
+        server.begin();
+        link.startUs = wallUs();
+        link.written = 0;
+        uint64_t begin = wallUs();
+        bool reset = false;
+        while (server.service()) {
+            if (!stalled && sentBefore + server.getBytesSent() >= stallAfter) {
+                stalled = reset = true;
+                fprintf(stderr, "stalling after %llu bytes\n", (unsigned long long)(sentBefore + server.getBytesSent()));
+                break;
+            }
+            if (link.blocked) {
+                struct pollfd out = { link.fd, POLLIN | POLLOUT, 0 };
+                poll(&out, 1, 1);
+                link.blocked = false;
+            } else {
+                struct pollfd in = { link.fd, POLLIN, 0 };
+                poll(&in, 1, 0);
+            }
+        }
+        double seconds = (wallUs() - begin) / 1e6;
+        sentBefore += server.getBytesSent();
+        fprintf(stderr, "offload: %u bytes in %.2f s, %u retransmits, %u bad request frames\n",
+                (unsigned)server.getBytesSent(), seconds, (unsigned)server.getRetransmits(),
+                (unsigned)server.getBadFrames());
+        if (reset) {
+            // A rebooted device has lost whatever was in flight
+            tcflush(slave, TCIOFLUSH);
+            uint8_t discard[256];
+            while (::read(link.fd, discard, sizeof(discard)) > 0) {}
+        }
+    }
+    close(slave);
+    close(link.fd);
+    return 0;
+}
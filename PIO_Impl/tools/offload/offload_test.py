@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""End-to-end test of the offload protocol over a pseudo-terminal.
+
+Runs offload_sim (build line in tools/offload/offload_sim.cpp) with frame
+corruption, a USB-like rate cap and a connection that dies mid-transfer,
+then drives it with the offload.py client:
+
+    python3 tools/offload/offload_test.py ./offload_sim
+
+Checks that list matches the sessions on the simulated flash, that every
+download survives the faults byte for byte, that an interrupted file
+resumes from where it stopped, and that a damaged partial file is fetched
+again. Prints the throughput of each transfer; exits non-zero on failure.
+"""
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import offload  # noqa: E402
+
+
+def check(condition, message):
+    if not condition:
+        sys.exit("FAIL: " + message)
+    print("ok: " + message)
+
+
+def same(a, b):
+    with open(a, "rb") as fa, open(b, "rb") as fb:
+        return fa.read() == fb.read()
+
+
+def timed_download(client, session_id, size, path):
+    start = time.monotonic()
+    transferred = client.download(session_id, size, path)
+    seconds = time.monotonic() - start
+    print("   session %d: %d bytes transferred in %.2f s, %.0f KiB/s" % (
+        session_id, transferred, seconds, transferred / 1024.0 / max(seconds, 1e-6)))
+    return transferred
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("sim", help="path to the offload_sim binary")
+    parser.add_argument("--minutes", default="15", help="length of each simulated session")
+    parser.add_argument("--rate", default="1000000", help="link rate in bytes/s, 0 for unlimited")
+    args = parser.parse_args()
+
+    work = tempfile.mkdtemp(prefix="offload_test.")
+    dump = os.path.join(work, "dump")
+    out = os.path.join(work, "out")
+    os.mkdir(dump)
+    os.mkdir(out)
+    sim = subprocess.Popen(
+        [args.sim, "--minutes", args.minutes, "--dump", dump, "--rate", args.rate,
+         "--corrupt", "97", "--stall-after", "1500000"],
+        stdout=subprocess.PIPE, text=True)
+    try:
+        line = sim.stdout.readline().split()
+        check(len(line) == 2 and line[0] == "PTY", "simulator is up")
+        client = offload.Client(offload.open_port(line[1]), window=16, log=sys.stdout)
+        client.connect()
+
+        sessions = client.list()
+        expected = sorted((int(name[:-4]), os.path.getsize(os.path.join(dump, name)))
+                          for name in os.listdir(dump))
+        check([(s[0], s[1]) for s in sessions] == expected, "list matches the stored sessions")
+
+        # The connection dies after 1.5 MB, inside the second session
+        for session_id, size, _ in sessions:
+            path = os.path.join(out, "session%d.bin" % session_id)
+            timed_download(client, session_id, size, path)
+            check(same(path, os.path.join(dump, "%d.bin" % session_id)),
+                  "session %d arrived intact" % session_id)
+        check(client.crc_errors > 0, "%d damaged frames were recovered" % client.crc_errors)
+
+        # A download cut short resumes with only the missing part
+        session_id, size, _ = sessions[0]
+        path = os.path.join(out, "session%d.bin" % session_id)
+        with open(path, "r+b") as f:
+            f.truncate(size * 2 // 3)
+        transferred = timed_download(client, session_id, size, path)
+        check(transferred == size - size * 2 // 3, "resume fetched only the last third")
+        check(same(path, os.path.join(dump, "%d.bin" % session_id)), "resumed file is intact")
+
+        # A partial file that does not match the logger starts over
+        with open(path, "r+b") as f:
+            f.truncate(size // 2)
+            f.seek(1000)
+            byte = f.read(1)
+            f.seek(1000)
+            f.write(bytes([byte[0] ^ 0xFF]))
+        transferred = timed_download(client, session_id, size, path)
+        check(transferred == size, "damaged partial file was fetched again")
+        check(same(path, os.path.join(dump, "%d.bin" % session_id)), "refetched file is intact")
+
+        client.bye()
+        time.sleep(0.2)     # BYE ends the read that carried it
+        os.write(client.fd, b"\nquit\n")
+        sim.wait(5)
+        print("PASS")
+    finally:
+        if sim.poll() is None:
+            sim.kill()
+        shutil.rmtree(work)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "session/log_flash.h"
+
+// NOR flash in RAM for the host tools: writes only clear bits, erases are
+// counted per sector, and a write over unerased bits is reported, since on
+// the device it would silently corrupt data.
+class RamFlash : public LogFlash {
+public:
+    explicit RamFlash(uint32_t bytes)
+        : image(bytes & ~(SECTOR_SIZE - 1), 0xFF), erases(image.size() / SECTOR_SIZE, 0), badWrites(0) {}
+
+    uint32_t size() const override { return (uint32_t)image.size(); }
+
+    bool read(uint32_t offset, void* data, size_t length) override {
+        if (offset + length > image.size()) return false;
+        memcpy(data, &image[offset], length);
+        return true;
+    }
+
+    bool write(uint32_t offset, const void* data, size_t length) override {
+        if (offset + length > image.size()) return false;
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < length; i++) {
+            if ((image[offset + i] & bytes[i]) != bytes[i]) badWrites++;
+            image[offset + i] &= bytes[i];
+        }
+        return true;
+    }
+
+    bool erase(uint32_t offset) override {
+        if (offset % SECTOR_SIZE || offset >= image.size()) return false;
+        memset(&image[offset], 0xFF, SECTOR_SIZE);
+        erases[offset / SECTOR_SIZE]++;
+        return true;
+    }
+
+    uint32_t getErases(uint32_t sector) const { return erases[sector]; }
+    uint32_t getBadWrites() const { return badWrites; }
+
+private:
+    std::vector<uint8_t> image;
+    std::vector<uint32_t> erases;
+    uint32_t badWrites;
+};
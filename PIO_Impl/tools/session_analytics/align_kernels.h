@@ -0,0 +1,160 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <cmath>
+#include "calculations/track_geometry.h"
+
+/**
+ * SIMD kernels for lap alignment, written with GCC vector extensions so the
+ * same source becomes SSE/AVX on x86 and NEON on ARM hosts. Per lane they
+ * do exactly the arithmetic of the scalar firmware code in track_geometry.h.
+ */
+namespace kernels {
+
+    static const size_t LANES = 8;
+    typedef float floatv __attribute__((vector_size(LANES * sizeof(float))));
+    typedef int32_t intv __attribute__((vector_size(LANES * sizeof(int32_t))));
+
+    inline floatv load(const float* p) {
+        floatv v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline floatv splat(float value) {
+        return floatv{} + value;
+    }
+
+    /**
+     * Same contract as geometry::projectOnto(): best projection of (x, y)
+     * onto segments [first, last), first of equally close segments wins.
+     */
+    inline float projectOnto(const float* xs, const float* ys, float x, float y,
+                             size_t first, size_t last, size_t* segment, float* along) {
+        const floatv px = splat(x);
+        const floatv py = splat(y);
+        const floatv zero = splat(0.0f);
+        const floatv one = splat(1.0f);
+        const floatv minLength = splat(1e-6f);
+
+        floatv bestSq = splat(INFINITY);
+        floatv bestT = zero;
+        floatv bestLength = zero;
+        intv bestIndex = intv{} - 1;
+        intv index;
+        for (size_t lane = 0; lane < LANES; lane++) {
+            index[lane] = (int32_t)(first + lane);
+        }
+
+        size_t i = first;
+        for (; i + LANES <= last; i += LANES) {
+            floatv x0 = load(xs + i);
+            floatv y0 = load(ys + i);
+            floatv sx = load(xs + i + 1) - x0;
+            floatv sy = load(ys + i + 1) - y0;
+            floatv lengthSq = sx * sx + sy * sy;
+
+            intv valid = lengthSq > minLength;
+            floatv t = ((px - x0) * sx + (py - y0) * sy) / (valid ? lengthSq : one);
+            t = t < zero ? zero : t;
+            t = t > one ? one : t;
+            t = valid ? t : zero;
+
+            floatv dx = px - (x0 + t * sx);
+            floatv dy = py - (y0 + t * sy);
+            floatv distSq = dx * dx + dy * dy;
+
+            intv closer = distSq < bestSq;
+            bestSq = closer ? distSq : bestSq;
+            bestT = closer ? t : bestT;
+            bestLength = closer ? lengthSq : bestLength;
+            bestIndex = closer ? index : bestIndex;
+            index += (int32_t)LANES;
+        }
+
+        float resultSq = INFINITY;
+        int32_t resultIndex = -1;
+        for (size_t lane = 0; lane < LANES; lane++) {
+            if (bestIndex[lane] < 0) continue;
+            if (bestSq[lane] < resultSq ||
+                (bestSq[lane] == resultSq && bestIndex[lane] < resultIndex)) {
+                resultSq = bestSq[lane];
+                resultIndex = bestIndex[lane];
+                *segment = resultIndex;
+                *along = bestT[lane] * sqrtf(bestLength[lane]);
+            }
+        }
+
+        // Remainder with the scalar firmware code; it only wins when strictly closer
+        size_t tailSegment = 0;
+        float tailAlong = 0;
+        float tailSq = geometry::projectOnto(xs, ys, x, y, i, last, &tailSegment, &tailAlong);
+        if (tailSq < resultSq) {
+            resultSq = tailSq;
+            *segment = tailSegment;
+            *along = tailAlong;
+        }
+        return resultSq;
+    }
+
+    /**
+     * Linear interpolation of time over distance onto a fixed grid,
+     * out[g] = time at g * step. distance must be non-decreasing; grid points
+     * outside the covered range are set to NaN.
+     */
+    inline void resample(const float* distance, const float* time, size_t count,
+                         float step, size_t gridCount, float* out) {
+        for (size_t g = 0; g < gridCount; g++) {
+            out[g] = NAN;
+        }
+        if (count < 2) {
+            return;
+        }
+
+        floatv offsets;
+        for (size_t lane = 0; lane < LANES; lane++) {
+            offsets[lane] = (float)lane;
+        }
+
+        for (size_t i = 0; i + 1 < count; i++) {
+            float span = distance[i + 1] - distance[i];
+            if (span <= 0) {
+                continue;
+            }
+            size_t g = (size_t)ceilf(distance[i] / step);
+            size_t end = (size_t)ceilf(distance[i + 1] / step);
+            if (i + 2 == count) {
+                end = (size_t)floorf(distance[i + 1] / step) + 1;  // Include the last point
+            }
+            if (end > gridCount) end = gridCount;
+
+            float slope = (time[i + 1] - time[i]) / span;
+            const floatv base = splat(time[i]);
+            const floatv start = splat(distance[i]);
+            const floatv slopev = splat(slope);
+            const floatv stepv = splat(step);
+            for (; g + LANES <= end; g += LANES) {
+                floatv grid = (splat((float)g) + offsets) * stepv;
+                floatv value = base + (grid - start) * slopev;
+                memcpy(out + g, &value, sizeof(value));
+            }
+            for (; g < end; g++) {
+                out[g] = time[i] + (g * step - distance[i]) * slope;
+            }
+        }
+    }
+
+    // out[g] = a[g] - b[g]
+    inline void subtract(const float* a, const float* b, size_t count, float* out) {
+        size_t i = 0;
+        for (; i + LANES <= count; i += LANES) {
+            floatv value = load(a + i) - load(b + i);
+            memcpy(out + i, &value, sizeof(value));
+        }
+        for (; i < count; i++) {
+            out[i] = a[i] - b[i];
+        }
+    }
+
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "util/cobs.h"
+#include "util/crc.h"
+#include "calculations/reference_trace.h"
+
+// Packet types and layouts written by Telemetry (include/telemetry/telemetry.h)
+static const uint8_t PACKET_STATE = 1;
+static const uint8_t PACKET_LAP = 2;
+static const size_t STATE_PAYLOAD = 34;
+static const size_t LAP_PAYLOAD = 11;
+
+struct Lap {
+    std::string source;
+    uint16_t number;
+    uint32_t lapTime;            // ms, from the firmware's lap event
+    std::vector<TracePoint> points;   // Timestamps relative to the lap start
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() : data(nullptr), length(0) {}
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+        data = (const uint8_t*)mapped;
+        length = info.st_size;
+        return true;
+    }
+
+    void close() {
+        if (data) {
+            munmap((void*)data, length);
+            data = nullptr;
+        }
+    }
+
+    const uint8_t* begin() const { return data; }
+    size_t size() const { return length; }
+
+private:
+    const uint8_t* data;
+    size_t length;
+};
+
+namespace capture {
+
+    inline uint32_t u32(const uint8_t* p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+    inline uint16_t u16(const uint8_t* p) { return p[0] | p[1] << 8; }
+
+    struct Sample {
+        uint32_t timestamp;   // millis() on the logger
+        TracePoint point;
+    };
+
+    struct LapEvent {
+        uint32_t timestamp;
+        uint16_t number;
+        uint32_t lapTime;
+    };
+
+    /**
+     * Splits a raw telemetry capture into laps. State samples between a
+     * lap's start (event time minus lap time) and its lap event belong to
+     * that lap. Text and damaged frames are skipped like the live decoder does.
+     */
+    inline bool read(const std::string& path, std::vector<Lap>& laps) {
+        MappedFile file;
+        if (!file.open(path)) {
+            return false;
+        }
+
+        std::vector<Sample> samples;
+        std::vector<LapEvent> events;
+        samples.reserve(file.size() / 40);
+
+        uint8_t packet[256];
+        const uint8_t* p = file.begin();
+        const uint8_t* end = p + file.size();
+        while (p < end) {
+            const uint8_t* delimiter = (const uint8_t*)memchr(p, 0, end - p);
+            if (!delimiter) {
+                break;  // Torn final frame
+            }
+            size_t frameLength = delimiter - p;
+            const uint8_t* frame = p;
+            p = delimiter + 1;
+
+            if (frameLength < 5 || frameLength > sizeof(packet)) {
+                continue;
+            }
+            size_t length = cobs::decode(frame, frameLength, packet);
+            if (length < 4 || crc::crc16(packet, length - 2) != u16(packet + length - 2)) {
+                continue;
+            }
+
+            const uint8_t* payload = packet + 2;
+            size_t payloadLength = length - 4;
+            if (packet[0] == PACKET_STATE && payloadLength == STATE_PAYLOAD) {
+                if (payload[32] == 0) {
+                    continue;  // No fix
+                }
+                Sample sample;
+                sample.timestamp = u32(payload);
+                sample.point.latitudeE7 = (int32_t)u32(payload + 4);
+                sample.point.longitudeE7 = (int32_t)u32(payload + 8);
+                sample.point.speed = (int32_t)u32(payload + 12);
+                sample.point.timestamp = 0;
+                samples.push_back(sample);
+            } else if (packet[0] == PACKET_LAP && payloadLength == LAP_PAYLOAD) {
+                events.push_back({ u32(payload), u16(payload + 4), u32(payload + 6) });
+            }
+        }
+
+        auto byTime = [](const Sample& s, uint32_t t) { return s.timestamp < t; };
+        for (const LapEvent& event : events) {
+            uint32_t start = event.timestamp - event.lapTime;
+            auto first = std::lower_bound(samples.begin(), samples.end(), start, byTime);
+            auto last = std::lower_bound(first, samples.end(), event.timestamp + 1, byTime);
+            if (last - first < 2) {
+                continue;
+            }
+
+            Lap lap;
+            lap.source = path;
+            lap.number = event.number;
+            lap.lapTime = event.lapTime;
+            lap.points.reserve(last - first);
+            for (auto it = first; it != last; ++it) {
+                TracePoint point = it->point;
+                point.timestamp = it->timestamp - start;
+                lap.points.push_back(point);
+            }
+            laps.push_back(std::move(lap));
+        }
+        return true;
+    }
+
+}
@@ -0,0 +1,355 @@
+/**
+ * Post-session lap analytics over recorded telemetry captures.
+ *
+ * Every capture (a raw dump of the binary telemetry stream, e.g.
+ * `cat /dev/ttyACM0 > day1.bin` after "telemetry on") is memory-mapped and
+ * split into laps. Each lap is aligned by distance against a reference lap
+ * (the fastest, or --reference FILE:LAP), giving a delta curve, sector times
+ * and a replay of the in-car delta_calculator for comparison. Laps are
+ * spread across all cores and sectors are ranked over the whole set.
+ *
+ * Build from PIO_Impl/:
+ *   g++ -std=gnu++17 -O3 -march=native -ffp-contract=off -pthread \
+ *       -Iinclude -Iinclude/calculations \
+ *       tools/session_analytics/session_analytics.cpp -o session_analytics
+ *
+ * -ffp-contract=off keeps the host from fusing multiply-adds, so the
+ * alignment rounds exactly like the firmware's scalar code.
+ *
+ * Usage:
+ *   session_analytics [--reference FILE:LAP] [--sectors N] [--step M]
+ *                     [--threads N] [--top K] capture.bin...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "capture_reader.h"
+#include "work_pool.h"
+#include "align_kernels.h"
+#include "calculations/delta_calculator.h"
+
+namespace {
+
+    struct Options {
+        std::string reference;    // FILE:LAP, empty for the fastest lap
+        unsigned sectors = 3;
+        float step = 1.0f;        // Distance grid resolution (m)
+        unsigned threads = 0;
+        unsigned top = 5;
+        std::vector<std::string> files;
+    };
+
+    // The reference lap, prepared once and shared read-only by all workers
+    struct Reference {
+        const Lap* lap;
+        geometry::LocalFrame frame;
+        std::vector<float> xs;
+        std::vector<float> ys;
+        std::vector<float> distance;
+        std::vector<float> timeGrid;
+        size_t gridCount;
+    };
+
+    struct LapResult {
+        std::vector<uint32_t> sectorTimes;   // 0 when the sector is not covered
+        float finalDelta = NAN;              // Aligned delta at the last grid point (ms)
+        float maxLoss = 0;                   // Largest delta and where (m)
+        float maxLossAt = 0;
+        float maxGain = 0;
+        float maxGainAt = 0;
+        float coverage = 0;                  // Share of points on the reference line
+        int32_t inCarFinal = 0;              // Last delta_calculator delta (ms)
+        uint32_t inCarMismatch = 0;          // Max |aligned - in-car| at the fixes (ms)
+        bool valid = false;
+    };
+
+    const float OFF_TRACK_SQ = 30.0f * 30.0f;   // Same limit as delta_calculator
+    const size_t SEARCH_BEHIND = 5;
+    const size_t SEARCH_AHEAD = 25;
+
+    bool parseOptions(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--reference" && hasValue) {
+                options.reference = argv[++i];
+            } else if (arg == "--sectors" && hasValue) {
+                options.sectors = std::max(1, atoi(argv[++i]));
+            } else if (arg == "--step" && hasValue) {
+                options.step = std::max(0.1f, (float)atof(argv[++i]));
+            } else if (arg == "--threads" && hasValue) {
+                options.threads = atoi(argv[++i]);
+            } else if (arg == "--top" && hasValue) {
+                options.top = atoi(argv[++i]);
+            } else if (arg[0] == '-') {
+                return false;
+            } else {
+                options.files.push_back(arg);
+            }
+        }
+        return !options.files.empty();
+    }
+
+    const Lap* findReference(const std::vector<Lap>& laps, const std::string& spec) {
+        const Lap* best = nullptr;
+        for (const Lap& lap : laps) {
+            if (spec.empty()) {
+                if (!best || lap.lapTime < best->lapTime) best = &lap;
+            } else if (spec == lap.source + ":" + std::to_string(lap.number)) {
+                return &lap;
+            }
+        }
+        return best;
+    }
+
+    void prepareReference(const Lap& lap, float step, Reference& reference) {
+        reference.lap = &lap;
+        const TracePoint* points = lap.points.data();
+        size_t count = lap.points.size();
+        reference.frame = geometry::LocalFrame(points[0].latitudeE7 / 1e7, points[0].longitudeE7 / 1e7);
+        geometry::project(reference.frame, points, count, reference.xs, reference.ys);
+        geometry::cumulativeDistances(points, count, reference.distance);
+
+        std::vector<float> time(count);
+        for (size_t i = 0; i < count; i++) {
+            time[i] = (float)points[i].timestamp;
+        }
+        reference.gridCount = (size_t)(reference.distance.back() / step) + 1;
+        reference.timeGrid.resize(reference.gridCount);
+        kernels::resample(reference.distance.data(), time.data(), count, step,
+                          reference.gridCount, reference.timeGrid.data());
+    }
+
+    // Time at a distance from a resampled grid, NaN when not covered
+    float gridAt(const std::vector<float>& grid, float step, float distance) {
+        float position = distance / step;
+        size_t i = (size_t)position;
+        if (i + 1 >= grid.size()) {
+            return grid.empty() ? NAN : grid.back();
+        }
+        float ratio = position - i;
+        return grid[i] + (grid[i + 1] - grid[i]) * ratio;
+    }
+
+    void analyseLap(const Lap& lap, const Reference& reference, const Options& options,
+                    LapResult& result, std::vector<float>& scratch) {
+        const size_t segments = reference.xs.size() - 1;
+        const float* xs = reference.xs.data();
+        const float* ys = reference.ys.data();
+
+        // Align every fix to a distance along the reference line
+        std::vector<float> distance;
+        std::vector<float> time;
+        std::vector<float> pointDistance(lap.points.size(), NAN);
+        distance.reserve(lap.points.size());
+        time.reserve(lap.points.size());
+        size_t cursor = 0;
+        for (size_t p = 0; p < lap.points.size(); p++) {
+            const TracePoint& point = lap.points[p];
+            float x = reference.frame.x(point.longitudeE7 / 1e7);
+            float y = reference.frame.y(point.latitudeE7 / 1e7);
+
+            size_t first = cursor > SEARCH_BEHIND ? cursor - SEARCH_BEHIND : 0;
+            size_t last = std::min(cursor + SEARCH_AHEAD, segments);
+            size_t segment = 0;
+            float along = 0;
+            float distSq = kernels::projectOnto(xs, ys, x, y, first, last, &segment, &along);
+            if (distSq > OFF_TRACK_SQ) {
+                distSq = kernels::projectOnto(xs, ys, x, y, 0, segments, &segment, &along);
+                if (distSq > OFF_TRACK_SQ) {
+                    continue;
+                }
+            }
+            cursor = segment;
+
+            float d = reference.distance[segment] + along;
+            pointDistance[p] = d;
+            if (!distance.empty() && d < distance.back()) {
+                continue;  // Jitter backwards along the line
+            }
+            distance.push_back(d);
+            time.push_back((float)point.timestamp);
+        }
+
+        result.coverage = (float)distance.size() / lap.points.size();
+        if (distance.size() < 2) {
+            return;
+        }
+
+        // Delta curve by distance
+        scratch.resize(reference.gridCount * 2);
+        float* lapGrid = scratch.data();
+        float* delta = lapGrid + reference.gridCount;
+        kernels::resample(distance.data(), time.data(), distance.size(), options.step,
+                          reference.gridCount, lapGrid);
+        kernels::subtract(lapGrid, reference.timeGrid.data(), reference.gridCount, delta);
+
+        for (size_t g = 0; g < reference.gridCount; g++) {
+            if (std::isnan(delta[g])) continue;
+            result.finalDelta = delta[g];
+            if (delta[g] > result.maxLoss) {
+                result.maxLoss = delta[g];
+                result.maxLossAt = g * options.step;
+            }
+            if (delta[g] < result.maxGain) {
+                result.maxGain = delta[g];
+                result.maxGainAt = g * options.step;
+            }
+        }
+
+        // Equal-distance sectors along the reference
+        std::vector<float> lapLine(lapGrid, lapGrid + reference.gridCount);
+        float length = reference.distance.back();
+        result.sectorTimes.assign(options.sectors, 0);
+        for (unsigned s = 0; s < options.sectors; s++) {
+            float start = s == 0 ? 0.0f : gridAt(lapLine, options.step, length * s / options.sectors);
+            float end = s + 1 == options.sectors ? (float)lap.lapTime
+                                                 : gridAt(lapLine, options.step, length * (s + 1) / options.sectors);
+            if (s == 0 && std::isnan(lapLine[0])) start = NAN;
+            if (!std::isnan(start) && !std::isnan(end) && end > start) {
+                result.sectorTimes[s] = (uint32_t)lroundf(end - start);
+            }
+        }
+
+        // Replay through the firmware delta to confirm both agree
+        delta_calculator inCar;
+        inCar.setAllTimeBest(ReferenceTrace(reference.lap->points.data(), reference.lap->points.size(),
+                                            reference.lap->lapTime));
+        inCar.startLap();
+        size_t referenceCursor = 0;
+        for (size_t p = 0; p < lap.points.size(); p++) {
+            const TracePoint& point = lap.points[p];
+            GpsPoint position = point.position();
+            inCar.storePoint(point.timestamp, position, point.speed);
+            inCar.update(point.timestamp, position);
+            if (!inCar.hasDelta(ReferenceKind::AllTimeBest)) {
+                continue;
+            }
+            int32_t inCarDelta = inCar.getDelta(ReferenceKind::AllTimeBest);
+            result.inCarFinal = inCarDelta;
+
+            if (std::isnan(pointDistance[p])) {
+                continue;
+            }
+            int32_t aligned = (int32_t)(point.timestamp - geometry::timeAtDistance(
+                reference.lap->points.data(), reference.distance.data(), reference.lap->points.size(),
+                pointDistance[p], referenceCursor));
+            uint32_t mismatch = (uint32_t)std::abs(aligned - inCarDelta);
+            result.inCarMismatch = std::max(result.inCarMismatch, mismatch);
+        }
+
+        result.valid = true;
+    }
+
+    void printTime(uint32_t ms) {
+        printf("%u:%02u.%03u", ms / 60000, (ms / 1000) % 60, ms % 1000);
+    }
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        fprintf(stderr, "usage: %s [--reference FILE:LAP] [--sectors N] [--step M] "
+                        "[--threads N] [--top K] capture.bin...\n", argv[0]);
+        return 2;
+    }
+
+    WorkPool pool(options.threads);
+    auto started = std::chrono::steady_clock::now();
+
+    // Load captures in parallel, one task per file
+    std::vector<std::vector<Lap>> perFile(options.files.size());
+    std::atomic<int> failed(0);
+    pool.run(options.files.size(), [&](size_t i, unsigned) {
+        if (!capture::read(options.files[i], perFile[i])) {
+            fprintf(stderr, "Failed to read %s\n", options.files[i].c_str());
+            failed++;
+        }
+    });
+
+    std::vector<Lap> laps;
+    for (auto& file : perFile) {
+        for (auto& lap : file) {
+            laps.push_back(std::move(lap));
+        }
+    }
+    auto loaded = std::chrono::steady_clock::now();
+
+    const Lap* referenceLap = findReference(laps, options.reference);
+    if (!referenceLap || referenceLap->points.size() < 2) {
+        fprintf(stderr, "No usable reference lap in %zu laps\n", laps.size());
+        return 1;
+    }
+
+    Reference reference;
+    prepareReference(*referenceLap, options.step, reference);
+
+    std::vector<LapResult> results(laps.size());
+    std::vector<std::vector<float>> scratch(pool.size());
+    pool.run(laps.size(), [&](size_t i, unsigned worker) {
+        analyseLap(laps[i], reference, options, results[i], scratch[worker]);
+    });
+    auto analysed = std::chrono::steady_clock::now();
+
+    // Lap table, fastest first
+    std::vector<size_t> order;
+    for (size_t i = 0; i < laps.size(); i++) {
+        if (results[i].valid) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return laps[a].lapTime < laps[b].lapTime; });
+
+    printf("Reference: %s lap %u ", referenceLap->source.c_str(), referenceLap->number);
+    printTime(referenceLap->lapTime);
+    printf(", %.0f m\n\n", reference.distance.back());
+    printf("%-28s %4s %10s %8s %8s %8s %8s %8s %6s %6s\n", "capture", "lap", "time", "gap_ms",
+           "delta", "in_car", "loss_ms", "at_m", "cover", "diff");
+    for (size_t i : order) {
+        const Lap& lap = laps[i];
+        const LapResult& r = results[i];
+        std::string name = lap.source.size() > 28 ? "..." + lap.source.substr(lap.source.size() - 25) : lap.source;
+        printf("%-28s %4u ", name.c_str(), lap.number);
+        printTime(lap.lapTime);
+        printf(" %8d %8.0f %8d %8.0f %8.0f %5.0f%% %6u\n", (int)(lap.lapTime - referenceLap->lapTime),
+               r.finalDelta, r.inCarFinal, r.maxLoss, r.maxLossAt, r.coverage * 100, r.inCarMismatch);
+    }
+
+    // Sector rankings across every capture
+    uint32_t theoretical = 0;
+    for (unsigned s = 0; s < options.sectors; s++) {
+        std::vector<size_t> ranked;
+        for (size_t i : order) {
+            if (results[i].sectorTimes[s]) ranked.push_back(i);
+        }
+        std::sort(ranked.begin(), ranked.end(), [&](size_t a, size_t b) {
+            return results[a].sectorTimes[s] < results[b].sectorTimes[s];
+        });
+
+        printf("\nSector %u (%.0f-%.0f m)\n", s + 1, reference.distance.back() * s / options.sectors,
+               reference.distance.back() * (s + 1) / options.sectors);
+        for (size_t k = 0; k < ranked.size() && k < options.top; k++) {
+            const Lap& lap = laps[ranked[k]];
+            printf("  %2zu. %8.3f s  %s lap %u\n", k + 1, results[ranked[k]].sectorTimes[s] / 1000.0,
+                   lap.source.c_str(), lap.number);
+        }
+        if (!ranked.empty()) {
+            theoretical += results[ranked[0]].sectorTimes[s];
+        }
+    }
+    printf("\nTheoretical best: ");
+    printTime(theoretical);
+
+    double loadSeconds = std::chrono::duration<double>(loaded - started).count();
+    double analyseSeconds = std::chrono::duration<double>(analysed - loaded).count();
+    size_t points = 0;
+    for (const Lap& lap : laps) points += lap.points.size();
+    printf("\n\n%zu captures, %zu laps, %zu fixes on %u threads\n", options.files.size(), laps.size(),
+           points, pool.size());
+    printf("load %.3f s, analyse %.3f s: %.0f laps/s, %.0f fixes/s\n", loadSeconds, analyseSeconds,
+           laps.size() / analyseSeconds, points / analyseSeconds);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <stddef.h>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fork-join pool with work stealing. Each worker starts with a contiguous
+ * slice of the indices and takes from the back of its own deque; an idle
+ * worker steals from the front of the others, so a few slow laps (long
+ * captures, many off-line points) do not leave cores idle.
+ */
+class WorkPool {
+public:
+    explicit WorkPool(unsigned threads = 0)
+        : threadCount(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+    unsigned size() const { return threadCount; }
+
+    // Calls fn(index, worker) for every index in [0, count)
+    template<typename Fn>
+    void run(size_t count, Fn fn) {
+        std::vector<Queue> queues(threadCount);
+        for (unsigned w = 0; w < threadCount; w++) {
+            size_t first = count * w / threadCount;
+            size_t last = count * (w + 1) / threadCount;
+            for (size_t i = first; i < last; i++) {
+                queues[w].items.push_back(i);
+            }
+        }
+
+        std::vector<std::thread> threads;
+        for (unsigned w = 0; w < threadCount; w++) {
+            threads.emplace_back([&queues, &fn, w, this]() {
+                size_t index;
+                while (take(queues, w, &index)) {
+                    fn(index, w);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> items;
+    };
+
+    unsigned threadCount;
+
+    bool take(std::vector<Queue>& queues, unsigned worker, size_t* index) {
+        {
+            Queue& own = queues[worker];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.items.empty()) {
+                *index = own.items.back();
+                own.items.pop_back();
+                return true;
+            }
+        }
+        // Nothing is ever added after start, so one empty pass means done
+        for (unsigned i = 1; i < threadCount; i++) {
+            Queue& victim = queues[(worker + i) % threadCount];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.items.empty()) {
+                *index = victim.items.front();
+                victim.items.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+};
@@ -0,0 +1,291 @@
+#!/usr/bin/env python3
+"""Decoder for the binary live telemetry stream.
+
+Send "telemetry on" to the logger, then point this at the USB CDC device
+(or a pty, or a captured file):
+
+    python3 tools/telemetry_decode.py /dev/ttyACM0
+    python3 tools/telemetry_decode.py capture.bin --csv > session.csv
+    python3 tools/telemetry_decode.py /dev/ttyACM0 --elf .pio/build/esp32s3/firmware.elf
+
+Frames are COBS-encoded and end in a zero byte. Each decoded packet is
+[type][sequence][payload][CRC16-CCITT little endian]. Text output from the
+firmware on the same port is skipped, as are frames that fail the CRC.
+Channel packets carry a short run of samples of one registry channel
+(include/channels/channel_registry.h) and decode to one dict per packet.
+Log packets carry the address of their format string; with --elf they are
+formatted here the way the firmware would have (see include/util/log.h).
+The Decoder class can be imported by other tools.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+PACKET_STATE = 1
+PACKET_LAP = 2
+PACKET_SECTOR = 3
+PACKET_HEALTH = 4
+PACKET_LOG = 5
+PACKET_CHANNEL = 6
+
+LOG_LEVELS = "-EWID"
+
+LAYOUTS = {
+    PACKET_STATE: ("state", "<IiiihhhhIiBB",
+                   ["timestamp", "lat", "lon", "speed", "accel_x", "accel_y",
+                    "accel_z", "gyro_z", "lap_time", "delta", "fix_type", "satellites"]),
+    PACKET_LAP: ("lap", "<IHIB", ["timestamp", "lap", "lap_time", "is_best"]),
+    PACKET_SECTOR: ("sector", "<IBI", ["timestamp", "sector", "time"]),
+    PACKET_HEALTH: ("health", "<IIIIII",
+                    ["timestamp", "frames_sent", "dropped_state",
+                     "dropped_health", "dropped_event", "free_heap"]),
+}
+
+
+def crc16(data, crc=0xFFFF):
+    # CRC-16/CCITT-FALSE, matches crc::crc16 in include/util/crc.h
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(frame):
+    out = bytearray()
+    i = 0
+    while i < len(frame):
+        code = frame[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(frame):
+            return None
+        out += frame[i:i + code - 1]
+        i += code - 1
+        if code != 0xFF and i < len(frame):
+            out.append(0)
+    return bytes(out)
+
+
+def scale(name, values):
+    # Fixed point on the wire, SI-ish units in the output
+    if name == "state":
+        values["lat"] /= 1e7
+        values["lon"] /= 1e7
+        values["speed"] /= 1000.0          # m/s
+        for axis in ("accel_x", "accel_y", "accel_z"):
+            values[axis] /= 1000.0         # g
+        values["gyro_z"] /= 100.0          # deg/s
+    return values
+
+
+class FormatTable:
+    """Resolves format string addresses against the firmware ELF."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.image = f.read()
+        if self.image[:4] != b"\x7fELF" or self.image[4] != 1:
+            raise ValueError("%s is not a 32-bit ELF file" % path)
+        shoff, = struct.unpack_from("<I", self.image, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.image, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            _, kind, flags, addr, offset, size = struct.unpack_from(
+                "<IIIIII", self.image, shoff + i * shentsize)
+            # Allocated and backed by file contents (not .bss)
+            if flags & 0x2 and kind != 8 and size:
+                self.sections.append((addr, offset, size))
+        self.cache = {}
+
+    def lookup(self, address):
+        if address not in self.cache:
+            text = None
+            for addr, offset, size in self.sections:
+                if addr <= address < addr + size:
+                    start = offset + address - addr
+                    end = self.image.find(b"\0", start, offset + size)
+                    text = self.image[start:end].decode("utf-8", "replace")
+                    break
+            self.cache[address] = text
+        return self.cache[address]
+
+
+def format_log(fmt, args):
+    # Mirrors logging::format(): consume argument bytes per conversion, with
+    # the device's 4-byte long, size_t and pointers
+    out = []
+    offset = 0
+    spec = re.compile(r"%([-+ #0-9.]*)(hh|h|ll|l|L|q|j|z|t)?([diuxXocfFeEgGaAsp%])")
+    pos = 0
+    for match in spec.finditer(fmt):
+        out.append(fmt[pos:match.start()])
+        pos = match.end()
+        flags, length, conv = match.groups()
+        try:
+            if conv == "%":
+                out.append("%")
+            elif conv in "diuxXoc":
+                wide = length in ("ll", "j", "q", "L")
+                code = ("<q" if wide else "<i") if conv in "di" else ("<Q" if wide else "<I")
+                value, = struct.unpack_from(code, args, offset)
+                offset += 8 if wide else 4
+                out.append(("%" + flags + conv) % (chr(value & 0xFF) if conv == "c" else value))
+            elif conv in "fFeEgGaA":
+                value, = struct.unpack_from("<d", args, offset)
+                offset += 8
+                out.append(("%" + flags + (conv if conv not in "aA" else "e")) % value)
+            elif conv == "s":
+                n = args[offset]
+                text = args[offset + 1:offset + 1 + n].decode("utf-8", "replace")
+                offset += 1 + n
+                out.append(("%" + flags + "s") % text)
+            elif conv == "p":
+                value, = struct.unpack_from("<I", args, offset)
+                offset += 4
+                out.append("0x%08x" % value)
+        except (struct.error, IndexError):
+            out.append("<?>")
+            return "".join(out)
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+class Decoder:
+    """Feed raw bytes, get decoded packets back as (name, seq, dict)."""
+
+    MAX_FRAME = 256
+
+    def __init__(self, formats=None):
+        self.formats = formats
+        self.buffer = bytearray()
+        self.crc_errors = 0
+        self.lost = 0
+        self.last_seq = None
+
+    def feed(self, data):
+        packets = []
+        for byte in data:
+            if byte != 0:
+                if len(self.buffer) < self.MAX_FRAME:
+                    self.buffer.append(byte)
+                continue
+            frame, self.buffer = bytes(self.buffer), bytearray()
+            packet = self._decode(frame)
+            if packet:
+                packets.append(packet)
+        return packets
+
+    def _log(self, payload):
+        micros, token, level = struct.unpack_from("<IIB", payload)
+        fmt = self.formats.lookup(token) if self.formats else None
+        text = format_log(fmt, payload[9:]) if fmt is not None else \
+            "token=0x%08x args=%s" % (token, payload[9:].hex())
+        return {"time": "%.6f" % (micros / 1e6),
+                "level": LOG_LEVELS[level] if level < len(LOG_LEVELS) else "?",
+                "text": text}
+
+    def _channel(self, payload):
+        channel, count, base = struct.unpack_from("<BBI", payload)
+        if len(payload) != 6 + 6 * count:
+            return None
+        samples = []
+        for i in range(count):
+            offset, value = struct.unpack_from("<Hf", payload, 6 + 6 * i)
+            samples.append(((base + offset * 100) & 0xFFFFFFFF, value))
+        return {"channel": channel,
+                "samples": " ".join("%.4f:%g" % (t / 1e6, v) for t, v in samples)}
+
+    def _decode(self, frame):
+        raw = cobs_decode(frame) if frame else None
+        if raw is None or len(raw) < 4:
+            return None  # Text or a torn frame
+        body, crc = raw[:-2], struct.unpack("<H", raw[-2:])[0]
+        if crc16(body) != crc:
+            self.crc_errors += 1
+            return None
+
+        kind, seq = body[0], body[1]
+        # Events overtake queued state frames, so a sequence number from
+        # behind is a late arrival filling an earlier gap, not a wrap
+        if self.last_seq is None:
+            self.last_seq = seq
+        else:
+            step = (seq - self.last_seq) & 0xFF
+            if step < 0x80:
+                self.lost += step - 1
+                self.last_seq = seq
+            elif self.lost > 0:
+                self.lost -= 1
+
+        if kind == PACKET_LOG and len(body) >= 11:
+            return ("log", seq, self._log(body[2:]))
+        if kind == PACKET_CHANNEL and len(body) >= 8:
+            values = self._channel(body[2:])
+            if values is None:
+                self.crc_errors += 1
+                return None
+            return ("channel", seq, values)
+
+        layout = LAYOUTS.get(kind)
+        if layout is None:
+            return ("unknown_%d" % kind, seq, {"payload": body[2:].hex()})
+        name, fmt, fields = layout
+        if len(body) - 2 != struct.calcsize(fmt):
+            self.crc_errors += 1
+            return None
+        values = dict(zip(fields, struct.unpack(fmt, body[2:])))
+        return (name, seq, scale(name, values))
+
+
+def open_source(path):
+    if path == "-":
+        return sys.stdin.buffer
+    source = open(path, "rb", buffering=0)
+    if os.isatty(source.fileno()):
+        import termios
+        import tty
+        tty.setraw(source.fileno(), termios.TCSANOW)
+    return source
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("source", help="serial device, pty, capture file or - for stdin")
+    parser.add_argument("--csv", action="store_true", help="print state packets as CSV")
+    parser.add_argument("--elf", help="firmware ELF used to format log packets")
+    args = parser.parse_args()
+
+    source = open_source(args.source)
+    decoder = Decoder(FormatTable(args.elf) if args.elf else None)
+    if args.csv:
+        print(",".join(LAYOUTS[PACKET_STATE][2]))
+
+    try:
+        while True:
+            data = source.read(4096)
+            if not data:
+                break
+            for name, seq, values in decoder.feed(data):
+                if args.csv:
+                    if name == "log":
+                        sys.stderr.write("[%(level)s %(time)s] %(text)s\n" % values)
+                    elif name == "state":
+                        print(",".join(str(values[f]) for f in LAYOUTS[PACKET_STATE][2]))
+                elif name == "log":
+                    print("[%(level)s %(time)s] %(text)s" % values)
+                else:
+                    print("%-7s %3d %s" % (name, seq, " ".join(
+                        "%s=%s" % item for item in values.items())))
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+
+    sys.stderr.write("crc errors: %d, lost frames: %d\n" % (decoder.crc_errors, decoder.lost))
+
+
+if __name__ == "__main__":
+    main()
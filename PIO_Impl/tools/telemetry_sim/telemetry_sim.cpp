@@ -0,0 +1,381 @@
+/**
+ * The firmware's telemetry stream on a pseudo-terminal.
+ *
+ * Waits for "telemetry on" like the device, then sends a fixed script
+ * through Telemetry: state samples every step, channel runs of one to
+ * MAX_CHANNEL_SAMPLES samples, sector and lap events, health packets and
+ * tokenized log records with the largest argument payloads the log ring
+ * produces. Text lines go out between frames, as the firmware's own
+ * output does. The pty path is printed on the first line of stdout; after
+ * the script the stream ends with a line "END".
+ *
+ * --expect FILE writes one JSON object per packet sent, in send order,
+ * with its sequence number and the values a decoder should produce,
+ * followed by a summary of drops and faults. tools/telemetry_test.py
+ * compares tools/telemetry_decode.py's output against it.
+ *
+ * Faults:
+ *   --corrupt N   flips a byte in every Nth frame written
+ *   --rate B      caps the link at B bytes/s and runs the script in real
+ *                 time, so the queues overflow and drop by priority;
+ *                 without it the script waits for the reader instead
+ *
+ * Build from PIO_Impl/:
+ *   g++ -std=gnu++17 -O2 -Iinclude tools/telemetry_sim/telemetry_sim.cpp src/telemetry/telemetry.cpp
+ *       src/util/log.cpp -o telemetry_sim
+ *
+ * Usage:
+ *   telemetry_sim [--steps N] [--text N] [--corrupt N] [--rate BYTES_PER_S] [--expect FILE]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include "telemetry/telemetry.h"
+
+namespace {
+
+    const char* const LOG_FORMAT = "Lap %u sector %d at %.3f s on %s";
+    const char* const TRACK = "Autodromo Nazionale Monza GP Circuit";   // Cut to logging::MAX_STRING
+
+    uint64_t wallUs() {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    class PtyLink : public ByteLink {
+    public:
+        int fd = -1;
+        uint32_t corruptEvery = 0;
+        uint32_t rate = 0;
+        uint64_t frames = 0;
+        uint64_t corrupted = 0;
+        uint64_t written = 0;
+        uint64_t startUs = 0;
+        bool blocked = false;
+        bool atBoundary = true;    // Last byte written ended a frame
+
+        size_t read(uint8_t* data, size_t max) override {
+            ssize_t n = ::read(fd, data, max);
+            return n > 0 ? n : 0;
+        }
+
+        size_t write(const uint8_t* data, size_t length) override {
+            if (rate) {
+                uint64_t allowed = (wallUs() - startUs) * rate / 1000000;
+                if (written >= allowed) {
+                    blocked = true;
+                    return 0;
+                }
+                if (length > allowed - written) length = allowed - written;
+            }
+            uint8_t copy[256];
+            if (length > sizeof(copy)) length = sizeof(copy);
+            memcpy(copy, data, length);
+            // Count frames by their delimiters; damage one byte in every Nth
+            for (size_t i = 0; i < length; i++) {
+                if (copy[i] == 0 && corruptEvery && ++frames % corruptEvery == 0 && i > 0) {
+                    copy[i - 1] ^= copy[i - 1] == 0x55 ? 0x0F : 0x55;
+                    corrupted++;
+                }
+            }
+            ssize_t n = ::write(fd, copy, length);
+            if (n <= 0) {
+                blocked = true;
+                return 0;
+            }
+            blocked = (size_t)n < length;
+            written += n;
+            atBoundary = copy[n - 1] == 0;
+            return n;
+        }
+
+        // Text the way Serial.print sends it, all of it
+        void text(const char* line) {
+            size_t length = strlen(line);
+            while (length > 0) {
+                ssize_t n = ::write(fd, line, length);
+                if (n > 0) {
+                    line += n;
+                    length -= n;
+                    written += n;
+                } else {
+                    struct pollfd out = { fd, POLLOUT, 0 };
+                    poll(&out, 1, 10);
+                }
+            }
+        }
+    };
+
+    bool readLine(int fd, std::string& line) {
+        char c;
+        while (::read(fd, &c, 1) == 1) {
+            if (c == '\n' || c == '\r') {
+                if (!line.empty()) return true;
+                continue;
+            }
+            if (c != 0 && line.size() < 64) line += c;
+        }
+        return false;
+    }
+
+    // Expected packets, as telemetry_decode.py reports them
+    struct Expect {
+        FILE* file = nullptr;
+        int sequence = 0;          // Telemetry numbers every packet it queues
+
+        void packet(const char* name, const char* values) {
+            if (file) {
+                fprintf(file, "{\"seq\": %d, \"name\": \"%s\", \"values\": {%s}}\n", sequence & 0xFF, name, values);
+            }
+            sequence++;
+        }
+    };
+
+    void sendState(Telemetry& telemetry, Expect& expect, uint32_t step) {
+        // Integers on the wire, chosen so the float inputs round back to them
+        int32_t latE7 = 480000000 + (int32_t)step * 37;
+        int32_t lonE7 = 110000000 - (int32_t)step * 53;
+        int32_t speedMm = 20000 + (int32_t)(step % 50000);
+        int16_t mg[3] = { (int16_t)(step % 2000 - 1000), (int16_t)(500 - step % 1000), 1000 };
+        int16_t gyroCentiDeg = (int16_t)((step * 7) % 20000 - 10000);
+
+        TelemetryState state = {};
+        state.timestamp = step;
+        state.latitude = latE7 / 1e7;
+        state.longitude = lonE7 / 1e7;
+        state.speed = speedMm / 1000.0;
+        state.accelX = mg[0] * 9.80665f / 1000.0f;
+        state.accelY = mg[1] * 9.80665f / 1000.0f;
+        state.accelZ = mg[2] * 9.80665f / 1000.0f;
+        state.gyroZ = gyroCentiDeg / 5729.578f;
+        state.lapTime = step * 10;
+        state.delta = (int32_t)(step % 3000) - 1500;
+        state.fixType = 3;
+        state.satellites = step % 30;
+        telemetry.sendState(state);
+
+        char values[512];
+        snprintf(values, sizeof(values),
+                 "\"timestamp\": %u, \"lat\": %.7f, \"lon\": %.7f, \"speed\": %.3f, \"accel_x\": %.3f, "
+                 "\"accel_y\": %.3f, \"accel_z\": %.3f, \"gyro_z\": %.2f, \"lap_time\": %u, \"delta\": %d, "
+                 "\"fix_type\": 3, \"satellites\": %u",
+                 step, latE7 / 1e7, lonE7 / 1e7, speedMm / 1000.0, mg[0] / 1000.0, mg[1] / 1000.0,
+                 mg[2] / 1000.0, gyroCentiDeg / 100.0, step * 10, state.delta, step % 30);
+        expect.packet("state", values);
+    }
+
+    void sendChannel(Telemetry& telemetry, Expect& expect, uint32_t step) {
+        ChannelSample samples[Telemetry::MAX_CHANNEL_SAMPLES];
+        size_t count = 1 + step % Telemetry::MAX_CHANNEL_SAMPLES;
+        uint8_t id = 1 + step % 40;
+        std::string list;
+        for (size_t i = 0; i < count; i++) {
+            // Multiples of the 100 us wire step
+            samples[i].timeUs = step * 1000 + i * 1200;
+            samples[i].value = (float)(sin(step + i) * 1000.0);
+            char sample[64];
+            snprintf(sample, sizeof(sample), "%s[%u, %.9g]", i ? ", " : "", (unsigned)samples[i].timeUs,
+                     samples[i].value);
+            list += sample;
+        }
+        telemetry.sendChannel(id, samples, count);
+
+        char values[512];
+        snprintf(values, sizeof(values), "\"channel\": %u, \"samples\": [%s]", id, list.c_str());
+        expect.packet("channel", values);
+    }
+
+    void sendLog(Telemetry& telemetry, Expect& expect, uint32_t step) {
+        unsigned int lap = step / 75;
+        int sector = step % 3 + 1;
+        double at = step / 1000.0;
+        LOG_INFO(LOG_FORMAT, lap, sector, at, TRACK);
+        logging::Record record;
+        if (!logging::pop(record)) {
+            return;
+        }
+        telemetry.sendLog(record);
+
+        char track[logging::MAX_STRING + 1];
+        snprintf(track, sizeof(track), "%.*s", (int)logging::MAX_STRING, TRACK);
+        char text[128];
+        snprintf(text, sizeof(text), LOG_FORMAT, lap, sector, at, track);
+        char values[512];
+        snprintf(values, sizeof(values), "\"level\": \"I\", \"text\": \"%s\", \"token\": %u, \"format\": \"%s\"",
+                 text, (unsigned)(uintptr_t)record.format, LOG_FORMAT);
+        expect.packet("log", values);
+    }
+
+    void step(Telemetry& telemetry, Expect& expect, uint32_t i) {
+        char values[256];
+        sendState(telemetry, expect, i);
+        if (i % 5 == 0) {
+            sendChannel(telemetry, expect, i);
+        }
+        if (i % 25 == 0) {
+            telemetry.sendSector(i % 3, 20000 + i);
+            snprintf(values, sizeof(values), "\"sector\": %u, \"time\": %u", i % 3, 20000 + i);
+            expect.packet("sector", values);
+        }
+        if (i % 75 == 0) {
+            uint16_t lap = i / 75;
+            telemetry.sendLap(lap, 60000 + i, lap % 3 == 0);
+            snprintf(values, sizeof(values), "\"lap\": %u, \"lap_time\": %u, \"is_best\": %u", lap, 60000 + i,
+                     lap % 3 == 0);
+            expect.packet("lap", values);
+        }
+        if (i % 40 == 0) {
+            sendLog(telemetry, expect, i);
+        }
+        if (i % 100 == 0) {
+            snprintf(values, sizeof(values),
+                     "\"frames_sent\": %u, \"dropped_state\": %u, \"dropped_health\": %u, \"dropped_event\": %u, "
+                     "\"free_heap\": 0",
+                     (unsigned)telemetry.getFramesSent(), (unsigned)telemetry.getDropped(Telemetry::PRIORITY_STATE),
+                     (unsigned)telemetry.getDropped(Telemetry::PRIORITY_HEALTH),
+                     (unsigned)telemetry.getDropped(Telemetry::PRIORITY_EVENT));
+            telemetry.sendHealth();
+            expect.packet("health", values);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t steps = 5000;
+    uint32_t textEvery = 0;
+    uint32_t corrupt = 0;
+    uint32_t rate = 0;
+    const char* expectPath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--steps") && i + 1 < argc) steps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--text") && i + 1 < argc) textEvery = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--corrupt") && i + 1 < argc) corrupt = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--rate") && i + 1 < argc) rate = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--expect") && i + 1 < argc) expectPath = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [--steps N] [--text N] [--corrupt N] [--rate BYTES_PER_S] [--expect FILE]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    Expect expect;
+    if (expectPath && !(expect.file = fopen(expectPath, "w"))) {
+        perror(expectPath);
+        return 1;
+    }
+
+    PtyLink link;
+    link.fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (link.fd < 0 || grantpt(link.fd) || unlockpt(link.fd)) {
+        perror("pty");
+        return 1;
+    }
+    // Raw mode on the terminal side, held open so the pty survives clients
+    int slave = open(ptsname(link.fd), O_RDWR | O_NOCTTY);
+    struct termios mode;
+    tcgetattr(slave, &mode);
+    cfmakeraw(&mode);
+    tcsetattr(slave, TCSANOW, &mode);
+    fcntl(link.fd, F_SETFL, O_NONBLOCK);
+    link.corruptEvery = corrupt;
+    link.rate = rate;
+    printf("PTY %s\n", ptsname(link.fd));
+    fflush(stdout);
+
+    std::string line;
+    while (line != "telemetry on") {
+        line.clear();
+        struct pollfd p = { link.fd, POLLIN, 0 };
+        poll(&p, 1, 100);
+        readLine(link.fd, line);
+    }
+
+    Telemetry telemetry(link);
+    telemetry.setEnabled(true);
+    link.startUs = wallUs();
+    uint64_t begin = wallUs();
+    uint32_t textLines = 0;
+    bool textPending = false;
+    for (uint32_t i = 0; i < steps; i++) {
+        step(telemetry, expect, i);
+        textPending |= textEvery && i % textEvery == 0;
+        if (rate) {
+            // The device's pace, 1 kHz, whether or not the link keeps up
+            while (wallUs() - begin < (uint64_t)(i + 1) * 1000) {
+                telemetry.service();
+                if (textPending && link.atBoundary) {
+                    link.text("Text from the firmware\r\n");
+                    textPending = false;
+                    textLines++;
+                }
+            }
+            continue;
+        }
+        // The reader's pace: everything queued goes out before the next step
+        do {
+            telemetry.service();
+            if (link.blocked) {
+                struct pollfd out = { link.fd, POLLOUT, 0 };
+                poll(&out, 1, 10);
+                link.blocked = false;
+            }
+        } while (!link.atBoundary || telemetry.getFramesSent() < (uint32_t)expect.sequence);
+        if (textPending) {
+            link.text("Text from the firmware\r\n");
+            textPending = false;
+            textLines++;
+        }
+    }
+    // What is still queued at the end goes out too
+    uint64_t drainUntil = wallUs() + 2000000;
+    while (wallUs() < drainUntil && telemetry.getFramesSent() +
+                                        telemetry.getDropped(Telemetry::PRIORITY_STATE) +
+                                        telemetry.getDropped(Telemetry::PRIORITY_HEALTH) +
+                                        telemetry.getDropped(Telemetry::PRIORITY_EVENT) < (uint32_t)expect.sequence) {
+        telemetry.service();
+        struct pollfd out = { link.fd, POLLOUT, 0 };
+        poll(&out, 1, 1);
+    }
+    double seconds = (wallUs() - begin) / 1e6;
+
+    fprintf(stderr, "telemetry: %u packets, %u frames sent in %.2f s, %u bytes, dropped %u/%u/%u, "
+                    "%u corrupted, %u text lines, %u oversized\n",
+            (unsigned)expect.sequence, (unsigned)telemetry.getFramesSent(), seconds, (unsigned)link.written,
+            (unsigned)telemetry.getDropped(Telemetry::PRIORITY_STATE),
+            (unsigned)telemetry.getDropped(Telemetry::PRIORITY_HEALTH),
+            (unsigned)telemetry.getDropped(Telemetry::PRIORITY_EVENT), (unsigned)link.corrupted, textLines,
+            (unsigned)telemetry.getOversized());
+    if (expect.file) {
+        fprintf(expect.file,
+                "{\"summary\": {\"packets\": %u, \"frames_sent\": %u, \"dropped_state\": %u, \"dropped_health\": %u, "
+                "\"dropped_event\": %u, \"corrupted\": %u, \"text\": %u, \"oversized\": %u}}\n",
+                (unsigned)expect.sequence, (unsigned)telemetry.getFramesSent(),
+                (unsigned)telemetry.getDropped(Telemetry::PRIORITY_STATE),
+                (unsigned)telemetry.getDropped(Telemetry::PRIORITY_HEALTH),
+                (unsigned)telemetry.getDropped(Telemetry::PRIORITY_EVENT), (unsigned)link.corrupted, textLines,
+                (unsigned)telemetry.getOversized());
+        fclose(expect.file);
+    }
+    link.text("END\n");
+
+    // Until the reader says so, so nothing in the pty is lost
+    line.clear();
+    uint64_t quitBy = wallUs() + 10000000;
+    while (line != "quit" && wallUs() < quitBy) {
+        line.clear();
+        struct pollfd p = { link.fd, POLLIN, 0 };
+        poll(&p, 1, 100);
+        readLine(link.fd, line);
+    }
+    close(slave);
+    close(link.fd);
+    return 0;
+}
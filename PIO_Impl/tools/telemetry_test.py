@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""End-to-end test of the live telemetry stream over a pseudo-terminal.
+
+Runs telemetry_sim (build line in tools/telemetry_sim/telemetry_sim.cpp)
+and decodes what it sends with telemetry_decode.py:
+
+    python3 tools/telemetry_test.py ./telemetry_sim
+
+Three runs: one paced by the reader with firmware text between frames,
+one with damaged frames, and one on a link too slow for the stream. Every
+packet that decodes must carry exactly what the simulator sent under its
+sequence number, including log records with the largest argument payload
+and channel packets with the most samples. What does not arrive must be
+accounted for: each text line costs the frame it runs into, each damaged
+frame is lost, and on the slow link only state and health packets are
+dropped, never events. Exits non-zero on failure.
+"""
+
+import argparse
+import json
+import math
+import os
+import select
+import shutil
+import subprocess
+import sys
+import tempfile
+import termios
+import time
+import tty
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import telemetry_decode  # noqa: E402
+
+
+def check(condition, message):
+    if not condition:
+        sys.exit("FAIL: " + message)
+    print("ok: " + message)
+
+
+class Formats:
+    """Format strings by token, as FormatTable finds them in the ELF."""
+
+    def __init__(self, expected):
+        self.table = {e["values"]["token"]: e["values"]["format"]
+                      for e in expected if e["name"] == "log"}
+
+    def lookup(self, address):
+        return self.table.get(address)
+
+
+def close(a, b):
+    return math.isclose(a, b, rel_tol=1e-6, abs_tol=1e-9)
+
+
+def matches(name, values, expected):
+    """The first difference between a decoded packet and what was sent, or None."""
+    for key, want in expected.items():
+        if key in ("token", "format"):
+            continue
+        got = values.get(key)
+        if name == "channel" and key == "samples":
+            pairs = [s.split(":") for s in got.split()]
+            if len(pairs) != len(want):
+                return "%d samples, sent %d" % (len(pairs), len(want))
+            for (t, v), (want_t, want_v) in zip(pairs, want):
+                # The decoder prints %g, six significant digits
+                if abs(float(t) * 1e6 - want_t) > 0.5 or not math.isclose(float(v), want_v, rel_tol=1e-5,
+                                                                             abs_tol=1e-3):
+                    return "sample %s:%s, sent %s:%s" % (t, v, want_t, want_v)
+        elif isinstance(want, float):
+            if got is None or not close(float(got), want):
+                return "%s=%s, sent %s" % (key, got, want)
+        elif got != want:
+            return "%s=%r, sent %r" % (key, got, want)
+    return None
+
+
+def run(sim, work, label, options):
+    expect = os.path.join(work, label + ".jsonl")
+    proc = subprocess.Popen([sim, "--expect", expect] + options, stdout=subprocess.PIPE, text=True)
+    try:
+        line = proc.stdout.readline().split()
+        check(len(line) == 2 and line[0] == "PTY", "%s: simulator is up" % label)
+        fd = os.open(line[1], os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(fd, termios.TCSANOW)
+        os.write(fd, b"telemetry on\n")
+
+        raw = bytearray()
+        deadline = time.monotonic() + 60
+        while not raw.endswith(b"END\n") and time.monotonic() < deadline:
+            ready, _, _ = select.select([fd], [], [], 1.0)
+            if ready:
+                raw += os.read(fd, 65536)
+        check(raw.endswith(b"END\n"), "%s: stream ended" % label)
+        os.write(fd, b"quit\n")
+        proc.wait(5)
+        os.close(fd)
+    finally:
+        if proc.poll() is None:
+            proc.kill()
+
+    with open(expect) as f:
+        entries = [json.loads(line) for line in f]
+    summary = entries.pop()["summary"]
+    decoder = telemetry_decode.Decoder(Formats(entries))
+    packets = decoder.feed(bytes(raw))
+
+    # Sequence numbers wrap every 256 packets and events overtake queued
+    # state, so each packet is matched near where the last one was
+    matched = [False] * len(entries)
+    base = 0
+    wrong = 0
+    for name, seq, values in packets:
+        found = None
+        for i in range(max(0, base - 64), min(len(entries), base + 128)):
+            if not matched[i] and entries[i]["seq"] == seq and entries[i]["name"] == name:
+                found = i
+                break
+        if found is None:
+            wrong += 1
+            if wrong <= 5:
+                print("   unexpected %s %d %s" % (name, seq, values))
+            continue
+        matched[found] = True
+        base = max(base, found)
+        difference = matches(name, values, entries[found]["values"])
+        if difference:
+            wrong += 1
+            if wrong <= 5:
+                print("   %s %d: %s" % (name, seq, difference))
+
+    missing = [e for e, m in zip(entries, matched) if not m]
+    missing_events = sum(e["name"] in ("lap", "sector") for e in missing)
+    dropped = summary["dropped_state"] + summary["dropped_health"] + summary["dropped_event"]
+    print("   %d packets sent, %d decoded, %d missing; dropped %d/%d/%d, %d damaged, %d text lines, "
+          "%d crc errors" % (len(entries), len(packets), len(missing), summary["dropped_state"],
+                             summary["dropped_health"], summary["dropped_event"], summary["corrupted"],
+                             summary["text"], decoder.crc_errors))
+    check(summary["packets"] == len(entries) and summary["oversized"] == 0, "%s: every packet fit" % label)
+    check(wrong == 0, "%s: every decoded packet is what was sent" % label)
+    return summary, missing, missing_events, decoder
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("sim", help="path to the telemetry_sim binary")
+    parser.add_argument("--steps", default="5000", help="script length, one state packet per step")
+    args = parser.parse_args()
+
+    work = tempfile.mkdtemp(prefix="telemetry_test.")
+    try:
+        summary, missing, _, _ = run(args.sim, work, "clean", ["--steps", args.steps, "--text", "250"])
+        check(summary["text"] > 0, "%d text lines were sent" % summary["text"])
+        check(len(missing) == summary["text"], "only the frames text ran into are missing")
+
+        summary, missing, _, decoder = run(args.sim, work, "damaged", ["--steps", args.steps, "--corrupt", "37"])
+        check(summary["corrupted"] > 0 and decoder.crc_errors > 0,
+              "%d damaged frames were rejected" % summary["corrupted"])
+        check(len(missing) == summary["corrupted"], "only the damaged frames are missing")
+        check(decoder.lost == len(missing), "the decoder counted them as lost")
+
+        summary, missing, missing_events, _ = run(args.sim, work, "slow", ["--steps", "3000", "--rate", "20000"])
+        check(summary["dropped_state"] > 0, "%d state packets were dropped" % summary["dropped_state"])
+        check(summary["dropped_event"] == 0 and missing_events == 0, "no lap or sector event was dropped")
+        dropped = summary["dropped_state"] + summary["dropped_health"] + summary["dropped_event"]
+        check(len(missing) == dropped, "only the dropped packets are missing")
+        print("PASS")
+    finally:
+        shutil.rmtree(work)
+
+
+if __name__ == "__main__":
+    main()
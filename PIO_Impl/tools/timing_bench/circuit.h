@@ -0,0 +1,232 @@
+#pragma once
+#include <stdint.h>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "track/track_types.h"
+#include "calculations/track_geometry.h"
+
+// Shape and vehicle limits of a generated circuit
+struct CircuitParams {
+    float radius = 300.0f;        // Mean radius (m)
+    float lobes3 = 0.18f;         // Relative amplitude of the 3- and 5-lobe terms, they make the corners
+    float lobes5 = 0.07f;
+    float maxSpeed = 60.0f;       // m/s
+    float lateralAccel = 14.0f;   // m/s^2
+    float accel = 6.0f;           // m/s^2
+    float brake = 14.0f;          // m/s^2
+};
+
+/**
+ * Closed parametric circuit r(theta) = R (1 + a cos 3theta + b sin 5theta),
+ * resampled at a fixed arc length step, with a curvature-limited speed
+ * profile (lateral grip, then forward acceleration and backward braking
+ * passes around the loop).
+ */
+class Circuit {
+public:
+    static constexpr float STEP = 0.5f;   // Arc length between samples (m)
+
+    explicit Circuit(const CircuitParams& params = CircuitParams(), double originLat = 52.07, double originLon = -1.01)
+        : frame(originLat, originLon) {
+        // Dense polar samples, then equal arc length resampling
+        const int dense = 40000;
+        std::vector<double> px(dense + 1), py(dense + 1), arc(dense + 1, 0.0);
+        for (int i = 0; i <= dense; i++) {
+            double theta = 2 * M_PI * i / dense;
+            double r = params.radius * (1 + params.lobes3 * cos(3 * theta) + params.lobes5 * sin(5 * theta));
+            px[i] = r * cos(theta);
+            py[i] = r * sin(theta);
+            if (i > 0) arc[i] = arc[i - 1] + hypot(px[i] - px[i - 1], py[i] - py[i - 1]);
+        }
+        totalLength = (float)arc[dense];
+
+        size_t count = (size_t)(totalLength / STEP);
+        xs.resize(count);
+        ys.resize(count);
+        size_t j = 0;
+        for (size_t i = 0; i < count; i++) {
+            double s = i * STEP;
+            while (j + 1 < (size_t)dense && arc[j + 1] < s) j++;
+            double ratio = (s - arc[j]) / (arc[j + 1] - arc[j]);
+            xs[i] = (float)(px[j] + (px[j + 1] - px[j]) * ratio);
+            ys[i] = (float)(py[j] + (py[j + 1] - py[j]) * ratio);
+        }
+
+        // Curvature from the turn of the heading between neighbours
+        curvature.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            size_t prev = (i + count - 1) % count;
+            size_t next = (i + 1) % count;
+            double h1 = atan2(ys[i] - ys[prev], xs[i] - xs[prev]);
+            double h2 = atan2(ys[next] - ys[i], xs[next] - xs[i]);
+            double turn = remainder(h2 - h1, 2 * M_PI);
+            curvature[i] = (float)(turn / STEP);
+        }
+
+        speed.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            float k = fabsf(curvature[i]);
+            speed[i] = k > 1e-6f ? std::min(params.maxSpeed, sqrtf(params.lateralAccel / k)) : params.maxSpeed;
+        }
+        for (int pass = 0; pass < 2; pass++) {
+            for (size_t i = 0; i < count; i++) {
+                size_t next = (i + 1) % count;
+                speed[next] = std::min(speed[next], sqrtf(speed[i] * speed[i] + 2 * params.accel * STEP));
+            }
+            for (size_t i = count; i-- > 0;) {
+                size_t next = (i + 1) % count;
+                speed[i] = std::min(speed[i], sqrtf(speed[next] * speed[next] + 2 * params.brake * STEP));
+            }
+        }
+    }
+
+    float length() const { return totalLength; }
+    size_t samples() const { return xs.size(); }
+    float speedAt(size_t i) const { return speed[i % speed.size()]; }
+    float curvatureAt(size_t i) const { return curvature[i % curvature.size()]; }
+
+    // Local position at arc length s, wrapping around the lap
+    void position(float s, float* x, float* y) const {
+        float wrapped = fmodf(s, totalLength);
+        if (wrapped < 0) wrapped += totalLength;
+        float index = wrapped / STEP;
+        size_t i = (size_t)index % xs.size();
+        size_t next = (i + 1) % xs.size();
+        float ratio = index - floorf(index);
+        *x = xs[i] + (xs[next] - xs[i]) * ratio;
+        *y = ys[i] + (ys[next] - ys[i]) * ratio;
+    }
+
+    GpsPoint toGps(float x, float y, float radius = 4.0f) const {
+        GpsPoint point;
+        point.latitude = frame.originLat + y / geometry::METERS_PER_DEGREE;
+        point.longitude = frame.originLon + x / frame.metersPerDegLon;
+        point.isSet = true;
+        point.radius = radius;
+        return point;
+    }
+
+    GpsPoint gate(float s, float radius) const {
+        float x, y;
+        position(s, &x, &y);
+        return toGps(x, y, radius);
+    }
+
+private:
+    geometry::LocalFrame frame;
+    float totalLength;
+    std::vector<float> xs;
+    std::vector<float> ys;
+    std::vector<float> curvature;
+    std::vector<float> speed;
+};
+
+/**
+ * Ground truth for one lap: time from the start line to every circuit
+ * sample. The driver's pace scales the speed profile and varies along the
+ * lap, so laps differ by corner, not just overall.
+ */
+class LapPlan {
+public:
+    LapPlan(const Circuit& circuit, float pace, float variation, float phase) : circuit(&circuit) {
+        size_t count = circuit.samples();
+        time.resize(count + 1);
+        time[0] = 0;
+        double total = 0;
+        for (size_t i = 0; i < count; i++) {
+            total += Circuit::STEP / speedAt(i, pace, variation, phase);
+            time[i + 1] = total;
+        }
+        this->pace = pace;
+        this->variation = variation;
+        this->phase = phase;
+    }
+
+    double lapTime() const { return time.back(); }
+
+    // Seconds from the lap start to arc length s (0..length)
+    double timeAt(float s) const {
+        float index = std::max(0.0f, std::min(s / Circuit::STEP, (float)(time.size() - 1)));
+        size_t i = std::min((size_t)index, time.size() - 2);
+        return time[i] + (time[i + 1] - time[i]) * (index - i);
+    }
+
+    // Arc length reached t seconds after the lap start
+    float distanceAt(double t) const {
+        size_t i = std::upper_bound(time.begin(), time.end(), t) - time.begin();
+        if (i == 0) return 0;
+        if (i >= time.size()) return circuit->length();
+        double ratio = (t - time[i - 1]) / (time[i] - time[i - 1]);
+        return (float)((i - 1 + ratio) * Circuit::STEP);
+    }
+
+    float speedAt(float s) const {
+        return speedAt((size_t)(s / Circuit::STEP), pace, variation, phase);
+    }
+
+private:
+    const Circuit* circuit;
+    std::vector<double> time;
+    float pace;
+    float variation;
+    float phase;
+
+    float speedAt(size_t i, float pace, float variation, float phase) const {
+        float s = i * Circuit::STEP;
+        float local = 1 + variation * sinf(8 * (float)M_PI * s / circuit->length() + phase);
+        return circuit->speedAt(i) * pace * local;
+    }
+};
+
+/**
+ * A stint: a run-up to the line, then whole laps, then a short run-out
+ * past the line so the last lap completes.
+ */
+class Session {
+public:
+    static constexpr float RUN_UP = 150.0f;   // m before the line at t = 0
+
+    Session(const Circuit& circuit, std::vector<LapPlan> laps) : circuit(&circuit), plans(std::move(laps)) {
+        start.resize(plans.size());
+        // Run-up uses the first lap's pace over the end of the lap
+        double t = plans[0].lapTime() - plans[0].timeAt(circuit.length() - RUN_UP);
+        for (size_t k = 0; k < plans.size(); k++) {
+            start[k] = t;
+            t += plans[k].lapTime();
+        }
+        end = t + plans.back().timeAt(RUN_UP);
+    }
+
+    double duration() const { return end; }
+    size_t laps() const { return plans.size(); }
+    const LapPlan& lap(size_t k) const { return plans[k]; }
+    double lapStart(size_t k) const { return start[k]; }
+
+    // True state at time t: lap index (-1 on the run-up, laps() on the run-out) and arc length
+    void stateAt(double t, int* lap, float* s, float* speed) const {
+        if (t < start[0]) {
+            *lap = -1;
+            *s = plans[0].distanceAt(plans[0].timeAt(circuit->length() - RUN_UP) + t);
+            *speed = plans[0].speedAt(*s);
+            return;
+        }
+        size_t k = std::upper_bound(start.begin(), start.end(), t) - start.begin() - 1;
+        double inLap = t - start[k];
+        if (inLap >= plans[k].lapTime()) {
+            *lap = (int)plans.size();
+            *s = plans.back().distanceAt(inLap - plans[k].lapTime());
+            *speed = plans.back().speedAt(*s);
+            return;
+        }
+        *lap = (int)k;
+        *s = plans[k].distanceAt(inLap);
+        *speed = plans[k].speedAt(*s);
+    }
+
+private:
+    const Circuit* circuit;
+    std::vector<LapPlan> plans;
+    std::vector<double> start;
+    double end;
+};
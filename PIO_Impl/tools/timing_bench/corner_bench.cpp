@@ -0,0 +1,344 @@
+/**
+ * Corner segmentation accuracy and cost.
+ *
+ * Synthetic mode drives stints on the generated circuit through
+ * RacingEngine, the way the firmware does. Each row feeds a different
+ * motion source per fix: IMU accelerations, GNSS course, or positions
+ * only. The truth corners come from the circuit's exact lateral
+ * acceleration, with the same thresholds. For every lap after the learning
+ * laps the bench reports:
+ *   - how many truth corners were found and matched to the learned map;
+ *   - the apex position error;
+ *   - the minimum speed error against that lap's exact speed profile.
+ * Cost is CornerEngine::update alone, in ns per fix.
+ *
+ * Capture mode replays laps recorded with "telemetry on" (see
+ * tools/session_analytics) through CornerEngine. It prints the learned
+ * map and each lap's corners. Captured accelerations are in the sensor's
+ * mounting frame, so replay uses positions and speed only.
+ *
+ * Build from PIO_Impl/:
+ *   g++ -std=gnu++17 -O2 -Iinclude -Iinclude/calculations \
+ *       tools/timing_bench/corner_bench.cpp -o corner_bench
+ *
+ * Usage:
+ *   corner_bench [--laps N] [--seeds N]
+ *   corner_bench --capture capture.bin...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "circuit.h"
+#include "sensor_model.h"
+#include "../session_analytics/capture_reader.h"
+#include "calculations/racing_engine.h"
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // The gate triggers this far before the line, lap distances start there
+    const float GATE_RADIUS = 15.0f;
+
+    enum class Source { Imu, Course, Positions };
+
+    struct Config {
+        const char* name;
+        Source source;
+        GnssParams gnss;
+    };
+
+    struct TruthCorner {
+        float entry;
+        float apex;
+        float exit;
+        int8_t direction;
+    };
+
+    struct Errors {
+        std::vector<float> values;
+
+        void add(float error) { values.push_back(fabsf(error)); }
+
+        float percentile(float pct) {
+            if (values.empty()) return NAN;
+            std::sort(values.begin(), values.end());
+            return values[std::min(values.size() - 1, (size_t)(values.size() * pct / 100.0f))];
+        }
+    };
+
+    struct Result {
+        size_t mapSize = 0;
+        size_t expected = 0;       // Truth corners in the laps after learning
+        size_t found = 0;          // ... detected and matched to the right map corner
+        size_t spurious = 0;       // Other detections
+        Errors apex;
+        Errors minSpeed;
+        double ns = 0;
+        size_t samples = 0;
+    };
+
+    // Same hysteresis as CornerEngine on the exact lateral acceleration of
+    // the circuit's speed profile; apexes at the lowest speed
+    std::vector<TruthCorner> truthCorners(const Circuit& circuit) {
+        std::vector<TruthCorner> corners;
+        bool inCorner = false;
+        TruthCorner current = {};
+        float minSpeed = 0, below = NAN;
+        for (size_t i = 0; i < circuit.samples(); i++) {
+            float s = i * Circuit::STEP;
+            float v = circuit.speedAt(i);
+            float lateral = v * v * circuit.curvatureAt(i);
+            int8_t direction = lateral > 0 ? 1 : -1;
+            float magnitude = fabsf(lateral);
+            if (!inCorner) {
+                if (magnitude > CornerEngine::ENTER_LATERAL) {
+                    inCorner = true;
+                    current = { s, s, s, direction };
+                    minSpeed = v;
+                    below = NAN;
+                }
+                continue;
+            }
+            bool flip = magnitude > CornerEngine::ENTER_LATERAL && direction != current.direction;
+            if (!flip && v < minSpeed) {
+                minSpeed = v;
+                current.apex = s;
+            }
+            if (magnitude < CornerEngine::EXIT_LATERAL) {
+                if (std::isnan(below)) below = s;
+            } else {
+                below = NAN;
+            }
+            bool exited = !std::isnan(below) && s - below >= CornerEngine::EXIT_HOLD;
+            if (flip || exited) {
+                current.exit = flip ? s : below;
+                if (current.exit - current.entry >= CornerEngine::MIN_LENGTH) {
+                    corners.push_back(current);
+                }
+                inCorner = flip;
+                current = { s, s, s, direction };
+                minSpeed = v;
+                below = NAN;
+            }
+        }
+        return corners;
+    }
+
+    class Collector : public RacingListener {
+    public:
+        std::vector<CornerMetrics> corners;
+        void onCorner(const CornerMetrics& corner) override { corners.push_back(corner); }
+    };
+
+    void runStint(const Circuit& circuit, const std::vector<TruthCorner>& truth, const Config& config,
+                  uint32_t seed, size_t laps, Result& result) {
+        std::mt19937 rng(seed * 7919u);
+        std::uniform_real_distribution<float> pace(0.95f, 1.0f);
+        std::uniform_real_distribution<float> phase(0.0f, 6.283f);
+        std::vector<LapPlan> plans;
+        for (size_t k = 0; k < laps; k++) {
+            plans.emplace_back(circuit, pace(rng), 0.03f, phase(rng));
+        }
+        Session session(circuit, plans);
+        std::vector<GnssFix> fixes = generateFixes(circuit, session, config.gnss, seed);
+        std::vector<ImuSample> imu = generateImu(circuit, session, ImuParams(), seed + 1);
+
+        TimingGates gates;
+        gates.startFinish = circuit.gate(0, GATE_RADIUS);
+
+        TripleBuffer<RacingState> snapshots;
+        RacingEngine engine(snapshots);
+        Collector collector;
+        engine.setListener(&collector);
+        CornerEngine timed;   // Same input, for the cost figure
+        CornerMetrics ignored;
+        uint16_t lapCount = 0;
+        bool lapActive = false;
+
+        size_t next = 0;
+        for (const GnssFix& fix : fixes) {
+            // Latest IMU sample when the fix is processed
+            double seconds = (fix.deliveredMs - 5000) / 1000.0;
+            while (next + 1 < imu.size() && imu[next + 1].time <= seconds) next++;
+
+            CornerSample sample = { fix.deliveredMs, fix.position, fix.groundSpeed, NAN, NAN, NAN };
+            if (config.source != Source::Positions) sample.heading = fix.heading;
+            if (config.source == Source::Imu) {
+                sample.longitudinal = imu[next].accelLongitudinal;
+                sample.lateral = imu[next].accelLateral;
+            }
+            engine.updateMotion(sample.speed, sample.heading, sample.longitudinal, sample.lateral);
+            engine.update(fix.deliveredMs, fix.position, fix.speed, true, 12, 0, gates);
+
+            // Follow the engine's laps
+            const RacingState& state = engine.current();
+            if (state.lapCount != lapCount) timed.completeLap();
+            if (state.lapActive && (!lapActive || state.lapCount != lapCount)) timed.startLap();
+            lapCount = state.lapCount;
+            lapActive = state.lapActive;
+            Clock::time_point t0 = Clock::now();
+            timed.update(sample, &ignored);
+            result.ns += std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+            result.samples++;
+        }
+
+        const CornerMap& map = engine.cornerEngine().getMap();
+        result.mapSize += map.count;
+
+        // Map corner each truth corner was learned as, by apex
+        std::vector<int> mapIndex(truth.size());
+        for (size_t i = 0; i < truth.size(); i++) {
+            mapIndex[i] = map.match(truth[i].apex + GATE_RADIUS, truth[i].direction, CornerEngine::MATCH_TOLERANCE);
+        }
+
+        for (uint16_t lap = CornerEngine::LEARN_LAPS; lap < laps; lap++) {
+            const LapPlan& plan = plans[lap];
+            result.expected += truth.size();
+            std::vector<bool> seen(truth.size(), false);
+            for (const CornerMetrics& m : collector.corners) {
+                if (m.lap != lap) continue;
+                int t = -1;
+                for (size_t i = 0; i < truth.size(); i++) {
+                    if (truth[i].direction == m.direction &&
+                        fabsf(truth[i].apex + GATE_RADIUS - m.apexDistance) <= CornerEngine::MATCH_TOLERANCE) {
+                        t = (int)i;
+                    }
+                }
+                if (t < 0 || seen[t] || m.corner == CornerMetrics::UNMATCHED || m.corner != mapIndex[t]) {
+                    result.spurious++;   // Noise, or one corner split in two
+                    continue;
+                }
+                seen[t] = true;
+                result.found++;
+
+                // Exact minimum of this lap's speed over the truth corner
+                float exactMin = INFINITY, exactApex = 0;
+                for (float s = truth[t].entry; s <= truth[t].exit; s += Circuit::STEP) {
+                    float v = plan.speedAt(s);
+                    if (v < exactMin) {
+                        exactMin = v;
+                        exactApex = s;
+                    }
+                }
+                result.apex.add(m.apexDistance - GATE_RADIUS - exactApex);
+                result.minSpeed.add((m.minSpeed - exactMin) * 3.6f);
+            }
+        }
+    }
+
+    int synthetic(size_t laps, uint32_t seeds) {
+        Circuit circuit;
+        std::vector<TruthCorner> truth = truthCorners(circuit);
+
+        GnssParams good;
+        good.noise = 0.5f;
+        good.drift = 0.3f;
+        GnssParams poor;
+        poor.rateHz = 10.0f;
+        poor.noise = 1.5f;
+        poor.drift = 1.0f;
+        poor.speedNoise = 0.3f;
+        poor.dropout = 0.05f;
+
+        const Config configs[] = {
+            { "imu 25Hz", Source::Imu, good },
+            { "course 25Hz", Source::Course, good },
+            { "positions 25Hz", Source::Positions, good },
+            { "imu 10Hz poor", Source::Imu, poor },
+            { "course 10Hz poor", Source::Course, poor },
+            { "positions 10Hz poor", Source::Positions, poor },
+        };
+
+        printf("Circuit %.0f m, %zu truth corners; %zu laps x %u seeds, first %u laps learn\n", circuit.length(),
+               truth.size(), laps, seeds, CornerEngine::LEARN_LAPS);
+        for (const TruthCorner& c : truth) {
+            printf("  %s %6.0f %6.0f %6.0f\n", c.direction > 0 ? "L" : "R", c.entry, c.apex, c.exit);
+        }
+        printf("\n%-22s %5s %7s %5s | %11s | %13s | %6s\n", "source", "map", "found", "extra", "apex m p50/95",
+               "vmin km/h p50/95", "ns/fix");
+        for (const Config& config : configs) {
+            Result result;
+            for (uint32_t seed = 1; seed <= seeds; seed++) {
+                runStint(circuit, truth, config, seed, laps, result);
+            }
+            printf("%-22s %5.1f %6.1f%% %5zu | %5.1f %5.1f | %6.2f %6.2f | %6.1f\n", config.name,
+                   (float)result.mapSize / seeds, 100.0f * result.found / std::max<size_t>(1, result.expected),
+                   result.spurious, result.apex.percentile(50), result.apex.percentile(95),
+                   result.minSpeed.percentile(50), result.minSpeed.percentile(95), result.ns / result.samples);
+        }
+        return 0;
+    }
+
+    int replay(const std::vector<std::string>& paths) {
+        std::vector<Lap> laps;
+        for (const std::string& path : paths) {
+            if (!capture::read(path, laps)) {
+                fprintf(stderr, "cannot read %s\n", path.c_str());
+                return 1;
+            }
+        }
+        if (laps.empty()) {
+            fprintf(stderr, "no laps in the captures\n");
+            return 1;
+        }
+
+        CornerEngine engine;
+        uint32_t lapStart = 0;     // Lap points are timed from their lap's start
+        for (const Lap& lap : laps) {
+            engine.startLap();
+            printf("%s lap %u, %.3f s\n", lap.source.c_str(), lap.number, lap.lapTime / 1000.0);
+            for (const TracePoint& point : lap.points) {
+                CornerSample sample = { lapStart + point.timestamp, point.position(), point.speed / 1000.0f, NAN, NAN, NAN };
+                CornerMetrics m;
+                if (engine.update(sample, &m)) {
+                    char index[4] = "--";
+                    if (m.corner != CornerMetrics::UNMATCHED) snprintf(index, sizeof(index), "%u", m.corner + 1);
+                    printf("  T%-2s %s %6.0f-%6.0f m  apex %6.0f  brake %6.0f  min %5.1f  exit %5.1f km/h  %4.1f g\n",
+                           index, m.direction > 0 ? "L" : "R", m.entryDistance, m.exitDistance, m.apexDistance,
+                           m.brakingPoint, m.minSpeed * 3.6f, m.exitSpeed * 3.6f, m.peakLateral / 9.81f);
+                }
+            }
+            engine.completeLap();
+            lapStart += lap.lapTime;
+        }
+
+        const CornerMap& map = engine.getMap();
+        printf("\ncorner map, %u corners\n", map.count);
+        for (uint8_t i = 0; i < map.count; i++) {
+            const CornerMap::Corner& c = map.corners[i];
+            printf("  T%-2u %s %6.0f %6.0f %6.0f  seen %u\n", i + 1, c.direction > 0 ? "L" : "R", c.entry, c.apex,
+                   c.exit, c.seen);
+        }
+        return 0;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    size_t laps = 10;
+    uint32_t seeds = 5;
+    std::vector<std::string> captures;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--laps") && i + 1 < argc) {
+            laps = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seeds") && i + 1 < argc) {
+            seeds = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--capture")) {
+            while (i + 1 < argc && argv[i + 1][0] != '-') captures.push_back(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--laps N] [--seeds N] | --capture capture.bin...\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!captures.empty()) {
+        return replay(captures);
+    }
+    if (laps <= CornerEngine::LEARN_LAPS) {
+        fprintf(stderr, "need more than %u laps\n", CornerEngine::LEARN_LAPS);
+        return 2;
+    }
+    return synthetic(laps, seeds);
+}
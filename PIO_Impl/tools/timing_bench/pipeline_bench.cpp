@@ -0,0 +1,202 @@
+/**
+ * Compute/render split of the racing display on the host.
+ *
+ * One std::thread plays the loop task: it feeds synthetic fixes into a
+ * RacingEngine at their delivery times, the engine publishing a RacingState
+ * per fix into the triple buffer. A second thread plays the render task:
+ * it wakes at the render period, takes the newest snapshot and spends a
+ * configurable time "drawing" it. Every snapshot the renderer sees is
+ * checked against what the engine published for that fix, so a torn or
+ * reordered hand-over shows up as an error.
+ *
+ * Time runs --speed times faster than real time; all reported times are in
+ * simulated milliseconds.
+ *
+ * Build from PIO_Impl/:
+ *   g++ -std=gnu++17 -O2 -pthread -Iinclude -Iinclude/calculations \
+ *       tools/timing_bench/pipeline_bench.cpp -o pipeline_bench
+ *
+ * Usage:
+ *   pipeline_bench [--laps N] [--rate HZ] [--render-ms MS] [--draw-ms MS] [--speed X]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "circuit.h"
+#include "sensor_model.h"
+#include "calculations/racing_engine.h"
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        size_t laps = 3;
+        float rateHz = 25;
+        float renderMs = 33;     // Render task period
+        float drawMs = 12;       // Display time per changed snapshot
+        float speed = 10;        // Simulated ms per wall ms
+    };
+
+    // What the engine published for a fix, recorded right after update()
+    struct Published {
+        uint32_t timestamp;
+        uint16_t lapCount;
+        int32_t delta;
+        Clock::time_point wall;
+    };
+
+    struct RenderStats {
+        size_t frames = 0;
+        size_t snapshots = 0;
+        size_t skipped = 0;        // Published but overtaken before the renderer looked
+        size_t mismatches = 0;
+        size_t reordered = 0;
+        std::vector<float> ageMs;  // Publish to start of drawing
+        uint16_t lastLapCount = 0;
+    };
+
+    float percentile(std::vector<float> values, float pct) {
+        if (values.empty()) return NAN;
+        std::sort(values.begin(), values.end());
+        return values[std::min(values.size() - 1, (size_t)(values.size() * pct / 100.0f))];
+    }
+
+    Clock::duration scaled(float simMs, float speed) {
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(simMs / speed));
+    }
+
+    float simMs(Clock::duration wall, float speed) {
+        return (float)(std::chrono::duration<double, std::milli>(wall).count() * speed);
+    }
+
+    // Stand-in for SPI transfers that keeps the core busy
+    void draw(Clock::duration cost) {
+        Clock::time_point end = Clock::now() + cost;
+        while (Clock::now() < end) {
+        }
+    }
+
+    void render(TripleBuffer<RacingState>& snapshots, const std::vector<Published>& published,
+                const std::atomic<size_t>& recorded, const std::atomic<bool>& done, const Options& options, RenderStats& stats) {
+        uint32_t lastSequence = 0;
+        Clock::time_point wake = Clock::now();
+        bool finished = false;
+        while (!finished) {
+            finished = done.load(std::memory_order_acquire);
+            stats.frames++;
+            if (snapshots.update()) {
+                const RacingState& s = snapshots.read();
+                if (s.sequence > 0) {
+                    // The record trails the snapshot by a few instructions
+                    while (recorded.load(std::memory_order_acquire) < s.sequence) {
+                    }
+                    const Published& expected = published[s.sequence - 1];
+                    if (s.timestamp != expected.timestamp || s.lapCount != expected.lapCount ||
+                        s.delta != expected.delta) {
+                        stats.mismatches++;
+                    }
+                    if (s.sequence <= lastSequence) {
+                        stats.reordered++;
+                    } else {
+                        stats.skipped += s.sequence - lastSequence - 1;
+                    }
+                    stats.ageMs.push_back(simMs(Clock::now() - expected.wall, options.speed));
+                    lastSequence = s.sequence;
+                    stats.lastLapCount = s.lapCount;
+                    stats.snapshots++;
+                    draw(scaled(options.drawMs, options.speed));
+                }
+            }
+            wake += scaled(options.renderMs, options.speed);
+            std::this_thread::sleep_until(wake);
+        }
+    }
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--laps") && i + 1 < argc) {
+            options.laps = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+            options.rateHz = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--render-ms") && i + 1 < argc) {
+            options.renderMs = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--draw-ms") && i + 1 < argc) {
+            options.drawMs = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--speed") && i + 1 < argc) {
+            options.speed = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--laps N] [--rate HZ] [--render-ms MS] [--draw-ms MS] [--speed X]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    Circuit circuit;
+    std::vector<LapPlan> plans;
+    for (size_t k = 0; k < options.laps; k++) {
+        plans.emplace_back(circuit, 0.97f, 0.03f, (float)k);
+    }
+    Session session(circuit, plans);
+    GnssParams gnss;
+    gnss.rateHz = options.rateHz;
+    std::vector<GnssFix> fixes = generateFixes(circuit, session, gnss, 1);
+
+    TimingGates gates;
+    gates.startFinish = circuit.gate(0, 8);
+    gates.sector1 = circuit.gate(circuit.length() / 3, 8);
+    gates.sector2 = circuit.gate(circuit.length() * 2 / 3, 8);
+
+    TripleBuffer<RacingState> snapshots;
+    RacingEngine engine(snapshots);
+    std::vector<Published> published(fixes.size());
+    std::vector<float> updateUs;
+    updateUs.reserve(fixes.size());
+    std::atomic<size_t> recorded(0);
+    std::atomic<bool> done(false);
+    RenderStats stats;
+
+    printf("%zu fixes at %.0f Hz over %zu laps, render every %.0f ms drawing %.0f ms, %.0fx real time\n",
+           fixes.size(), options.rateHz, options.laps, options.renderMs, options.drawMs, options.speed);
+
+    std::thread renderer(render, std::ref(snapshots), std::cref(published), std::cref(recorded), std::cref(done),
+                         std::cref(options), std::ref(stats));
+
+    // Compute thread, fixes at their delivery time
+    std::thread compute([&]() {
+        Clock::time_point start = Clock::now();
+        uint32_t firstMs = fixes.front().deliveredMs;
+        for (size_t i = 0; i < fixes.size(); i++) {
+            const GnssFix& fix = fixes[i];
+            std::this_thread::sleep_until(start + scaled(fix.deliveredMs - firstMs, options.speed));
+
+            Clock::time_point t0 = Clock::now();
+            engine.update(fix.deliveredMs, fix.position, fix.speed, true, 12, (uint32_t)i + 1, gates);
+            Clock::time_point t1 = Clock::now();
+            updateUs.push_back((float)std::chrono::duration<double, std::micro>(t1 - t0).count());
+
+            const RacingState& state = engine.current();
+            published[i] = Published{ state.timestamp, state.lapCount, state.delta, t1 };
+            recorded.store(i + 1, std::memory_order_release);
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    compute.join();
+    renderer.join();
+
+    printf("\ncompute: %zu laps timed, update %.1f us p50 / %.1f us p99 (wall)\n",
+           (size_t)engine.current().lapCount, percentile(updateUs, 50), percentile(updateUs, 99));
+    printf("render:  %zu frames, %zu snapshots drawn, %zu skipped\n", stats.frames, stats.snapshots, stats.skipped);
+    printf("age:     %.1f ms p50 / %.1f ms p99 / %.1f ms max from publish to draw\n",
+           percentile(stats.ageMs, 50), percentile(stats.ageMs, 99), percentile(stats.ageMs, 100));
+    printf("checks:  %zu mismatched, %zu out of order, final lap count %s\n", stats.mismatches, stats.reordered,
+           stats.lastLapCount == engine.current().lapCount ? "matches" : "DIFFERS");
+    return stats.mismatches || stats.reordered ? 1 : 0;
+}
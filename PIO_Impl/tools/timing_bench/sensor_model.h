@@ -0,0 +1,128 @@
+#pragma once
+#include <stdint.h>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "circuit.h"
+
+struct GnssParams {
+    float rateHz = 25.0f;
+    float noise = 1.0f;          // White position noise, 1 sigma per axis (m)
+    float drift = 0.5f;          // Slowly wandering bias, 1 sigma per axis (m)
+    float driftTau = 20.0f;      // Bias correlation time (s)
+    float latencyMs = 30.0f;     // Fix time to delivery
+    float jitterMs = 5.0f;       // Delivery jitter, 1 sigma
+    float dropout = 0.0f;        // Probability a fix is lost
+    float speedNoise = 0.1f;     // Doppler speed, 1 sigma (m/s); course error is speedNoise / speed
+};
+
+struct ImuParams {
+    float rateHz = 100.0f;
+    float accelNoise = 0.3f;     // m/s^2, 1 sigma
+    float accelBias = 0.1f;      // m/s^2, constant per run
+    float gyroNoise = 0.01f;     // rad/s, 1 sigma
+};
+
+// A fix as the firmware sees it, plus the truth it was made from
+struct GnssFix {
+    uint32_t deliveredMs;    // What millis() reads when the fix is processed
+    double truthTime;        // Session time of the measurement (s)
+    int truthLap;
+    float truthDistance;
+    GpsPoint position;
+    float speed;             // m/s, as RacingEngine::update takes it
+    float groundSpeed;       // m/s, unrounded like NAV-PVT gSpeed
+    float heading;           // Course over ground, degrees clockwise from north
+};
+
+struct ImuSample {
+    double time;
+    float accelLongitudinal;
+    float accelLateral;
+    float yawRate;
+};
+
+/**
+ * Produces fixes for a session at the configured rate with noise, a
+ * Gauss-Markov drift, delivery latency with jitter and dropouts. Fixes are
+ * returned in delivery order.
+ */
+inline std::vector<GnssFix> generateFixes(const Circuit& circuit, const Session& session,
+                                          const GnssParams& params, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    double interval = 1.0 / params.rateHz;
+    float decay = expf(-(float)interval / params.driftTau);
+    float driftStep = params.drift * sqrtf(1 - decay * decay);
+    float driftX = params.drift * gauss(rng);
+    float driftY = params.drift * gauss(rng);
+    const uint32_t bootMs = 5000;   // millis() when the session starts
+
+    std::vector<GnssFix> fixes;
+    fixes.reserve((size_t)(session.duration() * params.rateHz) + 1);
+    for (double t = 0; t < session.duration(); t += interval) {
+        driftX = driftX * decay + driftStep * gauss(rng);
+        driftY = driftY * decay + driftStep * gauss(rng);
+        if (uniform(rng) < params.dropout) {
+            continue;
+        }
+
+        GnssFix fix;
+        float speed;
+        session.stateAt(t, &fix.truthLap, &fix.truthDistance, &speed);
+        float x, y;
+        circuit.position(fix.truthDistance, &x, &y);
+        x += driftX + params.noise * gauss(rng);
+        y += driftY + params.noise * gauss(rng);
+
+        float delay = std::max(0.0f, params.latencyMs + params.jitterMs * gauss(rng));
+        fix.truthTime = t;
+        fix.deliveredMs = bootMs + (uint32_t)lround(t * 1000.0 + delay);
+        fix.position = circuit.toGps(x, y);
+        fix.speed = speed;
+        fix.groundSpeed = std::max(0.0f, speed + params.speedNoise * gauss(rng));
+        float ax, ay, bx, by;
+        circuit.position(fix.truthDistance - 0.5f, &ax, &ay);
+        circuit.position(fix.truthDistance + 0.5f, &bx, &by);
+        float course = atan2f(bx - ax, by - ay) + params.speedNoise / std::max(speed, 1.0f) * gauss(rng);
+        fix.heading = fmodf(course * 180.0f / (float)M_PI + 360.0f, 360.0f);
+        fixes.push_back(fix);
+    }
+
+    std::stable_sort(fixes.begin(), fixes.end(), [](const GnssFix& a, const GnssFix& b) {
+        return a.deliveredMs < b.deliveredMs;
+    });
+    return fixes;
+}
+
+// Body-frame IMU samples for the same session, for consumers that fuse them
+inline std::vector<ImuSample> generateImu(const Circuit& circuit, const Session& session,
+                                          const ImuParams& params, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    float biasLong = params.accelBias * gauss(rng);
+    float biasLat = params.accelBias * gauss(rng);
+
+    std::vector<ImuSample> samples;
+    double interval = 1.0 / params.rateHz;
+    float previousSpeed = -1;
+    for (double t = 0; t < session.duration(); t += interval) {
+        int lap;
+        float s, speed;
+        session.stateAt(t, &lap, &s, &speed);
+        float kappa = circuit.curvatureAt((size_t)(s / Circuit::STEP));
+
+        ImuSample sample;
+        sample.time = t;
+        sample.accelLongitudinal = (previousSpeed < 0 ? 0 : (speed - previousSpeed) / (float)interval)
+                                   + biasLong + params.accelNoise * gauss(rng);
+        sample.accelLateral = speed * speed * kappa + biasLat + params.accelNoise * gauss(rng);
+        sample.yawRate = speed * kappa + params.gyroNoise * gauss(rng);
+        samples.push_back(sample);
+        previousSpeed = speed;
+    }
+    return samples;
+}
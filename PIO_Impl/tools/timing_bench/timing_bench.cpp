@@ -0,0 +1,240 @@
+/**
+ * Timing accuracy and cost against synthetic ground truth.
+ *
+ * For every configuration (fix rate, GNSS noise, latency and jitter, gate
+ * radius) a stint of laps is driven on a generated circuit. The fixes go
+ * through LapTiming and delta_calculator in the same order as
+ * RacingEngine::update, and the lap, sector and live delta values are
+ * compared to the exact ones from the trajectory.
+ *
+ * Build from PIO_Impl/:
+ *   g++ -std=gnu++17 -O2 -Iinclude -Iinclude/calculations \
+ *       tools/timing_bench/timing_bench.cpp -o timing_bench
+ *
+ * Usage:
+ *   timing_bench [--laps N] [--seeds N] [--csv]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "circuit.h"
+#include "sensor_model.h"
+#include "calculations/lap_timing.h"
+#include "calculations/delta_calculator.h"
+
+namespace {
+
+    struct Config {
+        GnssParams gnss;
+        float gateRadius;
+    };
+
+    struct Errors {
+        std::vector<float> values;   // Absolute errors (ms)
+
+        void add(double error) { values.push_back((float)fabs(error)); }
+
+        float percentile(float pct) {
+            if (values.empty()) return NAN;
+            std::sort(values.begin(), values.end());
+            size_t i = std::min(values.size() - 1, (size_t)(values.size() * pct / 100.0f));
+            return values[i];
+        }
+    };
+
+    struct Result {
+        Errors lap;
+        Errors sector;
+        Errors delta;
+        size_t lapsTimed = 0;
+        size_t lapsDriven = 0;
+        size_t lapsMissed = 0;       // Missed a line and timed two laps as one
+        size_t lapsExtra = 0;        // Line triggered again shortly after a lap
+        size_t sectorsTimed = 0;
+        size_t sectorsDriven = 0;
+        double timingNs = 0;
+        double deltaNs = 0;
+        size_t fixes = 0;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    double nanos(Clock::time_point a, Clock::time_point b) {
+        return std::chrono::duration<double, std::nano>(b - a).count();
+    }
+
+    void runStint(const Circuit& circuit, const Config& config, uint32_t seed, size_t lapCount, Result& result) {
+        std::mt19937 rng(seed * 7919u);
+        std::uniform_real_distribution<float> pace(0.95f, 1.0f);
+        std::uniform_real_distribution<float> phase(0.0f, 6.283f);
+        std::vector<LapPlan> plans;
+        for (size_t k = 0; k < lapCount; k++) {
+            plans.emplace_back(circuit, pace(rng), 0.03f, phase(rng));
+        }
+        Session session(circuit, plans);
+        std::vector<GnssFix> fixes = generateFixes(circuit, session, config.gnss, seed);
+
+        const float length = circuit.length();
+        const float sectorLine[2] = { length / 3, length * 2 / 3 };
+        TimingGates gates;
+        gates.startFinish = circuit.gate(0, config.gateRadius);
+        gates.sector1 = circuit.gate(sectorLine[0], config.gateRadius);
+        gates.sector2 = circuit.gate(sectorLine[1], config.gateRadius);
+
+        LapTiming timing;
+        delta_calculator deltaCalculator;
+        int currentLap = -1;      // Truth lap being timed
+        int referenceLap = -1;    // Truth lap behind the session best reference
+
+        for (const GnssFix& fix : fixes) {
+            uint32_t now = fix.deliveredMs;
+
+            // Same order as RacingEngine::update: delta first, then gates
+            Clock::time_point t0 = Clock::now();
+            if (timing.isLapActive()) {
+                uint32_t lapTime = timing.getLapTime(now);
+                deltaCalculator.storePoint(lapTime, fix.position, (int32_t)lroundf(fix.speed * 1000.0f));
+                deltaCalculator.update(lapTime, fix.position);
+            }
+            Clock::time_point t1 = Clock::now();
+            TimingEvents events = timing.update(now, fix.position, fix.speed, gates);
+            Clock::time_point t2 = Clock::now();
+            result.deltaNs += nanos(t0, t1);
+            result.timingNs += nanos(t1, t2);
+            result.fixes++;
+
+            bool timedLap = currentLap >= 0 && currentLap < (int)lapCount;
+            if (deltaCalculator.hasDelta(ReferenceKind::SessionBest) && timedLap && referenceLap >= 0 &&
+                fix.truthLap == currentLap) {
+                double truth = (plans[currentLap].timeAt(fix.truthDistance) -
+                                plans[referenceLap].timeAt(fix.truthDistance)) * 1000.0;
+                result.delta.add(deltaCalculator.getDelta(ReferenceKind::SessionBest) - truth);
+            }
+
+            if (timedLap && (events.sectors & (1 << 2))) {
+                double truth = (plans[currentLap].lapTime() - plans[currentLap].timeAt(sectorLine[1])) * 1000.0;
+                result.sector.add(events.sectorTime[2] - truth);
+                result.sectorsTimed++;
+            }
+
+            if (events.lapCompleted) {
+                uint32_t best = deltaCalculator.getBestLapTime(ReferenceKind::SessionBest);
+                deltaCalculator.completeLap(events.lapTime);
+                if (timedLap) {
+                    double truth = plans[currentLap].lapTime() * 1000.0;
+                    if (events.lapTime > truth * 1.5) {
+                        result.lapsMissed++;
+                    } else if (events.lapTime < truth * 0.5) {
+                        result.lapsExtra++;
+                    } else {
+                        result.lap.add(events.lapTime - truth);
+                        result.lapsTimed++;
+                    }
+                    if (deltaCalculator.getBestLapTime(ReferenceKind::SessionBest) != best) {
+                        referenceLap = currentLap;
+                    }
+                }
+            }
+
+            if (events.lapStarted) {
+                // The line can trigger a few metres early, before the truth lap rolls over
+                currentLap = fix.truthDistance > length / 2 ? fix.truthLap + 1 : fix.truthLap;
+            }
+
+            timedLap = currentLap >= 0 && currentLap < (int)lapCount;
+            for (uint8_t sector = 0; sector < 2; sector++) {
+                if (!(events.sectors & (1 << sector))) continue;
+                deltaCalculator.markSector(sector, events.sectorEnd[sector]);
+                if (timedLap) {
+                    const LapPlan& plan = plans[currentLap];
+                    double truth = (plan.timeAt(sectorLine[sector]) -
+                                    (sector ? plan.timeAt(sectorLine[0]) : 0.0)) * 1000.0;
+                    result.sector.add(events.sectorTime[sector] - truth);
+                    result.sectorsTimed++;
+                }
+            }
+        }
+
+        result.lapsDriven += lapCount;
+        result.sectorsDriven += lapCount * 3;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    size_t laps = 10;
+    uint32_t seeds = 3;
+    bool csv = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--laps") && i + 1 < argc) {
+            laps = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seeds") && i + 1 < argc) {
+            seeds = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--csv")) {
+            csv = true;
+        } else {
+            fprintf(stderr, "usage: %s [--laps N] [--seeds N] [--csv]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    Circuit circuit;
+    std::vector<Config> configs;
+    const float rates[] = { 10, 25 };
+    const float noises[] = { 0.5f, 1.5f, 3.0f };
+    const float latencies[][2] = { { 30, 2 }, { 80, 15 } };
+    const float radii[] = { 4, 8 };
+    for (float rate : rates) {
+        for (float noise : noises) {
+            for (const auto& latency : latencies) {
+                for (float radius : radii) {
+                    Config config;
+                    config.gnss.rateHz = rate;
+                    config.gnss.noise = noise;
+                    config.gnss.drift = noise / 2;
+                    config.gnss.latencyMs = latency[0];
+                    config.gnss.jitterMs = latency[1];
+                    config.gateRadius = radius;
+                    configs.push_back(config);
+                }
+            }
+        }
+    }
+
+    if (csv) {
+        printf("rate_hz,noise_m,latency_ms,jitter_ms,radius_m,laps_timed,laps_driven,laps_missed,laps_extra,"
+               "lap_p50,lap_p95,lap_max,sector_p50,sector_p95,delta_p50,delta_p95,timing_ns,delta_ns\n");
+    } else {
+        printf("Circuit %.0f m, %zu laps x %u seeds per row; errors in ms (p50/p95/max), cost in ns per fix\n\n",
+               circuit.length(), laps, seeds);
+        printf("%4s %5s %7s %6s | %9s %4s %5s | %17s | %11s | %11s | %7s %7s\n", "Hz", "noise", "latency", "radius",
+               "laps", "miss", "extra", "lap error", "sector err", "delta err", "gates", "delta");
+    }
+
+    for (const Config& config : configs) {
+        Result result;
+        for (uint32_t seed = 1; seed <= seeds; seed++) {
+            runStint(circuit, config, seed, laps, result);
+        }
+        double timingNs = result.timingNs / result.fixes;
+        double deltaNs = result.deltaNs / result.fixes;
+        float lap50 = result.lap.percentile(50), lap95 = result.lap.percentile(95), lapMax = result.lap.percentile(100);
+        float sec50 = result.sector.percentile(50), sec95 = result.sector.percentile(95);
+        float del50 = result.delta.percentile(50), del95 = result.delta.percentile(95);
+
+        if (csv) {
+            printf("%.0f,%.1f,%.0f,%.0f,%.0f,%zu,%zu,%zu,%zu,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f\n",
+                   config.gnss.rateHz, config.gnss.noise, config.gnss.latencyMs, config.gnss.jitterMs,
+                   config.gateRadius, result.lapsTimed, result.lapsDriven, result.lapsMissed, result.lapsExtra, lap50, lap95, lapMax,
+                   sec50, sec95, del50, del95, timingNs, deltaNs);
+        } else {
+            printf("%4.0f %4.1fm %3.0f±%-3.0f %5.0fm | %4zu/%-4zu %4zu %5zu | %5.0f %5.0f %5.0f | %5.0f %5.0f | %5.0f %5.0f | %7.0f %7.0f\n",
+                   config.gnss.rateHz, config.gnss.noise, config.gnss.latencyMs, config.gnss.jitterMs,
+                   config.gateRadius, result.lapsTimed, result.lapsDriven, result.lapsMissed, result.lapsExtra, lap50, lap95, lapMax,
+                   sec50, sec95, del50, del95, timingNs, deltaNs);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,278 @@
+/**
+ * Track generation from a recorded out-lap.
+ *
+ * Synthetic mode drives the generated circuits from tools/timing_bench,
+ * with a 250 m pit exit that runs alongside and joins at the first fix. The
+ * fixes go through TrackBuilder until the loop closes, as the firmware's
+ * "track learn" command does. For each circuit and GNSS rate it reports:
+ *   - how far the builder had to drive before the loop closed;
+ *   - the loop length against the true circuit length;
+ *   - how far the gates are from the racing line, and their radii;
+ *   - the sector lengths, as a share of the lap, in both sector modes;
+ *   - outline points and the worst distance of the circuit from the outline;
+ *   - the cost of add() per fix and of build().
+ *
+ * Capture mode feeds laps recorded with "telemetry on" (see
+ * tools/session_analytics) as one continuous drive and prints the proposal.
+ *
+ * Build from PIO_Impl/:
+ *   g++ -std=gnu++17 -O2 -Iinclude -Iinclude/calculations \
+ *       tools/track_builder/track_builder.cpp -o track_builder
+ *
+ * Usage:
+ *   track_builder [--seeds N]
+ *   track_builder --capture capture.bin...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "../timing_bench/circuit.h"
+#include "../timing_bench/sensor_model.h"
+#include "../session_analytics/capture_reader.h"
+#include "calculations/track_builder.h"
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    const double ORIGIN_LAT = 52.07;    // Circuit's default origin
+    const double ORIGIN_LON = -1.01;
+    const float PIT_LENGTH = 250.0f;    // m of pit exit before the first fix
+    const float PIT_OFFSET = 25.0f;     // m from the track where the pit exit starts
+
+    struct Shape {
+        const char* name;
+        CircuitParams params;
+    };
+
+    struct Rate {
+        const char* name;
+        GnssParams gnss;
+    };
+
+    struct Summary {
+        size_t runs = 0;
+        size_t built = 0;
+        double driven = 0;          // m until the loop closed
+        double lengthError = 0;     // Worst |loop - circuit| (m)
+        double gateOffset = 0;      // Worst gate distance from the line (m)
+        double minRadius = 1e9;
+        double sectorSpread[2] = { 0, 0 };   // Worst |sector share - 1/3|, per mode
+        double outlinePoints = 0;
+        double outlineError = 0;    // Worst circuit distance from the outline (m)
+        double addNs = 0;
+        double buildUs = 0;
+        size_t fixes = 0;
+    };
+
+    // Nearest circuit arc length to a local point, and the distance to it
+    float nearest(const Circuit& circuit, float x, float y, float* distance) {
+        float best = 1e9f, at = 0;
+        for (size_t i = 0; i < circuit.samples(); i++) {
+            float cx, cy;
+            circuit.position(i * Circuit::STEP, &cx, &cy);
+            float d = hypotf(cx - x, cy - y);
+            if (d < best) {
+                best = d;
+                at = i * Circuit::STEP;
+            }
+        }
+        *distance = best;
+        return at;
+    }
+
+    // Worst distance of the circuit from the closed outline polyline
+    float outlineError(const Circuit& circuit, const geometry::LocalFrame& frame, const TrackOutline& outline) {
+        float ox = frame.x(outline.origin.longitude), oy = frame.y(outline.origin.latitude);
+        std::vector<float> xs, ys;
+        for (uint16_t i = 0; i <= outline.count; i++) {
+            xs.push_back(ox + outline.x[i % outline.count]);
+            ys.push_back(oy + outline.y[i % outline.count]);
+        }
+        float worst = 0;
+        for (size_t i = 0; i < circuit.samples(); i += 4) {
+            float x, y;
+            circuit.position(i * Circuit::STEP, &x, &y);
+            size_t segment;
+            float along;
+            float d = sqrtf(geometry::projectOnto(xs.data(), ys.data(), x, y, 0, xs.size() - 1, &segment, &along));
+            if (d > worst) worst = d;
+        }
+        return worst;
+    }
+
+    void run(const Circuit& circuit, const Rate& rate, uint32_t seed, Summary& summary) {
+        std::vector<LapPlan> plans;
+        plans.emplace_back(circuit, 0.8f, 0.03f, seed * 1.3f);   // An out-lap is not flat out
+        plans.emplace_back(circuit, 0.8f, 0.03f, seed * 2.1f);
+        Session session(circuit, plans);
+        std::vector<GnssFix> fixes = generateFixes(circuit, session, rate.gnss, seed);
+
+        // Pit exit: alongside the track on the outside, joining it at the first fix
+        geometry::LocalFrame frame(ORIGIN_LAT, ORIGIN_LON);
+        std::vector<GpsPoint> drive;
+        float pitStep = 15.0f / rate.gnss.rateHz;   // 15 m/s on the pit lane
+        for (float u = PIT_LENGTH; u > 0; u -= pitStep) {
+            float s = fixes[0].truthDistance - u;
+            float x, y, ax, ay, bx, by;
+            circuit.position(s, &x, &y);
+            circuit.position(s - 1, &ax, &ay);
+            circuit.position(s + 1, &bx, &by);
+            float tx = bx - ax, ty = by - ay, t = hypotf(tx, ty);
+            float offset = PIT_OFFSET * u / PIT_LENGTH;
+            drive.push_back(circuit.toGps(x + ty / t * offset, y - tx / t * offset));
+        }
+        for (const GnssFix& fix : fixes) {
+            drive.push_back(fix.position);
+        }
+
+        TrackBuilder builder;
+        summary.runs++;
+        auto begin = Clock::now();
+        size_t used = 0;
+        while (used < drive.size() && builder.add(drive[used].latitude, drive[used].longitude) == TrackBuilder::Status::Recording) {
+            used++;
+        }
+        summary.addNs += std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+        summary.fixes += used;
+        if (builder.getStatus() != TrackBuilder::Status::Closed) {
+            return;
+        }
+        summary.built++;
+        summary.driven += builder.getPathLength();
+
+        TrackBuilder::SectorMode modes[2] = { TrackBuilder::SectorMode::Even, TrackBuilder::SectorMode::Straights };
+        for (int m = 0; m < 2; m++) {
+            TrackProposal proposal;
+            begin = Clock::now();
+            builder.build(modes[m], &proposal);
+            summary.buildUs += std::chrono::duration<double, std::micro>(Clock::now() - begin).count() / 2;
+
+            summary.lengthError = std::max(summary.lengthError, (double)fabsf(proposal.length - circuit.length()));
+            const GpsPoint* gates[3] = { &proposal.startFinish, &proposal.sector2Start, &proposal.sector3Start };
+            float at[3];
+            for (int g = 0; g < 3; g++) {
+                float offset;
+                at[g] = nearest(circuit, frame.x(gates[g]->longitude), frame.y(gates[g]->latitude), &offset);
+                summary.gateOffset = std::max(summary.gateOffset, (double)offset);
+                summary.minRadius = std::min(summary.minRadius, (double)gates[g]->radius);
+            }
+            for (int g = 0; g < 3; g++) {
+                float sector = fmodf(at[(g + 1) % 3] - at[g] + circuit.length(), circuit.length());
+                summary.sectorSpread[m] = std::max(summary.sectorSpread[m], (double)fabsf(sector / circuit.length() - 1.0f / 3));
+            }
+            if (m == 0) {
+                summary.outlinePoints += proposal.outline.count;
+                summary.outlineError = std::max(summary.outlineError, (double)outlineError(circuit, frame, proposal.outline));
+            }
+        }
+    }
+
+    int synthetic(uint32_t seeds) {
+        Shape shapes[3];
+        shapes[0] = { "medium", CircuitParams() };
+        shapes[1] = { "tight", CircuitParams() };
+        shapes[1].params.radius = 200.0f;
+        shapes[1].params.lobes3 = 0.25f;
+        shapes[2] = { "long", CircuitParams() };
+        shapes[2].params.radius = 900.0f;
+        Rate rates[2];
+        rates[0] = { "25 Hz", GnssParams() };
+        rates[1] = { "10 Hz", GnssParams() };
+        rates[1].gnss.rateHz = 10.0f;
+        rates[1].gnss.noise = 2.0f;
+        rates[1].gnss.drift = 1.5f;
+
+        printf("%-7s %-6s %6s %6s %7s %7s %6s %6s %6s %6s %6s %7s %8s\n", "circuit", "rate", "length", "closed",
+               "driven", "len err", "gate", "radius", "even", "straig", "outln", "max dev", "add/build");
+        for (const Shape& shape : shapes) {
+            Circuit circuit(shape.params, ORIGIN_LAT, ORIGIN_LON);
+            for (const Rate& rate : rates) {
+                Summary s;
+                for (uint32_t seed = 1; seed <= seeds; seed++) {
+                    run(circuit, rate, seed, s);
+                }
+                if (s.built == 0) {
+                    printf("%-7s %-6s %6.0f %3zu/%-2zu\n", shape.name, rate.name, circuit.length(), s.built, s.runs);
+                    continue;
+                }
+                printf("%-7s %-6s %6.0f %3zu/%-2zu %7.0f %7.1f %6.1f %6.1f %5.1f%% %5.1f%% %6.0f %7.1f %3.0f ns/%.0f us\n",
+                       shape.name, rate.name, circuit.length(), s.built, s.runs, s.driven / s.built, s.lengthError,
+                       s.gateOffset, s.minRadius, 100 * s.sectorSpread[0], 100 * s.sectorSpread[1],
+                       s.outlinePoints / s.built, s.outlineError, s.addNs / s.fixes, s.buildUs / s.built);
+            }
+        }
+        printf("\nlen err, gate (distance from the line), even/straig (worst sector share off a third)\n"
+               "and max dev (circuit from outline) are worst cases in metres or percent\n");
+        return 0;
+    }
+
+    int replay(const std::vector<std::string>& paths) {
+        std::vector<Lap> laps;
+        for (const std::string& path : paths) {
+            if (!capture::read(path, laps)) {
+                fprintf(stderr, "cannot read %s\n", path.c_str());
+                return 1;
+            }
+        }
+
+        TrackBuilder builder;
+        for (const Lap& lap : laps) {
+            for (const TracePoint& point : lap.points) {
+                builder.add(point.latitudeE7 / 1e7, point.longitudeE7 / 1e7);
+            }
+            if (builder.getStatus() != TrackBuilder::Status::Recording) break;
+        }
+        if (builder.getStatus() != TrackBuilder::Status::Closed) {
+            fprintf(stderr, "the drive never closed a loop (%.0f m, %zu points)\n", builder.getPathLength(),
+                    builder.getPointCount());
+            return 1;
+        }
+
+        std::vector<float> distance;
+        geometry::cumulativeDistances(laps[0].points.data(), laps[0].points.size(), distance);
+        printf("loop closed after %.0f m; first captured lap %.0f m\n", builder.getPathLength(),
+               distance.empty() ? 0.0f : distance.back());
+
+        const char* names[2] = { "even", "straights" };
+        TrackBuilder::SectorMode modes[2] = { TrackBuilder::SectorMode::Even, TrackBuilder::SectorMode::Straights };
+        TrackProposal proposal;
+        for (int m = 0; m < 2; m++) {
+            builder.build(modes[m], &proposal);
+            printf("\n%s: loop %.0f m\n", names[m], proposal.length);
+            const GpsPoint* gates[3] = { &proposal.startFinish, &proposal.sector2Start, &proposal.sector3Start };
+            const char* labels[3] = { "start/finish", "sector 2", "sector 3" };
+            for (int g = 0; g < 3; g++) {
+                printf("  %-12s %.7f, %.7f  radius %.1f m\n", labels[g], gates[g]->latitude, gates[g]->longitude,
+                       gates[g]->radius);
+            }
+        }
+        printf("\noutline, %u points (m east, m north of start/finish)\n", proposal.outline.count);
+        for (uint16_t i = 0; i < proposal.outline.count; i++) {
+            printf("%6d %6d\n", proposal.outline.x[i], proposal.outline.y[i]);
+        }
+        return 0;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    uint32_t seeds = 10;
+    std::vector<std::string> captures;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--seeds") && i + 1 < argc) {
+            seeds = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--capture")) {
+            while (i + 1 < argc && argv[i + 1][0] != '-') captures.push_back(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--seeds N] | --capture capture.bin...\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!captures.empty()) {
+        return replay(captures);
+    }
+    return synthetic(seeds);
+}
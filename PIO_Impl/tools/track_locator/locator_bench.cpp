@@ -0,0 +1,303 @@
+/**
+ * TrackLocator against a brute-force nearest search.
+ *
+ * Builds a synthetic world of start/finish points, or reads them from a
+ * bundled database image (tools/trackdb/trackdb.py), and indexes them the
+ * way TrackManager does. Synthetic tracks are clustered the way real
+ * circuits are: most of them around a few hundred regional centres, some
+ * packed within a kilometre of each other (kart and club layouts at one
+ * venue), the rest scattered, plus fixed ones next to the poles and on both
+ * sides of the antimeridian.
+ *
+ * Queries are fixes from 0 to twice the detection radius away from a
+ * track, and fixes anywhere on the globe. For each one findNearest() must
+ * return the same distance as a linear scan using the same equirectangular
+ * metric; ties may pick either track. Reports the time to build the index,
+ * per-query times of both, and the index size. Exits non-zero on any
+ * mismatch.
+ *
+ * Build from PIO_Impl/:
+ *   g++ -std=gnu++17 -O2 -Iinclude tools/track_locator/locator_bench.cpp -o locator_bench
+ *
+ * Usage:
+ *   locator_bench [--tracks N] [--queries N] [--seed N]
+ *   locator_bench --image trackdb.bin [--queries N] [--seed N]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "track/track_locator.h"
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    const float DETECT_RADIUS_M = 3000.0f;     // TrackManager's default
+    const double METERS_PER_DEGREE = 111195.0; // As in TrackLocator
+
+    struct Point {
+        double latitude;
+        double longitude;
+    };
+
+    double elapsedNs(Clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    double wrapLongitude(double longitude) {
+        while (longitude >= 180.0) longitude -= 360.0;
+        while (longitude < -180.0) longitude += 360.0;
+        return longitude;
+    }
+
+    double clampLatitude(double latitude) {
+        return latitude > 89.999 ? 89.999 : (latitude < -89.999 ? -89.999 : latitude);
+    }
+
+    // Moves a point by meters north and east
+    Point offset(const Point& p, double north, double east) {
+        double cosLat = cos(p.latitude * M_PI / 180.0);
+        Point result;
+        result.latitude = clampLatitude(p.latitude + north / METERS_PER_DEGREE);
+        result.longitude = wrapLongitude(p.longitude + east / (METERS_PER_DEGREE * (cosLat > 0.01 ? cosLat : 0.01)));
+        return result;
+    }
+
+    std::vector<Point> syntheticWorld(size_t count, std::mt19937& rng) {
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        std::normal_distribution<double> normal(0.0, 1.0);
+        std::vector<Point> tracks;
+        tracks.reserve(count);
+
+        // Poles and antimeridian, where the grid wraps or degenerates
+        const Point fixed[] = {
+            { 89.95, 10.0 }, { -89.95, -170.0 }, { 64.73, 179.99 }, { 64.73, -179.99 },
+            { -16.5, 179.97 }, { -16.5, -179.98 }, { 0.0, 0.0 }, { 0.001, -0.001 },
+        };
+        for (const Point& p : fixed) {
+            if (tracks.size() < count) {
+                tracks.push_back(p);
+            }
+        }
+
+        // Regional centres on mid latitudes, where most circuits are
+        std::vector<Point> centres(count / 40 + 1);
+        for (Point& c : centres) {
+            c.latitude = clampLatitude(normal(rng) * 25.0 + (unit(rng) < 0.8 ? 42.0 : -30.0));
+            c.longitude = unit(rng) * 360.0 - 180.0;
+        }
+
+        while (tracks.size() < count) {
+            double kind = unit(rng);
+            if (kind < 0.7) {
+                // Within a region, a few hundred kilometres across
+                const Point& c = centres[rng() % centres.size()];
+                tracks.push_back(offset(c, normal(rng) * 150000.0, normal(rng) * 150000.0));
+            } else if (kind < 0.85 && !tracks.empty()) {
+                // Another layout at the same venue
+                const Point& venue = tracks[rng() % tracks.size()];
+                tracks.push_back(offset(venue, normal(rng) * 400.0, normal(rng) * 400.0));
+            } else {
+                Point p;
+                p.latitude = clampLatitude(asin(unit(rng) * 2.0 - 1.0) * 180.0 / M_PI);
+                p.longitude = unit(rng) * 360.0 - 180.0;
+                tracks.push_back(p);
+            }
+        }
+        return tracks;
+    }
+
+    uint32_t getU32(const uint8_t* data) {
+        return data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+    }
+
+    // Start/finish points of a "TRDB" image, the way TrackDatabase walks it:
+    // a 16 byte header, then length-prefixed TrackStore payloads
+    bool readImage(const char* path, std::vector<Point>* tracks) {
+        FILE* file = fopen(path, "rb");
+        if (!file) {
+            perror(path);
+            return false;
+        }
+        std::vector<uint8_t> image;
+        uint8_t buffer[4096];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            image.insert(image.end(), buffer, buffer + n);
+        }
+        fclose(file);
+
+        if (image.size() < 16 || memcmp(image.data(), "TRDB", 4) != 0) {
+            fprintf(stderr, "%s: not a track database image\n", path);
+            return false;
+        }
+        uint32_t size = getU32(&image[12]);
+        if (size > image.size() - 16) {
+            fprintf(stderr, "%s: truncated\n", path);
+            return false;
+        }
+        const uint8_t* data = image.data() + 16;
+        for (uint32_t pos = 0; pos < size; pos += 1 + data[pos]) {
+            const uint8_t* payload = data + pos + 1;
+            uint8_t length = data[pos];
+            if (pos + 1 + length > size || length < 3) {
+                break;
+            }
+            // Schema version, name length, name, flags, then the points
+            size_t flagsAt = 2 + payload[1];
+            if (flagsAt + 11 <= length && (payload[flagsAt] & 0x01)) {
+                Point p;
+                p.latitude = (int32_t)getU32(payload + flagsAt + 1) / 1e7;
+                p.longitude = (int32_t)getU32(payload + flagsAt + 5) / 1e7;
+                tracks->push_back(p);
+            }
+        }
+        return true;
+    }
+
+    // The locator's metric over the points as it stores them
+    struct BruteForce {
+        std::vector<Point> points;
+
+        explicit BruteForce(const std::vector<Point>& tracks) {
+            for (const Point& t : tracks) {
+                Point p;
+                p.latitude = (int32_t)lround(t.latitude * 1e7) / 1e7;
+                p.longitude = (int32_t)lround(t.longitude * 1e7) / 1e7;
+                points.push_back(p);
+            }
+        }
+
+        double distanceSq(size_t i, double latitude, double longitude, double cosLat) const {
+            double dLat = points[i].latitude - latitude;
+            double dLon = points[i].longitude - longitude;
+            if (dLon > 180.0) dLon -= 360.0;
+            if (dLon < -180.0) dLon += 360.0;
+            double x = dLon * cosLat * METERS_PER_DEGREE;
+            double y = dLat * METERS_PER_DEGREE;
+            return x * x + y * y;
+        }
+
+        bool findNearest(double latitude, double longitude, float maxDistance, uint32_t* ref, double* bestSq) const {
+            double cosLat = cos(latitude * M_PI / 180.0);
+            *bestSq = (double)maxDistance * maxDistance;
+            bool found = false;
+            for (size_t i = 0; i < points.size(); i++) {
+                double d = distanceSq(i, latitude, longitude, cosLat);
+                if (d < *bestSq) {
+                    *bestSq = d;
+                    *ref = i;
+                    found = true;
+                }
+            }
+            return found;
+        }
+    };
+
+    int run(const std::vector<Point>& tracks, size_t queryCount, std::mt19937& rng) {
+        Clock::time_point start = Clock::now();
+        TrackLocator locator;
+        locator.reserve(tracks.size());
+        for (size_t i = 0; i < tracks.size(); i++) {
+            locator.add(tracks[i].latitude, tracks[i].longitude, i);
+        }
+        locator.build();
+        double buildMs = elapsedNs(start) / 1e6;
+
+        BruteForce brute(tracks);
+
+        // Half near a track, half anywhere
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        std::vector<Point> queries(queryCount);
+        for (size_t i = 0; i < queryCount; i++) {
+            if (i % 2 == 0) {
+                double range = unit(rng) * 2.0 * DETECT_RADIUS_M;
+                double bearing = unit(rng) * 2.0 * M_PI;
+                queries[i] = offset(tracks[rng() % tracks.size()], range * cos(bearing), range * sin(bearing));
+            } else {
+                queries[i].latitude = clampLatitude(asin(unit(rng) * 2.0 - 1.0) * 180.0 / M_PI);
+                queries[i].longitude = unit(rng) * 360.0 - 180.0;
+            }
+        }
+
+        std::vector<int64_t> found(queryCount);
+        start = Clock::now();
+        for (size_t i = 0; i < queryCount; i++) {
+            uint32_t ref;
+            bool hit = locator.findNearest(queries[i].latitude, queries[i].longitude, DETECT_RADIUS_M, &ref);
+            found[i] = hit ? (int64_t)ref : -1;
+        }
+        double locatorNs = elapsedNs(start) / queryCount;
+
+        size_t mismatches = 0;
+        size_t hits = 0;
+        start = Clock::now();
+        for (size_t i = 0; i < queryCount; i++) {
+            const Point& q = queries[i];
+            uint32_t ref = 0;
+            double bestSq;
+            bool hit = brute.findNearest(q.latitude, q.longitude, DETECT_RADIUS_M, &ref, &bestSq);
+            hits += hit;
+            // Same distance is enough: venues can have two layouts at one spot
+            bool same = hit ? found[i] >= 0 &&
+                              brute.distanceSq(found[i], q.latitude, q.longitude, cos(q.latitude * M_PI / 180.0)) ==
+                                  bestSq
+                            : found[i] < 0;
+            if (!same) {
+                if (mismatches < 10) {
+                    fprintf(stderr, "query %.7f,%.7f: locator %lld, brute force %d at %.1f m\n", q.latitude,
+                            q.longitude, (long long)found[i], hit ? (int)ref : -1, hit ? sqrt(bestSq) : 0.0);
+                }
+                mismatches++;
+            }
+        }
+        double bruteNs = elapsedNs(start) / queryCount;
+
+        printf("%zu tracks, index %zu KB, built in %.2f ms\n", tracks.size(), tracks.size() * 16 / 1024, buildMs);
+        printf("%zu queries, %zu within %.0f m of a track\n", queryCount, hits, DETECT_RADIUS_M);
+        printf("locator %10.0f ns/query\nbrute   %10.0f ns/query (%.0fx)\n", locatorNs, bruteNs, bruteNs / locatorNs);
+        printf("mismatches: %zu\n", mismatches);
+        return mismatches == 0 ? 0 : 1;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    size_t trackCount = 20000;
+    size_t queries = 20000;
+    uint32_t seed = 1;
+    const char* image = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--tracks") && i + 1 < argc) {
+            trackCount = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--queries") && i + 1 < argc) {
+            queries = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--image") && i + 1 < argc) {
+            image = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--tracks N | --image FILE] [--queries N] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::mt19937 rng(seed);
+    std::vector<Point> tracks;
+    if (image) {
+        if (!readImage(image, &tracks)) {
+            return 2;
+        }
+    } else {
+        tracks = syntheticWorld(trackCount, rng);
+    }
+    if (tracks.empty() || queries == 0) {
+        fprintf(stderr, "nothing to search\n");
+        return 2;
+    }
+    return run(tracks, queries, rng);
+}
@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+"""Builds and lists the bundled track database image.
+
+The image is what TrackDatabase (include/track/track_database.h) maps from
+the "trackdb" partition: a 16 byte header ("TRDB", schema version, track
+count, data size), then per track one length byte and the TrackStore
+payload (src/track/track_store.cpp). Tracks come from a CSV file with a
+header row:
+
+    name,start_lat,start_lon,radius,sector2_lat,sector2_lon,sector3_lat,sector3_lon
+    Silverstone GP,52.0695,-1.0225,12,52.0736,-1.0152,52.0601,-1.0182
+
+radius (m, default 4) applies to every gate; the sector columns may be
+empty. Names are cut to 31 bytes of UTF-8. A track with all three gates
+takes 45 bytes plus its name, so the partition holds about 5000.
+
+    python3 tools/trackdb/trackdb.py build tracks.csv trackdb.bin
+    python3 tools/trackdb/trackdb.py build --synthetic 5000 trackdb.bin
+    python3 tools/trackdb/trackdb.py list trackdb.bin
+
+Flash it at the partition's offset in partitions.csv:
+
+    esptool.py --chip esp32s3 write_flash 0x330000 trackdb.bin
+
+tools/track_locator/locator_bench.cpp reads the same image with --image.
+"""
+
+import argparse
+import csv
+import math
+import random
+import struct
+import sys
+
+MAGIC = b"TRDB"
+SCHEMA_VERSION = 1             # TrackStore::SCHEMA_VERSION
+HEADER_SIZE = 16
+PARTITION_SIZE = 0x40000       # trackdb in partitions.csv
+MAX_NAME = 31                  # MAX_TRACK_NAME_LENGTH - 1
+MAX_PAYLOAD = 64               # TrackStore::MAX_PAYLOAD_SIZE
+
+POINT_START_FINISH = 0x01
+POINT_SECTOR2 = 0x02
+POINT_SECTOR3 = 0x04
+TRACK_VALID = 0x80
+
+GATES = [("start", POINT_START_FINISH), ("sector2", POINT_SECTOR2), ("sector3", POINT_SECTOR3)]
+
+
+def encode_name(name):
+    raw = name.encode("utf-8")[:MAX_NAME]
+    # Do not leave half a character at the cut
+    return raw.decode("utf-8", "ignore").encode("utf-8")
+
+
+def encode_point(lat, lon, radius):
+    if not (-90.0 <= lat <= 90.0 and -180.0 <= lon <= 180.0):
+        raise ValueError("position %.7f,%.7f out of range" % (lat, lon))
+    return struct.pack("<iiH", round(lat * 1e7), round(lon * 1e7), min(65535, int(radius * 100 + 0.5)))
+
+
+def encode_track(track):
+    """TrackStore::encode for one track dict: name, radius and (lat, lon) gates."""
+    name = encode_name(track["name"])
+    flags = TRACK_VALID
+    points = b""
+    for key, flag in GATES:
+        if track.get(key):
+            flags |= flag
+            points += encode_point(track[key][0], track[key][1], track["radius"])
+    payload = bytes([SCHEMA_VERSION, len(name)]) + name + bytes([flags]) + points
+    assert len(payload) <= MAX_PAYLOAD
+    return payload
+
+
+def decode_track(payload):
+    if len(payload) < 3 or payload[0] != SCHEMA_VERSION:
+        return None
+    length = payload[1]
+    name = payload[2:2 + length].decode("utf-8", "replace")
+    pos = 2 + length
+    flags = payload[pos]
+    pos += 1
+    track = {"name": name, "valid": bool(flags & TRACK_VALID)}
+    for key, flag in GATES:
+        if flags & flag:
+            lat, lon, radius = struct.unpack_from("<iiH", payload, pos)
+            track[key] = (lat / 1e7, lon / 1e7)
+            track["radius"] = radius / 100.0
+            pos += 10
+    return track
+
+
+def build_image(tracks):
+    data = bytearray()
+    names = set()
+    for track in tracks:
+        if not track.get("start"):
+            raise ValueError("%s has no start/finish" % track["name"])
+        name = encode_name(track["name"])
+        if name in names:
+            # The store and the detector tell tracks apart by name
+            raise ValueError("duplicate track name %r" % name.decode("utf-8"))
+        names.add(name)
+        payload = encode_track(track)
+        data += bytes([len(payload)]) + payload
+    header = MAGIC + struct.pack("<B3xII", SCHEMA_VERSION, len(tracks), len(data))
+    image = header + bytes(data)
+    if len(image) > PARTITION_SIZE:
+        raise ValueError("%d bytes do not fit the %d byte partition" % (len(image), PARTITION_SIZE))
+    return image
+
+
+def read_image(image):
+    if len(image) < HEADER_SIZE or image[:4] != MAGIC:
+        raise ValueError("not a track database image")
+    version, count, size = struct.unpack_from("<B3xII", image, 4)
+    if version != SCHEMA_VERSION:
+        raise ValueError("schema version %d, expected %d" % (version, SCHEMA_VERSION))
+    data = image[HEADER_SIZE:HEADER_SIZE + size]
+    if len(data) != size:
+        raise ValueError("truncated")
+    tracks = []
+    pos = 0
+    while pos < size:
+        length = data[pos]
+        track = decode_track(data[pos + 1:pos + 1 + length])
+        if track:
+            tracks.append(track)
+        pos += 1 + length
+    if len(tracks) != count:
+        raise ValueError("header says %d tracks, found %d" % (count, len(tracks)))
+    return tracks
+
+
+def read_csv(path):
+    tracks = []
+    with open(path, newline="", encoding="utf-8") as f:
+        for row in csv.DictReader(f):
+            track = {"name": row["name"].strip(), "radius": float(row.get("radius") or 4.0)}
+            for key, _ in GATES:
+                lat, lon = row.get(key + "_lat"), row.get(key + "_lon")
+                if lat and lon:
+                    track[key] = (float(lat), float(lon))
+            tracks.append(track)
+    return tracks
+
+
+def wrap(lon):
+    return (lon + 180.0) % 360.0 - 180.0
+
+
+def synthetic_tracks(count, seed):
+    """Start/finish points scattered over the land-heavy mid latitudes."""
+    rng = random.Random(seed)
+    tracks = []
+    for i in range(count):
+        lat = max(-89.9, min(89.9, rng.gauss(42.0 if rng.random() < 0.8 else -30.0, 25.0)))
+        lon = rng.uniform(-180.0, 180.0)
+        track = {"name": "Track %05d" % i, "radius": 12.0, "start": (lat, lon)}
+        # Sector gates a kilometre or so around the lap
+        scale = 1.0 / max(0.05, math.cos(math.radians(lat)))
+        track["sector2"] = (lat + 0.008, wrap(lon + 0.008 * scale))
+        track["sector3"] = (lat - 0.004, wrap(lon + 0.012 * scale))
+        tracks.append(track)
+    return tracks
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+    build = sub.add_parser("build", help="write an image from a CSV file or synthetic tracks")
+    build.add_argument("csv", nargs="?")
+    build.add_argument("image")
+    build.add_argument("--synthetic", type=int, metavar="N", help="N generated tracks instead of a CSV")
+    build.add_argument("--seed", type=int, default=1)
+    listing = sub.add_parser("list", help="print the tracks of an image")
+    listing.add_argument("image")
+    args = parser.parse_args()
+
+    try:
+        if args.command == "build":
+            if (args.csv is None) == (args.synthetic is None):
+                parser.error("build takes either a CSV file or --synthetic")
+            tracks = synthetic_tracks(args.synthetic, args.seed) if args.synthetic else read_csv(args.csv)
+            image = build_image(tracks)
+            # Read back what was written, as the firmware will
+            if len(read_image(image)) != len(tracks):
+                raise ValueError("image does not read back")
+            with open(args.image, "wb") as f:
+                f.write(image)
+            print("%d tracks, %d of %d bytes" % (len(tracks), len(image), PARTITION_SIZE))
+        else:
+            with open(args.image, "rb") as f:
+                tracks = read_image(f.read())
+            for track in tracks:
+                gates = " ".join("%s %.7f,%.7f" % (key, *track[key]) for key, _ in GATES if key in track)
+                print("%-31s r %.2f m  %s" % (track["name"], track.get("radius", 0.0), gates))
+            print("%d tracks" % len(tracks), file=sys.stderr)
+    except (OSError, ValueError, KeyError) as e:
+        sys.exit("trackdb: %s" % e)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,288 @@
+/**
+ * UbxParser throughput and robustness.
+ *
+ * The bench mode builds a stream of NAV-PVT, NAV-SAT and TIM-TP frames in
+ * the proportions the receiver sends them. It feeds the stream in
+ * UART-sized chunks and reports MB/s for UbxParser and for a byte-at-a-time
+ * state machine that copies every payload, the way the vendor library
+ * receives frames.
+ *
+ * The fuzz mode corrupts the same kind of stream: bit flips, dropped and
+ * inserted bytes, truncated frames, garbage bursts and fake headers. It
+ * feeds the result in random chunk sizes. Every frame left intact must
+ * come out exactly once with its payload unchanged. Any other frame that
+ * comes out got past the checksum; UBX's 8-bit Fletcher misses e.g. some
+ * top-bit flips, so these are counted, not failed.
+ * The exit status is non-zero on a failure.
+ *
+ * Build from PIO_Impl/ (add -fsanitize=address,undefined for fuzzing):
+ *   g++ -std=gnu++17 -O2 -Iinclude tools/ubx_bench/ubx_bench.cpp -o ubx_bench
+ *
+ * Usage:
+ *   ubx_bench [--mb N]
+ *   ubx_bench --fuzz [--rounds N] [--seed N]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "sensors/ubx_parser.h"
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Frame {
+        uint32_t tag;          // Unique, stored in the first four payload bytes
+        size_t start;
+        size_t size;
+    };
+
+    // Appends one frame of a type picked like the receiver's output at
+    // 25 Hz: PVT every epoch, TIM-TP every second, NAV-SAT every second
+    void appendFrame(std::vector<uint8_t>& stream, uint32_t tag, std::mt19937& rng, std::vector<Frame>* frames) {
+        uint8_t payload[ubx::MAX_PAYLOAD];
+        uint8_t cls = 0x01, id = 0x07;
+        uint16_t length = ubx::NavPvt::LENGTH;
+        if (tag % 25 == 12) {
+            cls = 0x0D; id = 0x01; length = ubx::TimTp::LENGTH;
+        } else if (tag % 25 == 24) {
+            id = 0x35; length = 8 + 12 * (20 + rng() % 20);
+        }
+        for (uint16_t i = 0; i < length; i++) {
+            payload[i] = (uint8_t)rng();
+        }
+        memcpy(payload, &tag, 4);
+
+        size_t start = stream.size();
+        stream.resize(start + length + ubx::OVERHEAD);
+        ubx::buildFrame(cls, id, payload, length, &stream[start]);
+        if (frames) {
+            frames->push_back(Frame{ tag, start, length + ubx::OVERHEAD });
+        }
+    }
+
+    // Byte-at-a-time receiver copying every payload, for comparison
+    class CopyingParser {
+    public:
+        uint32_t frames = 0;
+
+        void feed(const uint8_t* data, size_t length) {
+            for (size_t i = 0; i < length; i++) {
+                byte(data[i]);
+            }
+        }
+
+    private:
+        uint8_t buffer[ubx::MAX_PAYLOAD + ubx::OVERHEAD];
+        size_t count = 0;
+        size_t size = 0;
+        uint8_t payload[ubx::MAX_PAYLOAD];
+
+        void byte(uint8_t b) {
+            if ((count == 0 && b != ubx::SYNC1) || (count == 1 && b != ubx::SYNC2)) {
+                count = 0;
+                return;
+            }
+            buffer[count++] = b;
+            if (count == ubx::HEADER) {
+                size = ubx::u16(buffer + 4) + ubx::OVERHEAD;
+                if (size > sizeof(buffer)) {
+                    count = 0;
+                }
+            } else if (count > ubx::HEADER && count == size) {
+                uint16_t ck = ubx::checksum(buffer + 2, size - 4);
+                if (buffer[size - 2] == (ck & 0xFF) && buffer[size - 1] == (ck >> 8)) {
+                    memcpy(payload, buffer + ubx::HEADER, size - ubx::OVERHEAD);
+                    frames++;
+                }
+                count = 0;
+            }
+        }
+    };
+
+    // UART reads deliver whatever the FIFO holds, up to the read buffer
+    template<typename Parser>
+    double throughput(Parser& parser, const std::vector<uint8_t>& stream, size_t chunk) {
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < stream.size(); i += chunk) {
+            parser.feed(&stream[i], std::min(chunk, stream.size() - i));
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return stream.size() / seconds / 1e6;
+    }
+
+    int bench(size_t megabytes) {
+        std::mt19937 rng(1);
+        std::vector<uint8_t> stream;
+        uint32_t frames = 0;
+        while (stream.size() < megabytes * 1000000) {
+            appendFrame(stream, frames++, rng, nullptr);
+        }
+
+        printf("%.1f MB, %u frames\n\n%8s %14s %14s\n", stream.size() / 1e6, frames, "chunk", "UbxParser", "copying");
+        const size_t chunks[] = { 64, 256, 1024, 4096 };
+        for (size_t chunk : chunks) {
+            UbxParser parser;
+            CopyingParser reference;
+            uint32_t checksums = 0;
+            parser.setHandler([](void* context, uint16_t, const uint8_t* payload, uint16_t length) {
+                *(uint32_t*)context += payload[length - 1];
+            }, &checksums);
+            double fast = throughput(parser, stream, chunk);
+            double slow = throughput(reference, stream, chunk);
+            if (parser.getStats().frames != frames || reference.frames != frames) {
+                fprintf(stderr, "frame count mismatch at chunk %zu\n", chunk);
+                return 1;
+            }
+            printf("%8zu %9.0f MB/s %9.0f MB/s\n", chunk, fast, slow);
+        }
+        return 0;
+    }
+
+    struct FuzzResult {
+        std::unordered_map<uint32_t, int> seen;     // Intact tag to delivery count
+        const std::vector<uint8_t>* original;
+        const std::unordered_map<uint32_t, size_t>* intact;   // Tag to offset in original
+        uint32_t collisions = 0;
+        uint32_t altered = 0;
+    };
+
+    void fuzzHandler(void* context, uint16_t, const uint8_t* payload, uint16_t length) {
+        FuzzResult& r = *(FuzzResult*)context;
+        uint32_t tag;
+        memcpy(&tag, payload, 4);
+        auto it = r.intact->find(tag);
+        if (it == r.intact->end()) {
+            r.collisions++;
+            return;
+        }
+        const uint8_t* expected = &(*r.original)[it->second];
+        if (ubx::u16(expected + 4) != length || memcmp(expected + ubx::HEADER, payload, length) != 0) {
+            r.altered++;
+            return;
+        }
+        r.seen[tag]++;
+    }
+
+    int fuzz(uint32_t rounds, uint32_t seed) {
+        uint64_t intactTotal = 0, corruptedTotal = 0, collisions = 0, failures = 0;
+        UbxParser::Stats totals = {};
+
+        for (uint32_t round = 0; round < rounds; round++) {
+            std::mt19937 rng(seed + round);
+            std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+            std::vector<uint8_t> clean;
+            std::vector<Frame> frames;
+            for (uint32_t i = 0; i < 400; i++) {
+                appendFrame(clean, round * 1000 + i, rng, &frames);
+            }
+
+            // Corrupt some frames and the gaps between them
+            std::vector<uint8_t> stream;
+            std::unordered_map<uint32_t, size_t> intact;
+            for (const Frame& frame : frames) {
+                if (uniform(rng) < 0.05f) {
+                    size_t burst = 1 + rng() % 40;
+                    for (size_t i = 0; i < burst; i++) {
+                        stream.push_back(uniform(rng) < 0.2f ? ubx::SYNC1 : (uint8_t)rng());
+                    }
+                    if (uniform(rng) < 0.5f) {
+                        // Fake header claiming a long frame
+                        uint16_t length = rng() % 1200;
+                        const uint8_t header[] = { ubx::SYNC1, ubx::SYNC2, 0x01, 0x07,
+                                                   (uint8_t)length, (uint8_t)(length >> 8) };
+                        stream.insert(stream.end(), header, header + sizeof(header));
+                    }
+                }
+
+                std::vector<uint8_t> bytes(clean.begin() + frame.start, clean.begin() + frame.start + frame.size);
+                if (uniform(rng) < 0.15f) {
+                    size_t at = rng() % bytes.size();
+                    switch (rng() % 4) {
+                        case 0: bytes[at] ^= 1 << (rng() % 8); break;
+                        case 1: bytes.erase(bytes.begin() + at); break;
+                        case 2: bytes.insert(bytes.begin() + at, (uint8_t)rng()); break;
+                        default: bytes.resize(at); break;
+                    }
+                    corruptedTotal++;
+                } else {
+                    intact[frame.tag] = frame.start;
+                }
+                stream.insert(stream.end(), bytes.begin(), bytes.end());
+            }
+            // Idle line at the end, so a fake header claiming more bytes
+            // than are left is refuted rather than left pending
+            stream.resize(stream.size() + ubx::MAX_PAYLOAD + ubx::OVERHEAD, 0);
+
+            FuzzResult result;
+            result.original = &clean;
+            result.intact = &intact;
+            UbxParser parser;
+            parser.setHandler(fuzzHandler, &result);
+            for (size_t i = 0; i < stream.size();) {
+                size_t chunk = std::min<size_t>(1 + rng() % (uniform(rng) < 0.5f ? 16 : 2048), stream.size() - i);
+                parser.feed(&stream[i], chunk);
+                i += chunk;
+            }
+
+            size_t missing = 0, duplicated = 0;
+            for (const auto& entry : intact) {
+                auto it = result.seen.find(entry.first);
+                if (it == result.seen.end()) missing++;
+                else if (it->second > 1) duplicated++;
+            }
+            intactTotal += intact.size();
+            collisions += result.collisions;
+            // A colliding fake frame can swallow the intact frames it overlaps
+            bool ok = result.altered == 0 && duplicated == 0 && (missing == 0 || result.collisions > 0);
+            if (!ok) {
+                failures++;
+                fprintf(stderr, "round %u (seed %u): %zu missing, %zu duplicated, %u altered, %u collisions\n",
+                        round, seed + round, missing, duplicated, result.altered, result.collisions);
+            }
+
+            const UbxParser::Stats& stats = parser.getStats();
+            totals.bytes += stats.bytes;
+            totals.frames += stats.frames;
+            totals.checksumErrors += stats.checksumErrors;
+            totals.oversized += stats.oversized;
+            totals.assembled += stats.assembled;
+        }
+
+        printf("%u rounds: %llu intact and %llu corrupted frames, %u MB fed\n", rounds,
+               (unsigned long long)intactTotal, (unsigned long long)corruptedTotal, totals.bytes / 1000000);
+        printf("parser: %u frames, %u checksum errors, %u oversized, %u assembled across chunks\n",
+               totals.frames, totals.checksumErrors, totals.oversized, totals.assembled);
+        printf("corrupted frames passing the checksum: %llu, failed rounds: %llu\n",
+               (unsigned long long)collisions, (unsigned long long)failures);
+        return failures ? 1 : 0;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    bool fuzzMode = false;
+    size_t megabytes = 64;
+    uint32_t rounds = 200;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--fuzz")) {
+            fuzzMode = true;
+        } else if (!strcmp(argv[i], "--mb") && i + 1 < argc) {
+            megabytes = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--rounds") && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--mb N] | --fuzz [--rounds N] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+    return fuzzMode ? fuzz(rounds, seed) : bench(megabytes);
+}
@@ -0,0 +1,211 @@
+/**
+ * Warm restart snapshot: serialization, slot handling and restore.
+ *
+ * Encodes and decodes a snapshot, checks that every single-bit error and
+ * random RTC memory is refused, that a save torn by a reset leaves the
+ * previous snapshot, and that a RacingEngine restored from a snapshot
+ * carries the stint on with the time the reset took counted in.
+ *
+ * Build from PIO_Impl/:
+ *   g++ -std=gnu++17 -O2 -Iinclude -Iinclude/calculations -Iinclude/track \
+ *       tools/warm_restart/warm_restart_test.cpp src/session/warm_state.cpp -o warm_restart_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include "session/warm_state.h"
+#include "racing_engine.h"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+static uint64_t clockUs = 0;
+static uint64_t testClock() { return clockUs; }
+
+static WarmState sample() {
+    WarmState state;
+    strcpy(state.track, "Spa-Francorchamps");
+    state.stintActive = true;
+    state.stintElapsedMs = 1234567;
+    state.sectorBest[0] = 41234;
+    state.sectorBest[1] = 52345;
+    state.sectorBest[2] = UINT32_MAX;
+    state.theoreticalBest = 138001;
+    state.referenceLap = 139456;
+    state.lapCount = 17;
+    state.deltaReference = (uint8_t)ReferenceKind::Optimal;
+    return state;
+}
+
+static bool same(const WarmState& a, const WarmState& b) {
+    return strcmp(a.track, b.track) == 0 && a.stintActive == b.stintActive &&
+           a.stintElapsedMs == b.stintElapsedMs && a.sectorBest[0] == b.sectorBest[0] &&
+           a.sectorBest[1] == b.sectorBest[1] && a.sectorBest[2] == b.sectorBest[2] &&
+           a.theoreticalBest == b.theoreticalBest && a.referenceLap == b.referenceLap &&
+           a.lapCount == b.lapCount && a.deltaReference == b.deltaReference;
+}
+
+static void testRoundTrip() {
+    uint8_t data[WarmStore::ENCODED_SIZE];
+    WarmState in = sample();
+    WarmStore::encode(in, 42, 0x123456789ull, data);
+
+    WarmState out;
+    uint32_t sequence = 0;
+    uint64_t savedUs = 0;
+    CHECK(WarmStore::decode(data, &out, &sequence, &savedUs));
+    CHECK(same(in, out));
+    CHECK(sequence == 42);
+    CHECK(savedUs == 0x123456789ull);
+
+    // A name of the full length keeps its terminator
+    memset(in.track, 'x', sizeof(in.track));
+    WarmStore::encode(in, 1, 0, data);
+    CHECK(WarmStore::decode(data, &out, &sequence, &savedUs));
+    CHECK(strlen(out.track) == logfmt::MAX_TRACK_NAME - 1);
+}
+
+static void testCorruption() {
+    uint8_t data[WarmStore::ENCODED_SIZE];
+    WarmStore::encode(sample(), 7, 1000, data);
+    int accepted = 0;
+    for (size_t bit = 0; bit < sizeof(data) * 8; bit++) {
+        data[bit / 8] ^= 1 << (bit % 8);
+        WarmState out;
+        uint32_t sequence;
+        uint64_t savedUs;
+        accepted += WarmStore::decode(data, &out, &sequence, &savedUs);
+        data[bit / 8] ^= 1 << (bit % 8);
+    }
+    CHECK(accepted == 0);
+
+    // RTC memory after power-on
+    std::mt19937 rng(1);
+    uint8_t memory[WarmStore::MEMORY_SIZE];
+    WarmStore store(memory, testClock);
+    int loaded = 0;
+    for (int trial = 0; trial < 10000; trial++) {
+        for (size_t i = 0; i < sizeof(memory); i++) memory[i] = (uint8_t)rng();
+        WarmState out;
+        uint32_t ageMs;
+        loaded += store.load(&out, &ageMs);
+    }
+    CHECK(loaded == 0);
+}
+
+static void testSlots() {
+    uint8_t memory[WarmStore::MEMORY_SIZE];
+    memset(memory, 0xA5, sizeof(memory));
+    WarmStore store(memory, testClock);
+    WarmState out;
+    uint32_t ageMs;
+    CHECK(!store.load(&out, &ageMs));
+
+    WarmState first = sample();
+    WarmState second = sample();
+    second.lapCount = 18;
+    WarmState third = sample();
+    third.lapCount = 19;
+
+    clockUs = 5000000;
+    store.save(first);
+    clockUs = 6000000;
+    store.save(second);
+    clockUs = 7000000;
+    store.save(third);
+
+    // The newest, aged by the clock
+    clockUs = 9500000;
+    CHECK(store.load(&out, &ageMs));
+    CHECK(same(out, third));
+    CHECK(ageMs == 2500);
+
+    // A reset in the middle of the next save tears the older slot only
+    uint8_t saved[WarmStore::MEMORY_SIZE];
+    memcpy(saved, memory, sizeof(memory));
+    WarmState fourth = sample();
+    fourth.lapCount = 20;
+    store.save(fourth);
+    for (size_t torn = 1; torn < WarmStore::ENCODED_SIZE; torn++) {
+        uint8_t copy[WarmStore::MEMORY_SIZE];
+        memcpy(copy, memory, sizeof(copy));
+        // Slot written last holds the fourth; put back the bytes not reached
+        for (int slot = 0; slot < 2; slot++) {
+            uint8_t* s = copy + slot * WarmStore::ENCODED_SIZE;
+            if (memcmp(s, saved + slot * WarmStore::ENCODED_SIZE, WarmStore::ENCODED_SIZE) != 0) {
+                memcpy(s + torn, saved + slot * WarmStore::ENCODED_SIZE + torn, WarmStore::ENCODED_SIZE - torn);
+            }
+        }
+        WarmStore after(copy, testClock);
+        CHECK(after.load(&out, &ageMs));
+        CHECK(out.lapCount == 19);
+    }
+    CHECK(store.load(&out, &ageMs));
+    CHECK(out.lapCount == 20);
+
+    // The clock was reset as well: the age is unknown
+    clockUs = 1000;
+    CHECK(store.load(&out, &ageMs));
+    CHECK(ageMs == 0);
+
+    store.clear();
+    CHECK(!store.load(&out, &ageMs));
+}
+
+static void testEngine() {
+    TripleBuffer<RacingState> before;
+    RacingEngine engine(before);
+    engine.setSectorBests(30000, 40000, 50000);
+    engine.setDeltaReference(ReferenceKind::AllTimeBest);
+    engine.startStint(1000);
+
+    WarmState warm;
+    engine.saveWarm(&warm, 61000);
+    CHECK(warm.stintActive);
+    CHECK(warm.stintElapsedMs == 60000);
+
+    uint8_t data[WarmStore::ENCODED_SIZE];
+    WarmStore::encode(warm, 1, 0, data);
+    WarmState restored;
+    uint32_t sequence;
+    uint64_t savedUs;
+    CHECK(WarmStore::decode(data, &restored, &sequence, &savedUs));
+
+    // The reset took 700 ms and the new boot's clock is at 500
+    TripleBuffer<RacingState> after;
+    RacingEngine resumed(after);
+    resumed.setSectorBests(31000, 39000, UINT32_MAX);
+    resumed.restoreWarm(restored, 500, 700);
+    const RacingState& state = resumed.current();
+    CHECK(state.stintActive);
+    CHECK((uint32_t)(500 - state.stintStartTime) == 60700);
+    CHECK(state.sectorBest[0] == 30000);
+    CHECK(state.sectorBest[1] == 39000);
+    CHECK(state.sectorBest[2] == 50000);
+    CHECK(state.deltaReference == ReferenceKind::AllTimeBest);
+    CHECK(!state.lapActive);
+
+    // The renderer sees the restored values
+    after.update();
+    CHECK(after.read().stintActive);
+}
+
+int main() {
+    testRoundTrip();
+    testCorruption();
+    testSlots();
+    testEngine();
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All warm restart checks passed\n");
+    return 0;
+}